@@ -10,34 +10,144 @@
 
 #include "common_video/interface/i420_buffer_pool.h"
 
+#include <string.h>
+
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
 #include "base/checks.h"
+#include "base/scoped_ptr.h"
+#include "base/thread_annotations.h"
+#include "system_wrappers/interface/condition_variable_wrapper.h"
+#include "system_wrappers/interface/critical_section_wrapper.h"
+#include "system_wrappers/interface/tick_util.h"
+
+namespace webrtc {
 
 namespace {
 
-// One extra indirection is needed to make |HasOneRef| work.
-class PooledI420Buffer : public webrtc::VideoFrameBuffer {
+size_t BufferSize(const I420Buffer& buffer) {
+  const int chroma_height = (buffer.height() + 1) / 2;
+  return buffer.stride(kYPlane) * buffer.height() +
+         (buffer.stride(kUPlane) + buffer.stride(kVPlane)) * chroma_height;
+}
+
+}  // namespace
+
+// Holds the free lists. It is shared by the pool and the buffers handed out,
+// so that buffers returned after the pool is destroyed are deleted safely.
+class I420BufferPool::Recycler : public rtc::RefCountInterface {
  public:
-  explicit PooledI420Buffer(
-      const rtc::scoped_refptr<webrtc::I420Buffer>& buffer)
-      : buffer_(buffer) {}
+  Recycler(size_t max_buffers, int max_wait_ms, bool zero_initialize);
+
+  rtc::scoped_refptr<VideoFrameBuffer> CreateBuffer(int width,
+                                                    int height,
+                                                    int stride_y,
+                                                    int stride_uv);
+  // Called when the last reference to a buffer handed out in |generation| is
+  // released.
+  void Return(const rtc::scoped_refptr<I420Buffer>& buffer, int generation);
+  void Clear();
+  I420BufferPool::Stats GetStats() const;
+
+ protected:
+  ~Recycler() override {}
 
  private:
-  ~PooledI420Buffer() override {}
+  // The dimensions and strides of a buffer.
+  struct Resolution {
+    Resolution(int width, int height, int stride_y, int stride_uv)
+        : width(width),
+          height(height),
+          stride_y(stride_y),
+          stride_uv(stride_uv) {}
+    explicit Resolution(const I420Buffer& buffer)
+        : width(buffer.width()),
+          height(buffer.height()),
+          stride_y(buffer.stride(kYPlane)),
+          stride_uv(buffer.stride(kUPlane)) {}
+    bool operator<(const Resolution& other) const {
+      if (width != other.width)
+        return width < other.width;
+      if (height != other.height)
+        return height < other.height;
+      if (stride_y != other.stride_y)
+        return stride_y < other.stride_y;
+      return stride_uv < other.stride_uv;
+    }
+    bool operator==(const Resolution& other) const {
+      return width == other.width && height == other.height &&
+             stride_y == other.stride_y && stride_uv == other.stride_uv;
+    }
+
+    int width;
+    int height;
+    int stride_y;
+    int stride_uv;
+  };
+  struct FreeList {
+    FreeList() : last_request(0) {}
+    std::vector<rtc::scoped_refptr<I420Buffer>> buffers;
+    // Sequence number of the last request for the resolution.
+    uint64_t last_request;
+  };
+  typedef std::map<Resolution, FreeList> FreeLists;
+
+  // Returns the free list of |resolution|, added if needed. Adding one may
+  // remove the least recently requested one, whose buffers are moved to
+  // |removed|.
+  FreeLists::iterator FindOrAddFreeList(
+      const Resolution& resolution,
+      std::vector<rtc::scoped_refptr<I420Buffer>>* removed)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_);
+  void RemoveLeastRecentFreeList(
+      std::vector<rtc::scoped_refptr<I420Buffer>>* removed)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_);
+  // Removes a free buffer of another resolution than |resolution|. Returns
+  // false if there is none.
+  bool RemoveFreeBuffer(const Resolution& resolution,
+                        rtc::scoped_refptr<I420Buffer>* removed)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_);
+
+  const size_t max_buffers_;
+  const int max_wait_ms_;
+  const bool zero_initialize_;
+  const rtc::scoped_ptr<CriticalSectionWrapper> crit_;
+  // Signaled when a buffer is returned or the pool is cleared.
+  const rtc::scoped_ptr<ConditionVariableWrapper> returned_cond_;
+  FreeLists free_lists_ GUARDED_BY(crit_);
+  uint64_t num_requests_ GUARDED_BY(crit_);
+  // Incremented by Clear, buffers handed out before are not recycled.
+  int generation_ GUARDED_BY(crit_);
+  I420BufferPool::Stats stats_ GUARDED_BY(crit_);
+};
+
+// One extra indirection is needed to make |HasOneRef| work, and to return the
+// buffer to the pool when it is released.
+class I420BufferPool::PooledI420Buffer : public VideoFrameBuffer {
+ public:
+  PooledI420Buffer(const rtc::scoped_refptr<I420Buffer>& buffer,
+                   const rtc::scoped_refptr<Recycler>& recycler,
+                   int generation)
+      : buffer_(buffer), recycler_(recycler), generation_(generation) {}
+
+ private:
+  ~PooledI420Buffer() override { recycler_->Return(buffer_, generation_); }
 
   int width() const override { return buffer_->width(); }
   int height() const override { return buffer_->height(); }
-  const uint8_t* data(webrtc::PlaneType type) const override {
+  const uint8_t* data(PlaneType type) const override {
     return buffer_->data(type);
   }
-  uint8_t* MutableData(webrtc::PlaneType type) override {
+  uint8_t* MutableData(PlaneType type) override {
     // Make the HasOneRef() check here instead of in |buffer_|, because the pool
     // also has a reference to |buffer_|.
     RTC_DCHECK(HasOneRef());
     return const_cast<uint8_t*>(buffer_->data(type));
   }
-  int stride(webrtc::PlaneType type) const override {
-    return buffer_->stride(type);
-  }
+  int stride(PlaneType type) const override { return buffer_->stride(type); }
   void* native_handle() const override { return nullptr; }
 
   rtc::scoped_refptr<VideoFrameBuffer> NativeToI420Buffer() override {
@@ -46,45 +156,206 @@ class PooledI420Buffer : public webrtc::VideoFrameBuffer {
   }
 
   friend class rtc::RefCountedObject<PooledI420Buffer>;
-  rtc::scoped_refptr<webrtc::I420Buffer> buffer_;
+  const rtc::scoped_refptr<I420Buffer> buffer_;
+  const rtc::scoped_refptr<Recycler> recycler_;
+  const int generation_;
 };
 
-}  // namespace
+I420BufferPool::Recycler::Recycler(size_t max_buffers,
+                                   int max_wait_ms,
+                                   bool zero_initialize)
+    : max_buffers_(max_buffers),
+      max_wait_ms_(max_wait_ms),
+      zero_initialize_(zero_initialize),
+      crit_(CriticalSectionWrapper::CreateCriticalSection()),
+      returned_cond_(ConditionVariableWrapper::CreateConditionVariable()),
+      num_requests_(0),
+      generation_(0) {}
 
-namespace webrtc {
+rtc::scoped_refptr<VideoFrameBuffer> I420BufferPool::Recycler::CreateBuffer(
+    int width,
+    int height,
+    int stride_y,
+    int stride_uv) {
+  const Resolution resolution(width, height, stride_y, stride_uv);
+  // Released after |crit_|, so that their memory is not freed under the lock.
+  std::vector<rtc::scoped_refptr<I420Buffer>> removed_buffers;
+  rtc::scoped_refptr<I420Buffer> removed_buffer;
+  int generation;
+  {
+    CriticalSectionScoped cs(crit_.get());
+    FreeLists::iterator it = FindOrAddFreeList(resolution, &removed_buffers);
+    it->second.last_request = ++num_requests_;
 
-I420BufferPool::I420BufferPool() {
-  Release();
+    const int64_t deadline_ms =
+        TickTime::MillisecondTimestamp() + max_wait_ms_;
+    while (it->second.buffers.empty() &&
+           stats_.num_buffers >= max_buffers_ &&
+           !RemoveFreeBuffer(resolution, &removed_buffer)) {
+      const int64_t wait_ms = deadline_ms - TickTime::MillisecondTimestamp();
+      if (wait_ms <= 0) {
+        ++stats_.drops;
+        return nullptr;
+      }
+      returned_cond_->SleepCS(*crit_, static_cast<unsigned long>(wait_ms));
+      // The free list may have been removed while waiting.
+      it = FindOrAddFreeList(resolution, &removed_buffers);
+    }
+
+    generation = generation_;
+    ++stats_.num_buffers_in_use;
+    std::vector<rtc::scoped_refptr<I420Buffer>>& buffers = it->second.buffers;
+    if (!buffers.empty()) {
+      ++stats_.hits;
+      rtc::scoped_refptr<I420Buffer> buffer = buffers.back();
+      buffers.pop_back();
+      return new rtc::RefCountedObject<PooledI420Buffer>(buffer, this,
+                                                         generation);
+    }
+    // Count the buffer now, so that other threads see the pool as full while
+    // it is allocated.
+    ++stats_.misses;
+    ++stats_.num_buffers;
+  }
+
+  rtc::scoped_refptr<I420Buffer> buffer(
+      new rtc::RefCountedObject<I420Buffer>(width, height, stride_y, stride_uv,
+                                            stride_uv));
+  // The planes are one allocation.
+  if (zero_initialize_)
+    memset(buffer->MutableData(kYPlane), 0, BufferSize(*buffer));
+  {
+    CriticalSectionScoped cs(crit_.get());
+    if (generation == generation_)
+      stats_.resident_bytes += BufferSize(*buffer);
+  }
+  return new rtc::RefCountedObject<PooledI420Buffer>(buffer, this, generation);
+}
+
+void I420BufferPool::Recycler::Return(
+    const rtc::scoped_refptr<I420Buffer>& buffer,
+    int generation) {
+  CriticalSectionScoped cs(crit_.get());
+  if (generation != generation_)
+    return;
+  --stats_.num_buffers_in_use;
+  FreeLists::iterator it = free_lists_.find(Resolution(*buffer));
+  if (it == free_lists_.end()) {
+    // No longer requested, delete the buffer.
+    --stats_.num_buffers;
+    stats_.resident_bytes -= BufferSize(*buffer);
+  } else {
+    it->second.buffers.push_back(buffer);
+  }
+  returned_cond_->WakeAll();
+}
+
+void I420BufferPool::Recycler::Clear() {
+  // Released after |crit_|.
+  FreeLists free_lists;
+  CriticalSectionScoped cs(crit_.get());
+  free_lists.swap(free_lists_);
+  ++generation_;
+  stats_.num_buffers = 0;
+  stats_.num_buffers_in_use = 0;
+  stats_.resident_bytes = 0;
+  returned_cond_->WakeAll();
+}
+
+I420BufferPool::Stats I420BufferPool::Recycler::GetStats() const {
+  CriticalSectionScoped cs(crit_.get());
+  return stats_;
+}
+
+I420BufferPool::Recycler::FreeLists::iterator
+I420BufferPool::Recycler::FindOrAddFreeList(
+    const Resolution& resolution,
+    std::vector<rtc::scoped_refptr<I420Buffer>>* removed) {
+  FreeLists::iterator it = free_lists_.find(resolution);
+  if (it != free_lists_.end())
+    return it;
+  if (free_lists_.size() >= kMaxResolutions)
+    RemoveLeastRecentFreeList(removed);
+  return free_lists_.insert(std::make_pair(resolution, FreeList())).first;
+}
+
+void I420BufferPool::Recycler::RemoveLeastRecentFreeList(
+    std::vector<rtc::scoped_refptr<I420Buffer>>* removed) {
+  FreeLists::iterator least_recent = free_lists_.begin();
+  for (FreeLists::iterator it = free_lists_.begin(); it != free_lists_.end();
+       ++it) {
+    if (it->second.last_request < least_recent->second.last_request)
+      least_recent = it;
+  }
+  std::vector<rtc::scoped_refptr<I420Buffer>>& buffers =
+      least_recent->second.buffers;
+  for (const rtc::scoped_refptr<I420Buffer>& buffer : buffers) {
+    --stats_.num_buffers;
+    stats_.resident_bytes -= BufferSize(*buffer);
+  }
+  removed->insert(removed->end(), buffers.begin(), buffers.end());
+  free_lists_.erase(least_recent);
+}
+
+bool I420BufferPool::Recycler::RemoveFreeBuffer(
+    const Resolution& resolution,
+    rtc::scoped_refptr<I420Buffer>* removed) {
+  for (FreeLists::iterator it = free_lists_.begin(); it != free_lists_.end();
+       ++it) {
+    if (it->first == resolution || it->second.buffers.empty())
+      continue;
+    *removed = it->second.buffers.back();
+    it->second.buffers.pop_back();
+    --stats_.num_buffers;
+    stats_.resident_bytes -= BufferSize(**removed);
+    return true;
+  }
+  return false;
+}
+
+I420BufferPool::I420BufferPool()
+    : recycler_(new rtc::RefCountedObject<Recycler>(
+          std::numeric_limits<size_t>::max(),
+          0,
+          false)) {}
+
+I420BufferPool::I420BufferPool(bool zero_initialize)
+    : recycler_(new rtc::RefCountedObject<Recycler>(
+          std::numeric_limits<size_t>::max(),
+          0,
+          zero_initialize)) {}
+
+I420BufferPool::I420BufferPool(size_t max_buffers, int max_wait_ms)
+    : recycler_(new rtc::RefCountedObject<Recycler>(max_buffers,
+                                                    max_wait_ms,
+                                                    false)) {
+  RTC_DCHECK_GT(max_buffers, 0u);
+  RTC_DCHECK_GE(max_wait_ms, 0);
+}
+
+I420BufferPool::~I420BufferPool() {
+  recycler_->Clear();
 }
 
 void I420BufferPool::Release() {
-  thread_checker_.DetachFromThread();
-  buffers_.clear();
+  recycler_->Clear();
 }
 
 rtc::scoped_refptr<VideoFrameBuffer> I420BufferPool::CreateBuffer(int width,
                                                                   int height) {
-  RTC_DCHECK(thread_checker_.CalledOnValidThread());
-  // Release buffers with wrong resolution.
-  for (auto it = buffers_.begin(); it != buffers_.end();) {
-    if ((*it)->width() != width || (*it)->height() != height)
-      it = buffers_.erase(it);
-    else
-      ++it;
-  }
-  // Look for a free buffer.
-  for (const rtc::scoped_refptr<I420Buffer>& buffer : buffers_) {
-    // If the buffer is in use, the ref count will be 2, one from the list we
-    // are looping over and one from a PooledI420Buffer returned from
-    // CreateBuffer that has not been released yet. If the ref count is 1
-    // (HasOneRef), then the list we are looping over holds the only reference
-    // and it's safe to reuse.
-    if (buffer->HasOneRef())
-      return new rtc::RefCountedObject<PooledI420Buffer>(buffer);
-  }
-  // Allocate new buffer.
-  buffers_.push_back(new rtc::RefCountedObject<I420Buffer>(width, height));
-  return new rtc::RefCountedObject<PooledI420Buffer>(buffers_.back());
+  return CreateBuffer(width, height, width, (width + 1) / 2);
+}
+
+rtc::scoped_refptr<VideoFrameBuffer> I420BufferPool::CreateBuffer(
+    int width,
+    int height,
+    int stride_y,
+    int stride_uv) {
+  return recycler_->CreateBuffer(width, height, stride_y, stride_uv);
+}
+
+I420BufferPool::Stats I420BufferPool::GetStats() const {
+  return recycler_->GetStats();
 }
 
 }  // namespace webrtc
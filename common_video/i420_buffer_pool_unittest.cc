@@ -8,13 +8,49 @@
  *  be found in the AUTHORS file in the root of the source tree.
  */
 
+#include <algorithm>
 #include <string>
 
 #include "testing/gtest/include/gtest/gtest.h"
+#include "base/scoped_ptr.h"
 #include "common_video/interface/i420_buffer_pool.h"
+#include "system_wrappers/interface/scoped_vector.h"
+#include "system_wrappers/interface/sleep.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "system_wrappers/interface/tick_util.h"
+#include "test/testsupport/perf_test.h"
 
 namespace webrtc {
 
+namespace {
+
+// Releases |buffer| on its own thread after |delay_ms|.
+class DelayedRelease {
+ public:
+  DelayedRelease(const rtc::scoped_refptr<VideoFrameBuffer>& buffer,
+                 int delay_ms)
+      : buffer_(buffer),
+        delay_ms_(delay_ms),
+        thread_(ThreadWrapper::CreateThread(Run, this, "DelayedRelease")) {
+    thread_->Start();
+  }
+  ~DelayedRelease() { thread_->Stop(); }
+
+ private:
+  static bool Run(void* obj) {
+    DelayedRelease* release = static_cast<DelayedRelease*>(obj);
+    SleepMs(release->delay_ms_);
+    release->buffer_ = nullptr;
+    return false;
+  }
+
+  rtc::scoped_refptr<VideoFrameBuffer> buffer_;
+  const int delay_ms_;
+  rtc::scoped_ptr<ThreadWrapper> thread_;
+};
+
+}  // namespace
+
 TEST(TestI420BufferPool, SimpleFrameReuse) {
   I420BufferPool pool;
   rtc::scoped_refptr<VideoFrameBuffer> buffer = pool.CreateBuffer(16, 16);
@@ -71,4 +107,227 @@ TEST(TestI420BufferPool, FrameValidAfterPoolDestruction) {
   memset(buffer->MutableData(kYPlane), 0xA5, 16 * buffer->stride(kYPlane));
 }
 
+TEST(TestI420BufferPool, ReusesBuffersOfSeveralResolutions) {
+  I420BufferPool pool;
+  rtc::scoped_refptr<VideoFrameBuffer> small = pool.CreateBuffer(16, 16);
+  rtc::scoped_refptr<VideoFrameBuffer> large = pool.CreateBuffer(32, 32);
+  const uint8_t* small_y_ptr = small->data(kYPlane);
+  const uint8_t* large_y_ptr = large->data(kYPlane);
+  small = nullptr;
+  large = nullptr;
+  // Requesting one resolution keeps the buffers of the other.
+  large = pool.CreateBuffer(32, 32);
+  small = pool.CreateBuffer(16, 16);
+  EXPECT_EQ(large_y_ptr, large->data(kYPlane));
+  EXPECT_EQ(small_y_ptr, small->data(kYPlane));
+
+  I420BufferPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(2u, stats.hits);
+  EXPECT_EQ(2u, stats.misses);
+  EXPECT_EQ(2u, stats.num_buffers);
+  EXPECT_EQ(2u, stats.num_buffers_in_use);
+  EXPECT_EQ(16u * 16 * 3 / 2 + 32u * 32 * 3 / 2, stats.resident_bytes);
+}
+
+TEST(TestI420BufferPool, PaddedStrides) {
+  I420BufferPool pool;
+  rtc::scoped_refptr<VideoFrameBuffer> padded =
+      pool.CreateBuffer(15, 15, 16, 16);
+  EXPECT_EQ(15, padded->width());
+  EXPECT_EQ(16, padded->stride(kYPlane));
+  EXPECT_EQ(16, padded->stride(kUPlane));
+  EXPECT_EQ(16, padded->stride(kVPlane));
+  const uint8_t* y_ptr = padded->data(kYPlane);
+  padded = nullptr;
+  // Not reused for the same resolution with other strides.
+  rtc::scoped_refptr<VideoFrameBuffer> buffer = pool.CreateBuffer(15, 15);
+  EXPECT_EQ(15, buffer->stride(kYPlane));
+  EXPECT_EQ(8, buffer->stride(kUPlane));
+  padded = pool.CreateBuffer(15, 15, 16, 16);
+  EXPECT_EQ(y_ptr, padded->data(kYPlane));
+}
+
+TEST(TestI420BufferPool, ZeroInitializesNewBuffers) {
+  I420BufferPool pool(true);
+  rtc::scoped_refptr<VideoFrameBuffer> buffer =
+      pool.CreateBuffer(16, 16, 32, 32);
+  const size_t kSize = 32 * 16 + 2 * 32 * 8;
+  uint8_t* data = buffer->MutableData(kYPlane);
+  for (size_t i = 0; i < kSize; ++i)
+    ASSERT_EQ(0, data[i]) << "at " << i;
+  data[0] = 1;
+  buffer = nullptr;
+  // Recycled buffers are not cleared again.
+  buffer = pool.CreateBuffer(16, 16, 32, 32);
+  EXPECT_EQ(data, buffer->data(kYPlane));
+  EXPECT_EQ(1, buffer->data(kYPlane)[0]);
+}
+
+TEST(TestI420BufferPool, KeepsOnlyRecentResolutions) {
+  I420BufferPool pool;
+  for (int i = 0; i <= I420BufferPool::kMaxResolutions; ++i)
+    pool.CreateBuffer(16 * (i + 1), 16);
+  // The first resolution has been dropped to make room for the last.
+  EXPECT_EQ(static_cast<size_t>(I420BufferPool::kMaxResolutions),
+            pool.GetStats().num_buffers);
+  pool.CreateBuffer(16, 16);
+  EXPECT_EQ(static_cast<size_t>(I420BufferPool::kMaxResolutions + 2),
+            pool.GetStats().misses);
+}
+
+TEST(TestI420BufferPool, BoundedPoolDropsWhenFull) {
+  I420BufferPool pool(2, 0);
+  rtc::scoped_refptr<VideoFrameBuffer> first = pool.CreateBuffer(16, 16);
+  rtc::scoped_refptr<VideoFrameBuffer> second = pool.CreateBuffer(16, 16);
+  EXPECT_TRUE(pool.CreateBuffer(16, 16) == nullptr);
+  EXPECT_EQ(1u, pool.GetStats().drops);
+  first = nullptr;
+  EXPECT_TRUE(pool.CreateBuffer(16, 16) != nullptr);
+  EXPECT_EQ(2u, pool.GetStats().num_buffers);
+}
+
+TEST(TestI420BufferPool, BoundedPoolReplacesFreeBuffersOfOtherResolution) {
+  I420BufferPool pool(1, 0);
+  pool.CreateBuffer(16, 16);
+  rtc::scoped_refptr<VideoFrameBuffer> buffer = pool.CreateBuffer(32, 32);
+  ASSERT_TRUE(buffer != nullptr);
+  I420BufferPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(1u, stats.num_buffers);
+  EXPECT_EQ(32u * 32 * 3 / 2, stats.resident_bytes);
+}
+
+TEST(TestI420BufferPool, BoundedPoolWaitsForReturnedBuffer) {
+  const int kMaxWaitMs = 5000;
+  const int kReleaseDelayMs = 20;
+  I420BufferPool pool(1, kMaxWaitMs);
+  rtc::scoped_refptr<VideoFrameBuffer> buffer = pool.CreateBuffer(16, 16);
+  const uint8_t* y_ptr = buffer->data(kYPlane);
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  {
+    DelayedRelease release(buffer, kReleaseDelayMs);
+    buffer = nullptr;
+    buffer = pool.CreateBuffer(16, 16);
+  }
+  ASSERT_TRUE(buffer != nullptr);
+  EXPECT_EQ(y_ptr, buffer->data(kYPlane));
+  EXPECT_LT(TickTime::MillisecondTimestamp() - start_ms, kMaxWaitMs);
+  EXPECT_EQ(0u, pool.GetStats().drops);
+}
+
+TEST(TestI420BufferPool, ReleaseForgetsBuffersInUse) {
+  I420BufferPool pool;
+  rtc::scoped_refptr<VideoFrameBuffer> buffer = pool.CreateBuffer(16, 16);
+  pool.Release();
+  EXPECT_EQ(0u, pool.GetStats().num_buffers);
+  // The buffer in use is deleted when released, not recycled.
+  buffer = nullptr;
+  EXPECT_EQ(0u, pool.GetStats().num_buffers);
+  buffer = pool.CreateBuffer(16, 16);
+  EXPECT_EQ(1u, pool.GetStats().num_buffers);
+  EXPECT_EQ(0u, pool.GetStats().hits);
+}
+
+namespace {
+
+// Creates buffers on its own thread like a capturer or decoder, holding on to
+// the last few of them like a renderer or encoder would.
+class BufferProducer {
+ public:
+  enum { kNumHeldBuffers = 4 };
+
+  BufferProducer(I420BufferPool* pool, int width, int height, int num_buffers)
+      : pool_(pool),
+        width_(width),
+        height_(height),
+        num_buffers_(num_buffers),
+        num_created_(0),
+        thread_(ThreadWrapper::CreateThread(Run, this, "BufferProducer")) {}
+
+  void Start() { thread_->Start(); }
+  void Stop() { thread_->Stop(); }
+  int num_created() const { return num_created_; }
+
+ private:
+  static bool Run(void* obj) {
+    static_cast<BufferProducer*>(obj)->Produce();
+    return false;
+  }
+
+  void Produce() {
+    rtc::scoped_refptr<VideoFrameBuffer> held[kNumHeldBuffers];
+    for (int i = 0; i < num_buffers_; ++i) {
+      rtc::scoped_refptr<VideoFrameBuffer> buffer;
+      if (pool_) {
+        buffer = pool_->CreateBuffer(width_, height_);
+      } else {
+        buffer = new rtc::RefCountedObject<I420Buffer>(width_, height_);
+      }
+      if (!buffer)
+        continue;
+      // Fill the luma plane like a producer would. A new allocation pays for
+      // its page faults here.
+      memset(buffer->MutableData(kYPlane), i,
+             buffer->stride(kYPlane) * height_);
+      held[i % kNumHeldBuffers] = buffer;
+      ++num_created_;
+    }
+  }
+
+  I420BufferPool* const pool_;
+  const int width_;
+  const int height_;
+  const int num_buffers_;
+  int num_created_;
+  rtc::scoped_ptr<ThreadWrapper> thread_;
+};
+
+// Runs 8 producer threads of two resolutions against |pool|, or allocating
+// every buffer if |pool| is null, and reports the buffers created per second.
+void RunProducers(I420BufferPool* pool, const std::string& trace) {
+  const int kNumProducers = 8;
+  const int kNumBuffersPerProducer = 500;
+  ScopedVector<BufferProducer> producers;
+  for (int i = 0; i < kNumProducers; ++i) {
+    const bool large = i % 2 == 0;
+    producers.push_back(new BufferProducer(pool, large ? 1280 : 640,
+                                           large ? 720 : 360,
+                                           kNumBuffersPerProducer));
+  }
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  for (BufferProducer* producer : producers)
+    producer->Start();
+  int num_created = 0;
+  for (BufferProducer* producer : producers) {
+    producer->Stop();
+    num_created += producer->num_created();
+  }
+  const int64_t elapsed_ms =
+      std::max<int64_t>(1, TickTime::MillisecondTimestamp() - start_ms);
+  EXPECT_EQ(kNumProducers * kNumBuffersPerProducer, num_created);
+
+  test::PrintResult("i420_buffer_pool_throughput", "", trace,
+                    num_created * 1000.0 / elapsed_ms, "buffers/s", true);
+  if (pool) {
+    I420BufferPool::Stats stats = pool->GetStats();
+    test::PrintResult("i420_buffer_pool_hit_rate", "", trace,
+                      100.0 * stats.hits / (stats.hits + stats.misses), "%",
+                      false);
+    test::PrintResult("i420_buffer_pool_resident", "", trace,
+                      stats.resident_bytes / 1024.0, "KiB", false);
+  }
+}
+
+}  // namespace
+
+TEST(TestI420BufferPool, ConcurrentProducersPerformance) {
+  RunProducers(nullptr, "8_threads_unpooled");
+  I420BufferPool unbounded_pool;
+  RunProducers(&unbounded_pool, "8_threads_unbounded");
+  // Room for the buffers every producer holds plus the one it creates.
+  I420BufferPool bounded_pool(8 * (BufferProducer::kNumHeldBuffers + 1),
+                              1000);
+  RunProducers(&bounded_pool, "8_threads_bounded");
+  EXPECT_EQ(0u, bounded_pool.GetStats().drops);
+}
+
 }  // namespace webrtc
@@ -21,24 +21,28 @@
 #include <sys/time.h>
 #endif
 
+#include "base/atomicops.h"
 #include "common_video/libyuv/include/webrtc_libyuv.h"
 #include "common_video/video_render_frames.h"
 #include "system_wrappers/interface/critical_section_wrapper.h"
-#include "system_wrappers/interface/event_wrapper.h"
-#include "system_wrappers/interface/thread_wrapper.h"
 #include "system_wrappers/interface/tick_util.h"
 #include "system_wrappers/interface/trace.h"
 
 namespace webrtc {
 
 IncomingVideoStream::IncomingVideoStream(uint32_t stream_id)
+    : IncomingVideoStream(stream_id, nullptr) {
+}
+
+IncomingVideoStream::IncomingVideoStream(uint32_t stream_id,
+                                         RenderScheduler* scheduler)
     : stream_id_(stream_id),
       stream_critsect_(CriticalSectionWrapper::CreateCriticalSection()),
       thread_critsect_(CriticalSectionWrapper::CreateCriticalSection()),
       buffer_critsect_(CriticalSectionWrapper::CreateCriticalSection()),
-      incoming_render_thread_(),
-      deliver_buffer_event_(EventTimerWrapper::Create()),
-      running_(false),
+      own_scheduler_(scheduler ? nullptr : new RenderScheduler(0)),
+      scheduler_(scheduler ? scheduler : own_scheduler_.get()),
+      running_(0),
       external_callback_(nullptr),
       render_callback_(nullptr),
       render_buffers_(new VideoRenderFrames()),
@@ -63,9 +67,7 @@ VideoRenderCallback* IncomingVideoStream::ModuleCallback() {
 
 int32_t IncomingVideoStream::RenderFrame(const uint32_t stream_id,
                                          const VideoFrame& video_frame) {
-  CriticalSectionScoped csS(stream_critsect_.get());
-
-  if (!running_) {
+  if (!rtc::AtomicOps::AcquireLoad(&running_)) {
     return -1;
   }
 
@@ -73,17 +75,20 @@ int32_t IncomingVideoStream::RenderFrame(const uint32_t stream_id,
   num_frames_since_last_calculation_++;
   int64_t now_ms = TickTime::MillisecondTimestamp();
   if (now_ms >= last_rate_calculation_time_ms_ + kFrameRatePeriodMs) {
-    incoming_rate_ =
-        static_cast<uint32_t>(1000 * num_frames_since_last_calculation_ /
-                              (now_ms - last_rate_calculation_time_ms_));
+    rtc::AtomicOps::ReleaseStore(
+        &incoming_rate_,
+        static_cast<int>(1000 * num_frames_since_last_calculation_ /
+                         (now_ms - last_rate_calculation_time_ms_)));
     num_frames_since_last_calculation_ = 0;
     last_rate_calculation_time_ms_ = now_ms;
   }
 
-  // Insert frame.
-  CriticalSectionScoped csB(buffer_critsect_.get());
-  if (render_buffers_->AddFrame(video_frame) == 1)
-    deliver_buffer_event_->Set();
+  // Insert frame. The stream is run on its own for the frames after the
+  // first.
+  if (render_buffers_->AddFrame(video_frame) == 1) {
+    scheduler_->Reschedule(
+        this, render_buffers_->TimeToFrameRelease(video_frame.render_time_ms()));
+  }
 
   return 0;
 }
@@ -128,23 +133,8 @@ int32_t IncomingVideoStream::Start() {
     return 0;
   }
 
-  CriticalSectionScoped csT(thread_critsect_.get());
-  assert(incoming_render_thread_ == NULL);
-
-  incoming_render_thread_ = ThreadWrapper::CreateThread(
-      IncomingVideoStreamThreadFun, this, "IncomingVideoStreamThread");
-  if (!incoming_render_thread_) {
-    return -1;
-  }
-
-  if (incoming_render_thread_->Start()) {
-  } else {
-    return -1;
-  }
-  incoming_render_thread_->SetPriority(kRealtimePriority);
-  deliver_buffer_event_->StartTimer(false, kEventStartupTimeMs);
-
-  running_ = true;
+  scheduler_->AddStream(this, kEventStartupTimeMs);
+  rtc::AtomicOps::ReleaseStore(&running_, 1);
   return 0;
 }
 
@@ -155,27 +145,9 @@ int32_t IncomingVideoStream::Stop() {
     return 0;
   }
 
-  ThreadWrapper* thread = NULL;
-  {
-    CriticalSectionScoped cs_thread(thread_critsect_.get());
-    if (incoming_render_thread_) {
-      // Setting the incoming render thread to NULL marks that we're performing
-      // a shutdown and will make IncomingVideoStreamProcess abort after wakeup.
-      thread = incoming_render_thread_.release();
-      deliver_buffer_event_->StopTimer();
-      // Set the event to allow the thread to wake up and shut down without
-      // waiting for a timeout.
-      deliver_buffer_event_->Set();
-    }
-  }
-  if (thread) {
-    if (thread->Stop()) {
-      delete thread;
-    } else {
-      assert(false);
-    }
-  }
-  running_ = false;
+  // Waits for RenderDueFrames to return if it is running.
+  scheduler_->RemoveStream(this);
+  rtc::AtomicOps::ReleaseStore(&running_, 0);
   return 0;
 }
 
@@ -190,67 +162,70 @@ uint32_t IncomingVideoStream::StreamId() const {
 }
 
 uint32_t IncomingVideoStream::IncomingRate() const {
-  CriticalSectionScoped cs(stream_critsect_.get());
-  return incoming_rate_;
+  return static_cast<uint32_t>(rtc::AtomicOps::AcquireLoad(&incoming_rate_));
 }
 
-bool IncomingVideoStream::IncomingVideoStreamThreadFun(void* obj) {
-  return static_cast<IncomingVideoStream*>(obj)->IncomingVideoStreamProcess();
+uint32_t IncomingVideoStream::FramesDroppedTooOld() const {
+  return render_buffers_->NumDroppedTooOld();
 }
 
-bool IncomingVideoStream::IncomingVideoStreamProcess() {
-  if (kEventError != deliver_buffer_event_->Wait(kEventMaxWaitTimeMs)) {
-    CriticalSectionScoped cs(thread_critsect_.get());
-    if (incoming_render_thread_ == NULL) {
-      // Terminating
-      return false;
-    }
-    // Get a new frame to render and the time for the frame after this one.
-    VideoFrame frame_to_render;
-    uint32_t wait_time;
-    {
-      CriticalSectionScoped cs(buffer_critsect_.get());
-      frame_to_render = render_buffers_->FrameToRender();
-      wait_time = render_buffers_->TimeToNextFrameRelease();
-    }
+uint32_t IncomingVideoStream::FramesDroppedFuture() const {
+  return render_buffers_->NumDroppedFuture();
+}
 
-    // Set timer for next frame to render.
-    if (wait_time > kEventMaxWaitTimeMs) {
-      wait_time = kEventMaxWaitTimeMs;
-    }
-    deliver_buffer_event_->StartTimer(false, wait_time);
-
-    if (frame_to_render.IsZeroSize()) {
-      if (render_callback_) {
-        if (last_render_time_ms_ == 0 && !start_image_.IsZeroSize()) {
-          // We have not rendered anything and have a start image.
-          temp_frame_.CopyFrame(start_image_);
-          render_callback_->RenderFrame(stream_id_, temp_frame_);
-        } else if (!timeout_image_.IsZeroSize() &&
-                   last_render_time_ms_ + timeout_time_ <
-                       TickTime::MillisecondTimestamp()) {
-          // Render a timeout image.
-          temp_frame_.CopyFrame(timeout_image_);
-          render_callback_->RenderFrame(stream_id_, temp_frame_);
-        }
-      }
+uint32_t IncomingVideoStream::FramesDroppedQueueFull() const {
+  return render_buffers_->NumDroppedQueueFull();
+}
 
-      // No frame.
-      return true;
-    }
+uint32_t IncomingVideoStream::FramesOverwritten() const {
+  return render_buffers_->NumOverwritten();
+}
+
+uint32_t IncomingVideoStream::RenderDueFrames() {
+  CriticalSectionScoped cs(thread_critsect_.get());
+  // Get a new frame to render and the time for the frame after this one.
+  VideoFrame frame_to_render;
+  uint32_t wait_time;
+  {
+    CriticalSectionScoped cs(buffer_critsect_.get());
+    frame_to_render = render_buffers_->FrameToRender();
+    wait_time = render_buffers_->TimeToNextFrameRelease();
+  }
+
+  // Run again for the next frame.
+  if (wait_time > kEventMaxWaitTimeMs) {
+    wait_time = kEventMaxWaitTimeMs;
+  }
 
-    // Send frame for rendering.
-    if (external_callback_) {
-      external_callback_->RenderFrame(stream_id_, frame_to_render);
-    } else if (render_callback_) {
-      render_callback_->RenderFrame(stream_id_, frame_to_render);
+  if (frame_to_render.IsZeroSize()) {
+    if (render_callback_) {
+      if (last_render_time_ms_ == 0 && !start_image_.IsZeroSize()) {
+        // We have not rendered anything and have a start image.
+        temp_frame_.CopyFrame(start_image_);
+        render_callback_->RenderFrame(stream_id_, temp_frame_);
+      } else if (!timeout_image_.IsZeroSize() &&
+                 last_render_time_ms_ + timeout_time_ <
+                     TickTime::MillisecondTimestamp()) {
+        // Render a timeout image.
+        temp_frame_.CopyFrame(timeout_image_);
+        render_callback_->RenderFrame(stream_id_, temp_frame_);
+      }
     }
 
-    // We're done with this frame.
-    if (!frame_to_render.IsZeroSize())
-      last_render_time_ms_ = frame_to_render.render_time_ms();
+    // No frame.
+    return wait_time;
+  }
+
+  // Send frame for rendering.
+  if (external_callback_) {
+    external_callback_->RenderFrame(stream_id_, frame_to_render);
+  } else if (render_callback_) {
+    render_callback_->RenderFrame(stream_id_, frame_to_render);
   }
-  return true;
+
+  // We're done with this frame.
+  last_render_time_ms_ = frame_to_render.render_time_ms();
+  return wait_time;
 }
 
 }  // namespace webrtc
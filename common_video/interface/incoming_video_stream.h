@@ -13,12 +13,11 @@
 
 #include "base/scoped_ptr.h"
 #include "base/thread_annotations.h"
+#include "common_video/interface/render_scheduler.h"
 #include "common_video/video_render_frames.h"
 
 namespace webrtc {
 class CriticalSectionWrapper;
-class EventTimerWrapper;
-class ThreadWrapper;
 
 class VideoRenderCallback {
  public:
@@ -29,13 +28,20 @@ class VideoRenderCallback {
   virtual ~VideoRenderCallback() {}
 };
 
-class IncomingVideoStream : public VideoRenderCallback {
+class IncomingVideoStream : public VideoRenderCallback,
+                            public RenderScheduler::Stream {
  public:
+  // Renders on a thread of its own.
   explicit IncomingVideoStream(uint32_t stream_id);
+  // Renders on the thread of |scheduler|, shared with other streams.
+  // |scheduler| must outlive the stream.
+  IncomingVideoStream(uint32_t stream_id, RenderScheduler* scheduler);
   ~IncomingVideoStream();
 
   // Get callback to deliver frames to the module.
   VideoRenderCallback* ModuleCallback();
+  // Queues a frame without taking a lock. Must be called on one thread at a
+  // time, typically the decode thread.
   virtual int32_t RenderFrame(const uint32_t stream_id,
                               const VideoFrame& video_frame);
 
@@ -55,6 +61,11 @@ class IncomingVideoStream : public VideoRenderCallback {
   // Properties.
   uint32_t StreamId() const;
   uint32_t IncomingRate() const;
+  // Frames that were not rendered, by the reason they were dropped.
+  uint32_t FramesDroppedTooOld() const;
+  uint32_t FramesDroppedFuture() const;
+  uint32_t FramesDroppedQueueFull() const;
+  uint32_t FramesOverwritten() const;
 
   int32_t SetStartImage(const VideoFrame& video_frame);
 
@@ -64,8 +75,8 @@ class IncomingVideoStream : public VideoRenderCallback {
   int32_t SetExpectedRenderDelay(int32_t delay_ms);
 
  protected:
-  static bool IncomingVideoStreamThreadFun(void* obj);
-  bool IncomingVideoStreamProcess();
+  // Implements RenderScheduler::Stream.
+  uint32_t RenderDueFrames() override;
 
  private:
   enum { kEventStartupTimeMs = 10 };
@@ -77,19 +88,22 @@ class IncomingVideoStream : public VideoRenderCallback {
   const rtc::scoped_ptr<CriticalSectionWrapper> stream_critsect_;
   const rtc::scoped_ptr<CriticalSectionWrapper> thread_critsect_;
   const rtc::scoped_ptr<CriticalSectionWrapper> buffer_critsect_;
-  rtc::scoped_ptr<ThreadWrapper> incoming_render_thread_
-      GUARDED_BY(thread_critsect_);
-  rtc::scoped_ptr<EventTimerWrapper> deliver_buffer_event_;
+  // Set if the stream has a thread of its own.
+  const rtc::scoped_ptr<RenderScheduler> own_scheduler_;
+  RenderScheduler* const scheduler_;
 
-  bool running_ GUARDED_BY(stream_critsect_);
+  // Written under |stream_critsect_|, read by RenderFrame without it.
+  volatile int running_;
   VideoRenderCallback* external_callback_ GUARDED_BY(thread_critsect_);
   VideoRenderCallback* render_callback_ GUARDED_BY(thread_critsect_);
-  const rtc::scoped_ptr<VideoRenderFrames> render_buffers_
-      GUARDED_BY(buffer_critsect_);
-
-  uint32_t incoming_rate_ GUARDED_BY(stream_critsect_);
-  int64_t last_rate_calculation_time_ms_ GUARDED_BY(stream_critsect_);
-  uint16_t num_frames_since_last_calculation_ GUARDED_BY(stream_critsect_);
+  // Frames are added by RenderFrame without a lock, the consumer side is
+  // serialized by |buffer_critsect_|.
+  const rtc::scoped_ptr<VideoRenderFrames> render_buffers_;
+
+  volatile int incoming_rate_;
+  // Only accessed by RenderFrame.
+  int64_t last_rate_calculation_time_ms_;
+  uint16_t num_frames_since_last_calculation_;
   int64_t last_render_time_ms_ GUARDED_BY(thread_critsect_);
   VideoFrame temp_frame_ GUARDED_BY(thread_critsect_);
   VideoFrame start_image_ GUARDED_BY(thread_critsect_);
@@ -116,6 +116,38 @@ int ConvertToI420(VideoType src_video_type,
                   VideoRotation rotation,
                   VideoFrame* dst_frame);
 
+// Convert To I420, and crop and scale to the size of |dst_frame|.
+// The source is converted a band of rows at a time into a small buffer that
+// stays in the cache, which is scaled and rotated into |dst_frame| before the
+// next band is converted. This replaces a ConvertToI420 followed by a
+// Scaler::Scale, which both go through the whole frame in memory. Upscaling
+// is done in a single band, as the bilinear filter reads across bands.
+// Input:
+//   - src_video_type   : Type of input video.
+//   - src_frame        : Pointer to a source frame.
+//   - crop_x/crop_y    : Starting positions for cropping (0 for no crop).
+//   - crop_width       : Width of the cropped region, pre-rotation.
+//   - crop_height      : Height of the cropped region, pre-rotation.
+//   - src_width        : src width in pixels.
+//   - src_height       : src height in pixels.
+//   - sample_size      : Required only for the parsing of MJPG (set to 0 else).
+//   - rotate           : Rotation mode of output image.
+// Output:
+//   - dst_frame        : Reference to a destination frame of the target size,
+//                        post-rotation.
+// Return value: 0 if OK, < 0 otherwise.
+int ConvertToI420AndScale(VideoType src_video_type,
+                          const uint8_t* src_frame,
+                          int crop_x,
+                          int crop_y,
+                          int crop_width,
+                          int crop_height,
+                          int src_width,
+                          int src_height,
+                          size_t sample_size,
+                          VideoRotation rotation,
+                          VideoFrame* dst_frame);
+
 // Convert From I420
 // Input:
 //   - src_frame        : Reference to a source frame.
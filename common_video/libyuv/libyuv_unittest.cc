@@ -12,10 +12,14 @@
 #include <string.h>
 
 #include "testing/gtest/include/gtest/gtest.h"
+// NOTE(ajm): Path provided by gyp.
+#include "libyuv/cpu_id.h"  // NOLINT
 #include "base/scoped_ptr.h"
+#include "common_video/libyuv/include/scaler.h"
 #include "common_video/libyuv/include/webrtc_libyuv.h"
 #include "system_wrappers/interface/tick_util.h"
 #include "test/testsupport/fileutils.h"
+#include "test/testsupport/perf_test.h"
 #include "video_frame.h"
 
 namespace webrtc {
@@ -322,6 +326,197 @@ TEST_F(TestLibYuv, RotateTest) {
                              0, kVideoRotation_180, &rotated_res_i420_frame));
 }
 
+// Converts |src_frame| to YUY2, the usual format of webcams.
+rtc::scoped_ptr<uint8_t[]> CreateYuy2Image(const VideoFrame& src_frame) {
+  const size_t length =
+      CalcBufferSize(kYUY2, src_frame.width(), src_frame.height());
+  rtc::scoped_ptr<uint8_t[]> yuy2(new uint8_t[length]);
+  EXPECT_EQ(0, ConvertFromI420(src_frame, kYUY2, 0, yuy2.get()));
+  return yuy2.Pass();
+}
+
+// The frames ConvertToI420AndScale replaces: ConvertToI420 of the cropped
+// region, Scaler::Scale and the rotation.
+void ConvertThenScale(const uint8_t* yuy2, int crop_x, int crop_width,
+                      int src_width, int src_height, VideoRotation rotation,
+                      int dst_width, int dst_height, VideoFrame* dst_frame) {
+  VideoFrame converted;
+  ASSERT_EQ(0, converted.CreateEmptyFrame(crop_width, src_height, crop_width,
+                                          (crop_width + 1) / 2,
+                                          (crop_width + 1) / 2));
+  ASSERT_EQ(0, ConvertToI420(kYUY2, yuy2, crop_x, 0, src_width, src_height, 0,
+                             kVideoRotation_0, &converted));
+  Scaler scaler;
+  ASSERT_EQ(0, scaler.Set(crop_width, src_height, dst_width, dst_height, kI420,
+                          kI420, kScaleBox));
+  VideoFrame scaled;
+  ASSERT_EQ(0, scaler.Scale(converted, &scaled));
+  const size_t length = CalcBufferSize(kI420, dst_width, dst_height);
+  rtc::scoped_ptr<uint8_t[]> buffer(new uint8_t[length]);
+  ASSERT_EQ(static_cast<int>(length),
+            ExtractBuffer(scaled, length, buffer.get()));
+  ASSERT_EQ(0, ConvertToI420(kI420, buffer.get(), 0, 0, dst_width, dst_height,
+                             0, rotation, dst_frame));
+}
+
+TEST(TestConvertToI420AndScale, MatchesConvertThenScale) {
+  const int kSrcWidth = 480;
+  const int kSrcHeight = 270;
+  const int kDstWidth = 320;
+  const int kDstHeight = 180;
+  VideoFrame src_frame;
+  ASSERT_EQ(0, src_frame.CreateEmptyFrame(kSrcWidth, kSrcHeight, kSrcWidth,
+                                          kSrcWidth / 2, kSrcWidth / 2));
+  int plane_offset[kNumOfPlanes] = {0, 64, 128};
+  CreateImage(&src_frame, plane_offset);
+  rtc::scoped_ptr<uint8_t[]> yuy2 = CreateYuy2Image(src_frame);
+
+  const VideoRotation kRotations[] = {kVideoRotation_0, kVideoRotation_90,
+                                      kVideoRotation_180, kVideoRotation_270};
+  for (VideoRotation rotation : kRotations) {
+    const bool transpose =
+        rotation == kVideoRotation_90 || rotation == kVideoRotation_270;
+    const int width = transpose ? kDstHeight : kDstWidth;
+    const int height = transpose ? kDstWidth : kDstHeight;
+    int stride_y = 0;
+    int stride_uv = 0;
+    Calc16ByteAlignedStride(width, &stride_y, &stride_uv);
+    VideoFrame expected;
+    ASSERT_EQ(0, expected.CreateEmptyFrame(width, height, stride_y, stride_uv,
+                                           stride_uv));
+    VideoFrame fused;
+    ASSERT_EQ(0, fused.CreateEmptyFrame(width, height, stride_y, stride_uv,
+                                        stride_uv));
+    ConvertThenScale(yuy2.get(), 0, kSrcWidth, kSrcWidth, kSrcHeight,
+                     rotation, kDstWidth, kDstHeight, &expected);
+    EXPECT_EQ(0, ConvertToI420AndScale(kYUY2, yuy2.get(), 0, 0, kSrcWidth,
+                                       kSrcHeight, kSrcWidth, kSrcHeight, 0,
+                                       rotation, &fused));
+    EXPECT_EQ(kPerfectPSNR, I420PSNR(&expected, &fused)) << rotation;
+  }
+
+  // Cropped to 4:3.
+  VideoFrame expected;
+  ASSERT_EQ(0, expected.CreateEmptyFrame(240, 180, 240, 120, 120));
+  VideoFrame fused;
+  ASSERT_EQ(0, fused.CreateEmptyFrame(240, 180, 240, 120, 120));
+  ConvertThenScale(yuy2.get(), 60, 360, kSrcWidth, kSrcHeight,
+                   kVideoRotation_0, 240, 180, &expected);
+  EXPECT_EQ(0, ConvertToI420AndScale(kYUY2, yuy2.get(), 60, 0, 360,
+                                     kSrcHeight, kSrcWidth, kSrcHeight, 0,
+                                     kVideoRotation_0, &fused));
+  EXPECT_EQ(kPerfectPSNR, I420PSNR(&expected, &fused));
+}
+
+TEST(TestConvertToI420AndScale, MatchesConvertThenScaleWhenUpscaling) {
+  const int kSrcWidth = 320;
+  const int kSrcHeight = 180;
+  const int kDstWidth = 480;
+  const int kDstHeight = 270;
+  VideoFrame src_frame;
+  ASSERT_EQ(0, src_frame.CreateEmptyFrame(kSrcWidth, kSrcHeight, kSrcWidth,
+                                          kSrcWidth / 2, kSrcWidth / 2));
+  int plane_offset[kNumOfPlanes] = {0, 64, 128};
+  CreateImage(&src_frame, plane_offset);
+  rtc::scoped_ptr<uint8_t[]> yuy2 = CreateYuy2Image(src_frame);
+
+  const VideoRotation kRotations[] = {kVideoRotation_0, kVideoRotation_90};
+  for (VideoRotation rotation : kRotations) {
+    const bool transpose = rotation == kVideoRotation_90;
+    const int width = transpose ? kDstHeight : kDstWidth;
+    const int height = transpose ? kDstWidth : kDstHeight;
+    VideoFrame expected;
+    ASSERT_EQ(0, expected.CreateEmptyFrame(width, height, width,
+                                           (width + 1) / 2, (width + 1) / 2));
+    VideoFrame fused;
+    ASSERT_EQ(0, fused.CreateEmptyFrame(width, height, width, (width + 1) / 2,
+                                        (width + 1) / 2));
+    ConvertThenScale(yuy2.get(), 0, kSrcWidth, kSrcWidth, kSrcHeight,
+                     rotation, kDstWidth, kDstHeight, &expected);
+    EXPECT_EQ(0, ConvertToI420AndScale(kYUY2, yuy2.get(), 0, 0, kSrcWidth,
+                                       kSrcHeight, kSrcWidth, kSrcHeight, 0,
+                                       rotation, &fused));
+    EXPECT_EQ(kPerfectPSNR, I420PSNR(&expected, &fused)) << rotation;
+  }
+}
+
+TEST(TestConvertToI420AndScale, NoScaling) {
+  VideoFrame src_frame;
+  ASSERT_EQ(0, src_frame.CreateEmptyFrame(64, 48, 64, 32, 32));
+  int plane_offset[kNumOfPlanes] = {0, 64, 128};
+  CreateImage(&src_frame, plane_offset);
+  rtc::scoped_ptr<uint8_t[]> yuy2 = CreateYuy2Image(src_frame);
+  VideoFrame expected;
+  ASSERT_EQ(0, expected.CreateEmptyFrame(48, 64, 48, 24, 24));
+  VideoFrame fused;
+  ASSERT_EQ(0, fused.CreateEmptyFrame(48, 64, 48, 24, 24));
+  EXPECT_EQ(0, ConvertToI420(kYUY2, yuy2.get(), 0, 0, 64, 48, 0,
+                             kVideoRotation_90, &expected));
+  EXPECT_EQ(0, ConvertToI420AndScale(kYUY2, yuy2.get(), 0, 0, 64, 48, 64, 48,
+                                     0, kVideoRotation_90, &fused));
+  EXPECT_EQ(kPerfectPSNR, I420PSNR(&expected, &fused));
+}
+
+// Times 1080p YUY2 to 720p I420, as ConvertToI420 and Scaler::Scale and as
+// ConvertToI420AndScale, with the SIMD code libyuv picks when limited to
+// |cpu_flags|.
+void RunConvertAndScale(int cpu_flags, const std::string& trace) {
+  const int kSrcWidth = 1920;
+  const int kSrcHeight = 1080;
+  const int kDstWidth = 1280;
+  const int kDstHeight = 720;
+  const int kNumFrames = 50;
+  VideoFrame src_frame;
+  ASSERT_EQ(0, src_frame.CreateEmptyFrame(kSrcWidth, kSrcHeight, kSrcWidth,
+                                          kSrcWidth / 2, kSrcWidth / 2));
+  int plane_offset[kNumOfPlanes] = {0, 64, 128};
+  CreateImage(&src_frame, plane_offset);
+  rtc::scoped_ptr<uint8_t[]> yuy2 = CreateYuy2Image(src_frame);
+
+  libyuv::MaskCpuFlags(cpu_flags);
+  VideoFrame converted;
+  ASSERT_EQ(0, converted.CreateEmptyFrame(kSrcWidth, kSrcHeight, kSrcWidth,
+                                          kSrcWidth / 2, kSrcWidth / 2));
+  VideoFrame scaled;
+  Scaler scaler;
+  ASSERT_EQ(0, scaler.Set(kSrcWidth, kSrcHeight, kDstWidth, kDstHeight, kI420,
+                          kI420, kScaleBox));
+  int64_t start_us = TickTime::MicrosecondTimestamp();
+  for (int i = 0; i < kNumFrames; ++i) {
+    EXPECT_EQ(0, ConvertToI420(kYUY2, yuy2.get(), 0, 0, kSrcWidth, kSrcHeight,
+                               0, kVideoRotation_0, &converted));
+    EXPECT_EQ(0, scaler.Scale(converted, &scaled));
+  }
+  const int64_t sequence_us = TickTime::MicrosecondTimestamp() - start_us;
+
+  VideoFrame fused;
+  ASSERT_EQ(0, fused.CreateEmptyFrame(kDstWidth, kDstHeight, kDstWidth,
+                                      kDstWidth / 2, kDstWidth / 2));
+  start_us = TickTime::MicrosecondTimestamp();
+  for (int i = 0; i < kNumFrames; ++i) {
+    EXPECT_EQ(0, ConvertToI420AndScale(kYUY2, yuy2.get(), 0, 0, kSrcWidth,
+                                       kSrcHeight, kSrcWidth, kSrcHeight, 0,
+                                       kVideoRotation_0, &fused));
+  }
+  const int64_t fused_us = TickTime::MicrosecondTimestamp() - start_us;
+  libyuv::MaskCpuFlags(-1);
+
+  EXPECT_EQ(kPerfectPSNR, I420PSNR(&scaled, &fused));
+  test::PrintResult("convert_1080p_yuy2_to_720p", "_sequence", trace,
+                    static_cast<double>(sequence_us) / kNumFrames, "us",
+                    false);
+  test::PrintResult("convert_1080p_yuy2_to_720p", "_fused", trace,
+                    static_cast<double>(fused_us) / kNumFrames, "us", false);
+}
+
+TEST(TestConvertToI420AndScale, Performance) {
+  RunConvertAndScale(libyuv::kCpuInitialized | libyuv::kCpuHasX86 |
+                         libyuv::kCpuHasSSE2,
+                     "sse2");
+  // All the CPU supports, AVX2 where available.
+  RunConvertAndScale(-1, "all_cpu_features");
+}
+
 TEST_F(TestLibYuv, alignment) {
   int value = 0x3FF; // 1023
   EXPECT_EQ(0x400, AlignInt(value, 128));  // Low 7 bits are zero.
@@ -13,12 +13,22 @@
 #include <assert.h>
 #include <string.h>
 
+#include <algorithm>
+
 // NOTE(ajm): Path provided by gyp.
 #include "libyuv.h"  // NOLINT
+#include "base/scoped_ptr.h"
+#include "system_wrappers/interface/aligned_malloc.h"
 
 namespace webrtc {
 
 const int k16ByteAlignment = 16;
+// Alignment of the band buffers of ConvertToI420AndScale.
+const int kBandBufferAlignment = 64;
+// Destination rows per band of ConvertToI420AndScale, before rounding to a
+// whole scaling ratio. The band buffers are then small enough to stay in the
+// L2 cache for HD frames.
+const int kScaleBandRows = 16;
 
 VideoType RawVideoTypeToCommonVideoVideoType(RawVideoType type) {
   switch (type) {
@@ -259,6 +269,188 @@ int ConvertToI420(VideoType src_video_type,
                                ConvertVideoType(src_video_type));
 }
 
+namespace {
+
+int GreatestCommonDivisor(int a, int b) {
+  while (b != 0) {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// An I420 image in a buffer of its own, for a band of a frame.
+class BandBuffer {
+ public:
+  BandBuffer(int width, int height) : width_(width), height_(height) {
+    Calc16ByteAlignedStride(width, &stride_y_, &stride_uv_);
+    const int size_y = stride_y_ * height;
+    const int size_uv = stride_uv_ * ((height + 1) / 2);
+    data_.reset(AlignedMalloc<uint8_t>(size_y + 2 * size_uv,
+                                       kBandBufferAlignment));
+    y_ = data_.get();
+    u_ = y_ + size_y;
+    v_ = u_ + size_uv;
+  }
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  uint8_t* y() { return y_; }
+  uint8_t* u() { return u_; }
+  uint8_t* v() { return v_; }
+  int stride_y() const { return stride_y_; }
+  int stride_uv() const { return stride_uv_; }
+
+ private:
+  const int width_;
+  const int height_;
+  int stride_y_;
+  int stride_uv_;
+  rtc::scoped_ptr<uint8_t, AlignedFreeDeleter> data_;
+  uint8_t* y_;
+  uint8_t* u_;
+  uint8_t* v_;
+};
+
+}  // namespace
+
+int ConvertToI420AndScale(VideoType src_video_type,
+                          const uint8_t* src_frame,
+                          int crop_x,
+                          int crop_y,
+                          int crop_width,
+                          int crop_height,
+                          int src_width,
+                          int src_height,
+                          size_t sample_size,
+                          VideoRotation rotation,
+                          VideoFrame* dst_frame) {
+  const bool transpose =
+      rotation == kVideoRotation_90 || rotation == kVideoRotation_270;
+  // Pre-rotation size of the destination.
+  const int dst_width = transpose ? dst_frame->height() : dst_frame->width();
+  const int dst_height = transpose ? dst_frame->width() : dst_frame->height();
+  if (crop_width < 1 || crop_height < 1 || dst_width < 1 || dst_height < 1)
+    return -1;
+  if (crop_width == dst_width && crop_height == dst_height) {
+    // Nothing to scale, libyuv converts and rotates in one pass.
+    return ConvertToI420(src_video_type, src_frame, crop_x, crop_y, src_width,
+                         src_height, sample_size, rotation, dst_frame);
+  }
+
+  // Bands hold a whole number of scaling periods, so that the box filter
+  // reads only rows of its own band and the result matches scaling the
+  // whole frame. Both band heights are even to keep the chroma rows in step.
+  const int gcd = GreatestCommonDivisor(crop_height, dst_height);
+  const int period_src_rows = crop_height / gcd;
+  const int period_dst_rows = dst_height / gcd;
+  int periods = std::max(kScaleBandRows / period_dst_rows, 1);
+  if ((period_src_rows % 2 || period_dst_rows % 2) && periods % 2)
+    ++periods;
+  int band_src_rows = periods * period_src_rows;
+  int band_dst_rows = periods * period_dst_rows;
+  // MJPG decodes the whole frame for each call, and flipped sources count
+  // their rows from the bottom; those are converted in a single band. So are
+  // rotations of an odd height, whose bands would start mid chroma column,
+  // and upscaling, which libyuv filters bilinearly with a row past the band.
+  if (band_src_rows >= crop_height || src_video_type == kMJPG ||
+      src_height < 0 || (rotation != kVideoRotation_0 && dst_height % 2) ||
+      crop_height < dst_height) {
+    band_src_rows = crop_height;
+    band_dst_rows = dst_height;
+  }
+
+  BandBuffer converted(crop_width, band_src_rows);
+  rtc::scoped_ptr<BandBuffer> scaled;
+  if (rotation != kVideoRotation_0)
+    scaled.reset(new BandBuffer(dst_width, band_dst_rows));
+
+  for (int src_row = 0, dst_row = 0; src_row < crop_height;
+       src_row += band_src_rows, dst_row += band_dst_rows) {
+    const int src_rows = std::min(band_src_rows, crop_height - src_row);
+    const int dst_rows = std::min(band_dst_rows, dst_height - dst_row);
+    int ret = libyuv::ConvertToI420(src_frame, sample_size,
+                                    converted.y(), converted.stride_y(),
+                                    converted.u(), converted.stride_uv(),
+                                    converted.v(), converted.stride_uv(),
+                                    crop_x, crop_y + src_row,
+                                    src_width, src_height,
+                                    crop_width, src_rows,
+                                    libyuv::kRotate0,
+                                    ConvertVideoType(src_video_type));
+    if (ret < 0)
+      return ret;
+
+    if (rotation == kVideoRotation_0) {
+      ret = libyuv::I420Scale(
+          converted.y(), converted.stride_y(),
+          converted.u(), converted.stride_uv(),
+          converted.v(), converted.stride_uv(),
+          crop_width, src_rows,
+          dst_frame->buffer(kYPlane) + dst_row * dst_frame->stride(kYPlane),
+          dst_frame->stride(kYPlane),
+          dst_frame->buffer(kUPlane) +
+              dst_row / 2 * dst_frame->stride(kUPlane),
+          dst_frame->stride(kUPlane),
+          dst_frame->buffer(kVPlane) +
+              dst_row / 2 * dst_frame->stride(kVPlane),
+          dst_frame->stride(kVPlane),
+          dst_width, dst_rows, libyuv::kFilterBox);
+      if (ret < 0)
+        return ret;
+      continue;
+    }
+
+    ret = libyuv::I420Scale(converted.y(), converted.stride_y(),
+                            converted.u(), converted.stride_uv(),
+                            converted.v(), converted.stride_uv(),
+                            crop_width, src_rows,
+                            scaled->y(), scaled->stride_y(),
+                            scaled->u(), scaled->stride_uv(),
+                            scaled->v(), scaled->stride_uv(),
+                            dst_width, dst_rows, libyuv::kFilterBox);
+    if (ret < 0)
+      return ret;
+    // Where the band lands in |dst_frame|: rows for 180, columns for 90 and
+    // 270 degrees.
+    int dst_offset_y = 0;
+    int dst_offset_uv = 0;
+    switch (rotation) {
+      case kVideoRotation_0:
+        break;
+      case kVideoRotation_90:
+        dst_offset_y = dst_height - dst_row - dst_rows;
+        dst_offset_uv = dst_offset_y / 2;
+        break;
+      case kVideoRotation_180:
+        dst_offset_y = (dst_height - dst_row - dst_rows) *
+                       dst_frame->stride(kYPlane);
+        dst_offset_uv = (dst_height - dst_row - dst_rows) / 2 *
+                        dst_frame->stride(kUPlane);
+        break;
+      case kVideoRotation_270:
+        dst_offset_y = dst_row;
+        dst_offset_uv = dst_row / 2;
+        break;
+    }
+    ret = libyuv::I420Rotate(scaled->y(), scaled->stride_y(),
+                             scaled->u(), scaled->stride_uv(),
+                             scaled->v(), scaled->stride_uv(),
+                             dst_frame->buffer(kYPlane) + dst_offset_y,
+                             dst_frame->stride(kYPlane),
+                             dst_frame->buffer(kUPlane) + dst_offset_uv,
+                             dst_frame->stride(kUPlane),
+                             dst_frame->buffer(kVPlane) + dst_offset_uv,
+                             dst_frame->stride(kVPlane),
+                             dst_width, dst_rows,
+                             ConvertRotationMode(rotation));
+    if (ret < 0)
+      return ret;
+  }
+  return 0;
+}
+
 int ConvertFromI420(const VideoFrame& src_frame,
                     VideoType dst_video_type,
                     int dst_sample_size,
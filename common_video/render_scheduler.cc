@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "common_video/interface/render_scheduler.h"
+
+#include "system_wrappers/interface/condition_variable_wrapper.h"
+#include "system_wrappers/interface/critical_section_wrapper.h"
+#include "system_wrappers/interface/event_wrapper.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "system_wrappers/interface/tick_util.h"
+
+namespace webrtc {
+
+RenderScheduler::RenderScheduler(int timer_slack_ms)
+    : timer_slack_ms_(timer_slack_ms),
+      crit_(CriticalSectionWrapper::CreateCriticalSection()),
+      stream_done_(ConditionVariableWrapper::CreateConditionVariable()),
+      wake_event_(EventWrapper::Create()),
+      stopping_(false),
+      running_stream_(nullptr),
+      num_wakeups_(0),
+      last_generation_(0) {
+}
+
+RenderScheduler::~RenderScheduler() {
+  {
+    CriticalSectionScoped cs(crit_.get());
+    stopping_ = true;
+    wake_event_->Set();
+  }
+  if (render_thread_)
+    render_thread_->Stop();
+}
+
+void RenderScheduler::AddStream(Stream* stream, uint32_t delay_ms) {
+  CriticalSectionScoped cs(crit_.get());
+  if (!render_thread_) {
+    render_thread_ = ThreadWrapper::CreateThread(RenderThreadFun, this,
+                                                 "RenderSchedulerThread");
+    render_thread_->Start();
+    render_thread_->SetPriority(kRealtimePriority);
+  }
+  StreamState& state = streams_[stream];
+  state.generation = 0;
+  state.run_time_ms = -1;
+  ScheduleLocked(&state, stream, TickTime::MillisecondTimestamp() + delay_ms);
+  wake_event_->Set();
+}
+
+void RenderScheduler::RemoveStream(Stream* stream) {
+  CriticalSectionScoped cs(crit_.get());
+  streams_.erase(stream);
+  while (running_stream_ == stream)
+    stream_done_->SleepCS(*crit_);
+}
+
+void RenderScheduler::Reschedule(Stream* stream, uint32_t delay_ms) {
+  CriticalSectionScoped cs(crit_.get());
+  std::map<Stream*, StreamState>::iterator it = streams_.find(stream);
+  if (it == streams_.end())
+    return;
+  if (ScheduleLocked(&it->second, stream,
+                     TickTime::MillisecondTimestamp() + delay_ms)) {
+    wake_event_->Set();
+  }
+}
+
+int64_t RenderScheduler::NumWakeups() const {
+  CriticalSectionScoped cs(crit_.get());
+  return num_wakeups_;
+}
+
+bool RenderScheduler::ScheduleLocked(StreamState* state,
+                                     Stream* stream,
+                                     int64_t run_time_ms) {
+  if (state->run_time_ms >= 0 && state->run_time_ms <= run_time_ms)
+    return false;
+  // Unique across streams and registrations, so that entries of a stream
+  // that was removed and added again are still stale.
+  state->generation = ++last_generation_;
+  state->run_time_ms = run_time_ms;
+  Entry entry = {run_time_ms, stream, state->generation};
+  heap_.push(entry);
+  return true;
+}
+
+bool RenderScheduler::RenderThreadFun(void* obj) {
+  return static_cast<RenderScheduler*>(obj)->RenderProcess();
+}
+
+bool RenderScheduler::RenderProcess() {
+  Stream* stream = nullptr;
+  unsigned long wait_ms = WEBRTC_EVENT_INFINITE;
+  {
+    CriticalSectionScoped cs(crit_.get());
+    if (stopping_)
+      return false;
+    const int64_t now_ms = TickTime::MillisecondTimestamp();
+    while (!heap_.empty()) {
+      const Entry entry = heap_.top();
+      std::map<Stream*, StreamState>::iterator it = streams_.find(entry.stream);
+      if (it == streams_.end() || it->second.generation != entry.generation) {
+        // Removed or rescheduled.
+        heap_.pop();
+        continue;
+      }
+      if (entry.run_time_ms > now_ms) {
+        int64_t wake_time_ms = entry.run_time_ms;
+        if (timer_slack_ms_ > 0) {
+          wake_time_ms = (wake_time_ms + timer_slack_ms_ - 1) /
+                         timer_slack_ms_ * timer_slack_ms_;
+        }
+        wait_ms = static_cast<unsigned long>(wake_time_ms - now_ms);
+        break;
+      }
+      heap_.pop();
+      it->second.run_time_ms = -1;
+      stream = entry.stream;
+      running_stream_ = stream;
+      break;
+    }
+  }
+
+  if (!stream) {
+    wake_event_->Wait(wait_ms);
+    CriticalSectionScoped cs(crit_.get());
+    ++num_wakeups_;
+    return true;
+  }
+
+  // Run without the lock, so that frames can be added and other streams
+  // removed meanwhile.
+  const uint32_t next_ms = stream->RenderDueFrames();
+
+  CriticalSectionScoped cs(crit_.get());
+  running_stream_ = nullptr;
+  std::map<Stream*, StreamState>::iterator it = streams_.find(stream);
+  if (it != streams_.end()) {
+    ScheduleLocked(&it->second, stream,
+                   TickTime::MillisecondTimestamp() + next_ms);
+  }
+  stream_done_->WakeAll();
+  return true;
+}
+
+}  // namespace webrtc
@@ -0,0 +1,311 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+#include "base/scoped_ptr.h"
+#include "common_video/interface/incoming_video_stream.h"
+#include "common_video/interface/render_scheduler.h"
+#include "system_wrappers/interface/critical_section_wrapper.h"
+#include "system_wrappers/interface/event_wrapper.h"
+#include "system_wrappers/interface/scoped_vector.h"
+#include "system_wrappers/interface/sleep.h"
+#include "system_wrappers/interface/tick_util.h"
+#include "test/testsupport/perf_test.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kWaitTimeoutMs = 1000;
+
+// Runs every |interval_ms|, taking |run_time_ms|.
+class FakeStream : public RenderScheduler::Stream {
+ public:
+  FakeStream(uint32_t interval_ms, int run_time_ms)
+      : crit_(CriticalSectionWrapper::CreateCriticalSection()),
+        run_event_(EventWrapper::Create()),
+        interval_ms_(interval_ms),
+        run_time_ms_(run_time_ms),
+        num_runs_(0),
+        running_(false) {}
+
+  uint32_t RenderDueFrames() override {
+    {
+      CriticalSectionScoped cs(crit_.get());
+      running_ = true;
+    }
+    run_event_->Set();
+    if (run_time_ms_ > 0)
+      SleepMs(run_time_ms_);
+    CriticalSectionScoped cs(crit_.get());
+    running_ = false;
+    ++num_runs_;
+    return interval_ms_;
+  }
+
+  bool WaitForRun() {
+    return run_event_->Wait(kWaitTimeoutMs) == kEventSignaled;
+  }
+
+  int num_runs() const {
+    CriticalSectionScoped cs(crit_.get());
+    return num_runs_;
+  }
+
+  bool running() const {
+    CriticalSectionScoped cs(crit_.get());
+    return running_;
+  }
+
+ private:
+  const rtc::scoped_ptr<CriticalSectionWrapper> crit_;
+  const rtc::scoped_ptr<EventWrapper> run_event_;
+  const uint32_t interval_ms_;
+  const int run_time_ms_;
+  int num_runs_;
+  bool running_;
+};
+
+// Records when frames are rendered, and how far from their render time.
+class RenderRecorder : public VideoRenderCallback {
+ public:
+  explicit RenderRecorder(int render_delay_ms)
+      : crit_(CriticalSectionWrapper::CreateCriticalSection()),
+        render_event_(EventWrapper::Create()),
+        render_delay_ms_(render_delay_ms) {}
+
+  int32_t RenderFrame(const uint32_t stream_id,
+                      const VideoFrame& video_frame) override {
+    CriticalSectionScoped cs(crit_.get());
+    const int64_t now_ms = TickTime::MillisecondTimestamp();
+    widths_.push_back(video_frame.width());
+    if (video_frame.render_time_ms() > 0) {
+      jitter_ms_.push_back(static_cast<int>(std::abs(
+          now_ms - (video_frame.render_time_ms() - render_delay_ms_))));
+    }
+    render_event_->Set();
+    return 0;
+  }
+
+  bool WaitForFrame() {
+    return render_event_->Wait(kWaitTimeoutMs) == kEventSignaled;
+  }
+
+  std::vector<int> widths() const {
+    CriticalSectionScoped cs(crit_.get());
+    return widths_;
+  }
+
+  std::vector<int> jitter_ms() const {
+    CriticalSectionScoped cs(crit_.get());
+    return jitter_ms_;
+  }
+
+ private:
+  const rtc::scoped_ptr<CriticalSectionWrapper> crit_;
+  const rtc::scoped_ptr<EventWrapper> render_event_;
+  const int render_delay_ms_;
+  // Width of each rendered frame, to tell frames and images apart.
+  std::vector<int> widths_;
+  std::vector<int> jitter_ms_;
+};
+
+VideoFrame CreateFrame(int width, int64_t render_time_ms) {
+  VideoFrame frame;
+  frame.CreateEmptyFrame(width, 16, width, (width + 1) / 2, (width + 1) / 2);
+  frame.set_render_time_ms(render_time_ms);
+  return frame;
+}
+
+}  // namespace
+
+TEST(RenderSchedulerTest, RunsStreamsAtTheirIntervals) {
+  RenderScheduler scheduler(0);
+  FakeStream fast(10, 0);
+  FakeStream slow(50, 0);
+  scheduler.AddStream(&fast, 0);
+  scheduler.AddStream(&slow, 0);
+  SleepMs(500);
+  scheduler.RemoveStream(&fast);
+  scheduler.RemoveStream(&slow);
+  EXPECT_GE(fast.num_runs(), 25);
+  EXPECT_LE(fast.num_runs(), 51);
+  EXPECT_GE(slow.num_runs(), 5);
+  EXPECT_LE(slow.num_runs(), 11);
+}
+
+TEST(RenderSchedulerTest, RescheduleRunsStreamEarly) {
+  RenderScheduler scheduler(0);
+  FakeStream stream(10000, 0);
+  scheduler.AddStream(&stream, 10000);
+  SleepMs(20);
+  EXPECT_EQ(0, stream.num_runs());
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  scheduler.Reschedule(&stream, 0);
+  ASSERT_TRUE(stream.WaitForRun());
+  EXPECT_LT(TickTime::MillisecondTimestamp() - start_ms, 100);
+  scheduler.RemoveStream(&stream);
+}
+
+TEST(RenderSchedulerTest, RemoveStreamWaitsForRunningStream) {
+  RenderScheduler scheduler(0);
+  FakeStream stream(0, 100);
+  scheduler.AddStream(&stream, 0);
+  ASSERT_TRUE(stream.WaitForRun());
+  scheduler.RemoveStream(&stream);
+  EXPECT_FALSE(stream.running());
+  const int num_runs = stream.num_runs();
+  SleepMs(200);
+  EXPECT_EQ(num_runs, stream.num_runs());
+}
+
+TEST(RenderSchedulerTest, ReaddedStreamIgnoresEarlierEntries) {
+  RenderScheduler scheduler(0);
+  FakeStream stream(10000, 0);
+  scheduler.AddStream(&stream, 50);
+  scheduler.RemoveStream(&stream);
+  scheduler.AddStream(&stream, 10000);
+  SleepMs(150);
+  EXPECT_EQ(0, stream.num_runs());
+  scheduler.RemoveStream(&stream);
+}
+
+TEST(RenderSchedulerTest, StreamsShareScheduler) {
+  RenderScheduler scheduler(0);
+  IncomingVideoStream stream1(1, &scheduler);
+  IncomingVideoStream stream2(2, &scheduler);
+  RenderRecorder recorder1(10);
+  RenderRecorder recorder2(10);
+  stream1.SetRenderCallback(&recorder1);
+  stream2.SetRenderCallback(&recorder2);
+  EXPECT_EQ(0, stream1.SetStartImage(CreateFrame(32, 0)));
+  EXPECT_EQ(0, stream1.Start());
+  EXPECT_EQ(0, stream2.Start());
+
+  // The start image until the first frame.
+  ASSERT_TRUE(recorder1.WaitForFrame());
+  EXPECT_EQ(32, recorder1.widths()[0]);
+
+  const int64_t now_ms = TickTime::MillisecondTimestamp();
+  stream1.RenderFrame(1, CreateFrame(16, now_ms + 20));
+  stream2.RenderFrame(2, CreateFrame(16, now_ms + 20));
+  ASSERT_TRUE(recorder2.WaitForFrame());
+  EXPECT_EQ(16, recorder2.widths()[0]);
+  while (recorder1.widths().back() != 16)
+    ASSERT_TRUE(recorder1.WaitForFrame());
+
+  EXPECT_EQ(0, stream1.Stop());
+  EXPECT_EQ(0, stream2.Stop());
+}
+
+TEST(RenderSchedulerTest, TimeoutImage) {
+  RenderScheduler scheduler(0);
+  IncomingVideoStream stream(1, &scheduler);
+  RenderRecorder recorder(10);
+  stream.SetRenderCallback(&recorder);
+  EXPECT_EQ(0, stream.SetTimeoutImage(CreateFrame(48, 0), 50));
+  EXPECT_EQ(0, stream.Start());
+
+  stream.RenderFrame(1, CreateFrame(16, TickTime::MillisecondTimestamp()));
+  ASSERT_TRUE(recorder.WaitForFrame());
+  EXPECT_EQ(16, recorder.widths()[0]);
+  // No more frames, the timeout image follows.
+  ASSERT_TRUE(recorder.WaitForFrame());
+  EXPECT_EQ(48, recorder.widths().back());
+  EXPECT_EQ(0, stream.Stop());
+}
+
+namespace {
+
+// Renders 30 fps on |num_streams| streams for a second, on one scheduler or
+// on a scheduler per stream as before, and reports the wakeups of the render
+// threads and how far from their render time the frames were rendered.
+void RunStreams(int num_streams, bool shared, const std::string& trace) {
+  const int kFrameIntervalMs = 33;
+  const int kRenderDelayMs = 10;
+  const int kDurationMs = 1000;
+  ScopedVector<RenderScheduler> schedulers;
+  ScopedVector<RenderRecorder> recorders;
+  ScopedVector<IncomingVideoStream> streams;
+  for (int i = 0; i < num_streams; ++i) {
+    if (i == 0 || !shared)
+      schedulers.push_back(new RenderScheduler(
+          shared ? RenderScheduler::kSharedTimerSlackMs : 0));
+    recorders.push_back(new RenderRecorder(kRenderDelayMs));
+    streams.push_back(new IncomingVideoStream(i, schedulers.back()));
+    streams.back()->SetRenderCallback(recorders.back());
+    EXPECT_EQ(0, streams.back()->Start());
+  }
+
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  int64_t wakeups_at_start = 0;
+  for (RenderScheduler* scheduler : schedulers)
+    wakeups_at_start += scheduler->NumWakeups();
+  int64_t now_ms = start_ms;
+  for (int frame = 0; now_ms < start_ms + kDurationMs; ++frame) {
+    // Streams of other senders are not in step.
+    for (int i = 0; i < num_streams; ++i) {
+      streams[i]->RenderFrame(
+          i, CreateFrame(16, now_ms + 40 + i * kFrameIntervalMs / num_streams));
+    }
+    SleepMs(static_cast<int>(start_ms + (frame + 1) * kFrameIntervalMs -
+                             TickTime::MillisecondTimestamp()));
+    now_ms = TickTime::MillisecondTimestamp();
+  }
+  int64_t wakeups = -wakeups_at_start;
+  for (RenderScheduler* scheduler : schedulers)
+    wakeups += scheduler->NumWakeups();
+  const int64_t elapsed_ms = TickTime::MillisecondTimestamp() - start_ms;
+  for (IncomingVideoStream* stream : streams)
+    EXPECT_EQ(0, stream->Stop());
+
+  std::vector<int> jitter_ms;
+  for (RenderRecorder* recorder : recorders) {
+    const std::vector<int> stream_jitter_ms = recorder->jitter_ms();
+    EXPECT_FALSE(stream_jitter_ms.empty());
+    jitter_ms.insert(jitter_ms.end(), stream_jitter_ms.begin(),
+                     stream_jitter_ms.end());
+  }
+  ASSERT_FALSE(jitter_ms.empty());
+  std::sort(jitter_ms.begin(), jitter_ms.end());
+  double mean_jitter_ms = 0;
+  for (int jitter : jitter_ms)
+    mean_jitter_ms += jitter;
+  mean_jitter_ms /= jitter_ms.size();
+
+  test::PrintResult("render_wakeups", "", trace,
+                    wakeups * 1000.0 / elapsed_ms, "wakeups/s", true);
+  test::PrintResult("render_jitter_mean", "", trace, mean_jitter_ms, "ms",
+                    false);
+  test::PrintResult("render_jitter_p95", "", trace,
+                    static_cast<double>(jitter_ms[jitter_ms.size() * 95 / 100]),
+                    "ms", false);
+}
+
+}  // namespace
+
+TEST(RenderSchedulerTest, Performance) {
+  const int kNumStreams[] = {1, 16, 64};
+  for (int num_streams : kNumStreams) {
+    std::ostringstream trace;
+    trace << num_streams << "_streams";
+    RunStreams(num_streams, false, trace.str() + "_thread_per_stream");
+    RunStreams(num_streams, true, trace.str() + "_shared");
+  }
+}
+
+}  // namespace webrtc
@@ -12,6 +12,7 @@
 
 #include <assert.h>
 
+#include "base/atomicops.h"
 #include "interface/module_common_types.h"
 #include "system_wrappers/interface/tick_util.h"
 #include "system_wrappers/interface/trace.h"
@@ -23,16 +24,26 @@ const uint32_t kMinRenderDelayMs = 10;
 const uint32_t kMaxRenderDelayMs= 500;
 
 VideoRenderFrames::VideoRenderFrames()
-    : render_delay_ms_(10) {
+    : frames_(KMaxNumberOfFrames + 1),
+      write_index_(0),
+      read_index_(0),
+      render_delay_ms_(10),
+      num_dropped_too_old_(0),
+      num_dropped_future_(0),
+      num_dropped_queue_full_(0),
+      num_overwritten_(0) {
 }
 
 int32_t VideoRenderFrames::AddFrame(const VideoFrame& new_frame) {
   const int64_t time_now = TickTime::MillisecondTimestamp();
+  const int ring_size = static_cast<int>(frames_.size());
+  const int write_index = write_index_;
 
   // Drop old frames only when there are other frames in the queue, otherwise, a
   // really slow system never renders any frames.
-  if (!incoming_frames_.empty() &&
+  if (rtc::AtomicOps::AcquireLoad(&read_index_) != write_index &&
       new_frame.render_time_ms() + KOldRenderTimestampMS < time_now) {
+    rtc::AtomicOps::Increment(&num_dropped_too_old_);
     WEBRTC_TRACE(kTraceWarning,
                  kTraceVideoRenderer,
                  -1,
@@ -43,38 +54,74 @@ int32_t VideoRenderFrames::AddFrame(const VideoFrame& new_frame) {
   }
 
   if (new_frame.render_time_ms() > time_now + KFutureRenderTimestampMS) {
+    rtc::AtomicOps::Increment(&num_dropped_future_);
     WEBRTC_TRACE(kTraceWarning, kTraceVideoRenderer, -1,
                  "%s: frame too long into the future, timestamp=%u.",
                  __FUNCTION__, new_frame.timestamp());
     return -1;
   }
 
-  incoming_frames_.push_back(new_frame);
-  return static_cast<int32_t>(incoming_frames_.size());
+  const int next_write_index = (write_index + 1) % ring_size;
+  if (next_write_index == rtc::AtomicOps::AcquireLoad(&read_index_)) {
+    rtc::AtomicOps::Increment(&num_dropped_queue_full_);
+    WEBRTC_TRACE(kTraceWarning, kTraceVideoRenderer, -1,
+                 "%s: render queue full, timestamp=%u.",
+                 __FUNCTION__, new_frame.timestamp());
+    return -1;
+  }
+
+  // The consumer does not touch the slot until the index is published.
+  frames_[write_index] = new_frame;
+  StoreIndex(&write_index_, next_write_index);
+  // Counted after publishing, so that a frame the consumer may have missed
+  // is reported as the next to render.
+  const int read_index = rtc::AtomicOps::AcquireLoad(&read_index_);
+  return (next_write_index - read_index + ring_size) % ring_size;
 }
 
 VideoFrame VideoRenderFrames::FrameToRender() {
+  const int ring_size = static_cast<int>(frames_.size());
   VideoFrame render_frame;
+  bool has_frame = false;
   // Get the newest frame that can be released for rendering.
-  while (!incoming_frames_.empty() && TimeToNextFrameRelease() <= 0) {
-    render_frame = incoming_frames_.front();
-    incoming_frames_.pop_front();
+  int read_index = read_index_;
+  while (read_index != rtc::AtomicOps::AcquireLoad(&write_index_) &&
+         TimeToFrameRelease(frames_[read_index].render_time_ms()) == 0) {
+    if (has_frame)
+      rtc::AtomicOps::Increment(&num_overwritten_);
+    render_frame = frames_[read_index];
+    has_frame = true;
+    // Let go of the buffer before the producer may reuse the slot.
+    frames_[read_index] = VideoFrame();
+    read_index = (read_index + 1) % ring_size;
+    StoreIndex(&read_index_, read_index);
   }
   return render_frame;
 }
 
 int32_t VideoRenderFrames::ReleaseAllFrames() {
-  incoming_frames_.clear();
+  const int ring_size = static_cast<int>(frames_.size());
+  int read_index = read_index_;
+  while (read_index != rtc::AtomicOps::AcquireLoad(&write_index_)) {
+    frames_[read_index] = VideoFrame();
+    read_index = (read_index + 1) % ring_size;
+    StoreIndex(&read_index_, read_index);
+  }
   return 0;
 }
 
 uint32_t VideoRenderFrames::TimeToNextFrameRelease() {
-  if (incoming_frames_.empty()) {
+  const int read_index = read_index_;
+  if (read_index == rtc::AtomicOps::AcquireLoad(&write_index_)) {
     return KEventMaxWaitTimeMs;
   }
-  const int64_t time_to_release = incoming_frames_.front().render_time_ms() -
-                                  render_delay_ms_ -
-                                  TickTime::MillisecondTimestamp();
+  return TimeToFrameRelease(frames_[read_index].render_time_ms());
+}
+
+uint32_t VideoRenderFrames::TimeToFrameRelease(int64_t render_time_ms) const {
+  const int64_t time_to_release =
+      render_time_ms - rtc::AtomicOps::AcquireLoad(&render_delay_ms_) -
+      TickTime::MillisecondTimestamp();
   return time_to_release < 0 ? 0u : static_cast<uint32_t>(time_to_release);
 }
 
@@ -88,8 +135,34 @@ int32_t VideoRenderFrames::SetRenderDelay(
     return -1;
   }
 
-  render_delay_ms_ = render_delay;
+  rtc::AtomicOps::ReleaseStore(&render_delay_ms_,
+                               static_cast<int>(render_delay));
   return 0;
 }
 
+uint32_t VideoRenderFrames::NumDroppedTooOld() const {
+  return static_cast<uint32_t>(
+      rtc::AtomicOps::AcquireLoad(&num_dropped_too_old_));
+}
+
+uint32_t VideoRenderFrames::NumDroppedFuture() const {
+  return static_cast<uint32_t>(
+      rtc::AtomicOps::AcquireLoad(&num_dropped_future_));
+}
+
+uint32_t VideoRenderFrames::NumDroppedQueueFull() const {
+  return static_cast<uint32_t>(
+      rtc::AtomicOps::AcquireLoad(&num_dropped_queue_full_));
+}
+
+uint32_t VideoRenderFrames::NumOverwritten() const {
+  return static_cast<uint32_t>(rtc::AtomicOps::AcquireLoad(&num_overwritten_));
+}
+
+void VideoRenderFrames::StoreIndex(volatile int* index, int value) {
+  // Only the owner of |index| writes it, so the swap always succeeds; unlike
+  // ReleaseStore it also orders the store before the loads that follow.
+  rtc::AtomicOps::CompareAndSwap(index, *index, value);
+}
+
 }  // namespace webrtc
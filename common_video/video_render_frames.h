@@ -13,18 +13,25 @@
 
 #include <stdint.h>
 
-#include <list>
+#include <vector>
 
 #include "video_frame.h"
 
 namespace webrtc {
 
-// Class definitions
+// Queue of frames between the decoder and the renderer, a bounded ring with
+// one producer and one consumer. AddFrame is called on the decode thread and
+// takes no lock; FrameToRender, TimeToNextFrameRelease and ReleaseAllFrames
+// are the consumer side, and must not be called concurrently with each other.
+// SetRenderDelay must not be called while frames are added.
+//
+// Frames that are not rendered are counted by the reason they were dropped.
 class VideoRenderFrames {
  public:
   VideoRenderFrames();
 
-  // Add a frame to the render queue
+  // Add a frame to the render queue. Returns the number of frames in the
+  // queue, 1 if the frame is the next to render, or -1 if it was dropped.
   int32_t AddFrame(const VideoFrame& new_frame);
 
   // Get a frame for rendering, or a zero-size frame if it's not time to render.
@@ -35,10 +42,23 @@ class VideoRenderFrames {
 
   // Returns the number of ms to next frame to render
   uint32_t TimeToNextFrameRelease();
+  // Returns the number of ms until a frame to render at |render_time_ms| is
+  // released.
+  uint32_t TimeToFrameRelease(int64_t render_time_ms) const;
 
   // Sets estimates delay in renderer
   int32_t SetRenderDelay(const uint32_t render_delay);
 
+  // Frames dropped by AddFrame as older than KOldRenderTimestampMS.
+  uint32_t NumDroppedTooOld() const;
+  // Frames dropped by AddFrame as more than KFutureRenderTimestampMS ahead.
+  uint32_t NumDroppedFuture() const;
+  // Frames dropped by AddFrame as the queue was full.
+  uint32_t NumDroppedQueueFull() const;
+  // Frames that were due but replaced by a newer due frame before being
+  // rendered, as the renderer fell behind.
+  uint32_t NumOverwritten() const;
+
  private:
   // 10 seconds for 30 fps.
   enum { KMaxNumberOfFrames = 300 };
@@ -47,11 +67,26 @@ class VideoRenderFrames {
   // Don't render frames with timestamp more than 10s into the future.
   enum { KFutureRenderTimestampMS = 10000 };
 
-  // Sorted list with framed to be rendered, oldest first.
-  std::list<VideoFrame> incoming_frames_;
+  // Publishes an index, with a full barrier so that the other side's index is
+  // read after it.
+  static void StoreIndex(volatile int* index, int value);
+
+  // Frames to be rendered, oldest first, from |read_index_| up to
+  // |write_index_|. One slot is kept free to tell a full ring from an empty
+  // one.
+  std::vector<VideoFrame> frames_;
+  // Written by the producer only.
+  volatile int write_index_;
+  // Written by the consumer only.
+  volatile int read_index_;
 
   // Estimated delay from a frame is released until it's rendered.
-  uint32_t render_delay_ms_;
+  volatile int render_delay_ms_;
+
+  volatile int num_dropped_too_old_;
+  volatile int num_dropped_future_;
+  volatile int num_dropped_queue_full_;
+  volatile int num_overwritten_;
 };
 
 }  // namespace webrtc
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "testing/gtest/include/gtest/gtest.h"
+#include "base/scoped_ptr.h"
+#include "common_video/video_render_frames.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "system_wrappers/interface/tick_util.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kRenderDelayMs = 10;
+
+VideoFrame CreateFrame(int64_t render_time_ms, uint32_t timestamp) {
+  VideoFrame frame;
+  frame.CreateEmptyFrame(16, 16, 16, 8, 8);
+  frame.set_render_time_ms(render_time_ms);
+  frame.set_timestamp(timestamp);
+  return frame;
+}
+
+}  // namespace
+
+class VideoRenderFramesTest : public ::testing::Test {
+ protected:
+  VideoRenderFramesTest() : now_ms_(TickTime::MillisecondTimestamp()) {
+    EXPECT_EQ(0, frames_.SetRenderDelay(kRenderDelayMs));
+  }
+
+  const int64_t now_ms_;
+  VideoRenderFrames frames_;
+};
+
+TEST_F(VideoRenderFramesTest, RendersDueFramesInOrder) {
+  EXPECT_EQ(200u, frames_.TimeToNextFrameRelease());
+  EXPECT_EQ(1, frames_.AddFrame(CreateFrame(now_ms_, 1)));
+  EXPECT_EQ(2, frames_.AddFrame(CreateFrame(now_ms_ + 10000, 2)));
+  EXPECT_EQ(0u, frames_.TimeToNextFrameRelease());
+
+  VideoFrame frame = frames_.FrameToRender();
+  EXPECT_EQ(1u, frame.timestamp());
+  EXPECT_GT(frames_.TimeToNextFrameRelease(), 9000u);
+  EXPECT_TRUE(frames_.FrameToRender().IsZeroSize());
+  EXPECT_EQ(0u, frames_.NumOverwritten());
+}
+
+TEST_F(VideoRenderFramesTest, CountsOverwrittenFrames) {
+  for (uint32_t i = 0; i < 3; ++i)
+    frames_.AddFrame(CreateFrame(now_ms_ - 100 + i, i));
+  // The renderer fell behind, only the newest due frame is rendered.
+  EXPECT_EQ(2u, frames_.FrameToRender().timestamp());
+  EXPECT_EQ(2u, frames_.NumOverwritten());
+}
+
+TEST_F(VideoRenderFramesTest, CountsDroppedFrames) {
+  // The first frame is kept however old, for slow systems.
+  EXPECT_EQ(1, frames_.AddFrame(CreateFrame(now_ms_ - 1000, 1)));
+  EXPECT_EQ(-1, frames_.AddFrame(CreateFrame(now_ms_ - 1000, 2)));
+  EXPECT_EQ(-1, frames_.AddFrame(CreateFrame(now_ms_ + 20000, 3)));
+  EXPECT_EQ(1u, frames_.NumDroppedTooOld());
+  EXPECT_EQ(1u, frames_.NumDroppedFuture());
+  EXPECT_EQ(0u, frames_.NumDroppedQueueFull());
+}
+
+TEST_F(VideoRenderFramesTest, DropsFramesWhenFull) {
+  int num_added = 0;
+  while (frames_.AddFrame(CreateFrame(now_ms_ + 5000, num_added)) > 0)
+    ++num_added;
+  EXPECT_EQ(300, num_added);
+  EXPECT_EQ(1u, frames_.NumDroppedQueueFull());
+
+  EXPECT_EQ(0, frames_.ReleaseAllFrames());
+  EXPECT_EQ(200u, frames_.TimeToNextFrameRelease());
+  EXPECT_EQ(1, frames_.AddFrame(CreateFrame(now_ms_ + 5000, 0)));
+}
+
+namespace {
+
+const uint32_t kNumFrames = 5000;
+
+// Adds frames that are due right away, as fast as it can.
+bool AddFrames(void* obj) {
+  VideoRenderFrames* frames = static_cast<VideoRenderFrames*>(obj);
+  const int64_t now_ms = TickTime::MillisecondTimestamp();
+  uint32_t timestamp = 0;
+  while (timestamp < kNumFrames) {
+    if (frames->AddFrame(CreateFrame(now_ms, timestamp)) > 0)
+      ++timestamp;
+  }
+  return false;
+}
+
+}  // namespace
+
+TEST_F(VideoRenderFramesTest, ProducerAndConsumerThreads) {
+  rtc::scoped_ptr<ThreadWrapper> thread(
+      ThreadWrapper::CreateThread(&AddFrames, &frames_, "AddFrames"));
+  ASSERT_TRUE(thread->Start());
+
+  // Every frame is either rendered or counted, in order.
+  uint32_t num_rendered = 0;
+  uint32_t last_timestamp = 0;
+  while (last_timestamp + 1 < kNumFrames) {
+    VideoFrame frame = frames_.FrameToRender();
+    if (frame.IsZeroSize())
+      continue;
+    if (num_rendered > 0) {
+      EXPECT_GT(frame.timestamp(), last_timestamp);
+    }
+    last_timestamp = frame.timestamp();
+    ++num_rendered;
+  }
+  EXPECT_TRUE(thread->Stop());
+  EXPECT_EQ(kNumFrames, num_rendered + frames_.NumOverwritten());
+}
+
+}  // namespace webrtc
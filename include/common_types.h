@@ -632,10 +632,29 @@ struct VideoCodecVP9 {
 };
 
 // H264 specific.
+enum H264LatencyMode {
+  kH264LowLatency,   // No frame reordering or lookahead: every input frame is
+                     // output by the same Encode call. For interactive calls.
+  kH264HighQuality   // B-frames and rate control lookahead, adds several
+                     // frames of delay. For streaming and recording.
+};
+
+enum H264ThreadingMode {
+  kH264ThreadingAuto,   // Sliced threads in kH264LowLatency, frame threads
+                        // otherwise.
+  kH264SlicedThreads,   // Slices of one frame are encoded in parallel. Adds
+                        // no delay but costs some compression efficiency.
+  kH264FrameThreads     // Consecutive frames are encoded in parallel. Scales
+                        // better but delays the output by threads - 1 frames.
+};
+
 struct VideoCodecH264 {
   VideoCodecProfile profile;
   bool           frameDroppingOn;
   int            keyFrameInterval;
+  H264LatencyMode latencyMode;
+  H264ThreadingMode threadingMode;
+  bool           automaticResizeOn;
   // These are NULL/0 if not externally negotiated.
   const uint8_t* spsData;
   size_t         spsLen;
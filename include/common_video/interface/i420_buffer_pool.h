@@ -11,31 +11,80 @@
 #ifndef WEBRTC_COMMON_VIDEO_INTERFACE_I420_BUFFER_POOL_H_
 #define WEBRTC_COMMON_VIDEO_INTERFACE_I420_BUFFER_POOL_H_
 
-#include <list>
-
-#include "base/thread_checker.h"
+#include "base/scoped_ref_ptr.h"
 #include "common_video/interface/video_frame_buffer.h"
 
 namespace webrtc {
 
-// Simple buffer pool to avoid unnecessary allocations of I420Buffer objects.
-// The pool manages the memory of the I420Buffer returned from CreateBuffer.
-// When the I420Buffer is destructed, the memory is returned to the pool for use
-// by subsequent calls to CreateBuffer. If the resolution passed to CreateBuffer
-// changes, old buffers will be purged from the pool.
+// Buffer pool to avoid unnecessary allocations of I420Buffer objects. The pool
+// manages the memory of the I420Buffer returned from CreateBuffer. When the
+// I420Buffer is destructed, the memory is returned to the pool for use by
+// subsequent calls to CreateBuffer with the same resolution and strides.
+//
+// The pool may be used from several threads at once, for instance shared by
+// capture, decode and scaling. It keeps a free list per resolution, for the
+// kMaxResolutions most recently requested resolutions; buffers of other
+// resolutions are released. Taking a buffer from a free list and returning
+// one are O(1).
+//
+// A bounded pool holds at most |max_buffers| buffers, in use or free. When it
+// is full, free buffers of other resolutions are released to make room; when
+// all buffers are in use, CreateBuffer waits up to |max_wait_ms| for one to
+// be returned and returns null if none is. A consumer that holds on to frames
+// thus slows down or drops the producer instead of growing the pool.
 class I420BufferPool {
  public:
+  enum { kMaxResolutions = 4 };
+
+  struct Stats {
+    Stats()
+        : hits(0),
+          misses(0),
+          drops(0),
+          num_buffers(0),
+          num_buffers_in_use(0),
+          resident_bytes(0) {}
+    // CreateBuffer calls served from a free list.
+    size_t hits;
+    // CreateBuffer calls that allocated a buffer.
+    size_t misses;
+    // CreateBuffer calls of a bounded pool that returned null.
+    size_t drops;
+    size_t num_buffers;
+    size_t num_buffers_in_use;
+    // The memory of all buffers, in use or free.
+    size_t resident_bytes;
+  };
+
+  // An unbounded pool.
   I420BufferPool();
+  // An unbounded pool which zero-initializes the buffers it allocates, e.g.
+  // for decoders which read uninitialized memory of a new buffer. Recycled
+  // buffers keep their content.
+  explicit I420BufferPool(bool zero_initialize);
+  I420BufferPool(size_t max_buffers, int max_wait_ms);
+  ~I420BufferPool();
+
   // Returns a buffer from the pool, or creates a new buffer if no suitable
-  // buffer exists in the pool.
+  // buffer exists in the pool. A bounded pool returns null if it is full.
   rtc::scoped_refptr<VideoFrameBuffer> CreateBuffer(int width, int height);
-  // Clears buffers_ and detaches the thread checker so that it can be reused
-  // later from another thread.
+  // As above, with padded strides, for instance to align the rows for SIMD
+  // code.
+  rtc::scoped_refptr<VideoFrameBuffer> CreateBuffer(int width,
+                                                    int height,
+                                                    int stride_y,
+                                                    int stride_uv);
+  // Releases the free buffers. Buffers in use are no longer counted by the
+  // pool and are deleted rather than recycled when returned.
   void Release();
 
+  Stats GetStats() const;
+
  private:
-  rtc::ThreadChecker thread_checker_;
-  std::list<rtc::scoped_refptr<I420Buffer>> buffers_;
+  class PooledI420Buffer;
+  class Recycler;
+
+  const rtc::scoped_refptr<Recycler> recycler_;
 };
 
 }  // namespace webrtc
@@ -0,0 +1,112 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef WEBRTC_COMMON_VIDEO_INTERFACE_RENDER_SCHEDULER_H_
+#define WEBRTC_COMMON_VIDEO_INTERFACE_RENDER_SCHEDULER_H_
+
+#include <functional>
+#include <map>
+#include <queue>
+#include <vector>
+
+#include "base/scoped_ptr.h"
+#include "base/thread_annotations.h"
+#include "typedefs.h"
+
+namespace webrtc {
+class ConditionVariableWrapper;
+class CriticalSectionWrapper;
+class EventWrapper;
+class ThreadWrapper;
+
+// Runs the render loops of several streams on one realtime thread, from a
+// heap of the times the streams asked to run at. A display with many tiles
+// then has one thread, which wakes up for the earliest stream and runs all
+// streams that are due, instead of one thread per stream that wakes up on
+// its own. A stream that renders slowly delays the others.
+//
+// With a timer slack, the thread wakes up on multiples of the slack only, so
+// that streams due at nearly the same time are run in one wakeup, at the
+// cost of rendering up to the slack later.
+class RenderScheduler {
+ public:
+  // The slack of the scheduler shared by the streams of a render module.
+  enum { kSharedTimerSlackMs = 4 };
+
+  class Stream {
+   public:
+    // Renders the frames that are due. Returns the time in ms until the
+    // stream wants to run again.
+    virtual uint32_t RenderDueFrames() = 0;
+
+   protected:
+    virtual ~Stream() {}
+  };
+
+  explicit RenderScheduler(int timer_slack_ms);
+  ~RenderScheduler();
+
+  // Runs |stream| in |delay_ms|, and then as it asks for.
+  void AddStream(Stream* stream, uint32_t delay_ms);
+  // Returns once |stream| is not running and will not run again. Must not be
+  // called from RenderDueFrames.
+  void RemoveStream(Stream* stream);
+  // Runs |stream| in |delay_ms| if that is before its next run, for instance
+  // when a frame arrives at an empty queue.
+  void Reschedule(Stream* stream, uint32_t delay_ms);
+
+  // Times the thread has woken up, for tests and statistics.
+  int64_t NumWakeups() const;
+
+ private:
+  struct Entry {
+    int64_t run_time_ms;
+    Stream* stream;
+    // Entries of older generations of the stream are stale and skipped.
+    uint32_t generation;
+
+    bool operator>(const Entry& other) const {
+      return run_time_ms > other.run_time_ms;
+    }
+  };
+  typedef std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> >
+      EntryHeap;
+
+  struct StreamState {
+    uint32_t generation;
+    // The time of the current entry, -1 if the stream has none.
+    int64_t run_time_ms;
+  };
+
+  static bool RenderThreadFun(void* obj);
+  bool RenderProcess();
+  // Schedules |stream| at |run_time_ms|. Returns false, and leaves the
+  // stream as is, if it is already scheduled no later.
+  bool ScheduleLocked(StreamState* state, Stream* stream, int64_t run_time_ms)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_);
+
+  const int timer_slack_ms_;
+  const rtc::scoped_ptr<CriticalSectionWrapper> crit_;
+  const rtc::scoped_ptr<ConditionVariableWrapper> stream_done_;
+  const rtc::scoped_ptr<EventWrapper> wake_event_;
+  rtc::scoped_ptr<ThreadWrapper> render_thread_;
+
+  bool stopping_ GUARDED_BY(crit_);
+  EntryHeap heap_ GUARDED_BY(crit_);
+  std::map<Stream*, StreamState> streams_ GUARDED_BY(crit_);
+  Stream* running_stream_ GUARDED_BY(crit_);
+  int64_t num_wakeups_ GUARDED_BY(crit_);
+  // The generation of the latest entry. 0 is never used.
+  uint32_t last_generation_ GUARDED_BY(crit_);
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_COMMON_VIDEO_INTERFACE_RENDER_SCHEDULER_H_
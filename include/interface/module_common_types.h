@@ -211,13 +211,47 @@ namespace webrtc {
         // that was too large to fit into a single packet.
     };
 
+    // A NAL unit in an H.264 RTP payload.
+    struct H264NaluInfo {
+        uint8_t type;
+        // Position of the NAL unit in the payload, starting with the NAL unit
+        // header. For a FU-A packet only the fragment data, see
+        // RTPVideoHeaderH264::fu_nalu_header.
+        uint16_t offset;
+        uint16_t length;
+    };
+
+    const size_t kMaxNalusPerPacket = 10;
+
     struct RTPVideoHeaderH264 {
+        void InitRTPVideoHeaderH264() {
+            nalu_type = 0;
+            packetization_type = kH264SingleNalu;
+            memset(nalus, 0, sizeof(nalus));
+            nalus_length = 0;
+            fu_nalu_header = 0;
+            fu_start = false;
+            fu_end = false;
+        }
+
         uint8_t nalu_type;  // The NAL unit type. If this is a header for a
         // fragmented packet, it's the NAL unit type of
         // the original data. If this is the header for an
         // aggregated packet, it's the NAL unit type of
         // the first NAL unit in the packet.
         H264PacketizationTypes packetization_type;
+        // The NAL units of the payload, as found by H264Depacketizer. If
+        // |nalus_length| is 0 the payload is one NAL unit, or the data of a
+        // FU-A fragment which already starts with the NAL unit header if it
+        // is the first fragment.
+        H264NaluInfo nalus[kMaxNalusPerPacket];
+        size_t nalus_length;
+        // FU-A only: the header of the fragmented NAL unit, which is written
+        // before the data of the first fragment, and the start and end bits
+        // of the FU header.
+        uint8_t fu_nalu_header;
+        bool fu_start;
+        bool fu_end;
     };
 
     union RTPVideoTypeHeader {
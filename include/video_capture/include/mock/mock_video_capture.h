@@ -41,10 +41,12 @@ class MockVideoCaptureModule : public VideoCaptureModule {
   MOCK_METHOD1(SetCaptureRotation, int32_t(VideoRotation rotation));
   MOCK_METHOD1(SetApplyRotation, bool(bool));
   MOCK_METHOD0(GetApplyRotation, bool());
+  MOCK_METHOD2(SetCaptureOutputSize, int32_t(int width, int height));
   MOCK_METHOD1(GetEncodeInterface,
                VideoCaptureEncodeInterface*(const VideoCodec& codec));
   MOCK_METHOD1(EnableFrameRateCallback, void(const bool enable));
   MOCK_METHOD1(EnableNoPictureAlarm, void(const bool enable));
+  MOCK_METHOD1(EnableAsyncConversion, void(bool enable));
 };
 
 }  // namespace webrtc
@@ -11,6 +11,8 @@
 #ifndef WEBRTC_MODULES_INTERFACE_VIDEO_CODING_DEFINES_H_
 #define WEBRTC_MODULES_INTERFACE_VIDEO_CODING_DEFINES_H_
 
+#include <vector>
+
 #include "interface/module_common_types.h"
 #include "typedefs.h"
 #include "video_frame.h"
@@ -95,6 +97,47 @@ class VCMSendStatisticsCallback {
   }
 };
 
+// Encode time and capture queueing of the send stream, over its last frames.
+// The encode time is the time from handing a frame to the encoder until the
+// encoder outputs it; the encode usage is the encode time relative to the
+// frame interval; the capture queue delay is the time from capture until the
+// frame is handed to the encoder. All values are -1 until enough frames have
+// been encoded.
+struct VCMEncodeUsageStats {
+  VCMEncodeUsageStats()
+      : encode_time_p50_ms(-1),
+        encode_time_p95_ms(-1),
+        encode_usage_p50_percent(-1),
+        encode_usage_p95_percent(-1),
+        capture_queue_delay_p50_ms(-1),
+        capture_queue_delay_p95_ms(-1) {}
+  int encode_time_p50_ms;
+  int encode_time_p95_ms;
+  int encode_usage_p50_percent;
+  int encode_usage_p95_percent;
+  int capture_queue_delay_p50_ms;
+  int capture_queue_delay_p95_ms;
+};
+
+// Callback class used for informing the user of the encode load, and for
+// asking to lower the frame rate or resolution before frames start to pile up
+// in front of an encoder that cannot keep up. The VCM doesn't adapt the stream
+// itself: the owner of the callback has to reduce the frame rate or the
+// resolution of the frames it adds on an overuse, or the overuse continues.
+class VCMEncodeUsageCallback {
+ public:
+  // Called once a second.
+  virtual void OnEncodeUsageUpdated(const VCMEncodeUsageStats& stats) = 0;
+  // The owner must lower the frame rate or resolution one step.
+  virtual void OnEncodeOveruse() = 0;
+  // The encoder has headroom again, the owner may undo one earlier step.
+  virtual void OnEncodeUnderuse() = 0;
+
+ protected:
+  virtual ~VCMEncodeUsageCallback() {
+  }
+};
+
 // Callback class used for informing the user of the incoming bit rate and frame rate.
 class VCMReceiveStatisticsCallback {
  public:
@@ -158,6 +201,16 @@ class VCMFrameTypeCallback {
   }
 };
 
+// A generic NACK feedback control item (RFC 4585, section 6.2.1): the packet
+// |pid| and, in |blp|, which of the 16 packets following it are also
+// requested, the least significant bit being packet pid + 1.
+struct VCMNackBlock {
+  VCMNackBlock() : pid(0), blp(0) {}
+
+  uint16_t pid;
+  uint16_t blp;
+};
+
 // Callback class used for telling the user about which packet sequence numbers are currently
 // missing and need to be resent.
 class VCMPacketRequestCallback {
@@ -165,6 +218,24 @@ class VCMPacketRequestCallback {
   virtual int32_t ResendPackets(const uint16_t* sequenceNumbers,
                                       uint16_t length) = 0;
 
+  // Requests the packets of |blocks|, which can be sent as they are in a
+  // generic NACK message. The default implementation passes the sequence
+  // numbers to ResendPackets().
+  virtual int32_t ResendPacketBlocks(const VCMNackBlock* blocks,
+                                     size_t num_blocks) {
+    std::vector<uint16_t> sequence_numbers;
+    sequence_numbers.reserve(num_blocks * 17);
+    for (size_t i = 0; i < num_blocks; ++i) {
+      sequence_numbers.push_back(blocks[i].pid);
+      for (int bit = 0; bit < 16; ++bit) {
+        if (blocks[i].blp & (1 << bit))
+          sequence_numbers.push_back(blocks[i].pid + bit + 1);
+      }
+    }
+    return ResendPackets(&sequence_numbers[0],
+                         static_cast<uint16_t>(sequence_numbers.size()));
+  }
+
  protected:
   virtual ~VCMPacketRequestCallback() {
   }
@@ -144,6 +144,13 @@ class VideoCaptureModule: public RefCountedModule {
   // Return whether the rotation is applied or left pending.
   virtual bool GetApplyRotation() = 0;
 
+  // Scales the captured frames to |width| x |height| in the same pass that
+  // converts them to I420, cropping the center of the frame to keep its
+  // aspect ratio. The size is that of the delivered frames, after any
+  // applied rotation. 0 x 0, the default, delivers frames at the size they
+  // were captured in. Returns 0 on success, -1 on an invalid size.
+  virtual int32_t SetCaptureOutputSize(int width, int height) = 0;
+
   // Gets a pointer to an encode interface if the capture device supports the
   // requested type and size.  NULL otherwise.
   virtual VideoCaptureEncodeInterface* GetEncodeInterface(
@@ -152,6 +159,13 @@ class VideoCaptureModule: public RefCountedModule {
   virtual void EnableFrameRateCallback(const bool enable) = 0;
   virtual void EnableNoPictureAlarm(const bool enable) = 0;
 
+  // Converts the captured frames on a thread of the module instead of the
+  // thread that captured them, so that the capture device gets its buffer
+  // back as soon as the frame is copied. Frames are delivered on the
+  // conversion thread then. If it falls behind, the oldest frames waiting
+  // for it are dropped.
+  virtual void EnableAsyncConversion(bool enable) = 0;
+
 protected:
   virtual ~VideoCaptureModule() {};
 };
@@ -169,6 +169,10 @@ class TestVideoCaptureCallback : public VideoCaptureDataCallback {
     CriticalSectionScoped cs(capture_cs_.get());
     return timing_warnings_;
   }
+  int64_t last_render_time_ms() {
+    CriticalSectionScoped cs(capture_cs_.get());
+    return last_render_time_ms_;
+  }
   VideoCaptureCapability capability() {
     CriticalSectionScoped cs(capture_cs_.get());
     return capability_;
@@ -479,6 +483,88 @@ TEST_F(VideoCaptureExternalTest, TestExternalCapture) {
   EXPECT_TRUE(capture_callback_.CompareLastFrame(test_frame_));
 }
 
+// Test input of external video frames converted on the conversion thread.
+TEST_F(VideoCaptureExternalTest, AsyncConversion) {
+  capture_module_->EnableAsyncConversion(true);
+  size_t length = webrtc::CalcBufferSize(webrtc::kI420,
+                                         test_frame_.width(),
+                                         test_frame_.height());
+  scoped_ptr<uint8_t[]> test_buffer(new uint8_t[length]);
+  webrtc::ExtractBuffer(test_frame_, length, test_buffer.get());
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  EXPECT_EQ(0, capture_input_interface_->IncomingFrame(test_buffer.get(),
+      length, capture_callback_.capability(), 0));
+  const int64_t end_ms = TickTime::MillisecondTimestamp();
+  // The frame was copied, the caller may reuse its buffer.
+  memset(test_buffer.get(), 0, length);
+  EXPECT_TRUE_WAIT(capture_callback_.incoming_frames() == 1, kTimeOut);
+  EXPECT_TRUE(capture_callback_.CompareLastFrame(test_frame_));
+  // Stamped on arrival, not after waiting for the conversion thread.
+  EXPECT_GE(capture_callback_.last_render_time_ms(), start_ms);
+  EXPECT_LE(capture_callback_.last_render_time_ms(), end_ms);
+  capture_module_->EnableAsyncConversion(false);
+
+  webrtc::ExtractBuffer(test_frame_, length, test_buffer.get());
+  EXPECT_EQ(0, capture_input_interface_->IncomingFrame(test_buffer.get(),
+      length, capture_callback_.capability(), 0));
+  EXPECT_EQ(2, capture_callback_.incoming_frames());
+}
+
+// Test scaling the external video frames to an output size.
+TEST_F(VideoCaptureExternalTest, OutputSize) {
+  EXPECT_EQ(-1, capture_module_->SetCaptureOutputSize(-1, 144));
+  EXPECT_EQ(-1, capture_module_->SetCaptureOutputSize(192, 0));
+  size_t length = webrtc::CalcBufferSize(webrtc::kI420,
+                                         test_frame_.width(),
+                                         test_frame_.height());
+  scoped_ptr<uint8_t[]> test_buffer(new uint8_t[length]);
+  webrtc::ExtractBuffer(test_frame_, length, test_buffer.get());
+  VideoCaptureCapability capability = capture_callback_.capability();
+
+  // The center of the frame is cropped to 4:3 and scaled down. The rows of
+  // the output need no padding, so that the whole frame can be compared.
+  const int kOutputWidth = 192;
+  const int kOutputHeight = 144;
+  EXPECT_EQ(0, capture_module_->SetCaptureOutputSize(kOutputWidth,
+                                                     kOutputHeight));
+  VideoCaptureCapability output_capability = capability;
+  output_capability.width = kOutputWidth;
+  output_capability.height = kOutputHeight;
+  capture_callback_.SetExpectedCapability(output_capability);
+  EXPECT_EQ(0, capture_input_interface_->IncomingFrame(test_buffer.get(),
+      length, capability, 0));
+  EXPECT_EQ(1, capture_callback_.incoming_frames());
+  webrtc::VideoFrame expected_frame;
+  expected_frame.CreateEmptyFrame(kOutputWidth, kOutputHeight, kOutputWidth,
+                                  kOutputWidth / 2, kOutputWidth / 2);
+  memset(expected_frame.buffer(webrtc::kYPlane), 127,
+         expected_frame.allocated_size(webrtc::kYPlane));
+  memset(expected_frame.buffer(webrtc::kUPlane), 127,
+         expected_frame.allocated_size(webrtc::kUPlane));
+  memset(expected_frame.buffer(webrtc::kVPlane), 127,
+         expected_frame.allocated_size(webrtc::kVPlane));
+  EXPECT_TRUE(capture_callback_.CompareLastFrame(expected_frame));
+
+  // The output size applies after the rotation.
+  EXPECT_EQ(0, capture_module_->SetCaptureRotation(webrtc::kVideoRotation_90));
+  capture_callback_.SetExpectedCaptureRotation(webrtc::kVideoRotation_90);
+  EXPECT_EQ(0, capture_module_->SetCaptureOutputSize(kOutputHeight,
+                                                     kOutputWidth));
+  EXPECT_EQ(0, capture_input_interface_->IncomingFrame(test_buffer.get(),
+      length, capability, 0));
+  EXPECT_EQ(2, capture_callback_.incoming_frames());
+
+  // 0 x 0 delivers the frames at the captured size again.
+  EXPECT_EQ(0, capture_module_->SetCaptureRotation(webrtc::kVideoRotation_0));
+  capture_callback_.SetExpectedCaptureRotation(webrtc::kVideoRotation_0);
+  EXPECT_EQ(0, capture_module_->SetCaptureOutputSize(0, 0));
+  capture_callback_.SetExpectedCapability(capability);
+  EXPECT_EQ(0, capture_input_interface_->IncomingFrame(test_buffer.get(),
+      length, capability, 0));
+  EXPECT_EQ(1, capture_callback_.incoming_frames());
+  EXPECT_TRUE(capture_callback_.CompareLastFrame(test_frame_));
+}
+
 // Test frame rate and no picture alarm.
 // Flaky on Win32, see webrtc:3270.
 TEST_F(VideoCaptureExternalTest, DISABLED_ON_WIN(FrameRate)) {
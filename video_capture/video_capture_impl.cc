@@ -17,8 +17,10 @@
 #include "video_capture/video_capture_config.h"
 #include "system_wrappers/interface/clock.h"
 #include "system_wrappers/interface/critical_section_wrapper.h"
+#include "system_wrappers/interface/event_wrapper.h"
 #include "system_wrappers/interface/logging.h"
 #include "system_wrappers/interface/ref_count.h"
+#include "system_wrappers/interface/thread_wrapper.h"
 #include "system_wrappers/interface/tick_util.h"
 #include "system_wrappers/interface/trace_event.h"
 
@@ -27,6 +29,13 @@ namespace webrtc
 
 namespace videocapturemodule
 {
+namespace {
+// Raw frames that can wait for the conversion thread. One is copied into
+// while the conversion thread works on another.
+const size_t kNumRawFrames = 3;
+const unsigned long kConversionWaitMs = 100;
+}  // namespace
+
 VideoCaptureModule* VideoCaptureImpl::Create(
     const int32_t id,
     VideoCaptureExternal*& externalCapture)
@@ -157,7 +166,12 @@ VideoCaptureImpl::VideoCaptureImpl(const int32_t id)
       _captureCallBack(NULL),
       _lastProcessFrameCount(TickTime::Now()),
       _rotateFrame(kVideoRotation_0),
-      apply_rotation_(true) {
+      apply_rotation_(true),
+      output_width_(0),
+      output_height_(0),
+      enable_conversion_cs_(CriticalSectionWrapper::CreateCriticalSection()),
+      conversion_cs_(CriticalSectionWrapper::CreateCriticalSection()),
+      async_conversion_(false) {
     _requestedCapability.width = kDefaultWidth;
     _requestedCapability.height = kDefaultHeight;
     _requestedCapability.maxFPS = 30;
@@ -168,6 +182,7 @@ VideoCaptureImpl::VideoCaptureImpl(const int32_t id)
 
 VideoCaptureImpl::~VideoCaptureImpl()
 {
+    EnableAsyncConversion(false);
     DeRegisterCaptureDataCallback();
     DeRegisterCaptureCallback();
     delete &_callBackCs;
@@ -236,88 +251,203 @@ int32_t VideoCaptureImpl::IncomingFrame(
     const VideoCaptureCapability& frameInfo,
     int64_t captureTime/*=0*/)
 {
-    CriticalSectionScoped cs(&_apiCs);
-    CriticalSectionScoped cs2(&_callBackCs);
+    TRACE_EVENT1("webrtc", "VC::IncomingFrame", "capture_time", captureTime);
+    const int64_t renderTimeMs = TickTime::MillisecondTimestamp();
+
+    if (frameInfo.codecType != kVideoCodecUnknown)
+    {
+        // Encoded format
+        assert(false);
+        return -1;
+    }
 
+    // Not encoded, convert to I420.
+    if (frameInfo.rawType != kVideoMJPEG &&
+        CalcBufferSize(RawVideoTypeToCommonVideoVideoType(frameInfo.rawType),
+                       frameInfo.width, abs(frameInfo.height)) !=
+            videoFrameLength)
+    {
+        LOG(LS_ERROR) << "Wrong incoming frame length.";
+        return -1;
+    }
+
+    if (QueueFrame(videoFrame, videoFrameLength, frameInfo, captureTime,
+                   renderTimeMs))
+        return 0;
+    return ConvertAndDeliverFrame(videoFrame, videoFrameLength, frameInfo,
+                                  captureTime, renderTimeMs);
+}
+
+int32_t VideoCaptureImpl::ConvertAndDeliverFrame(
+    const uint8_t* videoFrame,
+    size_t videoFrameLength,
+    const VideoCaptureCapability& frameInfo,
+    int64_t captureTime,
+    int64_t renderTimeMs)
+{
     const int32_t width = frameInfo.width;
     const int32_t height = frameInfo.height;
+    const VideoType commonVideoType =
+        RawVideoTypeToCommonVideoVideoType(frameInfo.rawType);
 
-    TRACE_EVENT1("webrtc", "VC::IncomingFrame", "capture_time", captureTime);
+    VideoRotation rotateFrame;
+    int outputWidth;
+    int outputHeight;
+    {
+        CriticalSectionScoped cs(&_callBackCs);
+        rotateFrame = _rotateFrame;
+        outputWidth = output_width_;
+        outputHeight = output_height_;
+    }
+
+    int target_width = width;
+    int target_height = height;
 
-    if (frameInfo.codecType == kVideoCodecUnknown)
+    // SetApplyRotation doesn't take any lock. Make a local copy here.
+    bool apply_rotation = apply_rotation_;
+
+    const bool transpose = apply_rotation &&
+        (rotateFrame == kVideoRotation_90 ||
+         rotateFrame == kVideoRotation_270);
+    if (transpose) {
+      // Rotating resolution when for 90/270 degree rotations.
+      target_width = abs(height);
+      target_height = width;
+    }
+
+    // The region of the captured frame that is converted, pre-rotation.
+    int crop_x = 0;
+    int crop_y = 0;
+    int crop_width = width;
+    int crop_height = abs(height);
+    if (outputWidth > 0) {
+      target_width = outputWidth;
+      target_height = outputHeight;
+      const int scaled_width = transpose ? outputHeight : outputWidth;
+      const int scaled_height = transpose ? outputWidth : outputHeight;
+      // libyuv decodes MJPG frames whole, those are only scaled. Offsets
+      // and sizes are even to not split the chroma samples.
+      if (commonVideoType != kMJPG) {
+        if (crop_width * scaled_height > crop_height * scaled_width)
+          crop_width = (crop_height * scaled_width / scaled_height) & ~1;
+        else
+          crop_height = (crop_width * scaled_height / scaled_width) & ~1;
+        crop_x = ((width - crop_width) / 2) & ~1;
+        crop_y = ((abs(height) - crop_height) / 2) & ~1;
+      }
+    }
+
+    int stride_y = 0;
+    int stride_uv = 0;
+    Calc16ByteAlignedStride(target_width, &stride_y, &stride_uv);
+    // Setting absolute height (in case it was negative).
+    // In Windows, the image starts bottom left, instead of top left.
+    // Setting a negative source height, inverts the image (within LibYuv).
+    // The frame holds the only reference to the pooled buffer, so that
+    // ConvertToI420AndScale can write to it. Without an output size it
+    // converts the whole frame in one libyuv call, as ConvertToI420 does.
+    VideoFrame captureFrame(
+        buffer_pool_.CreateBuffer(target_width, abs(target_height), stride_y,
+                                  stride_uv),
+        0, 0, kVideoRotation_0);
+    const int conversionResult = ConvertToI420AndScale(
+        commonVideoType, videoFrame, crop_x, crop_y, crop_width, crop_height,
+        width, height, videoFrameLength,
+        apply_rotation ? rotateFrame : kVideoRotation_0, &captureFrame);
+    if (conversionResult < 0)
     {
-        // Not encoded, convert to I420.
-        const VideoType commonVideoType =
-                  RawVideoTypeToCommonVideoVideoType(frameInfo.rawType);
+      LOG(LS_ERROR) << "Failed to convert capture frame from type "
+                    << frameInfo.rawType << "to I420.";
+        return -1;
+    }
 
-        if (frameInfo.rawType != kVideoMJPEG &&
-            CalcBufferSize(commonVideoType, width,
-                           abs(height)) != videoFrameLength)
-        {
-            LOG(LS_ERROR) << "Wrong incoming frame length.";
-            return -1;
-        }
+    if (!apply_rotation) {
+      captureFrame.set_rotation(rotateFrame);
+    } else {
+      captureFrame.set_rotation(kVideoRotation_0);
+    }
+    captureFrame.set_ntp_time_ms(captureTime);
+    captureFrame.set_render_time_ms(renderTimeMs);
 
-        int stride_y = width;
-        int stride_uv = (width + 1) / 2;
-        int target_width = width;
-        int target_height = height;
-
-        // SetApplyRotation doesn't take any lock. Make a local copy here.
-        bool apply_rotation = apply_rotation_;
-
-        if (apply_rotation) {
-          // Rotating resolution when for 90/270 degree rotations.
-          if (_rotateFrame == kVideoRotation_90 ||
-              _rotateFrame == kVideoRotation_270) {
-            target_width = abs(height);
-            target_height = width;
-          }
-        }
+    CriticalSectionScoped cs(&_apiCs);
+    CriticalSectionScoped cs2(&_callBackCs);
+    return DeliverCapturedFrame(captureFrame);
+}
 
-        // TODO(mikhal): Update correct aligned stride values.
-        //Calc16ByteAlignedStride(target_width, &stride_y, &stride_uv);
-        // Setting absolute height (in case it was negative).
-        // In Windows, the image starts bottom left, instead of top left.
-        // Setting a negative source height, inverts the image (within LibYuv).
-        int ret = _captureFrame.CreateEmptyFrame(target_width,
-                                                 abs(target_height),
-                                                 stride_y,
-                                                 stride_uv, stride_uv);
-        if (ret < 0)
+bool VideoCaptureImpl::QueueFrame(const uint8_t* videoFrame,
+                                  size_t videoFrameLength,
+                                  const VideoCaptureCapability& frameInfo,
+                                  int64_t captureTime,
+                                  int64_t renderTimeMs)
+{
+    RawFrame* frame = NULL;
+    {
+        CriticalSectionScoped cs(conversion_cs_.get());
+        if (!async_conversion_)
+            return false;
+        if (free_frames_.empty())
         {
-            LOG(LS_ERROR) << "Failed to create empty frame, this should only "
-                             "happen due to bad parameters.";
-            return -1;
+            // All frames are being copied or converted.
+            if (pending_frames_.empty())
+                return false;
+            // The conversion thread is behind, drop the oldest frame.
+            frame = pending_frames_.front();
+            pending_frames_.pop_front();
         }
-        const int conversionResult = ConvertToI420(
-            commonVideoType, videoFrame, 0, 0,  // No cropping
-            width, height, videoFrameLength,
-            apply_rotation ? _rotateFrame : kVideoRotation_0, &_captureFrame);
-        if (conversionResult < 0)
+        else
         {
-          LOG(LS_ERROR) << "Failed to convert capture frame from type "
-                        << frameInfo.rawType << "to I420.";
-            return -1;
+            frame = free_frames_.back();
+            free_frames_.pop_back();
         }
+    }
 
-        if (!apply_rotation) {
-          _captureFrame.set_rotation(_rotateFrame);
-        } else {
-          _captureFrame.set_rotation(kVideoRotation_0);
-        }
-        _captureFrame.set_ntp_time_ms(captureTime);
-        _captureFrame.set_render_time_ms(TickTime::MillisecondTimestamp());
+    // Copied without the lock; the vector keeps its capacity from earlier
+    // frames.
+    frame->data.assign(videoFrame, videoFrame + videoFrameLength);
+    frame->frameInfo = frameInfo;
+    frame->captureTime = captureTime;
+    frame->renderTimeMs = renderTimeMs;
 
-        DeliverCapturedFrame(_captureFrame);
-    }
-    else // Encoded format
+    CriticalSectionScoped cs(conversion_cs_.get());
+    if (!async_conversion_)
     {
-        assert(false);
-        return -1;
+        // Disabled meanwhile, the conversion thread may be gone.
+        free_frames_.push_back(frame);
+        return false;
     }
+    pending_frames_.push_back(frame);
+    conversion_event_->Set();
+    return true;
+}
 
-    return 0;
+// static
+bool VideoCaptureImpl::ConversionThread(void* obj)
+{
+    return static_cast<VideoCaptureImpl*>(obj)->ConvertPendingFrames();
+}
+
+bool VideoCaptureImpl::ConvertPendingFrames()
+{
+    conversion_event_->Wait(kConversionWaitMs);
+    while (true)
+    {
+        RawFrame* frame = NULL;
+        {
+            CriticalSectionScoped cs(conversion_cs_.get());
+            if (!async_conversion_)
+                return false;
+            if (pending_frames_.empty())
+                return true;
+            frame = pending_frames_.front();
+            pending_frames_.pop_front();
+        }
+        // Not in the free list, so IncomingFrame does not write to it.
+        ConvertAndDeliverFrame(&frame->data[0], frame->data.size(),
+                               frame->frameInfo, frame->captureTime,
+                               frame->renderTimeMs);
+        CriticalSectionScoped cs(conversion_cs_.get());
+        free_frames_.push_back(frame);
+    }
 }
 
 int32_t VideoCaptureImpl::SetCaptureRotation(VideoRotation rotation) {
@@ -327,6 +457,16 @@ int32_t VideoCaptureImpl::SetCaptureRotation(VideoRotation rotation) {
   return 0;
 }
 
+int32_t VideoCaptureImpl::SetCaptureOutputSize(int width, int height) {
+  if (width < 0 || height < 0 || (width == 0) != (height == 0))
+    return -1;
+  CriticalSectionScoped cs(&_apiCs);
+  CriticalSectionScoped cs2(&_callBackCs);
+  output_width_ = width;
+  output_height_ = height;
+  return 0;
+}
+
 void VideoCaptureImpl::EnableFrameRateCallback(const bool enable) {
     CriticalSectionScoped cs(&_apiCs);
     CriticalSectionScoped cs2(&_callBackCs);
@@ -351,6 +491,45 @@ void VideoCaptureImpl::EnableNoPictureAlarm(const bool enable) {
     _noPictureAlarmCallBack = enable;
 }
 
+void VideoCaptureImpl::EnableAsyncConversion(bool enable) {
+    // Held until the thread is stopped, so that it is not enabled again
+    // before.
+    CriticalSectionScoped enable_cs(enable_conversion_cs_.get());
+    rtc::scoped_ptr<ThreadWrapper> thread;
+    {
+        CriticalSectionScoped cs(conversion_cs_.get());
+        if (enable == async_conversion_)
+            return;
+        async_conversion_ = enable;
+        if (enable)
+        {
+            if (raw_frames_.empty())
+            {
+                conversion_event_.reset(EventWrapper::Create());
+                for (size_t i = 0; i < kNumRawFrames; ++i)
+                {
+                    raw_frames_.push_back(new RawFrame());
+                    free_frames_.push_back(raw_frames_.back());
+                }
+            }
+            conversion_thread_ = ThreadWrapper::CreateThread(
+                VideoCaptureImpl::ConversionThread, this, "ConversionThread");
+            conversion_thread_->Start();
+            conversion_thread_->SetPriority(kHighPriority);
+            return;
+        }
+        thread.reset(conversion_thread_.release());
+        conversion_event_->Set();
+    }
+    // Stopped without the lock, the thread may be converting a frame.
+    thread->Stop();
+
+    CriticalSectionScoped cs(conversion_cs_.get());
+    free_frames_.insert(free_frames_.end(), pending_frames_.begin(),
+                        pending_frames_.end());
+    pending_frames_.clear();
+}
+
 void VideoCaptureImpl::UpdateFrameCount()
 {
     if (_incomingFrameTimes[0].MicrosecondTimestamp() == 0)
@@ -15,16 +15,24 @@
  * video_capture_impl.h
  */
 
+#include <deque>
+#include <vector>
+
+#include "base/scoped_ptr.h"
+#include "common_video/interface/i420_buffer_pool.h"
 #include "common_video/libyuv/include/webrtc_libyuv.h"
 #include "common_video/rotation.h"
 #include "video_capture/include/video_capture.h"
 #include "video_capture/video_capture_config.h"
+#include "system_wrappers/interface/scoped_vector.h"
 #include "system_wrappers/interface/tick_util.h"
 #include "video_frame.h"
 
 namespace webrtc
 {
 class CriticalSectionWrapper;
+class EventWrapper;
+class ThreadWrapper;
 
 namespace videocapturemodule {
 // Class definitions
@@ -71,9 +79,11 @@ public:
     virtual bool GetApplyRotation() {
       return apply_rotation_;
     }
+    virtual int32_t SetCaptureOutputSize(int width, int height);
 
     virtual void EnableFrameRateCallback(const bool enable);
     virtual void EnableNoPictureAlarm(const bool enable);
+    virtual void EnableAsyncConversion(bool enable);
 
     virtual const char* CurrentDeviceName() const;
 
@@ -112,8 +122,35 @@ protected:
     int32_t _captureDelay; // Current capture delay. May be changed of platform dependent parts.
     VideoCaptureCapability _requestedCapability; // Should be set by platform dependent code in StartCapture.
 private:
+    // A copy of a raw frame waiting for the conversion thread.
+    struct RawFrame
+    {
+        std::vector<uint8_t> data;
+        VideoCaptureCapability frameInfo;
+        int64_t captureTime;
+        int64_t renderTimeMs;
+    };
+
     void UpdateFrameCount();
     uint32_t CalculateFrameRate(const TickTime& now);
+    // Converts a raw frame into a pooled I420 buffer and delivers it. Only
+    // the delivery holds |_apiCs| and |_callBackCs|. |renderTimeMs| is the
+    // time the frame arrived in IncomingFrame, so that it does not include
+    // the time spent queued for the conversion thread.
+    int32_t ConvertAndDeliverFrame(const uint8_t* videoFrame,
+                                   size_t videoFrameLength,
+                                   const VideoCaptureCapability& frameInfo,
+                                   int64_t captureTime,
+                                   int64_t renderTimeMs);
+    // Queues a copy of the frame for the conversion thread. Returns false if
+    // asynchronous conversion is disabled.
+    bool QueueFrame(const uint8_t* videoFrame,
+                    size_t videoFrameLength,
+                    const VideoCaptureCapability& frameInfo,
+                    int64_t captureTime,
+                    int64_t renderTimeMs);
+    static bool ConversionThread(void* obj);
+    bool ConvertPendingFrames();
 
     CriticalSectionWrapper& _callBackCs;
 
@@ -132,10 +169,27 @@ private:
     VideoRotation _rotateFrame;  // Set if the frame should be rotated by the
                                  // capture module.
 
-    VideoFrame _captureFrame;
-
     // Indicate whether rotation should be applied before delivered externally.
     bool apply_rotation_;
+
+    // Size of the delivered frames, 0 x 0 for the captured size. Protected
+    // by |_callBackCs|.
+    int output_width_;
+    int output_height_;
+
+    // Converted frames, with 16-byte aligned rows.
+    I420BufferPool buffer_pool_;
+
+    // Serializes EnableAsyncConversion.
+    const rtc::scoped_ptr<CriticalSectionWrapper> enable_conversion_cs_;
+    // Protects the members below.
+    const rtc::scoped_ptr<CriticalSectionWrapper> conversion_cs_;
+    bool async_conversion_;
+    rtc::scoped_ptr<EventWrapper> conversion_event_;
+    rtc::scoped_ptr<ThreadWrapper> conversion_thread_;
+    ScopedVector<RawFrame> raw_frames_;
+    std::deque<RawFrame*> pending_frames_;
+    std::vector<RawFrame*> free_frames_;
 };
 }  // namespace videocapturemodule
 }  // namespace webrtc
@@ -14,6 +14,7 @@
 #if defined(WEBRTC_THIRD_PARTY_H264)
 #include "video_coding/codecs/h264/h264_encoder_impl.h"
 #include "video_coding/codecs/h264/h264_decoder_impl.h"
+#include "video_coding/codecs/h264/h264_simulcast_encoder.h"
 #endif
 #if defined(WEBRTC_IOS)
 #include "video_coding/codecs/h264/h264_video_toolbox_decoder.h"
@@ -55,8 +56,8 @@ H264Encoder* H264Encoder::Create() {
   }
 #endif
 #if defined(WEBRTC_THIRD_PARTY_H264)
-  LOG(LS_INFO) << "Creating H264EncoderImpl.";
-  return new H264EncoderImpl();
+  LOG(LS_INFO) << "Creating H264SimulcastEncoder.";
+  return new H264SimulcastEncoder();
 #else
   RTC_NOTREACHED();
   return nullptr;
@@ -33,6 +33,63 @@ const AVPixelFormat kPixelFormat = AV_PIX_FMT_YUV420P;
 const size_t kYPlaneIndex = 0;
 const size_t kUPlaneIndex = 1;
 const size_t kVPlaneIndex = 2;
+// Strides of the decoded planes are padded to a multiple of this, so that
+// every row starts on a boundary suitable for SSE2/AVX2/NEON loads.
+const int kStrideAlignment = 32;
+
+const uint8_t kNaluTypeSps = 7;
+
+// Returns true if one of the NAL units listed in |fragmentation| is a sequence
+// parameter set.
+bool HasSps(const EncodedImage& input_image,
+            const RTPFragmentationHeader& fragmentation) {
+  for (uint16_t i = 0; i < fragmentation.fragmentationVectorSize; ++i) {
+    const size_t offset = fragmentation.fragmentationOffset[i];
+    if (fragmentation.fragmentationLength[i] > 0 &&
+        offset < input_image._length &&
+        (input_image._buffer[offset] & 0x1F) == kNaluTypeSps) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int AlignStride(int stride, int alignment) {
+  return (stride + alignment - 1) / alignment * alignment;
+}
+
+// FFmpeg only splits a frame between slice threads along the slices the
+// encoder produced, so more threads than a sender would reasonably use slices
+// are idle. |width| and |height| are 0 when unknown.
+int NumberOfSliceThreads(int width, int height, int number_of_cores) {
+  if (width * height >= 1280 * 720 || width * height == 0)
+    return std::min(number_of_cores, 8);
+  if (width * height > 640 * 480)
+    return std::min(number_of_cores, 4);
+  return std::min(number_of_cores, 2);
+}
+
+// Every frame thread holds one frame in flight and adds a frame of output
+// delay, FFmpeg itself stops scaling at 16.
+int NumberOfFrameThreads(int width, int height, int number_of_cores) {
+  if (width * height >= 1280 * 720 || width * height == 0)
+    return std::min(number_of_cores, 16);
+  if (width * height > 640 * 480)
+    return std::min(number_of_cores, 8);
+  return std::min(number_of_cores, 4);
+}
+
+bool UseFrameThreads(const VideoCodecH264& settings) {
+  switch (settings.threadingMode) {
+    case kH264SlicedThreads:
+      return false;
+    case kH264FrameThreads:
+      return true;
+    case kH264ThreadingAuto:
+      break;
+  }
+  return settings.latencyMode == kH264HighQuality;
+}
 
 #if !defined(WEBRTC_CHROMIUM_BUILD)
 
@@ -77,95 +134,12 @@ void InitializeFFmpeg() {
 
 #endif  // !defined(WEBRTC_CHROMIUM_BUILD)
 
-// Called by FFmpeg when it is done with a frame buffer, see AVGetBuffer2.
-void AVFreeBuffer2(void* opaque, uint8_t* data) {
-  VideoFrame* video_frame = static_cast<VideoFrame*>(opaque);
-  delete video_frame;
-}
-
-// Called by FFmpeg when it needs a frame buffer to store decoded frames in.
-// The VideoFrames returned by FFmpeg at |Decode| originate from here. They are
-// reference counted and freed by FFmpeg using |AVFreeBuffer2|.
-// TODO(hbos): Use a frame pool for better performance instead of create/free.
-// Could be owned by decoder, |static_cast<H264DecoderImpl*>(context->opaque)|.
-// Consider verifying that the buffer was allocated by us to avoid unsafe type
-// cast. See https://bugs.chromium.org/p/webrtc/issues/detail?id=5428.
-int AVGetBuffer2(AVCodecContext* context, AVFrame* av_frame, int flags) {
-  RTC_CHECK_EQ(context->pix_fmt, kPixelFormat);  // Same as in InitDecode.
-  // Necessary capability to be allowed to provide our own buffers.
-  RTC_CHECK(context->codec->capabilities | AV_CODEC_CAP_DR1);
-  // |av_frame->width| and |av_frame->height| are set by FFmpeg. These are the
-  // actual image's dimensions and may be different from |context->width| and
-  // |context->coded_width| due to reordering.
-  int width = av_frame->width;
-  int height = av_frame->height;
-  // See |lowres|, if used the decoder scales the image by 1/2^(lowres). This
-  // has implications on which resolutions are valid, but we don't use it.
-  RTC_CHECK_EQ(context->lowres, 0);
-  // Adjust the |width| and |height| to values acceptable by the decoder.
-  // Without this, FFmpeg may overflow the buffer. If modified, |width| and/or
-  // |height| are larger than the actual image and the image has to be cropped
-  // (top-left corner) after decoding to avoid visible borders to the right and
-  // bottom of the actual image.
-  avcodec_align_dimensions(context, &width, &height);
-
-  RTC_CHECK_GE(width, 0);
-  RTC_CHECK_GE(height, 0);
-  int ret = av_image_check_size(static_cast<unsigned int>(width),
-                                static_cast<unsigned int>(height), 0, nullptr);
-  if (ret < 0) {
-    LOG(LS_ERROR) << "Invalid picture size " << width << "x" << height;
-    return ret;
-  }
-
-  // The video frame is stored in |video_frame|. |av_frame| is FFmpeg's version
-  // of a video frame and will be set up to reference |video_frame|'s buffers.
-  VideoFrame* video_frame = new VideoFrame();
-  int stride_y = width;
-  int stride_uv = (width + 1) / 2;
-  RTC_CHECK_EQ(0, video_frame->CreateEmptyFrame(
-      width, height, stride_y, stride_uv, stride_uv));
-  int total_size = video_frame->allocated_size(kYPlane) +
-                   video_frame->allocated_size(kUPlane) +
-                   video_frame->allocated_size(kVPlane);
-  RTC_DCHECK_EQ(total_size, stride_y * height +
-                (stride_uv + stride_uv) * ((height + 1) / 2));
-
-  // FFmpeg expects the initial allocation to be zero-initialized according to
-  // http://crbug.com/390941.
-  // Using a single |av_frame->buf| - YUV is required to be a continuous blob of
-  // memory. We can zero-initialize with one memset operation for all planes.
-  RTC_DCHECK_EQ(video_frame->buffer(kUPlane),
-      video_frame->buffer(kYPlane) + video_frame->allocated_size(kYPlane));
-  RTC_DCHECK_EQ(video_frame->buffer(kVPlane),
-      video_frame->buffer(kUPlane) + video_frame->allocated_size(kUPlane));
-  memset(video_frame->buffer(kYPlane), 0, total_size);
-
-  av_frame->format = context->pix_fmt;
-  av_frame->reordered_opaque = context->reordered_opaque;
-
-  // Set |av_frame| members as required by FFmpeg.
-  av_frame->data[kYPlaneIndex] = video_frame->buffer(kYPlane);
-  av_frame->linesize[kYPlaneIndex] = video_frame->stride(kYPlane);
-  av_frame->data[kUPlaneIndex] = video_frame->buffer(kUPlane);
-  av_frame->linesize[kUPlaneIndex] = video_frame->stride(kUPlane);
-  av_frame->data[kVPlaneIndex] = video_frame->buffer(kVPlane);
-  av_frame->linesize[kVPlaneIndex] = video_frame->stride(kVPlane);
-  RTC_DCHECK_EQ(av_frame->extended_data, av_frame->data);
-
-  av_frame->buf[0] = av_buffer_create(av_frame->data[kYPlaneIndex],
-                                      total_size,
-                                      AVFreeBuffer2,
-                                      static_cast<void*>(video_frame),
-                                      0);
-  RTC_CHECK(av_frame->buf[0]);
-  return 0;
-}
-
 }  // namespace
 
 H264DecoderImpl::H264DecoderImpl()
-    : decoded_image_callback_(nullptr) {
+    : pool_(true),
+      decoded_image_callback_(nullptr),
+      has_sps_(false) {
 }
 
 H264DecoderImpl::~H264DecoderImpl() {
@@ -208,8 +182,21 @@ int32_t H264DecoderImpl::InitDecode(const VideoCodec* codec_settings,
   av_context_->extradata = nullptr;
   av_context_->extradata_size = 0;
 
-  av_context_->thread_count = 1;
-  av_context_->thread_type = FF_THREAD_SLICE;
+  int width = codec_settings ? codec_settings->width : 0;
+  int height = codec_settings ? codec_settings->height : 0;
+  number_of_cores = std::max(number_of_cores, 1);
+  if (codec_settings && UseFrameThreads(codec_settings->codecSpecific.H264)) {
+    av_context_->thread_type = FF_THREAD_FRAME;
+    av_context_->thread_count =
+        NumberOfFrameThreads(width, height, number_of_cores);
+  } else {
+    av_context_->thread_type = FF_THREAD_SLICE;
+    av_context_->thread_count =
+        NumberOfSliceThreads(width, height, number_of_cores);
+  }
+  // |pool_| may be used from several threads, let FFmpeg call AVGetBuffer2
+  // from its frame threads instead of serializing on the decoding thread.
+  av_context_->thread_safe_callbacks = 1;
 
   // FFmpeg will get video buffers from our AVGetBuffer2, memory managed by us.
   av_context_->get_buffer2 = AVGetBuffer2;
@@ -235,22 +222,60 @@ int32_t H264DecoderImpl::InitDecode(const VideoCodec* codec_settings,
   }
 
   av_frame_.reset(av_frame_alloc());
+  has_sps_ = false;
+  LOG(LS_INFO) << "H.264 decoder using " << av_context_->thread_count << " "
+               << (av_context_->active_thread_type == FF_THREAD_FRAME
+                       ? "frame" : "slice")
+               << " threads.";
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
 int32_t H264DecoderImpl::Release() {
   av_context_.reset();
   av_frame_.reset();
+  // Buffers still referenced by FFmpeg or by decoded frames are freed when
+  // their last reference goes away.
+  pool_.Release();
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
 int32_t H264DecoderImpl::Reset() {
   if (!IsInitialized())
     return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
-  InitDecode(nullptr, 1);
+  // Drops the frames in flight on the frame threads and the reference frames,
+  // without tearing down the threads.
+  avcodec_flush_buffers(av_context_.get());
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
+int32_t H264DecoderImpl::Flush() {
+  if (!IsInitialized())
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  if (!decoded_image_callback_)
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  // An empty packet makes FFmpeg output one delayed frame per call.
+  while (true) {
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = nullptr;
+    packet.size = 0;
+    int frame_decoded = 0;
+    int result = avcodec_decode_video2(av_context_.get(),
+                                       av_frame_.get(),
+                                       &frame_decoded,
+                                       &packet);
+    if (result < 0) {
+      LOG(LS_ERROR) << "avcodec_decode_video2 error: " << result;
+      return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+    if (!frame_decoded)
+      return WEBRTC_VIDEO_CODEC_OK;
+    int32_t ret = ReturnDecodedFrame();
+    if (ret != WEBRTC_VIDEO_CODEC_OK)
+      return ret;
+  }
+}
+
 int32_t H264DecoderImpl::RegisterDecodeCompleteCallback(
     DecodedImageCallback* callback) {
   decoded_image_callback_ = callback;
@@ -259,7 +284,7 @@ int32_t H264DecoderImpl::RegisterDecodeCompleteCallback(
 
 int32_t H264DecoderImpl::Decode(const EncodedImage& input_image,
                                 bool /*missing_frames*/,
-                                const RTPFragmentationHeader* /*fragmentation*/,
+                                const RTPFragmentationHeader* fragmentation,
                                 const CodecSpecificInfo* codec_specific_info,
                                 int64_t /*render_time_ms*/) {
   if (!IsInitialized())
@@ -276,6 +301,17 @@ int32_t H264DecoderImpl::Decode(const EncodedImage& input_image,
     return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
   }
 
+  // Nothing can be decoded before the first sequence parameter set. Fail,
+  // which makes the receiver request a key frame, instead of having FFmpeg
+  // discard one slice after another.
+  if (!has_sps_ && fragmentation && fragmentation->fragmentationVectorSize) {
+    if (!HasSps(input_image, *fragmentation)) {
+      LOG(LS_WARNING) << "Waiting for a sequence parameter set.";
+      return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+    has_sps_ = true;
+  }
+
   // FFmpeg requires padding due to some optimized bitstream readers reading 32
   // or 64 bits at once and could read over the end. See avcodec_decode_video2.
   // RTC_CHECK_GE(input_image._size, input_image._length +
@@ -296,7 +332,9 @@ int32_t H264DecoderImpl::Decode(const EncodedImage& input_image,
     return WEBRTC_VIDEO_CODEC_ERROR;
   }
   packet.size = static_cast<int>(input_image._length);
-  av_context_->reordered_opaque = input_image.ntp_time_ms_ * 1000;  // ms -> μs
+  // Handed back with the picture decoded from this packet, which may be output
+  // by a later call. See |ReturnDecodedFrame|.
+  av_context_->reordered_opaque = input_image._timeStamp;
 
   int frame_decoded = 0;
   int result = avcodec_decode_video2(av_context_.get(),
@@ -315,11 +353,19 @@ int32_t H264DecoderImpl::Decode(const EncodedImage& input_image,
   }
 
   if (!frame_decoded) {
-    LOG(LS_WARNING) << "avcodec_decode_video2 successful but no frame was "
-        "decoded.";
+    // Expected while frame threads or B-frame reordering fill up.
+    if (av_context_->active_thread_type != FF_THREAD_FRAME &&
+        !av_context_->has_b_frames) {
+      LOG(LS_WARNING) << "avcodec_decode_video2 successful but no frame was "
+          "decoded.";
+    }
     return WEBRTC_VIDEO_CODEC_OK;
   }
 
+  return ReturnDecodedFrame();
+}
+
+int32_t H264DecoderImpl::ReturnDecodedFrame() {
   // Obtain the |video_frame| containing the decoded image.
   VideoFrame* video_frame = static_cast<VideoFrame*>(
       av_buffer_get_opaque(av_frame_->buf[0]));
@@ -327,7 +373,10 @@ int32_t H264DecoderImpl::Decode(const EncodedImage& input_image,
   RTC_CHECK_EQ(av_frame_->data[kYPlane], video_frame->buffer(kYPlane));
   RTC_CHECK_EQ(av_frame_->data[kUPlane], video_frame->buffer(kUPlane));
   RTC_CHECK_EQ(av_frame_->data[kVPlane], video_frame->buffer(kVPlane));
-  video_frame->set_timestamp(input_image._timeStamp);
+  // The frame may have been decoded from an earlier input, use the RTP
+  // timestamp that input was given in |Decode|.
+  video_frame->set_timestamp(
+      static_cast<uint32_t>(av_frame_->reordered_opaque));
 
   // The decoded image may be larger than what is supposed to be visible, see
   // |AVGetBuffer2|'s use of |avcodec_align_dimensions|. This crops the image
@@ -356,6 +405,105 @@ int32_t H264DecoderImpl::Decode(const EncodedImage& input_image,
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
+// Called by FFmpeg when it is done with a frame buffer, see AVGetBuffer2.
+void H264DecoderImpl::AVFreeBuffer2(void* opaque, uint8_t* data) {
+  // The buffer pool recycles the buffer used by |video_frame| when there are no
+  // more references to it. |video_frame| is a thin buffer holder and is not
+  // recycled.
+  VideoFrame* video_frame = static_cast<VideoFrame*>(opaque);
+  delete video_frame;
+}
+
+// Called by FFmpeg when it needs a frame buffer to store decoded frames in.
+// The VideoFrames returned by FFmpeg at |Decode| originate from here. Their
+// buffers are reference counted and come from |pool_|; FFmpeg releases its
+// reference with |AVFreeBuffer2|.
+// May be called on FFmpeg's decoding threads.
+int H264DecoderImpl::AVGetBuffer2(
+    AVCodecContext* context, AVFrame* av_frame, int flags) {
+  // Set in |InitDecode|.
+  H264DecoderImpl* decoder = static_cast<H264DecoderImpl*>(context->opaque);
+  // DCHECK values set in |InitDecode|.
+  RTC_DCHECK(decoder);
+  RTC_CHECK_EQ(context->pix_fmt, kPixelFormat);  // Same as in InitDecode.
+  // Necessary capability to be allowed to provide our own buffers.
+  RTC_CHECK(context->codec->capabilities | AV_CODEC_CAP_DR1);
+  // |av_frame->width| and |av_frame->height| are set by FFmpeg. These are the
+  // actual image's dimensions and may be different from |context->width| and
+  // |context->coded_width| due to reordering.
+  int width = av_frame->width;
+  int height = av_frame->height;
+  // See |lowres|, if used the decoder scales the image by 1/2^(lowres). This
+  // has implications on which resolutions are valid, but we don't use it.
+  RTC_CHECK_EQ(context->lowres, 0);
+  // Adjust the |width| and |height| to values acceptable by the decoder.
+  // Without this, FFmpeg may overflow the buffer. If modified, |width| and/or
+  // |height| are larger than the actual image and the image has to be cropped
+  // (top-left corner) after decoding to avoid visible borders to the right and
+  // bottom of the actual image. |linesize_align| is the stride alignment
+  // FFmpeg's optimized code expects.
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(context, &width, &height, linesize_align);
+
+  RTC_CHECK_GE(width, 0);
+  RTC_CHECK_GE(height, 0);
+  int ret = av_image_check_size(static_cast<unsigned int>(width),
+                                static_cast<unsigned int>(height), 0, nullptr);
+  if (ret < 0) {
+    LOG(LS_ERROR) << "Invalid picture size " << width << "x" << height;
+    return ret;
+  }
+
+  int stride_y = AlignStride(
+      width, std::max(kStrideAlignment, linesize_align[kYPlaneIndex]));
+  int stride_uv = AlignStride(
+      (width + 1) / 2,
+      std::max(kStrideAlignment, std::max(linesize_align[kUPlaneIndex],
+                                          linesize_align[kVPlaneIndex])));
+
+  // The video frame is stored in |video_frame|. |av_frame| is FFmpeg's version
+  // of a video frame and will be set up to reference |video_frame|'s buffers.
+  // FFmpeg expects the initial allocation to be zero-initialized according to
+  // http://crbug.com/390941. The pool zero-initializes new buffers; recycled
+  // buffers only ever held decoded pictures and are not cleared again.
+  rtc::scoped_refptr<VideoFrameBuffer> frame_buffer =
+      decoder->pool_.CreateBuffer(width, height, stride_y, stride_uv);
+  int total_size =
+      stride_y * height + (stride_uv + stride_uv) * ((height + 1) / 2);
+  // Using a single |av_frame->buf| - YUV is required to be a continuous blob of
+  // memory.
+  RTC_DCHECK_EQ(frame_buffer->MutableData(kUPlane),
+      frame_buffer->MutableData(kYPlane) + stride_y * height);
+  RTC_DCHECK_EQ(frame_buffer->MutableData(kVPlane),
+      frame_buffer->MutableData(kUPlane) + stride_uv * ((height + 1) / 2));
+
+  av_frame->format = context->pix_fmt;
+  av_frame->reordered_opaque = context->reordered_opaque;
+
+  // Set |av_frame| members as required by FFmpeg.
+  av_frame->data[kYPlaneIndex] = frame_buffer->MutableData(kYPlane);
+  av_frame->linesize[kYPlaneIndex] = frame_buffer->stride(kYPlane);
+  av_frame->data[kUPlaneIndex] = frame_buffer->MutableData(kUPlane);
+  av_frame->linesize[kUPlaneIndex] = frame_buffer->stride(kUPlane);
+  av_frame->data[kVPlaneIndex] = frame_buffer->MutableData(kVPlane);
+  av_frame->linesize[kVPlaneIndex] = frame_buffer->stride(kVPlane);
+  RTC_DCHECK_EQ(av_frame->extended_data, av_frame->data);
+
+  // The VideoFrame keeps a reference to the pooled buffer for as long as
+  // FFmpeg uses it. Its timestamp is set in |Decode|.
+  av_frame->buf[0] = av_buffer_create(
+      av_frame->data[kYPlaneIndex],
+      total_size,
+      AVFreeBuffer2,
+      static_cast<void*>(new VideoFrame(frame_buffer,
+                                        0 /* timestamp */,
+                                        0 /* render_time_ms */,
+                                        kVideoRotation_0)),
+      0);
+  RTC_CHECK(av_frame->buf[0]);
+  return 0;
+}
+
 bool H264DecoderImpl::IsInitialized() const {
   return av_context_ != nullptr;
 }
@@ -19,6 +19,7 @@ extern "C" {
 }  // extern "C"
 
 #include "base/scoped_ptr.h"
+#include "common_video/interface/i420_buffer_pool.h"
 
 namespace webrtc {
 
@@ -36,28 +37,67 @@ class H264DecoderImpl : public H264Decoder {
 
   // If |codec_settings| is NULL it is ignored. If it is not NULL,
   // |codec_settings->codecType| must be |kVideoCodecH264|.
+  // |codec_settings->codecSpecific.H264| selects the FFmpeg threading: slice
+  // threads for |kH264LowLatency| (the default), frame threads for
+  // |kH264HighQuality|, unless |threadingMode| says otherwise. Frame threads
+  // delay the output by one frame per thread and suit receive-only and
+  // recording sinks. The thread count depends on |number_of_cores| and the
+  // resolution.
   int32_t InitDecode(const VideoCodec* codec_settings,
                      int32_t number_of_cores) override;
   int32_t Release() override;
+  // Discards the frames the decoder still holds and waits for the next key
+  // frame. The threading configuration is kept.
   int32_t Reset() override;
 
   int32_t RegisterDecodeCompleteCallback(
       DecodedImageCallback* callback) override;
 
-  // |missing_frames|, |fragmentation| and |render_time_ms| are ignored.
+  // |missing_frames| and |render_time_ms| are ignored. |fragmentation|, one
+  // fragment per NAL unit as built by the jitter buffer, is optional; with
+  // it, frames before the first sequence parameter set after InitDecode are
+  // refused.
+  // Decoded frames may be output by a later call, with frame threads or when
+  // the stream has B-frames. They carry the RTP timestamp of their own
+  // |input_image|.
   int32_t Decode(const EncodedImage& input_image,
                  bool /*missing_frames*/,
-                 const RTPFragmentationHeader* /*fragmentation*/,
+                 const RTPFragmentationHeader* fragmentation,
                  const CodecSpecificInfo* codec_specific_info = nullptr,
                  int64_t render_time_ms = -1) override;
 
+  // Outputs the frames the decoder still holds because of frame threading or
+  // reordering, e.g. at the end of a recording. Unlike |Reset| nothing is
+  // discarded.
+  int32_t Flush();
+
+  // Number of frame buffers allocated since construction. Decoded frames are
+  // stored in recycled buffers once the decoder has reached steady state.
+  size_t NumFrameBufferAllocations() const {
+    return pool_.GetStats().misses;
+  }
+
  private:
+  // Called by FFmpeg when it needs a frame buffer to store decoded frames in.
+  static int AVGetBuffer2(
+      AVCodecContext* context, AVFrame* av_frame, int flags);
+  // Called by FFmpeg when it is done with a frame buffer, see AVGetBuffer2.
+  static void AVFreeBuffer2(void* opaque, uint8_t* data);
+
   bool IsInitialized() const;
+  // Sends the picture in |av_frame_| to |decoded_image_callback_| and releases
+  // it.
+  int32_t ReturnDecodedFrame();
 
+  // Zero-initializes new buffers, see AVGetBuffer2.
+  I420BufferPool pool_;
   rtc::scoped_ptr<AVCodecContext, AVCodecContextDeleter> av_context_;
   rtc::scoped_ptr<AVFrame, AVFrameDeleter> av_frame_;
 
   DecodedImageCallback* decoded_image_callback_;
+  // If a sequence parameter set has been decoded since InitDecode, FFmpeg
+  // keeps it over Reset.
+  bool has_sps_;
 };
 
 }  // namespace webrtc
@@ -0,0 +1,163 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include "base/scoped_ptr.h"
+#include "video_coding/codecs/h264/h264_decoder_impl.h"
+#include "video_coding/codecs/h264/test/synthetic_h264_stream.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kWidth = 320;
+const int kHeight = 240;
+const int kFramerate = 30;
+const int kNumFrames = 30;
+const int kNumberOfCores = 4;
+
+class TimestampCallback : public DecodedImageCallback {
+ public:
+  int32_t Decoded(VideoFrame& decoded_image) override {
+    timestamps_.push_back(decoded_image.timestamp());
+    return 0;
+  }
+
+  const std::vector<uint32_t>& timestamps() const { return timestamps_; }
+  void Clear() { timestamps_.clear(); }
+
+ private:
+  std::vector<uint32_t> timestamps_;
+};
+
+// Sets |fragmentation| to the NAL units of the Annex B |image|.
+void FindNalus(const EncodedImage& image,
+               RTPFragmentationHeader* fragmentation) {
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i + 3 <= image._length; ++i) {
+    if (image._buffer[i] == 0 && image._buffer[i + 1] == 0 &&
+        image._buffer[i + 2] == 1) {
+      offsets.push_back(i + 3);
+    }
+  }
+  fragmentation->VerifyAndAllocateFragmentationHeader(offsets.size());
+  fragmentation->fragmentationVectorSize =
+      static_cast<uint16_t>(offsets.size());
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    fragmentation->fragmentationOffset[i] = offsets[i];
+    fragmentation->fragmentationLength[i] =
+        (i + 1 < offsets.size() ? offsets[i + 1] - 3 : image._length) -
+        offsets[i];
+  }
+}
+
+}  // namespace
+
+class H264DecoderImplTest : public ::testing::Test {
+ protected:
+  H264DecoderImplTest()
+      : stream_(kWidth, kHeight, kFramerate, 500, kNumFrames, kNumFrames) {}
+
+  void SetUp() override {
+    memset(&codec_settings_, 0, sizeof(codec_settings_));
+    codec_settings_.codecType = kVideoCodecH264;
+    codec_settings_.width = kWidth;
+    codec_settings_.height = kHeight;
+    codec_settings_.codecSpecific.H264 =
+        VideoEncoder::GetDefaultH264Settings();
+    decoder_.reset(new H264DecoderImpl());
+    decoder_->RegisterDecodeCompleteCallback(&callback_);
+  }
+
+  void InitDecode(H264ThreadingMode threading_mode) {
+    codec_settings_.codecSpecific.H264.threadingMode = threading_mode;
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              decoder_->InitDecode(&codec_settings_, kNumberOfCores));
+  }
+
+  void DecodeFrames(size_t first, size_t end) {
+    for (size_t i = first; i < end; ++i) {
+      ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+                decoder_->Decode(stream_.frame(i), false, nullptr));
+    }
+  }
+
+  std::vector<uint32_t> StreamTimestamps(size_t first, size_t end) const {
+    std::vector<uint32_t> timestamps;
+    for (size_t i = first; i < end; ++i)
+      timestamps.push_back(stream_.frame(i)._timeStamp);
+    return timestamps;
+  }
+
+  VideoCodec codec_settings_;
+  test::SyntheticH264Stream stream_;
+  TimestampCallback callback_;
+  rtc::scoped_ptr<H264DecoderImpl> decoder_;
+};
+
+// Slice threads must not delay the output of a low latency stream.
+TEST_F(H264DecoderImplTest, SliceThreadsOutputEveryFrameRightAway) {
+  InitDecode(kH264SlicedThreads);
+  for (size_t i = 0; i < stream_.num_frames(); ++i) {
+    DecodeFrames(i, i + 1);
+    ASSERT_EQ(i + 1, callback_.timestamps().size());
+  }
+  EXPECT_EQ(StreamTimestamps(0, stream_.num_frames()), callback_.timestamps());
+}
+
+// Frame threads delay the output; every frame still has to come out, after
+// Flush, with the RTP timestamp of the input it was decoded from.
+TEST_F(H264DecoderImplTest, FrameThreadsKeepTimestampsOfDelayedFrames) {
+  InitDecode(kH264FrameThreads);
+  DecodeFrames(0, stream_.num_frames());
+  EXPECT_LT(callback_.timestamps().size(), stream_.num_frames());
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder_->Flush());
+  EXPECT_EQ(StreamTimestamps(0, stream_.num_frames()), callback_.timestamps());
+}
+
+// Reset drops the frames in flight, decoding resumes at the next key frame
+// with the same threading configuration.
+TEST_F(H264DecoderImplTest, ResetDiscardsFramesInFlight) {
+  const size_t kFramesBeforeReset = 10;
+  InitDecode(kH264FrameThreads);
+  DecodeFrames(0, kFramesBeforeReset);
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder_->Reset());
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder_->Flush());
+  EXPECT_LT(callback_.timestamps().size(), kFramesBeforeReset);
+
+  callback_.Clear();
+  DecodeFrames(0, stream_.num_frames());
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder_->Flush());
+  EXPECT_EQ(StreamTimestamps(0, stream_.num_frames()), callback_.timestamps());
+}
+
+// With a fragmentation header, frames before the first sequence parameter set
+// are refused instead of being passed to FFmpeg.
+TEST_F(H264DecoderImplTest, RefusesFramesBeforeSps) {
+  InitDecode(kH264SlicedThreads);
+  RTPFragmentationHeader fragmentation;
+  FindNalus(stream_.frame(1), &fragmentation);
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERROR,
+            decoder_->Decode(stream_.frame(1), false, &fragmentation));
+  EXPECT_TRUE(callback_.timestamps().empty());
+
+  for (size_t i = 0; i < stream_.num_frames(); ++i) {
+    FindNalus(stream_.frame(i), &fragmentation);
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              decoder_->Decode(stream_.frame(i), false, &fragmentation));
+  }
+  EXPECT_EQ(StreamTimestamps(0, stream_.num_frames()), callback_.timestamps());
+}
+
+}  // namespace webrtc
@@ -11,7 +11,9 @@
 
 #include "video_coding/codecs/h264/h264_encoder_impl.h"
 
+#include <algorithm>
 #include <limits>
+#include <map>
 
 #include "base/checks.h"
 #include "base/logging.h"
@@ -24,6 +26,36 @@ namespace {
 
 const bool kOpenH264EncoderDetailedLogging = false;
 
+// The pts given to x264 are (unwrapped) RTP timestamps.
+const uint32_t kRtpTimestampRate = 90000;
+// Used when |codec_settings| specifies neither a start nor a max bitrate.
+const uint32_t kDefaultStartBitrateKbit = 300;
+// VBV buffer size, in milliseconds worth of the target bitrate. Kept short so
+// that a new target from the bandwidth estimator takes effect within a few
+// frames instead of being absorbed by the buffer.
+const uint32_t kVbvBufferSizeMs = 500;
+// B-frames and rate control lookahead used by kH264HighQuality.
+const int kHighQualityBFrames = 3;
+const int kHighQualityLookaheadFrames = 20;
+// Loss fraction, in Q8, above which the channel is considered lossy (5%) and
+// below which it is considered clean again (1%).
+const uint32_t kLossyChannelEnterQ8 = 13;
+const uint32_t kLossyChannelLeaveQ8 = 3;
+// Up to this RTT loss is recovered from by invalidating references, beyond it
+// the frames to invalidate would no longer be in the DPB.
+const int64_t kReferenceInvalidationMaxRttMs = 100;
+// Added to the RTT to cover the time the receiver takes to detect the loss.
+const int64_t kReferenceInvalidationMarginMs = 50;
+// Enough old references for (RTT + margin) at 30 fps, with room to spare.
+const int kReferenceInvalidationDpbSize = 8;
+// Average QP at or below which the resolution is raised again, and above
+// which it is lowered. The gap between them keeps the resolution from
+// oscillating.
+const int kLowQpThreshold = 24;
+const int kHighQpThreshold = 37;
+
+// Thread count when slices of a frame are encoded in parallel. Every thread
+// adds a slice and its header cost, so stay conservative.
 int NumberOfThreads(int width, int height, int number_of_cores) {
   if (width * height >= 1920 * 1080 && number_of_cores > 8) {
     return 8;  // 8 threads for 1080p on high perf machines.
@@ -36,25 +68,66 @@ int NumberOfThreads(int width, int height, int number_of_cores) {
   }
 }
 
-}  // namespace
+// Thread count when whole frames are encoded in parallel. Frame threads cost
+// little compression but each one depends on the rows of the previous frame
+// that are already done, so small frames leave little to run in parallel.
+int NumberOfFrameThreads(int width, int height, int number_of_cores) {
+  int max_threads;
+  if (width * height >= 1920 * 1080) {
+    max_threads = 16;
+  } else if (width * height >= 1280 * 720) {
+    max_threads = 12;
+  } else if (width * height > 640 * 480) {
+    max_threads = 8;
+  } else {
+    max_threads = 4;
+  }
+  return std::min(number_of_cores, max_threads);
+}
 
+bool UseSlicedThreads(const VideoCodecH264& settings) {
+  switch (settings.threadingMode) {
+    case kH264SlicedThreads:
+      return true;
+    case kH264FrameThreads:
+      return false;
+    case kH264ThreadingAuto:
+      break;
+  }
+  return settings.latencyMode == kH264LowLatency;
+}
+
+// Maps a WebRTC target bitrate (kbit/s) and frame rate onto x264 ABR with a
+// capped VBV. Only fields x264_encoder_reconfig is allowed to change are set.
+void ConfigureRateControl(uint32_t bitrate_kbit,
+                          uint32_t framerate,
+                          x264_param_t* param) {
+  param->rc.i_rc_method = X264_RC_ABR;
+  param->rc.i_bitrate = bitrate_kbit;
+  param->rc.i_vbv_max_bitrate = bitrate_kbit;
+  param->rc.i_vbv_buffer_size =
+      std::max<uint32_t>(1, bitrate_kbit * kVbvBufferSizeMs / 1000);
+  param->i_fps_num = framerate;
+  param->i_fps_den = 1;
+}
+
+}  // namespace
 
-// Helper method used by H264EncoderImpl::Encode.
-// Copies the encoded bytes from |info| to |encoded_image| and updates the
-// fragmentation information of |frag_header|. The |encoded_image->_buffer| may
-// be deleted and reallocated if a bigger buffer is required.
-//
-// After OpenH264 encoding, the encoded bytes are stored in |info| spread out
-// over a number of layers and "NAL units". Each NAL unit is a fragment starting
-// with the four-byte start code {0,0,0,1}. All of this data (including the
-// start codes) is copied to the |encoded_image->_buffer| and the |frag_header|
-// is updated to point to each fragment, with offsets and lengths set as to
-// exclude the start codes.
 
 H264EncoderImpl::H264EncoderImpl()
-    : encoder_(nullptr),
+    : encoded_image_buffer_size_(0),
       encoded_image_callback_(nullptr),
-    inited_(false){
+      inited_(false),
+      encoder_(nullptr),
+      first_frame_(true),
+      last_timestamp_(0),
+      num_threads_for_testing_(0),
+      zero_delay_(false),
+      lossy_channel_(false),
+      rtt_ms_(0),
+      periodic_key_frames_(true),
+      loss_recovery_(kRecoverWithKeyFrame),
+      periodic_key_frames_applied_(true) {
 }
 
 H264EncoderImpl::~H264EncoderImpl() {
@@ -87,91 +160,121 @@ int32_t H264EncoderImpl::InitEncode(const VideoCodec* inst,
             return ret_val;
         }
         codec_settings_ = *inst;
-        /* Get default params for preset/tuning */
-        x264_param_t param;
-        memset(&param, 0, sizeof(param));
-        x264_param_default(&param);
-        ret_val = x264_param_default_preset(&param, "veryfast", "zerolatency");
+        const bool low_latency =
+            codec_settings_.codecSpecific.H264.latencyMode == kH264LowLatency;
+        memset(&param_, 0, sizeof(param_));
+        x264_param_default(&param_);
+        // "zerolatency" disables B-frames, rate control lookahead and the
+        // sync lookahead and switches to sliced threads, so that no frame is
+        // held back inside the encoder.
+        ret_val = x264_param_default_preset(&param_, "veryfast",
+                                            low_latency ? "zerolatency" : NULL);
         if (ret_val != 0) {
             WEBRTC_TRACE(webrtc::kTraceError, webrtc::kTraceVideoCoding, -1,
                          "H264EncoderImpl::InitEncode() fails to initialize encoder ret_val %d",
                          ret_val);
-            x264_encoder_close(encoder_);
-            encoder_ = NULL;
             return WEBRTC_VIDEO_CODEC_ERROR;
         }
-        /* Configure non-default params */
-        /*cpuFlags 去空缓冲区继续使用不死锁保证*/
-        param.i_threads = X264_SYNC_LOOKAHEAD_AUTO;
-        param.i_width = inst->width;
-        param.i_height = inst->height;
-        param.i_frame_total   =0;//要编码的总帧数，不知道用0
-        param.i_keyint_max    =50;
-        param.i_bframe        =5;
-        param.b_open_gop      =0;
-        param.i_bframe_pyramid=0;
-        param.i_bframe_adaptive=X264_B_ADAPT_TRELLIS;
-    /*log参数，不需要打印编码信息时直接注释掉*/
-//    param.i_log_level    =X264_LOG_DEBUG;
-        param.i_fps_den               =1;//码率分母
-        param.i_fps_num               =25;//码率分子
-        param.b_intra_refresh =1;
-        param.b_annexb = 1;//这里设置为1，是为了使编码后的NAL统一有4字节的起始码
-        param.i_csp = X264_CSP_I420;
-    
-        param.b_vfr_input = 0;
-        param.b_repeat_headers = 1; //sps, pps
-        param.rc.i_bitrate = codec_settings_.maxBitrate;
-        /* Apply profile restrictions. */
-        ret_val = x264_param_apply_profile(&param, "baseline");
-        if (ret_val != 0) {
-            WEBRTC_TRACE(webrtc::kTraceError, webrtc::kTraceVideoCoding, -1,
-                         "H264EncoderImpl::InitEncode() fails to initialize encoder ret_val %d",
-                         ret_val);
-            x264_encoder_close(encoder_);
-            encoder_ = NULL;
-            return WEBRTC_VIDEO_CODEC_ERROR;
+        param_.i_width = inst->width;
+        param_.i_height = inst->height;
+        param_.i_frame_total = 0;  // Unknown.
+        param_.i_csp = X264_CSP_I420;
+        // Annex B output, every NAL unit starts with a start code.
+        param_.b_annexb = 1;
+        // Repeat SPS/PPS in front of every IDR.
+        param_.b_repeat_headers = 1;
+        param_.b_open_gop = 0;
+        if (low_latency) {
+          param_.i_bframe = 0;
+          param_.rc.i_lookahead = 0;
+          param_.i_sync_lookahead = 0;
+        } else {
+          param_.i_bframe = kHighQualityBFrames;
+          param_.i_bframe_pyramid = X264_B_PYRAMID_NONE;
+          param_.i_bframe_adaptive = X264_B_ADAPT_FAST;
+          param_.rc.i_lookahead = kHighQualityLookaheadFrames;
         }
-    
-//    初始化pic
-        ret_val = x264_picture_alloc(&pic_, param.i_csp, param.i_width, param.i_height);
+        if (UseSlicedThreads(codec_settings_.codecSpecific.H264)) {
+          param_.b_sliced_threads = 1;
+          param_.i_threads = NumberOfThreads(inst->width, inst->height,
+                                             number_of_cores);
+        } else {
+          param_.b_sliced_threads = 0;
+          param_.i_threads = NumberOfFrameThreads(inst->width, inst->height,
+                                                  number_of_cores);
+        }
+        if (num_threads_for_testing_ > 0)
+          param_.i_threads = num_threads_for_testing_;
+        param_.i_lookahead_threads = X264_THREADS_AUTO;
+        // Also rules out B-frames, which neither intra refresh nor reference
+        // invalidation work with.
+        zero_delay_ = low_latency &&
+                      (param_.b_sliced_threads || param_.i_threads == 1);
+        // A new resolution reopens the encoder, which would lose the frames
+        // x264 holds back.
+        if (codec_settings_.codecSpecific.H264.automaticResizeOn &&
+            !zero_delay_) {
+            LOG(LS_ERROR) << "automaticResizeOn requires the low latency mode "
+                             "with sliced threads or a single thread.";
+            return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+        }
+        loss_recovery_ = SelectLossRecovery();
+        ConfigureLossRecovery();
+
+        // Rate control follows the frame timestamps rather than a fixed frame
+        // rate, so a change of the actual input rate is picked up without a
+        // reconfiguration.
+        param_.b_vfr_input = 1;
+        param_.i_timebase_num = 1;
+        param_.i_timebase_den = kRtpTimestampRate;
+        // VBV has to be enabled when the encoder is opened, otherwise
+        // x264_encoder_reconfig ignores later bitrate changes.
+        uint32_t start_bitrate = codec_settings_.startBitrate;
+        if (start_bitrate == 0)
+          start_bitrate = codec_settings_.targetBitrate;
+        if (start_bitrate == 0)
+          start_bitrate = codec_settings_.maxBitrate;
+        if (start_bitrate == 0)
+          start_bitrate = kDefaultStartBitrateKbit;
+        codec_settings_.targetBitrate = start_bitrate;
+        ConfigureRateControl(start_bitrate, codec_settings_.maxFramerate,
+                             &param_);
+        param_.rc.f_vbv_buffer_init = 0.9f;
+        // Apply profile restrictions. Baseline has no B-frames, so the high
+        // quality mode only has an effect with the main profile.
+        ret_val = x264_param_apply_profile(
+            &param_,
+            codec_settings_.codecSpecific.H264.profile == kProfileMain
+                ? "main" : "baseline");
         if (ret_val != 0) {
             WEBRTC_TRACE(webrtc::kTraceError, webrtc::kTraceVideoCoding, -1,
                          "H264EncoderImpl::InitEncode() fails to initialize encoder ret_val %d",
                          ret_val);
-            x264_encoder_close(encoder_);
-            encoder_ = NULL;
             return WEBRTC_VIDEO_CODEC_ERROR;
         }
     
-//    pic_.img.plane[0] = encoder->yuv;
-//    encoder->yuv420p_picture->img.plane[1] = encoder->yuv+IMAGE_WIDTH*IMAGE_HEIGHT;
-//    encoder->yuv420p_picture->img.plane[2] = encoder->yuv+IMAGE_WIDTH*IMAGE_HEIGHT+IMAGE_WIDTH*IMAGE_HEIGHT/4;
-    
-//     打开编码器
-    
-        encoder_ = x264_encoder_open(&param);
+        // The planes of |pic_| are pointed at the input frame in Encode, no
+        // picture memory of our own is needed.
+        x264_picture_init(&pic_);
+
+        encoder_ = x264_encoder_open(&param_);
         if (!encoder_){
             WEBRTC_TRACE(webrtc::kTraceError, webrtc::kTraceVideoCoding, -1,
-                         "H264EncoderImpl::InitEncode() fails to initialize encoder ret_val %d",
-                         ret_val);
-            x264_encoder_close(encoder_);
-            x264_picture_clean(&pic_);
-            encoder_ = NULL;
+                         "H264EncoderImpl::InitEncode() fails to open encoder");
             return WEBRTC_VIDEO_CODEC_ERROR;
         }
     
-        if (encoded_image_._buffer != NULL) {
-            delete[] encoded_image_._buffer;
-        }
-        encoded_image_._size = CalcBufferSize(kI420, codec_settings_.width, codec_settings_.height);
-        encoded_image_._buffer = new uint8_t[encoded_image_._size];
         encoded_image_._completeFrame = true;
-        
+        first_frame_ = true;
+        input_frames_.clear();
+        quality_scaler_.Init(kLowQpThreshold, kHighQpThreshold, false);
+        quality_scaler_.ReportFramerate(codec_settings_.maxFramerate);
+
         inited_ = true;
         WEBRTC_TRACE(webrtc::kTraceApiCall, webrtc::kTraceVideoCoding, -1,
-                     "H264EncoderImpl::InitEncode(width:%d, height:%d, framerate:%d, start_bitrate:%d, max_bitrate:%d)",
-                     inst->width, inst->height, inst->maxFramerate, inst->startBitrate, inst->maxBitrate);
+                     "H264EncoderImpl::InitEncode(width:%d, height:%d, framerate:%d, start_bitrate:%d, max_bitrate:%d, threads:%d, sliced:%d, loss_recovery:%d)",
+                     inst->width, inst->height, inst->maxFramerate, inst->startBitrate, inst->maxBitrate,
+                     param_.i_threads, param_.b_sliced_threads, loss_recovery_);
         
         return WEBRTC_VIDEO_CODEC_OK;  
 }
@@ -179,12 +282,15 @@ int32_t H264EncoderImpl::InitEncode(const VideoCodec* inst,
 
 int32_t H264EncoderImpl::Release() {
   if (encoder_) {
+    x264_encoder_close(encoder_);
     encoder_ = nullptr;
   }
-  if (encoded_image_._buffer != nullptr) {
-    encoded_image_._buffer = nullptr;
-    encoded_image_buffer_.reset();
-  }
+  inited_ = false;
+  encoded_image_._buffer = nullptr;
+  encoded_image_._length = 0;
+  encoded_image_._size = 0;
+  encoded_image_buffer_.reset();
+  encoded_image_buffer_size_ = 0;
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
@@ -194,15 +300,35 @@ int32_t H264EncoderImpl::RegisterEncodeCompleteCallback(
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
-    int32_t H264EncoderImpl::SetRates(uint32_t bitrate, uint32_t framerate) {
-        if (bitrate <= 0 || framerate <= 0) {
-            return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
-        }
-        codec_settings_.targetBitrate = bitrate;
-        codec_settings_.maxFramerate = framerate;
-        
-              return WEBRTC_VIDEO_CODEC_OK;
-    }
+int32_t H264EncoderImpl::SetRates(uint32_t bitrate, uint32_t framerate) {
+  if (!IsInitialized()) {
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  }
+  if (bitrate == 0 || framerate == 0) {
+    return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+  }
+  if (codec_settings_.maxBitrate > 0 && bitrate > codec_settings_.maxBitrate) {
+    bitrate = codec_settings_.maxBitrate;
+  }
+  if (bitrate < codec_settings_.minBitrate) {
+    bitrate = codec_settings_.minBitrate;
+  }
+  quality_scaler_.ReportFramerate(framerate);
+  if (bitrate == codec_settings_.targetBitrate &&
+      framerate == codec_settings_.maxFramerate) {
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  codec_settings_.targetBitrate = bitrate;
+  codec_settings_.maxFramerate = framerate;
+
+  ConfigureRateControl(bitrate, framerate, &param_);
+  int ret_val = x264_encoder_reconfig(encoder_, &param_);
+  if (ret_val < 0) {
+    LOG(LS_ERROR) << "x264_encoder_reconfig failed: " << ret_val;
+    return WEBRTC_VIDEO_CODEC_ERROR;
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
 
 int32_t H264EncoderImpl::Encode(
     const VideoFrame& input_image, const CodecSpecificInfo* codec_specific_info,
@@ -217,30 +343,62 @@ int32_t H264EncoderImpl::Encode(
             return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
         }
         
-        VideoFrameType frame_type = kDeltaFrame;
-        // We only support one stream at the moment.
-        if (frame_types && frame_types->size() > 0) {
-            frame_type = (*frame_types)[0];
+        // One stream per encoder, simulcast is done by H264SimulcastEncoder.
+        bool send_key_frame = false;
+        if (frame_types) {
+          for (size_t i = 0; i < frame_types->size(); ++i) {
+            if ((*frame_types)[i] == kKeyFrame) {
+              send_key_frame = true;
+              break;
+            }
+          }
         }
-        
-//        bool send_keyframe = (frame_type == kKeyFrame);
-//        if (send_keyframe) {
-//            pic_.b_keyframe = true;
-//            WEBRTC_TRACE(webrtc::kTraceApiCall, webrtc::kTraceVideoCoding, -1,
-//                         "H264EncoderImpl::EncodeKeyFrame(width:%d, height:%d)",
-//                         input_image.width(), input_image.height());
-//        }
-    
-    
-        /* Read input frame */
-     pic_.img.i_csp =X264_CSP_I420;
+
+        const bool use_quality_scaler = UseQualityScaler();
+        if (use_quality_scaler)
+          quality_scaler_.OnEncodeFrame(input_image);
+        const VideoFrame& frame = use_quality_scaler
+                                      ? quality_scaler_.GetScaledFrame(
+                                            input_image)
+                                      : input_image;
+        if (frame.width() != param_.i_width ||
+            frame.height() != param_.i_height) {
+          int32_t ret_val = ResizeEncoder(frame.width(), frame.height());
+          if (ret_val < 0)
+            return ret_val;
+          send_key_frame = false;
+        }
+
+        pic_.img.i_csp = X264_CSP_I420;
         pic_.img.i_plane = 3;
-        pic_.i_type = X264_TYPE_AUTO;
-    pic_.img.plane[0] = const_cast<uint8_t*>(input_image.buffer(kYPlane));
-        pic_.img.plane[1] = const_cast<uint8_t*>(input_image.buffer(kUPlane));
-        pic_.img.plane[2] = const_cast<uint8_t*>(input_image.buffer(kVPlane));
-//        pic_.i_pts = i_frame;
-       pic_.i_pts++;
+        pic_.img.plane[0] = const_cast<uint8_t*>(frame.buffer(kYPlane));
+        pic_.img.plane[1] = const_cast<uint8_t*>(frame.buffer(kUPlane));
+        pic_.img.plane[2] = const_cast<uint8_t*>(frame.buffer(kVPlane));
+        pic_.img.i_stride[0] = frame.stride(kYPlane);
+        pic_.img.i_stride[1] = frame.stride(kUPlane);
+        pic_.img.i_stride[2] = frame.stride(kVPlane);
+        // x264 requires strictly increasing pts, unwrap the RTP timestamp.
+        if (first_frame_) {
+          pic_.i_pts = 0;
+          first_frame_ = false;
+        } else {
+          // A repeated or backwards timestamp still advances the pts by one.
+          const int32_t diff =
+              static_cast<int32_t>(frame.timestamp() - last_timestamp_);
+          pic_.i_pts += diff > 0 ? diff : 1;
+        }
+        last_timestamp_ = frame.timestamp();
+        if (send_key_frame) {
+          int32_t ret_val = OnKeyFrameRequest(pic_.i_pts, &send_key_frame);
+          if (ret_val < 0)
+            return ret_val;
+        }
+        pic_.i_type = send_key_frame ? X264_TYPE_IDR : X264_TYPE_AUTO;
+        // With B-frames the output lags the input, remember the timestamps
+        // until the picture comes out again.
+        InputFrameInfo& input_frame = input_frames_[pic_.i_pts];
+        input_frame.timestamp = frame.timestamp();
+        input_frame.capture_time_ms = frame.render_time_ms();
         int n_nal = 0;
         int i_frame_size = x264_encoder_encode(encoder_, &nal_t_, &n_nal, &pic_, &pic_out_);
         if (i_frame_size < 0)
@@ -248,72 +406,235 @@ int32_t H264EncoderImpl::Encode(
             WEBRTC_TRACE(webrtc::kTraceError, webrtc::kTraceVideoCoding, -1,
                          "H264EncoderImpl::Encode() fails to encode %d",
                          i_frame_size);
-            x264_encoder_close(encoder_);
-            x264_picture_clean(&pic_);
-            encoder_ = NULL;
+            Release();
             return WEBRTC_VIDEO_CODEC_ERROR;
         }
-//   if((ret = x264_encoder_encode(encoder->x264_encoder,&encoder->nal,&n_nal,encoder->yuv420p_picture,&pic_out))<0){ 
-//    for(my_nal = encoder->nal; my_nal<encoder->nal+n_nal; ++my_nal){
-//        write(fd_write,my_nal->p_payload,my_nal->i_payload);
-//    }
-        RTPFragmentationHeader frag_info;
-    
-        if (i_frame_size)
-        {
-            if (n_nal == 0) {
-                return WEBRTC_VIDEO_CODEC_OK;
-            }
-            frag_info.VerifyAndAllocateFragmentationHeader(n_nal);
-            encoded_image_._length = 0;
-            
-            uint32_t totalNaluIndex = 0;
-            for (int nal_index = 0; nal_index < n_nal; nal_index++)
-            {
-                uint32_t currentNaluSize = 0;
-                currentNaluSize = nal_t_[nal_index].i_payload; //x264_encoder_encode编码得到的nal单元是已经带有起始码的，此外，这里直接使用nal[index]即可，不必再使用x264_nal_encode函数
-                memcpy(encoded_image_._buffer + encoded_image_._length, nal_t_[nal_index].p_payload, currentNaluSize);//encoded_image_中存有的是去掉起始码的数据
-                encoded_image_._length += currentNaluSize;
-                
-                WEBRTC_TRACE(webrtc::kTraceApiCall, webrtc::kTraceVideoCoding, -1,
-                             "H264EncoderImpl::Encode() nal_type %d, length:%d",
-                             nal_t_[nal_index].i_type, encoded_image_._length);
-                
-                
-                frag_info.fragmentationOffset[totalNaluIndex] = encoded_image_._length - currentNaluSize;
-                frag_info.fragmentationLength[totalNaluIndex] = currentNaluSize;
-                frag_info.fragmentationPlType[totalNaluIndex] = nal_t_[nal_index].i_type;
-                frag_info.fragmentationTimeDiff[totalNaluIndex] = 0;
-                totalNaluIndex++;
-            }
+        if (i_frame_size == 0 || n_nal == 0) {
+            // The frame is held back inside the encoder (B-frames or frame
+            // threads) and will be output by a later call.
+            return WEBRTC_VIDEO_CODEC_OK;
         }
-        i_frame++;
-        if (encoded_image_._length > 0) {
-            encoded_image_._timeStamp = input_image.timestamp();
-            encoded_image_.capture_time_ms_ = input_image.render_time_ms();
-            encoded_image_._encodedHeight = codec_settings_.height;
-            encoded_image_._encodedWidth = codec_settings_.width;
-            encoded_image_._frameType = frame_type;
-            // call back
-            encoded_image_callback_->Encoded(encoded_image_, NULL, &frag_info);
-        }  
+        DeliverEncodedPicture(n_nal);
         return WEBRTC_VIDEO_CODEC_OK;
 }
 
+int32_t H264EncoderImpl::Flush() {
+  if (!inited_) {
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  }
+  if (encoded_image_callback_ == NULL) {
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  }
+  while (x264_encoder_delayed_frames(encoder_) > 0) {
+    int n_nal = 0;
+    int i_frame_size =
+        x264_encoder_encode(encoder_, &nal_t_, &n_nal, NULL, &pic_out_);
+    if (i_frame_size < 0) {
+      LOG(LS_ERROR) << "x264_encoder_encode failed to flush: " << i_frame_size;
+      Release();
+      return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+    if (i_frame_size > 0 && n_nal > 0)
+      DeliverEncodedPicture(n_nal);
+  }
+  return Release();
+}
+
+void H264EncoderImpl::SetNumberOfThreadsForTesting(int num_threads) {
+  num_threads_for_testing_ = num_threads;
+}
+
+void H264EncoderImpl::DeliverEncodedPicture(int num_nals) {
+  RTPFragmentationHeader frag_info;
+  SetEncodedImage(nal_t_, num_nals, &frag_info);
+  if (encoded_image_._length == 0)
+    return;
+  // |pic_out_| is the picture that was just output, which is not
+  // necessarily the last input.
+  std::map<int64_t, InputFrameInfo>::iterator it =
+      input_frames_.find(pic_out_.i_pts);
+  if (it != input_frames_.end()) {
+    encoded_image_._timeStamp = it->second.timestamp;
+    encoded_image_.capture_time_ms_ = it->second.capture_time_ms;
+    input_frames_.erase(it);
+  }
+  encoded_image_._encodedHeight = param_.i_height;
+  encoded_image_._encodedWidth = param_.i_width;
+  // The average QP of the picture, rounded.
+  encoded_image_.qp_ = pic_out_.i_qpplus1 - 1;
+  if (UseQualityScaler())
+    quality_scaler_.ReportQP(encoded_image_.qp_);
+  // x264 also flags the start of an intra refresh as keyframe, but only an
+  // IDR can be decoded on its own.
+  encoded_image_._frameType =
+      pic_out_.i_type == X264_TYPE_IDR ? kKeyFrame : kDeltaFrame;
+  CodecSpecificInfo codec_specific;
+  memset(&codec_specific, 0, sizeof(codec_specific));
+  codec_specific.codecType = kVideoCodecH264;
+  encoded_image_callback_->Encoded(encoded_image_, &codec_specific,
+                                   &frag_info);
+}
+
+// x264 guarantees that the payloads of all NAL units output by one
+// x264_encoder_encode call are sequential in memory, so |encoded_image_|
+// references x264's buffer instead of copying it. That buffer is valid until
+// the next x264_encoder_encode call, which covers the encode complete
+// callback; like with any encoder, a callback that needs the data for longer
+// has to copy it. Should the payloads not be contiguous they are gathered into
+// |encoded_image_buffer_|, which grows as needed and is reused across frames.
+//
+// With |b_annexb| every NAL unit is preceded by a three or four byte start
+// code. The fragmentation header describes the NAL units without start codes.
+void H264EncoderImpl::SetEncodedImage(const x264_nal_t* nals,
+                                      int num_nals,
+                                      RTPFragmentationHeader* frag_header) {
+  uint8_t* payload = nals[0].p_payload;
+  size_t length = 0;
+  bool contiguous = true;
+  for (int i = 0; i < num_nals; ++i) {
+    if (nals[i].p_payload != payload + length)
+      contiguous = false;
+    length += nals[i].i_payload;
+  }
+  if (contiguous) {
+    encoded_image_._buffer = payload;
+    encoded_image_._size = length;
+  } else {
+    if (encoded_image_buffer_size_ < length) {
+      encoded_image_buffer_size_ =
+          std::max(length, encoded_image_buffer_size_ * 3 / 2);
+      encoded_image_buffer_.reset(new uint8_t[encoded_image_buffer_size_]);
+    }
+    size_t offset = 0;
+    for (int i = 0; i < num_nals; ++i) {
+      memcpy(encoded_image_buffer_.get() + offset, nals[i].p_payload,
+             nals[i].i_payload);
+      offset += nals[i].i_payload;
+    }
+    encoded_image_._buffer = encoded_image_buffer_.get();
+    encoded_image_._size = encoded_image_buffer_size_;
+  }
+  encoded_image_._length = length;
+
+  frag_header->VerifyAndAllocateFragmentationHeader(num_nals);
+  size_t offset = 0;
+  for (int i = 0; i < num_nals; ++i) {
+    size_t start_code_length = nals[i].b_long_startcode ? 4 : 3;
+    RTC_DCHECK_GT(static_cast<size_t>(nals[i].i_payload), start_code_length);
+    frag_header->fragmentationOffset[i] = offset + start_code_length;
+    frag_header->fragmentationLength[i] =
+        nals[i].i_payload - start_code_length;
+    frag_header->fragmentationPlType[i] = 0;
+    frag_header->fragmentationTimeDiff[i] = 0;
+    offset += nals[i].i_payload;
+  }
+}
+
 bool H264EncoderImpl::IsInitialized() const {
   return encoder_ != nullptr;
 }
 
+bool H264EncoderImpl::UseQualityScaler() const {
+  return codec_settings_.codecSpecific.H264.automaticResizeOn;
+}
+
+int32_t H264EncoderImpl::ResizeEncoder(int width, int height) {
+  param_.i_width = width;
+  param_.i_height = height;
+  // The IDR serves a pending change of the loss recovery mode too.
+  if (zero_delay_) {
+    loss_recovery_ = SelectLossRecovery();
+    ConfigureLossRecovery();
+  }
+  x264_encoder_close(encoder_);
+  encoder_ = x264_encoder_open(&param_);
+  if (!encoder_) {
+    LOG(LS_ERROR) << "Failed to reopen x264 for " << width << "x" << height;
+    Release();
+    return WEBRTC_VIDEO_CODEC_ERROR;
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+H264EncoderImpl::LossRecovery H264EncoderImpl::SelectLossRecovery() const {
+  if (!zero_delay_ || !lossy_channel_)
+    return kRecoverWithKeyFrame;
+  return rtt_ms_ <= kReferenceInvalidationMaxRttMs
+             ? kRecoverWithReferenceInvalidation
+             : kRecoverWithIntraRefresh;
+}
+
+void H264EncoderImpl::ConfigureLossRecovery() {
+  int key_frame_interval = codec_settings_.codecSpecific.H264.keyFrameInterval;
+  // With intra refresh this is the refresh period. An on demand refresh with
+  // an infinite period sweeps one macroblock column per frame.
+  param_.i_keyint_max = periodic_key_frames_ && key_frame_interval > 0
+                            ? key_frame_interval
+                            : X264_KEYINT_MAX_INFINITE;
+  param_.b_intra_refresh = loss_recovery_ == kRecoverWithIntraRefresh;
+  param_.i_dpb_size = loss_recovery_ == kRecoverWithReferenceInvalidation
+                          ? kReferenceInvalidationDpbSize
+                          : param_.i_frame_reference;
+  periodic_key_frames_applied_ = periodic_key_frames_;
+}
+
+int32_t H264EncoderImpl::OnKeyFrameRequest(int64_t pts, bool* send_key_frame) {
+  LossRecovery loss_recovery = SelectLossRecovery();
+  if (loss_recovery != loss_recovery_ ||
+      (zero_delay_ && periodic_key_frames_ != periodic_key_frames_applied_)) {
+    // The new encoder starts with an IDR, which serves the request.
+    loss_recovery_ = loss_recovery;
+    ConfigureLossRecovery();
+    x264_encoder_close(encoder_);
+    encoder_ = x264_encoder_open(&param_);
+    if (!encoder_) {
+      LOG(LS_ERROR) << "Failed to reopen x264 for loss recovery mode "
+                    << loss_recovery_;
+      Release();
+      return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+    *send_key_frame = false;
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  switch (loss_recovery_) {
+    case kRecoverWithKeyFrame:
+      *send_key_frame = true;
+      break;
+    case kRecoverWithIntraRefresh:
+      x264_encoder_intra_refresh(encoder_);
+      *send_key_frame = false;
+      break;
+    case kRecoverWithReferenceInvalidation: {
+      int64_t window = (rtt_ms_ + kReferenceInvalidationMarginMs) *
+                       kRtpTimestampRate / 1000;
+      // Falls back to an IDR if the frames before the window are gone.
+      *send_key_frame =
+          x264_encoder_invalidate_reference(encoder_, pts - window) < 0;
+      break;
+    }
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
 int32_t H264EncoderImpl::SetChannelParameters(
     uint32_t packet_loss, int64_t rtt) {
+  if (packet_loss >= kLossyChannelEnterQ8) {
+    lossy_channel_ = true;
+  } else if (packet_loss < kLossyChannelLeaveQ8) {
+    lossy_channel_ = false;
+  }
+  rtt_ms_ = rtt;
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
 int32_t H264EncoderImpl::SetPeriodicKeyFrames(bool enable) {
+  periodic_key_frames_ = enable;
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
 void H264EncoderImpl::OnDroppedFrame() {
+  if (UseQualityScaler())
+    quality_scaler_.ReportDroppedFrame();
 }
 
 }  // namespace webrtc
@@ -14,9 +14,11 @@
 
 #include "video_coding/codecs/h264/include/h264.h"
 
+#include <map>
 #include <vector>
 
 #include "base/scoped_ptr.h"
+#include "video_coding/utility/include/quality_scaler.h"
 #include "x264.h"
 #include "x264_config.h"
 
@@ -32,10 +34,19 @@ class H264EncoderImpl : public H264Encoder {
   // |max_payload_size| is ignored.
   // The following members of |codec_settings| are used. The rest are ignored.;
   // - codecType (must be kVideoCodecH264)
-  // - targetBitrate
+  // - startBitrate, minBitrate, maxBitrate
   // - maxFramerate
   // - width
   // - height
+  // - codecSpecific.H264.profile, keyFrameInterval, latencyMode,
+  //   threadingMode and automaticResizeOn
+  // The number of encoder threads is derived from |number_of_cores| and the
+  // resolution.
+  // With automaticResizeOn the input is downscaled while x264 has to encode
+  // at a high QP to meet the bitrate, and scaled back up once the QP is low,
+  // see QualityScaler. A new resolution reopens the encoder, so
+  // automaticResizeOn is rejected with WEBRTC_VIDEO_CODEC_ERR_PARAMETER
+  // unless the low latency mode uses sliced threads or one thread.
   int32_t InitEncode(const VideoCodec* codec_settings,
                      int32_t number_of_cores,
                      size_t /*max_payload_size*/) override;
@@ -43,36 +54,118 @@ class H264EncoderImpl : public H264Encoder {
 
   int32_t RegisterEncodeCompleteCallback(
       EncodedImageCallback* callback) override;
+  // Applies the new rates to the running encoder with x264_encoder_reconfig,
+  // no flush or keyframe is required. |bitrate| is in kbit/s and is clamped
+  // to [minBitrate, maxBitrate] of the codec settings.
   int32_t SetRates(uint32_t bitrate, uint32_t framerate) override;
 
   // The result of encoding - an EncodedImage and RTPFragmentationHeader - are
-  // passed to the encode complete callback.
+  // passed to the encode complete callback. The EncodedImage references the
+  // encoder's internal buffer, which is only valid during the callback.
   int32_t Encode(const VideoFrame& frame,
                  const CodecSpecificInfo* codec_specific_info,
                  const std::vector<VideoFrameType>* frame_types) override;
 
-  // Unsupported / Do nothing.
+  // Selects how key frame requests are served. On a lossy channel a full IDR
+  // is a burst that is likely to be hit by loss itself, so instead:
+  // - with a short |rtt| the frames sent within the last round trip, which
+  //   the receiver most likely failed to decode, are no longer referenced
+  //   (x264_encoder_invalidate_reference);
+  // - with a long |rtt| the picture is refreshed with a column of intra
+  //   macroblocks sweeping over several frames (x264 intra refresh), which
+  //   also replaces the periodic key frames.
+  // Recovering without an IDR requires a receiver that decodes with errors.
+  // |packet_loss| is the loss fraction in Q8. Switching between these modes
+  // reopens the encoder, which is deferred to the next key frame request so
+  // that it never costs an extra key frame. Only in the low latency mode with
+  // sliced threads or one thread, where no frames are held in the encoder;
+  // otherwise every request is served with an IDR.
   int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt) override;
+  // Enables the key frames, or intra refreshes, every keyFrameInterval
+  // frames. Takes effect like a change of the loss recovery mode.
   int32_t SetPeriodicKeyFrames(bool enable) override;
+  // Counts towards downscaling with automaticResizeOn.
   void OnDroppedFrame() override;
 
+  // Passes the frames still held inside the encoder, by frame threads or
+  // B-frames, to the encode complete callback and releases the encoder.
+  // InitEncode has to be called again before the next Encode.
+  int32_t Flush();
+  // Makes the following InitEncode calls open x264 with |num_threads|
+  // threads instead of deriving the count from |number_of_cores|. 0 restores
+  // the derived count. For benchmarks.
+  void SetNumberOfThreadsForTesting(int num_threads);
+
  private:
+  enum LossRecovery {
+    kRecoverWithKeyFrame,
+    kRecoverWithIntraRefresh,
+    kRecoverWithReferenceInvalidation,
+  };
+
   bool IsInitialized() const;
+  LossRecovery SelectLossRecovery() const;
+  bool UseQualityScaler() const;
+  // Reopens the encoder for frames of |width| x |height|. The new encoder
+  // starts with an IDR.
+  int32_t ResizeEncoder(int width, int height);
+  // Sets the fields of |param_| that depend on |loss_recovery_| and
+  // |periodic_key_frames_|.
+  void ConfigureLossRecovery();
+  // Serves a key frame request for the frame with |pts|. Sets |send_key_frame|
+  // if an IDR has to be forced.
+  int32_t OnKeyFrameRequest(int64_t pts, bool* send_key_frame);
+  // Sets |encoded_image_| and |frag_header| from the NAL units output by
+  // x264_encoder_encode.
+  void SetEncodedImage(const x264_nal_t* nals,
+                       int num_nals,
+                       RTPFragmentationHeader* frag_header);
+  // Passes the picture output by x264_encoder_encode, |pic_out_| and
+  // |num_nals| NAL units in |nal_t_|, to the encode complete callback.
+  void DeliverEncodedPicture(int num_nals);
 
 //  ISVCEncoder* openh264_encoder_;
   VideoCodec codec_settings_;
 
   EncodedImage encoded_image_;
+  // Only used when x264's output can't be referenced directly, see
+  // SetEncodedImage.
   rtc::scoped_ptr<uint8_t[]> encoded_image_buffer_;
+  size_t encoded_image_buffer_size_;
   EncodedImageCallback* encoded_image_callback_;
     
   bool inited_;
   x264_picture_t pic_;
   x264_picture_t pic_out_;
   x264_t *encoder_;
-  int i_frame = 0;//frame index
+  // Used to unwrap RTP timestamps into x264 pts.
+  bool first_frame_;
+  uint32_t last_timestamp_;
+  // RTP timestamp and capture time of the pictures inside the encoder, by
+  // pts.
+  struct InputFrameInfo {
+    uint32_t timestamp;
+    int64_t capture_time_ms;
+  };
+  std::map<int64_t, InputFrameInfo> input_frames_;
   x264_nal_t *nal_t_;
-//  x264_param_t x264_parameter;
+  // Parameters the encoder was opened with, kept up to date by SetRates so
+  // that they can be handed to x264_encoder_reconfig.
+  x264_param_t param_;
+  // Set by SetNumberOfThreadsForTesting, 0 if unset.
+  int num_threads_for_testing_;
+  // Whether x264 outputs every frame from the Encode call that inputs it,
+  // which is required to reopen the encoder while encoding.
+  bool zero_delay_;
+  // Set by SetChannelParameters, with hysteresis on the loss.
+  bool lossy_channel_;
+  int64_t rtt_ms_;
+  bool periodic_key_frames_;
+  // The mode the encoder was opened with, and the requested settings that
+  // are applied with the next key frame request.
+  LossRecovery loss_recovery_;
+  bool periodic_key_frames_applied_;
+  QualityScaler quality_scaler_;
 };
 
 }  // namespace webrtc
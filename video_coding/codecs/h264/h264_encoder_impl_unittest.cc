@@ -0,0 +1,349 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include "base/arraysize.h"
+#include "base/scoped_ptr.h"
+#include "video_coding/codecs/h264/h264_encoder_impl.h"
+#include "video_coding/codecs/h264/test/synthetic_frame_source.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kWidth = 320;
+const int kHeight = 240;
+const int kFramerate = 30;
+
+class FrameSizeCallback : public EncodedImageCallback {
+ public:
+  int32_t Encoded(const EncodedImage& encoded_image,
+                  const CodecSpecificInfo* codec_specific_info,
+                  const RTPFragmentationHeader* fragmentation) override {
+    frame_sizes_.push_back(encoded_image._length);
+    frame_types_.push_back(encoded_image._frameType);
+    frame_widths_.push_back(encoded_image._encodedWidth);
+    timestamps_.push_back(encoded_image._timeStamp);
+    last_qp_ = encoded_image.qp_;
+    last_frame_.assign(encoded_image._buffer,
+                       encoded_image._buffer + encoded_image._length);
+    last_fragmentation_.CopyFrom(*fragmentation);
+    return 0;
+  }
+
+  const std::vector<size_t>& frame_sizes() const { return frame_sizes_; }
+  const std::vector<VideoFrameType>& frame_types() const {
+    return frame_types_;
+  }
+  const std::vector<int>& frame_widths() const { return frame_widths_; }
+  const std::vector<uint32_t>& timestamps() const { return timestamps_; }
+  int last_qp() const { return last_qp_; }
+  const std::vector<uint8_t>& last_frame() const { return last_frame_; }
+  const RTPFragmentationHeader& last_fragmentation() const {
+    return last_fragmentation_;
+  }
+
+ private:
+  std::vector<size_t> frame_sizes_;
+  std::vector<VideoFrameType> frame_types_;
+  std::vector<int> frame_widths_;
+  std::vector<uint32_t> timestamps_;
+  int last_qp_ = -1;
+  std::vector<uint8_t> last_frame_;
+  RTPFragmentationHeader last_fragmentation_;
+};
+
+}  // namespace
+
+class H264EncoderImplTest : public ::testing::Test {
+ protected:
+  H264EncoderImplTest() : source_(kWidth, kHeight, kFramerate) {}
+
+  void SetUp() override {
+    memset(&codec_settings_, 0, sizeof(codec_settings_));
+    codec_settings_.codecType = kVideoCodecH264;
+    codec_settings_.width = kWidth;
+    codec_settings_.height = kHeight;
+    codec_settings_.maxFramerate = kFramerate;
+    codec_settings_.startBitrate = 1000;
+    codec_settings_.maxBitrate = 2000;
+    codec_settings_.minBitrate = 30;
+    codec_settings_.codecSpecific.H264 =
+        VideoEncoder::GetDefaultH264Settings();
+    encoder_.reset(new H264EncoderImpl());
+    encoder_->RegisterEncodeCompleteCallback(&callback_);
+  }
+
+  void EncodeFrame(const std::vector<VideoFrameType>* frame_types) {
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              encoder_->Encode(source_.NextFrame(), nullptr, frame_types));
+  }
+
+  // Bitrate, in kbit/s, of the second of output ending at |last_frame|.
+  int WindowBitrateKbps(size_t last_frame) const {
+    const std::vector<size_t>& sizes = callback_.frame_sizes();
+    size_t bytes = 0;
+    for (size_t i = last_frame + 1 - kFramerate; i <= last_frame; ++i)
+      bytes += sizes[i];
+    return static_cast<int>(bytes * 8 / 1000);
+  }
+
+  // Encodes four seconds on a channel with |packet_loss| (Q8) and |rtt_ms|,
+  // with a key frame request every second. Returns the peak to mean frame
+  // size ratio, after the rate control settled, and sets |key_frames| to the
+  // number of key frames after the first frame.
+  double PeakToMeanFrameSize(uint32_t packet_loss,
+                             int64_t rtt_ms,
+                             int* key_frames) {
+    encoder_->SetChannelParameters(packet_loss, rtt_ms);
+    EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              encoder_->InitEncode(&codec_settings_, 1, 0));
+    std::vector<VideoFrameType> delta_frame(1, kDeltaFrame);
+    std::vector<VideoFrameType> key_frame(1, kKeyFrame);
+    const size_t first = callback_.frame_sizes().size();
+    const int kNumFrames = 4 * kFramerate;
+    for (int i = 0; i < kNumFrames; ++i)
+      EncodeFrame(i > 0 && i % kFramerate == 0 ? &key_frame : &delta_frame);
+
+    const std::vector<size_t>& sizes = callback_.frame_sizes();
+    const std::vector<VideoFrameType>& types = callback_.frame_types();
+    EXPECT_EQ(first + kNumFrames, sizes.size());
+    *key_frames = 0;
+    for (size_t i = first + 1; i < types.size(); ++i) {
+      if (types[i] == kKeyFrame)
+        ++*key_frames;
+    }
+    size_t peak = 0;
+    size_t sum = 0;
+    for (size_t i = first + kFramerate / 2; i < sizes.size(); ++i) {
+      peak = std::max(peak, sizes[i]);
+      sum += sizes[i];
+    }
+    size_t count = sizes.size() - first - kFramerate / 2;
+    return static_cast<double>(peak) * count / sum;
+  }
+
+  VideoCodec codec_settings_;
+  test::SyntheticFrameSource source_;
+  FrameSizeCallback callback_;
+  rtc::scoped_ptr<H264EncoderImpl> encoder_;
+};
+
+TEST_F(H264EncoderImplTest, SetRatesRequiresInitializedEncoder) {
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_UNINITIALIZED, encoder_->SetRates(500, 30));
+}
+
+TEST_F(H264EncoderImplTest, SetRatesRejectsZeroRates) {
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERR_PARAMETER, encoder_->SetRates(0, 30));
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERR_PARAMETER, encoder_->SetRates(500, 0));
+}
+
+// Steps the target bitrate down and back up while encoding and verifies that
+// the per-second output bitrate tracks the new target within a bounded number
+// of frames, without reinitializing the encoder.
+TEST_F(H264EncoderImplTest, OutputBitrateConvergesAfterRateStep) {
+  const int kHighBitrateKbps = 1000;
+  const int kLowBitrateKbps = 250;
+  const int kFramesPerStep = 4 * kFramerate;
+  // The VBV buffer is half a second, allow for it to drain plus one second of
+  // measurement window.
+  const int kMaxConvergenceFrames = 2 * kFramerate;
+  const double kTolerance = 0.3;
+
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+  const int kTargets[] = {kHighBitrateKbps, kLowBitrateKbps, kHighBitrateKbps};
+  int frame_index = 0;
+  for (int target : kTargets) {
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder_->SetRates(target, kFramerate));
+    const int step_start = frame_index;
+    for (int i = 0; i < kFramesPerStep; ++i, ++frame_index)
+      EncodeFrame(nullptr);
+    ASSERT_EQ(static_cast<size_t>(frame_index),
+              callback_.frame_sizes().size());
+
+    for (int last = step_start + kMaxConvergenceFrames; last < frame_index;
+         ++last) {
+      int bitrate = WindowBitrateKbps(last);
+      EXPECT_LE(bitrate, target * (1 + kTolerance))
+          << "target " << target << " kbps, frame " << last;
+      // Lower bound only when stepping down; going up, a static scene may
+      // legitimately need less than the target.
+      if (target == kLowBitrateKbps) {
+        EXPECT_GE(bitrate, target * (1 - kTolerance))
+            << "target " << target << " kbps, frame " << last;
+      }
+    }
+  }
+}
+
+// In the default low latency mode every input frame has to be output by the
+// same Encode call, and a key frame request has to produce an IDR right away.
+TEST_F(H264EncoderImplTest, LowLatencyOutputsKeyFrameOnRequest) {
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+  std::vector<VideoFrameType> delta_frame(1, kDeltaFrame);
+  std::vector<VideoFrameType> key_frame(1, kKeyFrame);
+  const int kKeyFrameIndex = 10;
+  for (int i = 0; i < 2 * kKeyFrameIndex; ++i) {
+    EncodeFrame(i == kKeyFrameIndex ? &key_frame : &delta_frame);
+    ASSERT_EQ(static_cast<size_t>(i + 1), callback_.frame_types().size());
+  }
+  const std::vector<VideoFrameType>& types = callback_.frame_types();
+  EXPECT_EQ(kKeyFrame, types[0]);
+  for (int i = 1; i < 2 * kKeyFrameIndex; ++i) {
+    EXPECT_EQ(i == kKeyFrameIndex ? kKeyFrame : kDeltaFrame, types[i])
+        << "frame " << i;
+  }
+}
+
+// The output timestamps have to be the input RTP timestamps, also after a
+// repeated timestamp, a timestamp going backwards, and a wrap around.
+TEST_F(H264EncoderImplTest, OutputTimestampsMatchInput) {
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+  const uint32_t kTimestamps[] = {
+      0xFFFFE000u, 0xFFFFE000u, 0xFFFFF000u, 0xFFFFE800u, 0x00000400u,
+      0x00001400u};
+  VideoFrame frame;
+  for (uint32_t timestamp : kTimestamps) {
+    frame.ShallowCopy(source_.NextFrame());
+    frame.set_timestamp(timestamp);
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder_->Encode(frame, nullptr, nullptr));
+  }
+  ASSERT_EQ(arraysize(kTimestamps), callback_.timestamps().size());
+  for (size_t i = 0; i < arraysize(kTimestamps); ++i)
+    EXPECT_EQ(kTimestamps[i], callback_.timestamps()[i]) << "frame " << i;
+}
+
+// In the high quality mode B-frames and the lookahead hold frames back,
+// Flush has to output all of them.
+TEST_F(H264EncoderImplTest, FlushOutputsHeldFrames) {
+  codec_settings_.codecSpecific.H264.latencyMode = kH264HighQuality;
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+  const int kNumFrames = 10;
+  for (int i = 0; i < kNumFrames; ++i)
+    EncodeFrame(nullptr);
+  EXPECT_LT(callback_.frame_sizes().size(), static_cast<size_t>(kNumFrames));
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder_->Flush());
+  EXPECT_EQ(static_cast<size_t>(kNumFrames), callback_.frame_sizes().size());
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_UNINITIALIZED,
+            encoder_->Encode(source_.NextFrame(), nullptr, nullptr));
+}
+
+// The fragmentation header has to describe every NAL unit of the Annex B
+// output, without its start code, and the fragments must cover the buffer.
+TEST_F(H264EncoderImplTest, FragmentationDescribesNalUnits) {
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+  for (int i = 0; i < 3; ++i) {
+    EncodeFrame(nullptr);
+    const std::vector<uint8_t>& frame = callback_.last_frame();
+    const RTPFragmentationHeader& frag = callback_.last_fragmentation();
+    ASSERT_GT(frag.fragmentationVectorSize, 0u);
+    size_t end = 0;
+    for (size_t j = 0; j < frag.fragmentationVectorSize; ++j) {
+      size_t offset = frag.fragmentationOffset[j];
+      ASSERT_GE(offset, end + 3);
+      ASSERT_LE(offset, end + 4);
+      EXPECT_EQ(0, frame[offset - 3]);
+      EXPECT_EQ(0, frame[offset - 2]);
+      EXPECT_EQ(1, frame[offset - 1]);
+      ASSERT_GT(frag.fragmentationLength[j], 0u);
+      end = offset + frag.fragmentationLength[j];
+    }
+    EXPECT_EQ(frame.size(), end);
+  }
+}
+
+// Key frame requests on a lossy channel are served without IDRs, which spike
+// the frame size: by invalidating references with a short RTT and by intra
+// refresh with a long one.
+TEST_F(H264EncoderImplTest, LossyChannelAvoidsKeyFrameBursts) {
+  const uint32_t kClean = 0;
+  const uint32_t kTenPercentLoss = 26;
+  int key_frames = 0;
+  const double clean_ratio = PeakToMeanFrameSize(kClean, 50, &key_frames);
+  EXPECT_EQ(3, key_frames);
+
+  const double short_rtt_ratio =
+      PeakToMeanFrameSize(kTenPercentLoss, 50, &key_frames);
+  EXPECT_EQ(0, key_frames);
+  EXPECT_LT(short_rtt_ratio, clean_ratio);
+
+  const double long_rtt_ratio =
+      PeakToMeanFrameSize(kTenPercentLoss, 300, &key_frames);
+  EXPECT_EQ(0, key_frames);
+  EXPECT_LT(long_rtt_ratio, clean_ratio);
+}
+
+// Changing the loss recovery mode reopens the encoder, which waits for the
+// next key frame request.
+TEST_F(H264EncoderImplTest, SwitchesLossRecoveryOnKeyFrameRequest) {
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+  std::vector<VideoFrameType> delta_frame(1, kDeltaFrame);
+  std::vector<VideoFrameType> key_frame(1, kKeyFrame);
+  EncodeFrame(&delta_frame);
+  encoder_->SetChannelParameters(26, 300);
+  EncodeFrame(&delta_frame);
+  EXPECT_EQ(kDeltaFrame, callback_.frame_types().back());
+  EncodeFrame(&key_frame);
+  EXPECT_EQ(kKeyFrame, callback_.frame_types().back());
+  for (int i = 0; i < kFramerate; ++i) {
+    EncodeFrame(i == 0 ? &key_frame : &delta_frame);
+    EXPECT_EQ(kDeltaFrame, callback_.frame_types().back());
+  }
+}
+
+// With automatic resizing, a bitrate far too low for the resolution makes
+// x264 encode at a high QP and the encoder steps the resolution down; with
+// plenty of bitrate the QP drops and the full resolution comes back.
+TEST_F(H264EncoderImplTest, AutomaticResizeFollowsBitrate) {
+  const int kFramesPerStep = 10 * kFramerate;
+  codec_settings_.codecSpecific.H264.automaticResizeOn = true;
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->SetRates(codec_settings_.minBitrate, kFramerate));
+  for (int i = 0; i < kFramesPerStep; ++i)
+    EncodeFrame(nullptr);
+  ASSERT_EQ(static_cast<size_t>(kFramesPerStep),
+            callback_.frame_widths().size());
+  EXPECT_EQ(kWidth, callback_.frame_widths().front());
+  EXPECT_LT(callback_.frame_widths().back(), kWidth);
+  EXPECT_GT(callback_.last_qp(), 0);
+
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->SetRates(codec_settings_.maxBitrate, kFramerate));
+  for (int i = 0; i < kFramesPerStep; ++i)
+    EncodeFrame(nullptr);
+  EXPECT_EQ(kWidth, callback_.frame_widths().back());
+}
+
+// x264 holds frames back in the high quality mode, which reopening the
+// encoder at a new resolution would lose.
+TEST_F(H264EncoderImplTest, RejectsAutomaticResizeInHighQualityMode) {
+  codec_settings_.codecSpecific.H264.automaticResizeOn = true;
+  codec_settings_.codecSpecific.H264.latencyMode = kH264HighQuality;
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERR_PARAMETER,
+            encoder_->InitEncode(&codec_settings_, 1, 0));
+}
+
+}  // namespace webrtc
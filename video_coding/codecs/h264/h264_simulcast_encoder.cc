@@ -0,0 +1,467 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#include "video_coding/codecs/h264/h264_simulcast_encoder.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/checks.h"
+#include "base/logging.h"
+#include "common_video/libyuv/include/scaler.h"
+#include "system_wrappers/interface/event_wrapper.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "video_coding/codecs/h264/h264_encoder_impl.h"
+
+namespace webrtc {
+
+namespace {
+
+uint32_t SumStreamTargetBitrate(size_t streams, const VideoCodec& codec) {
+  uint32_t bitrate_sum = 0;
+  for (size_t i = 0; i < streams; ++i)
+    bitrate_sum += codec.simulcastStream[i].targetBitrate;
+  return bitrate_sum;
+}
+
+size_t NumberOfStreams(const VideoCodec& codec) {
+  size_t streams =
+      codec.numberOfSimulcastStreams < 1 ? 1 : codec.numberOfSimulcastStreams;
+  uint32_t max_bitrate_sum = 0;
+  for (size_t i = 0; i < streams; ++i)
+    max_bitrate_sum += codec.simulcastStream[i].maxBitrate;
+  return max_bitrate_sum == 0 ? 1 : streams;
+}
+
+bool ValidSimulcastResolutions(const VideoCodec& codec, size_t num_streams) {
+  if (codec.width != codec.simulcastStream[num_streams - 1].width ||
+      codec.height != codec.simulcastStream[num_streams - 1].height) {
+    return false;
+  }
+  for (size_t i = 0; i < num_streams; ++i) {
+    if (codec.width * codec.simulcastStream[i].height !=
+        codec.height * codec.simulcastStream[i].width) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The bitrate of stream |stream_idx| out of |bitrate_kbit|, see
+// SimulcastEncoderAdapter::GetStreamBitrate. |send_stream| is set to whether
+// there is enough bitrate to send the stream at all.
+uint32_t StreamBitrate(const VideoCodec& codec,
+                       size_t stream_idx,
+                       size_t num_streams,
+                       uint32_t bitrate_kbit,
+                       bool* send_stream) {
+  if (num_streams == 1) {
+    *send_stream = true;
+    return bitrate_kbit;
+  }
+  uint32_t sum_target_lower_streams = SumStreamTargetBitrate(stream_idx, codec);
+  if (bitrate_kbit <
+      codec.simulcastStream[stream_idx].minBitrate + sum_target_lower_streams) {
+    *send_stream = false;
+    return stream_idx > 0 ? codec.simulcastStream[stream_idx - 1].maxBitrate
+                          : codec.simulcastStream[0].minBitrate;
+  }
+  *send_stream = true;
+  uint32_t stream_bitrate = bitrate_kbit - sum_target_lower_streams;
+  // The highest stream gets whatever the lower streams do not use.
+  if (stream_idx == num_streams - 1)
+    return stream_bitrate;
+  // Lower streams are capped at their target if the next stream is sent,
+  // otherwise at their max.
+  uint32_t max_rate = codec.simulcastStream[stream_idx].maxBitrate;
+  if (bitrate_kbit >= SumStreamTargetBitrate(stream_idx + 1, codec) +
+                         codec.simulcastStream[stream_idx + 1].minBitrate) {
+    max_rate = codec.simulcastStream[stream_idx].targetBitrate;
+  }
+  return std::min(stream_bitrate, max_rate);
+}
+
+// The share of |number_of_cores| of stream |stream_idx|, by its number of
+// pixels. Every stream gets at least one core.
+int StreamCores(const VideoCodec& codec,
+                size_t stream_idx,
+                size_t num_streams,
+                int number_of_cores) {
+  if (num_streams == 1)
+    return number_of_cores;
+  int64_t total_pixels = 0;
+  for (size_t i = 0; i < num_streams; ++i) {
+    total_pixels += static_cast<int64_t>(codec.simulcastStream[i].width) *
+                    codec.simulcastStream[i].height;
+  }
+  const int64_t pixels =
+      static_cast<int64_t>(codec.simulcastStream[stream_idx].width) *
+      codec.simulcastStream[stream_idx].height;
+  return std::max(1, static_cast<int>((number_of_cores * pixels +
+                                       total_pixels / 2) / total_pixels));
+}
+
+}  // namespace
+
+// Forwards the output of one layer's encoder with the layer index.
+class H264SimulcastEncoder::LayerCallback : public EncodedImageCallback {
+ public:
+  LayerCallback(H264SimulcastEncoder* encoder, size_t layer)
+      : encoder_(encoder), layer_(layer) {}
+
+  int32_t Encoded(const EncodedImage& encoded_image,
+                  const CodecSpecificInfo* codec_specific_info,
+                  const RTPFragmentationHeader* fragmentation) override {
+    return encoder_->Encoded(layer_, encoded_image, codec_specific_info,
+                             fragmentation);
+  }
+
+ private:
+  H264SimulcastEncoder* const encoder_;
+  const size_t layer_;
+};
+
+// One simulcast stream: its encoder, the scaler producing its input and, with
+// more than one layer, the thread it encodes on.
+class H264SimulcastEncoder::Layer {
+ public:
+  Layer(H264SimulcastEncoder* parent, size_t index, int width, int height)
+      : send_stream_(true),
+        key_frame_request_(false),
+        callback_(parent, index),
+        width_(width),
+        height_(height),
+        scaler_src_width_(0),
+        scaler_src_height_(0),
+        frame_types_(1, kDeltaFrame),
+        input_(nullptr),
+        result_(WEBRTC_VIDEO_CODEC_OK),
+        stopping_(false) {
+    encoder_.RegisterEncodeCompleteCallback(&callback_);
+  }
+
+  ~Layer() {
+    if (thread_) {
+      stopping_ = true;
+      start_event_->Set();
+      thread_->Stop();
+    }
+  }
+
+  void StartThread() {
+    start_event_.reset(EventWrapper::Create());
+    done_event_.reset(EventWrapper::Create());
+    thread_ = ThreadWrapper::CreateThread(ThreadRun, this,
+                                          "H264SimulcastLayer");
+    RTC_CHECK(thread_->Start());
+    thread_->SetPriority(kHighPriority);
+  }
+
+  // Scales |src| to the size of this layer into |frame_|. The scaler is only
+  // reconfigured when the size of |src| changes.
+  const VideoFrame* Scale(const VideoFrame& src) {
+    if (src.width() == width_ && src.height() == height_)
+      return &src;
+    if (src.width() != scaler_src_width_ ||
+        src.height() != scaler_src_height_) {
+      // Box filtering averages all source pixels, the pyramid steps are
+      // typically 2:1.
+      if (scaler_.Set(src.width(), src.height(), width_, height_, kI420,
+                      kI420, kScaleBox) != 0) {
+        return nullptr;
+      }
+      scaler_src_width_ = src.width();
+      scaler_src_height_ = src.height();
+    }
+    if (scaler_.Scale(src, &frame_) != 0)
+      return nullptr;
+    frame_.set_timestamp(src.timestamp());
+    frame_.set_ntp_time_ms(src.ntp_time_ms());
+    frame_.set_render_time_ms(src.render_time_ms());
+    frame_.set_rotation(src.rotation());
+    return &frame_;
+  }
+
+  // Starts encoding |input| on the layer thread. |input| must stay valid
+  // until WaitForEncode returns.
+  void EncodeAsync(const VideoFrame* input) {
+    RTC_DCHECK(thread_);
+    input_ = input;
+    start_event_->Set();
+  }
+
+  int32_t WaitForEncode() {
+    done_event_->Wait(WEBRTC_EVENT_INFINITE);
+    input_ = nullptr;
+    return result_;
+  }
+
+  H264EncoderImpl* encoder() { return &encoder_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  std::vector<VideoFrameType>* frame_types() { return &frame_types_; }
+
+  // Only changed on the caller's thread while no layer is encoding.
+  bool send_stream_;
+  bool key_frame_request_;
+
+ private:
+  static bool ThreadRun(void* obj) {
+    return static_cast<Layer*>(obj)->Process();
+  }
+
+  bool Process() {
+    start_event_->Wait(WEBRTC_EVENT_INFINITE);
+    if (stopping_)
+      return false;
+    result_ = encoder_.Encode(*input_, nullptr, &frame_types_);
+    done_event_->Set();
+    return true;
+  }
+
+  LayerCallback callback_;
+  H264EncoderImpl encoder_;
+  const int width_;
+  const int height_;
+  Scaler scaler_;
+  int scaler_src_width_;
+  int scaler_src_height_;
+  VideoFrame frame_;
+  std::vector<VideoFrameType> frame_types_;
+
+  // Handed between the caller's thread and |thread_| through the events.
+  const VideoFrame* input_;
+  int32_t result_;
+  volatile bool stopping_;
+  rtc::scoped_ptr<EventWrapper> start_event_;
+  rtc::scoped_ptr<EventWrapper> done_event_;
+  rtc::scoped_ptr<ThreadWrapper> thread_;
+};
+
+H264SimulcastEncoder::H264SimulcastEncoder()
+    : encoded_image_callback_(nullptr) {
+  memset(&codec_settings_, 0, sizeof(codec_settings_));
+}
+
+H264SimulcastEncoder::~H264SimulcastEncoder() {
+  Release();
+}
+
+int32_t H264SimulcastEncoder::InitEncode(const VideoCodec* codec_settings,
+                                         int32_t number_of_cores,
+                                         size_t max_payload_size) {
+  if (codec_settings == nullptr || number_of_cores < 1)
+    return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+  Release();
+
+  const size_t num_layers = NumberOfStreams(*codec_settings);
+  if (num_layers > 1 &&
+      !ValidSimulcastResolutions(*codec_settings, num_layers)) {
+    return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+  }
+  codec_settings_ = *codec_settings;
+
+  for (size_t i = 0; i < num_layers; ++i) {
+    VideoCodec layer_settings = *codec_settings;
+    bool send_stream = true;
+    if (num_layers > 1) {
+      const SimulcastStream& stream = codec_settings->simulcastStream[i];
+      layer_settings.numberOfSimulcastStreams = 0;
+      layer_settings.width = stream.width;
+      layer_settings.height = stream.height;
+      layer_settings.maxBitrate = stream.maxBitrate;
+      layer_settings.minBitrate = stream.minBitrate;
+      layer_settings.targetBitrate = 0;
+      layer_settings.startBitrate =
+          StreamBitrate(*codec_settings, i, num_layers,
+                        codec_settings->startBitrate, &send_stream);
+      // The layer resolutions are fixed by the simulcast configuration.
+      layer_settings.codecSpecific.H264.automaticResizeOn = false;
+    }
+    Layer* layer =
+        new Layer(this, i, layer_settings.width, layer_settings.height);
+    layers_.push_back(layer);
+    layer->send_stream_ = send_stream;
+    // The layers encode at the same time, so they split the cores.
+    int32_t ret = layer->encoder()->InitEncode(
+        &layer_settings,
+        StreamCores(*codec_settings, i, num_layers, number_of_cores),
+        max_payload_size);
+    if (ret < 0) {
+      Release();
+      return ret;
+    }
+    if (num_layers > 1)
+      layer->StartThread();
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t H264SimulcastEncoder::Release() {
+  layers_.clear();
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t H264SimulcastEncoder::RegisterEncodeCompleteCallback(
+    EncodedImageCallback* callback) {
+  rtc::CritScope cs(&callback_crit_);
+  encoded_image_callback_ = callback;
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t H264SimulcastEncoder::Encode(
+    const VideoFrame& input_image,
+    const CodecSpecificInfo* codec_specific_info,
+    const std::vector<VideoFrameType>* frame_types) {
+  if (!IsInitialized())
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  if (layers_.size() == 1)
+    return layers_[0]->encoder()->Encode(input_image, codec_specific_info,
+                                         frame_types);
+  if (input_image.IsZeroSize())
+    return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+
+  const bool per_layer_frame_types =
+      frame_types && frame_types->size() == layers_.size();
+  bool key_frame_for_all = false;
+  if (frame_types && !per_layer_frame_types) {
+    key_frame_for_all = std::find(frame_types->begin(), frame_types->end(),
+                                  kKeyFrame) != frame_types->end();
+  }
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    Layer* layer = layers_[i];
+    bool key_frame = key_frame_for_all || layer->key_frame_request_ ||
+                     (per_layer_frame_types && (*frame_types)[i] == kKeyFrame);
+    // A layer that is not sent does not encode; the request is kept for
+    // when it is sent again.
+    if (key_frame && !layer->send_stream_) {
+      layer->key_frame_request_ = true;
+      key_frame = false;
+    } else if (key_frame) {
+      layer->key_frame_request_ = false;
+    }
+    (*layer->frame_types())[0] = key_frame ? kKeyFrame : kDeltaFrame;
+  }
+
+  // Walk down the pyramid. Every layer starts encoding as soon as its input
+  // is ready, and is the source of the next smaller layer. Layers that are
+  // not sent are not scaled either, the next smaller layer is scaled from
+  // the last one that is.
+  std::vector<Layer*> encoding;
+  const VideoFrame* src = &input_image;
+  int32_t ret = WEBRTC_VIDEO_CODEC_OK;
+  for (size_t i = layers_.size(); i-- > 0;) {
+    Layer* layer = layers_[i];
+    if (!layer->send_stream_)
+      continue;
+    const VideoFrame* layer_input = layer->Scale(*src);
+    if (!layer_input) {
+      LOG(LS_ERROR) << "Failed to scale " << src->width() << "x"
+                    << src->height() << " to " << layer->width() << "x"
+                    << layer->height() << ".";
+      ret = WEBRTC_VIDEO_CODEC_ERROR;
+      break;
+    }
+    layer->EncodeAsync(layer_input);
+    encoding.push_back(layer);
+    src = layer_input;
+  }
+  for (Layer* layer : encoding) {
+    int32_t layer_ret = layer->WaitForEncode();
+    if (layer_ret < 0 && ret == WEBRTC_VIDEO_CODEC_OK)
+      ret = layer_ret;
+  }
+  return ret;
+}
+
+int32_t H264SimulcastEncoder::SetChannelParameters(uint32_t packet_loss,
+                                                   int64_t rtt) {
+  for (Layer* layer : layers_)
+    layer->encoder()->SetChannelParameters(packet_loss, rtt);
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t H264SimulcastEncoder::SetRates(uint32_t bitrate, uint32_t framerate) {
+  if (!IsInitialized())
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  if (layers_.size() == 1)
+    return layers_[0]->encoder()->SetRates(bitrate, framerate);
+  if (bitrate == 0 || framerate == 0)
+    return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+  if (codec_settings_.maxBitrate > 0 && bitrate > codec_settings_.maxBitrate)
+    bitrate = codec_settings_.maxBitrate;
+  bitrate = std::max(bitrate, codec_settings_.minBitrate);
+
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    bool send_stream = true;
+    uint32_t layer_bitrate = StreamBitrate(codec_settings_, i, layers_.size(),
+                                           bitrate, &send_stream);
+    // A layer that starts to be sent again needs a key frame.
+    if (send_stream && !layers_[i]->send_stream_)
+      layers_[i]->key_frame_request_ = true;
+    layers_[i]->send_stream_ = send_stream;
+    if (!send_stream)
+      continue;
+    int32_t ret = layers_[i]->encoder()->SetRates(
+        std::max<uint32_t>(layer_bitrate, 1), framerate);
+    if (ret < 0)
+      return ret;
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t H264SimulcastEncoder::SetLayerRates(size_t layer,
+                                            uint32_t bitrate,
+                                            uint32_t framerate) {
+  if (!IsInitialized())
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  if (layer >= layers_.size())
+    return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+  return layers_[layer]->encoder()->SetRates(bitrate, framerate);
+}
+
+int32_t H264SimulcastEncoder::SetPeriodicKeyFrames(bool enable) {
+  for (Layer* layer : layers_)
+    layer->encoder()->SetPeriodicKeyFrames(enable);
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+void H264SimulcastEncoder::OnDroppedFrame() {
+  for (Layer* layer : layers_)
+    layer->encoder()->OnDroppedFrame();
+}
+
+bool H264SimulcastEncoder::IsInitialized() const {
+  return !layers_.empty();
+}
+
+int32_t H264SimulcastEncoder::Encoded(
+    size_t layer,
+    const EncodedImage& encoded_image,
+    const CodecSpecificInfo* codec_specific_info,
+    const RTPFragmentationHeader* fragmentation) {
+  CodecSpecificInfo layer_codec_specific;
+  memset(&layer_codec_specific, 0, sizeof(layer_codec_specific));
+  if (codec_specific_info)
+    layer_codec_specific = *codec_specific_info;
+  layer_codec_specific.codecType = kVideoCodecH264;
+  layer_codec_specific.codecSpecific.H264.simulcast_idx =
+      static_cast<uint8_t>(layer);
+
+  rtc::CritScope cs(&callback_crit_);
+  if (!encoded_image_callback_)
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  return encoded_image_callback_->Encoded(encoded_image, &layer_codec_specific,
+                                          fragmentation);
+}
+
+}  // namespace webrtc
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_H264_SIMULCAST_ENCODER_H_
+#define WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_H264_SIMULCAST_ENCODER_H_
+
+#include <vector>
+
+#include "base/criticalsection.h"
+#include "system_wrappers/interface/scoped_vector.h"
+#include "video_coding/codecs/h264/include/h264.h"
+
+namespace webrtc {
+
+// H.264 simulcast on top of H264EncoderImpl, one encoder per simulcast stream
+// (layer). Without simulcast it passes everything to a single encoder.
+//
+// The layers are downscaled as a pyramid: each layer is scaled from the next
+// larger one rather than from the input, so the input is read once and every
+// further scale costs a quarter of the previous one for 2:1 steps. Layers
+// that are not sent are skipped. Each layer encodes on its own thread; the top layer starts while the lower layers are
+// still being scaled. Encode returns when all layers are done, so the
+// encoders, like the callers of a single encoder, never see two frames at
+// once. Encode complete callbacks come from the layer threads, one at a time,
+// with |codecSpecific.H264.simulcast_idx| set.
+//
+// All public methods are expected to be called on the same thread.
+class H264SimulcastEncoder : public H264Encoder {
+ public:
+  H264SimulcastEncoder();
+  ~H264SimulcastEncoder() override;
+
+  // The layers are described by |codec_settings->simulcastStream|, which must
+  // all have the aspect ratio of |codec_settings|, the last one at its full
+  // resolution. |number_of_cores| is split between the layers by their number
+  // of pixels. Otherwise see H264EncoderImpl::InitEncode.
+  int32_t InitEncode(const VideoCodec* codec_settings,
+                     int32_t number_of_cores,
+                     size_t max_payload_size) override;
+  int32_t Release() override;
+  int32_t RegisterEncodeCompleteCallback(
+      EncodedImageCallback* callback) override;
+  // If |frame_types| has one entry per layer, only the layers with kKeyFrame
+  // encode a key frame. Otherwise a kKeyFrame entry applies to all layers.
+  int32_t Encode(const VideoFrame& frame,
+                 const CodecSpecificInfo* codec_specific_info,
+                 const std::vector<VideoFrameType>* frame_types) override;
+  int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt) override;
+  // Splits |bitrate| between the layers the way SimulcastEncoderAdapter does:
+  // lower layers get their target bitrate first, a layer that does not get its
+  // min bitrate is not sent.
+  int32_t SetRates(uint32_t bitrate, uint32_t framerate) override;
+  int32_t SetPeriodicKeyFrames(bool enable) override;
+  void OnDroppedFrame() override;
+
+  // Sets the rates of |layer| alone, e.g. for an SFU that allocates the
+  // bandwidth of each layer itself. Layer 0 is the smallest.
+  int32_t SetLayerRates(size_t layer, uint32_t bitrate, uint32_t framerate);
+
+ private:
+  class Layer;
+  class LayerCallback;
+
+  bool IsInitialized() const;
+  // Called by the LayerCallback of |layer|, on the layer's thread.
+  int32_t Encoded(size_t layer,
+                  const EncodedImage& encoded_image,
+                  const CodecSpecificInfo* codec_specific_info,
+                  const RTPFragmentationHeader* fragmentation);
+
+  VideoCodec codec_settings_;
+  // The smallest first.
+  ScopedVector<Layer> layers_;
+  // Serializes the calls to |encoded_image_callback_|.
+  rtc::CriticalSection callback_crit_;
+  EncodedImageCallback* encoded_image_callback_;
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_H264_SIMULCAST_ENCODER_H_
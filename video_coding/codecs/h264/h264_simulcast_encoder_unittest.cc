@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include "base/scoped_ptr.h"
+#include "video_coding/codecs/h264/h264_simulcast_encoder.h"
+#include "video_coding/codecs/h264/test/synthetic_frame_source.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kNumLayers = 3;
+const int kWidth = 640;
+const int kHeight = 360;
+const int kFramerate = 30;
+
+struct EncodedLayerFrame {
+  int simulcast_idx;
+  uint32_t width;
+  uint32_t height;
+  VideoFrameType frame_type;
+};
+
+// Called from the layer threads, but never by two at once.
+class LayerFrameCallback : public EncodedImageCallback {
+ public:
+  int32_t Encoded(const EncodedImage& encoded_image,
+                  const CodecSpecificInfo* codec_specific_info,
+                  const RTPFragmentationHeader* fragmentation) override {
+    EXPECT_EQ(kVideoCodecH264, codec_specific_info->codecType);
+    EncodedLayerFrame frame;
+    frame.simulcast_idx = codec_specific_info->codecSpecific.H264.simulcast_idx;
+    frame.width = encoded_image._encodedWidth;
+    frame.height = encoded_image._encodedHeight;
+    frame.frame_type = encoded_image._frameType;
+    frames_.push_back(frame);
+    return 0;
+  }
+
+  // Returns the frames of the last Encode call, indexed by simulcast_idx.
+  // Layers without output have frame_type kSkipFrame.
+  std::vector<EncodedLayerFrame> TakeFrames() {
+    EncodedLayerFrame none = {-1, 0, 0, kSkipFrame};
+    std::vector<EncodedLayerFrame> by_layer(kNumLayers, none);
+    for (const EncodedLayerFrame& frame : frames_) {
+      EXPECT_LT(frame.simulcast_idx, kNumLayers);
+      by_layer[frame.simulcast_idx] = frame;
+    }
+    frames_.clear();
+    return by_layer;
+  }
+
+ private:
+  std::vector<EncodedLayerFrame> frames_;
+};
+
+}  // namespace
+
+class H264SimulcastEncoderTest : public ::testing::Test {
+ protected:
+  H264SimulcastEncoderTest() : source_(kWidth, kHeight, kFramerate) {}
+
+  void SetUp() override {
+    memset(&codec_settings_, 0, sizeof(codec_settings_));
+    codec_settings_.codecType = kVideoCodecH264;
+    codec_settings_.width = kWidth;
+    codec_settings_.height = kHeight;
+    codec_settings_.maxFramerate = kFramerate;
+    codec_settings_.minBitrate = 30;
+    codec_settings_.codecSpecific.H264 =
+        VideoEncoder::GetDefaultH264Settings();
+    codec_settings_.numberOfSimulcastStreams = kNumLayers;
+    const uint32_t kMinBitrates[] = {30, 150, 600};
+    const uint32_t kTargetBitrates[] = {100, 450, 1200};
+    const uint32_t kMaxBitrates[] = {150, 600, 2000};
+    uint32_t max_bitrate = 0;
+    for (int i = 0; i < kNumLayers; ++i) {
+      SimulcastStream* stream = &codec_settings_.simulcastStream[i];
+      stream->width = kWidth >> (kNumLayers - 1 - i);
+      stream->height = kHeight >> (kNumLayers - 1 - i);
+      stream->minBitrate = kMinBitrates[i];
+      stream->targetBitrate = kTargetBitrates[i];
+      stream->maxBitrate = kMaxBitrates[i];
+      max_bitrate += kTargetBitrates[i];
+    }
+    codec_settings_.maxBitrate = max_bitrate + 1000;
+    codec_settings_.startBitrate = max_bitrate;
+    encoder_.reset(new H264SimulcastEncoder());
+    encoder_->RegisterEncodeCompleteCallback(&callback_);
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              encoder_->InitEncode(&codec_settings_, 2, 0));
+  }
+
+  std::vector<EncodedLayerFrame> EncodeFrame(
+      const std::vector<VideoFrameType>* frame_types) {
+    EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              encoder_->Encode(source_.NextFrame(), nullptr, frame_types));
+    return callback_.TakeFrames();
+  }
+
+  VideoCodec codec_settings_;
+  test::SyntheticFrameSource source_;
+  LayerFrameCallback callback_;
+  rtc::scoped_ptr<H264SimulcastEncoder> encoder_;
+};
+
+TEST_F(H264SimulcastEncoderTest, EncodesEveryLayerAtItsResolution) {
+  for (int i = 0; i < 5; ++i) {
+    std::vector<EncodedLayerFrame> frames = EncodeFrame(nullptr);
+    for (int layer = 0; layer < kNumLayers; ++layer) {
+      EXPECT_EQ(layer, frames[layer].simulcast_idx);
+      EXPECT_EQ(codec_settings_.simulcastStream[layer].width,
+                frames[layer].width);
+      EXPECT_EQ(codec_settings_.simulcastStream[layer].height,
+                frames[layer].height);
+      EXPECT_EQ(i == 0 ? kKeyFrame : kDeltaFrame, frames[layer].frame_type)
+          << "frame " << i << ", layer " << layer;
+    }
+  }
+}
+
+// With one frame type per layer, a key frame request only affects its layer.
+TEST_F(H264SimulcastEncoderTest, KeyFrameRequestPerLayer) {
+  std::vector<VideoFrameType> frame_types(kNumLayers, kDeltaFrame);
+  EncodeFrame(&frame_types);
+  frame_types[1] = kKeyFrame;
+  std::vector<EncodedLayerFrame> frames = EncodeFrame(&frame_types);
+  EXPECT_EQ(kDeltaFrame, frames[0].frame_type);
+  EXPECT_EQ(kKeyFrame, frames[1].frame_type);
+  EXPECT_EQ(kDeltaFrame, frames[2].frame_type);
+
+  // A single key frame entry applies to all layers.
+  std::vector<VideoFrameType> key_frame(1, kKeyFrame);
+  frames = EncodeFrame(&key_frame);
+  for (int layer = 0; layer < kNumLayers; ++layer)
+    EXPECT_EQ(kKeyFrame, frames[layer].frame_type) << "layer " << layer;
+}
+
+// Layers that do not get their min bitrate are not encoded, and start again
+// with a key frame. The lowest layer is then scaled from the input directly.
+TEST_F(H264SimulcastEncoderTest, LowBitrateStopsUpperLayers) {
+  EncodeFrame(nullptr);
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder_->SetRates(120, kFramerate));
+  std::vector<EncodedLayerFrame> frames = EncodeFrame(nullptr);
+  EXPECT_EQ(kDeltaFrame, frames[0].frame_type);
+  EXPECT_EQ(codec_settings_.simulcastStream[0].width, frames[0].width);
+  EXPECT_EQ(codec_settings_.simulcastStream[0].height, frames[0].height);
+  EXPECT_EQ(kSkipFrame, frames[1].frame_type);
+  EXPECT_EQ(kSkipFrame, frames[2].frame_type);
+
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder_->SetRates(codec_settings_.startBitrate, kFramerate));
+  frames = EncodeFrame(nullptr);
+  EXPECT_EQ(kDeltaFrame, frames[0].frame_type);
+  EXPECT_EQ(kKeyFrame, frames[1].frame_type);
+  EXPECT_EQ(kKeyFrame, frames[2].frame_type);
+}
+
+}  // namespace webrtc
@@ -103,6 +103,7 @@ struct FrameEncodeParams {
     if (csi) {
       codec_specific_info = *csi;
     } else {
+      memset(&codec_specific_info, 0, sizeof(codec_specific_info));
       codec_specific_info.codecType = webrtc::kVideoCodecH264;
     }
   }
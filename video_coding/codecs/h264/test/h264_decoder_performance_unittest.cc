@@ -0,0 +1,308 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include "base/checks.h"
+#include "base/scoped_ptr.h"
+#include "base/stringencode.h"
+#include "system_wrappers/interface/cpu_info.h"
+#include "system_wrappers/interface/event_wrapper.h"
+#include "system_wrappers/interface/scoped_vector.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "system_wrappers/interface/tick_util.h"
+#include "test/testsupport/perf_test.h"
+#include "video_coding/codecs/h264/h264_decoder_impl.h"
+#include "video_coding/codecs/h264/test/synthetic_h264_stream.h"
+#include "video_coding/main/source/gop_parallel_decoder.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kFramerate = 30;
+
+class DecodedFrameCountCallback : public DecodedImageCallback {
+ public:
+  DecodedFrameCountCallback() : frames_(0) {}
+
+  int32_t Decoded(VideoFrame& decoded_image) override {
+    ++frames_;
+    return 0;
+  }
+
+  int frames() const { return frames_; }
+
+ private:
+  int frames_;
+};
+
+// Decodes a pre-encoded stream as fast as possible and reports frames per
+// second and frame buffer allocations per decoded frame. Without buffer
+// pooling every decoded frame costs one allocation.
+void RunDecodeTest(int width,
+                   int height,
+                   int bitrate_kbps,
+                   const std::string& trace) {
+  const int kNumStreamFrames = 60;
+  const int kNumLoops = 5;
+  test::SyntheticH264Stream stream(width, height, kFramerate, bitrate_kbps,
+                                   kNumStreamFrames, kNumStreamFrames);
+  ASSERT_EQ(static_cast<size_t>(kNumStreamFrames), stream.num_frames());
+
+  DecodedFrameCountCallback callback;
+  rtc::scoped_ptr<H264DecoderImpl> decoder(new H264DecoderImpl());
+  decoder->RegisterDecodeCompleteCallback(&callback);
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder->InitDecode(nullptr, 1));
+
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  for (int loop = 0; loop < kNumLoops; ++loop) {
+    // Every loop starts with the key frame of the stream.
+    for (size_t i = 0; i < stream.num_frames(); ++i) {
+      ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+                decoder->Decode(stream.frame(i), false, nullptr));
+    }
+  }
+  const int64_t elapsed_ms =
+      std::max<int64_t>(1, TickTime::MillisecondTimestamp() - start_ms);
+  ASSERT_EQ(kNumLoops * kNumStreamFrames, callback.frames());
+
+  test::PrintResult("h264_decoder_throughput", "", trace,
+                    callback.frames() * 1000.0 / elapsed_ms, "fps", true);
+  test::PrintResult(
+      "h264_decoder_allocations", "", trace,
+      static_cast<double>(decoder->NumFrameBufferAllocations()) /
+          callback.frames(),
+      "allocations/frame", false);
+}
+
+// Decodes one stream on its own thread, as a receive stream would, one
+// frame per thread iteration.
+class StreamDecoder {
+ public:
+  StreamDecoder(const test::SyntheticH264Stream* stream,
+                H264ThreadingMode threading_mode,
+                int number_of_cores,
+                int width,
+                int height)
+      : stream_(stream),
+        next_frame_(0),
+        done_(EventWrapper::Create()),
+        thread_(ThreadWrapper::CreateThread(Run, this, "StreamDecoder")) {
+    VideoCodec codec_settings;
+    memset(&codec_settings, 0, sizeof(codec_settings));
+    codec_settings.codecType = kVideoCodecH264;
+    codec_settings.width = width;
+    codec_settings.height = height;
+    codec_settings.codecSpecific.H264 = VideoEncoder::GetDefaultH264Settings();
+    codec_settings.codecSpecific.H264.threadingMode = threading_mode;
+    decoder_.RegisterDecodeCompleteCallback(&callback_);
+    RTC_CHECK_EQ(WEBRTC_VIDEO_CODEC_OK,
+                 decoder_.InitDecode(&codec_settings, number_of_cores));
+  }
+
+  void Start() { thread_->Start(); }
+  bool WaitAndStop() {
+    bool done = done_->Wait(60000) == kEventSignaled;
+    thread_->Stop();
+    return done;
+  }
+  int frames() const { return callback_.frames(); }
+
+ private:
+  static bool Run(void* obj) {
+    return static_cast<StreamDecoder*>(obj)->DecodeNextFrame();
+  }
+
+  bool DecodeNextFrame() {
+    if (next_frame_ < stream_->num_frames()) {
+      EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+                decoder_.Decode(stream_->frame(next_frame_++), false,
+                                nullptr));
+      return true;
+    }
+    EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder_.Flush());
+    done_->Set();
+    return false;
+  }
+
+  const test::SyntheticH264Stream* const stream_;
+  size_t next_frame_;
+  DecodedFrameCountCallback callback_;
+  H264DecoderImpl decoder_;
+  rtc::scoped_ptr<EventWrapper> done_;
+  rtc::scoped_ptr<ThreadWrapper> thread_;
+};
+
+// Decodes |num_streams| copies of a 720p stream concurrently, each decoder
+// told it may use all cores like VCM does, and reports the aggregate and the
+// per-stream frame rate.
+void RunMultiStreamTest(int num_streams,
+                        H264ThreadingMode threading_mode,
+                        const std::string& trace) {
+  const int kWidth = 1280;
+  const int kHeight = 720;
+  const int kNumStreamFrames = 90;
+  test::SyntheticH264Stream stream(kWidth, kHeight, kFramerate, 2500,
+                                   kNumStreamFrames, kNumStreamFrames);
+  const int number_of_cores = CpuInfo::DetectNumberOfCores();
+
+  std::vector<StreamDecoder*> decoders;
+  for (int i = 0; i < num_streams; ++i) {
+    decoders.push_back(new StreamDecoder(&stream, threading_mode,
+                                         number_of_cores, kWidth, kHeight));
+  }
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  for (StreamDecoder* decoder : decoders)
+    decoder->Start();
+  int total_frames = 0;
+  for (StreamDecoder* decoder : decoders) {
+    EXPECT_TRUE(decoder->WaitAndStop());
+    EXPECT_EQ(kNumStreamFrames, decoder->frames());
+    total_frames += decoder->frames();
+  }
+  const int64_t elapsed_ms =
+      std::max<int64_t>(1, TickTime::MillisecondTimestamp() - start_ms);
+  for (StreamDecoder* decoder : decoders)
+    delete decoder;
+
+  const double fps = total_frames * 1000.0 / elapsed_ms;
+  test::PrintResult("h264_decoder_multi_stream", "_total", trace, fps, "fps",
+                    true);
+  test::PrintResult("h264_decoder_multi_stream", "_per_stream", trace,
+                    fps / num_streams, "fps", true);
+}
+
+void RunMultiStreamTests(int num_streams) {
+  std::string name = "720p_" + rtc::ToString(num_streams) + "_streams";
+  RunMultiStreamTest(num_streams, kH264SlicedThreads, name + "_slice");
+  RunMultiStreamTest(num_streams, kH264FrameThreads, name + "_frame");
+}
+
+// Counts the frames a GopParallelDecoder delivers and checks that they are in
+// timestamp order.
+class OrderedFrameCallback : public DecodedImageCallback {
+ public:
+  explicit OrderedFrameCallback(int expected_frames)
+      : done_(EventWrapper::Create()),
+        expected_frames_(expected_frames),
+        frames_(0),
+        last_timestamp_(0) {}
+
+  // Delivery is serialized, frames are counted on one thread at a time.
+  int32_t Decoded(VideoFrame& decoded_image) override {
+    if (frames_ > 0) {
+      EXPECT_TRUE(IsNewerTimestamp(decoded_image.timestamp(), last_timestamp_));
+    }
+    last_timestamp_ = decoded_image.timestamp();
+    if (++frames_ == expected_frames_)
+      done_->Set();
+    return 0;
+  }
+
+  bool Wait() { return done_->Wait(60000) == kEventSignaled; }
+
+ private:
+  rtc::scoped_ptr<EventWrapper> done_;
+  const int expected_frames_;
+  int frames_;
+  uint32_t last_timestamp_;
+};
+
+// Decodes |stream| as fast as possible with a GopParallelDecoder of
+// |num_decoders| decoders and returns the frame rate.
+double RunGopParallelDecode(const test::SyntheticH264Stream& stream,
+                            const VideoCodec& codec_settings,
+                            int num_decoders) {
+  ScopedVector<H264DecoderImpl> decoders;
+  std::vector<VideoDecoder*> decoder_ptrs;
+  for (int i = 0; i < num_decoders; ++i) {
+    decoders.push_back(new H264DecoderImpl());
+    decoder_ptrs.push_back(decoders.back());
+  }
+  const int num_frames = static_cast<int>(stream.num_frames());
+  OrderedFrameCallback callback(num_frames);
+  GopParallelDecoder decoder(decoder_ptrs);
+  decoder.RegisterDecodeCompleteCallback(&callback);
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            decoder.InitDecode(&codec_settings,
+                               CpuInfo::DetectNumberOfCores()));
+
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  for (int i = 0; i < num_frames; ++i) {
+    EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              decoder.Decode(stream.frame(i), false, nullptr, nullptr, -1));
+  }
+  EXPECT_TRUE(callback.Wait());
+  const int64_t elapsed_ms =
+      std::max<int64_t>(1, TickTime::MillisecondTimestamp() - start_ms);
+  return num_frames * 1000.0 / elapsed_ms;
+}
+
+}  // namespace
+
+TEST(H264DecoderPerformanceTest, Decode720p) {
+  RunDecodeTest(1280, 720, 2500, "720p");
+}
+
+TEST(H264DecoderPerformanceTest, Decode1080p) {
+  RunDecodeTest(1920, 1080, 4000, "1080p");
+}
+
+// Decodes a long 720p stream, one GOP per decoder in parallel as in the
+// throughput mode of the receiver, with up to one decoder per core. Reports
+// the frame rate and the speedup over a single decoder.
+TEST(H264DecoderPerformanceTest, GopParallelDecode720p) {
+  const int kWidth = 1280;
+  const int kHeight = 720;
+  const int kGopLength = 30;
+  const int kNumStreamFrames = 40 * kGopLength;
+  test::SyntheticH264Stream stream(kWidth, kHeight, kFramerate, 2500,
+                                   kGopLength, kNumStreamFrames);
+  VideoCodec codec_settings;
+  memset(&codec_settings, 0, sizeof(codec_settings));
+  codec_settings.codecType = kVideoCodecH264;
+  codec_settings.width = kWidth;
+  codec_settings.height = kHeight;
+  codec_settings.codecSpecific.H264 = VideoEncoder::GetDefaultH264Settings();
+
+  const int num_cores = CpuInfo::DetectNumberOfCores();
+  double single_decoder_fps = 0;
+  for (int num_decoders = 1; num_decoders <= num_cores; num_decoders *= 2) {
+    const double fps =
+        RunGopParallelDecode(stream, codec_settings, num_decoders);
+    if (num_decoders == 1)
+      single_decoder_fps = fps;
+    std::string trace = "720p_" + rtc::ToString(num_decoders) + "_decoders";
+    test::PrintResult("h264_gop_parallel_decode", "", trace, fps, "fps",
+                      true);
+    test::PrintResult("h264_gop_parallel_decode_speedup", "", trace,
+                      fps / single_decoder_fps, "x", true);
+  }
+}
+
+TEST(H264DecoderPerformanceTest, MultiStream1) {
+  RunMultiStreamTests(1);
+}
+
+TEST(H264DecoderPerformanceTest, MultiStream4) {
+  RunMultiStreamTests(4);
+}
+
+TEST(H264DecoderPerformanceTest, MultiStream16) {
+  RunMultiStreamTests(16);
+}
+
+}  // namespace webrtc
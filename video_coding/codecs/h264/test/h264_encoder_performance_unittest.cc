@@ -0,0 +1,354 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include "base/scoped_ptr.h"
+#include "base/stringencode.h"
+#include "common_video/libyuv/include/scaler.h"
+#include "system_wrappers/interface/scoped_vector.h"
+#include "system_wrappers/interface/sleep.h"
+#include "system_wrappers/interface/tick_util.h"
+#include "test/testsupport/perf_test.h"
+#include "video_coding/codecs/h264/h264_encoder_impl.h"
+#include "video_coding/codecs/h264/h264_simulcast_encoder.h"
+#include "video_coding/codecs/h264/test/synthetic_frame_source.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 480;
+const int kFramerate = 30;
+const int kBitrateKbps = 800;
+
+// Records, for every output frame, how many input frames and how many
+// milliseconds it spent inside the encoder.
+class LatencyCallback : public EncodedImageCallback {
+ public:
+  LatencyCallback()
+      : frames_in_(0), frames_out_(0), sum_delay_frames_(0),
+        sum_delay_ms_(0), max_delay_frames_(0), max_delay_ms_(0) {}
+
+  void OnFrameIn(uint32_t timestamp) {
+    inputs_[timestamp] = Input(frames_in_++, TickTime::MillisecondTimestamp());
+  }
+
+  int32_t Encoded(const EncodedImage& encoded_image,
+                  const CodecSpecificInfo* codec_specific_info,
+                  const RTPFragmentationHeader* fragmentation) override {
+    std::map<uint32_t, Input>::iterator it =
+        inputs_.find(encoded_image._timeStamp);
+    EXPECT_TRUE(it != inputs_.end());
+    if (it == inputs_.end())
+      return 0;
+    // |frames_in_| already counts the frame whose Encode call produced this
+    // output.
+    int delay_frames = frames_in_ - 1 - it->second.index;
+    int64_t delay_ms = TickTime::MillisecondTimestamp() - it->second.time_ms;
+    inputs_.erase(it);
+    ++frames_out_;
+    sum_delay_frames_ += delay_frames;
+    sum_delay_ms_ += delay_ms;
+    max_delay_frames_ = std::max(max_delay_frames_, delay_frames);
+    max_delay_ms_ = std::max(max_delay_ms_, delay_ms);
+    return 0;
+  }
+
+  int frames_out() const { return frames_out_; }
+  double mean_delay_frames() const {
+    return static_cast<double>(sum_delay_frames_) / frames_out_;
+  }
+  double mean_delay_ms() const {
+    return static_cast<double>(sum_delay_ms_) / frames_out_;
+  }
+  int max_delay_frames() const { return max_delay_frames_; }
+  int64_t max_delay_ms() const { return max_delay_ms_; }
+
+ private:
+  struct Input {
+    Input() : index(0), time_ms(0) {}
+    Input(int index, int64_t time_ms) : index(index), time_ms(time_ms) {}
+    int index;
+    int64_t time_ms;
+  };
+
+  std::map<uint32_t, Input> inputs_;
+  int frames_in_;
+  int frames_out_;
+  int64_t sum_delay_frames_;
+  int64_t sum_delay_ms_;
+  int max_delay_frames_;
+  int64_t max_delay_ms_;
+};
+
+// Feeds |num_frames| frames in real time and reports the frames-in to
+// NALs-out delay of |latency_mode|.
+void RunLatencyTest(H264LatencyMode latency_mode,
+                    VideoCodecProfile profile,
+                    const std::string& trace,
+                    int num_frames) {
+  VideoCodec codec_settings;
+  memset(&codec_settings, 0, sizeof(codec_settings));
+  codec_settings.codecType = kVideoCodecH264;
+  codec_settings.width = kWidth;
+  codec_settings.height = kHeight;
+  codec_settings.maxFramerate = kFramerate;
+  codec_settings.startBitrate = kBitrateKbps;
+  codec_settings.maxBitrate = kBitrateKbps;
+  codec_settings.codecSpecific.H264 = VideoEncoder::GetDefaultH264Settings();
+  codec_settings.codecSpecific.H264.latencyMode = latency_mode;
+  codec_settings.codecSpecific.H264.profile = profile;
+
+  LatencyCallback callback;
+  rtc::scoped_ptr<H264EncoderImpl> encoder(new H264EncoderImpl());
+  encoder->RegisterEncodeCompleteCallback(&callback);
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder->InitEncode(&codec_settings, 4, 0));
+
+  test::SyntheticFrameSource source(kWidth, kHeight, kFramerate);
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  for (int i = 0; i < num_frames; ++i) {
+    // Pace the input like a camera would.
+    int64_t due_ms = start_ms + i * 1000 / kFramerate;
+    int64_t now_ms = TickTime::MillisecondTimestamp();
+    if (due_ms > now_ms)
+      SleepMs(static_cast<int>(due_ms - now_ms));
+    const VideoFrame& frame = source.NextFrame();
+    callback.OnFrameIn(frame.timestamp());
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder->Encode(frame, nullptr, nullptr));
+  }
+  ASSERT_GT(callback.frames_out(), 0);
+
+  test::PrintResult("h264_encoder_latency", "_mean", trace,
+                    callback.mean_delay_frames(), "frames", true);
+  test::PrintResult("h264_encoder_latency", "_max", trace,
+                    static_cast<size_t>(callback.max_delay_frames()), "frames",
+                    false);
+  test::PrintResult("h264_encoder_latency", "_mean", trace,
+                    callback.mean_delay_ms(), "ms", true);
+  test::PrintResult("h264_encoder_latency", "_max", trace,
+                    static_cast<size_t>(callback.max_delay_ms()), "ms", false);
+}
+
+class FrameCountCallback : public EncodedImageCallback {
+ public:
+  FrameCountCallback() : frames_(0) {}
+
+  int32_t Encoded(const EncodedImage& encoded_image,
+                  const CodecSpecificInfo* codec_specific_info,
+                  const RTPFragmentationHeader* fragmentation) override {
+    ++frames_;
+    return 0;
+  }
+
+  int frames() const { return frames_; }
+
+ private:
+  int frames_;
+};
+
+// Encodes as fast as possible with |num_threads| x264 threads and reports
+// frames per second, including the frames held by frame threads at the end.
+// The input is rendered up front so that only encoding is measured.
+void RunThroughputTest(int width,
+                       int height,
+                       H264ThreadingMode threading_mode,
+                       int num_threads,
+                       const std::string& trace) {
+  const int kNumSourceFrames = 30;
+  const int kNumFrames = 120;
+  VideoCodec codec_settings;
+  memset(&codec_settings, 0, sizeof(codec_settings));
+  codec_settings.codecType = kVideoCodecH264;
+  codec_settings.width = width;
+  codec_settings.height = height;
+  codec_settings.maxFramerate = kFramerate;
+  codec_settings.startBitrate = 2500;
+  codec_settings.maxBitrate = 2500;
+  codec_settings.codecSpecific.H264 = VideoEncoder::GetDefaultH264Settings();
+  codec_settings.codecSpecific.H264.threadingMode = threading_mode;
+
+  test::SyntheticFrameSource source(width, height, kFramerate);
+  std::vector<VideoFrame> frames(kNumSourceFrames);
+  for (size_t i = 0; i < frames.size(); ++i)
+    frames[i].CopyFrame(source.NextFrame());
+
+  FrameCountCallback callback;
+  rtc::scoped_ptr<H264EncoderImpl> encoder(new H264EncoderImpl());
+  encoder->RegisterEncodeCompleteCallback(&callback);
+  encoder->SetNumberOfThreadsForTesting(num_threads);
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            encoder->InitEncode(&codec_settings, num_threads, 0));
+
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  for (int i = 0; i < kNumFrames; ++i) {
+    VideoFrame frame = frames[i % kNumSourceFrames];
+    frame.set_timestamp(static_cast<uint32_t>(i * 90000 / kFramerate));
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder->Encode(frame, nullptr, nullptr));
+  }
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder->Flush());
+  const int64_t elapsed_ms =
+      std::max<int64_t>(1, TickTime::MillisecondTimestamp() - start_ms);
+  ASSERT_EQ(kNumFrames, callback.frames());
+
+  test::PrintResult("h264_encoder_throughput", "", trace,
+                    kNumFrames * 1000.0 / elapsed_ms, "fps", true);
+}
+
+void RunThroughputTests(int width, int height, const std::string& name) {
+  const int kThreads[] = {1, 2, 4, 8};
+  for (int threads : kThreads) {
+    std::string suffix = "_" + rtc::ToString(threads) + "_threads";
+    RunThroughputTest(width, height, kH264SlicedThreads, threads,
+                      name + "_sliced" + suffix);
+    RunThroughputTest(width, height, kH264FrameThreads, threads,
+                      name + "_frame" + suffix);
+  }
+}
+
+// 1080p, 540p and 270p, the smallest first.
+const int kNumSimulcastLayers = 3;
+
+VideoCodec SimulcastCodecSettings() {
+  const uint32_t kLayerBitrates[] = {300, 1000, 3000};
+  VideoCodec codec_settings;
+  memset(&codec_settings, 0, sizeof(codec_settings));
+  codec_settings.codecType = kVideoCodecH264;
+  codec_settings.width = 1920;
+  codec_settings.height = 1080;
+  codec_settings.maxFramerate = kFramerate;
+  codec_settings.codecSpecific.H264 = VideoEncoder::GetDefaultH264Settings();
+  codec_settings.numberOfSimulcastStreams = kNumSimulcastLayers;
+  for (int i = 0; i < kNumSimulcastLayers; ++i) {
+    SimulcastStream* stream = &codec_settings.simulcastStream[i];
+    stream->width = codec_settings.width >> (kNumSimulcastLayers - 1 - i);
+    stream->height = codec_settings.height >> (kNumSimulcastLayers - 1 - i);
+    stream->minBitrate = kLayerBitrates[i] / 2;
+    stream->targetBitrate = kLayerBitrates[i];
+    stream->maxBitrate = kLayerBitrates[i];
+    codec_settings.startBitrate += kLayerBitrates[i];
+  }
+  codec_settings.maxBitrate = codec_settings.startBitrate;
+  return codec_settings;
+}
+
+// Encodes the three layers either with H264SimulcastEncoder, or with one
+// H264EncoderImpl per layer each scaling from the source, and reports the
+// CPU time per input frame over all threads, and frames per second.
+void RunSimulcastTest(bool shared_scaling, const std::string& trace) {
+  const int kNumSourceFrames = 30;
+  const int kNumFrames = 120;
+  VideoCodec codec_settings = SimulcastCodecSettings();
+  test::SyntheticFrameSource source(codec_settings.width,
+                                    codec_settings.height, kFramerate);
+  std::vector<VideoFrame> frames(kNumSourceFrames);
+  for (size_t i = 0; i < frames.size(); ++i)
+    frames[i].CopyFrame(source.NextFrame());
+
+  FrameCountCallback callback;
+  rtc::scoped_ptr<H264SimulcastEncoder> simulcast_encoder;
+  ScopedVector<H264EncoderImpl> encoders;
+  ScopedVector<Scaler> scalers;
+  std::vector<VideoFrame> scaled_frames(kNumSimulcastLayers);
+  if (shared_scaling) {
+    simulcast_encoder.reset(new H264SimulcastEncoder());
+    simulcast_encoder->RegisterEncodeCompleteCallback(&callback);
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              simulcast_encoder->InitEncode(&codec_settings, 4, 0));
+  } else {
+    for (int i = 0; i < kNumSimulcastLayers; ++i) {
+      const SimulcastStream& stream = codec_settings.simulcastStream[i];
+      VideoCodec layer_settings = codec_settings;
+      layer_settings.numberOfSimulcastStreams = 0;
+      layer_settings.width = stream.width;
+      layer_settings.height = stream.height;
+      layer_settings.startBitrate = stream.targetBitrate;
+      layer_settings.maxBitrate = stream.maxBitrate;
+      encoders.push_back(new H264EncoderImpl());
+      encoders.back()->RegisterEncodeCompleteCallback(&callback);
+      ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+                encoders.back()->InitEncode(&layer_settings, 4, 0));
+      scalers.push_back(new Scaler());
+      ASSERT_EQ(0, scalers.back()->Set(codec_settings.width,
+                                       codec_settings.height, stream.width,
+                                       stream.height, kI420, kI420,
+                                       kScaleBox));
+    }
+  }
+
+  const clock_t start_cpu = clock();
+  const int64_t start_ms = TickTime::MillisecondTimestamp();
+  for (int i = 0; i < kNumFrames; ++i) {
+    VideoFrame frame = frames[i % kNumSourceFrames];
+    frame.set_timestamp(static_cast<uint32_t>(i * 90000 / kFramerate));
+    if (shared_scaling) {
+      ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+                simulcast_encoder->Encode(frame, nullptr, nullptr));
+      continue;
+    }
+    for (int layer = 0; layer < kNumSimulcastLayers; ++layer) {
+      const VideoFrame* input = &frame;
+      if (layer < kNumSimulcastLayers - 1) {
+        ASSERT_EQ(0, scalers[layer]->Scale(frame, &scaled_frames[layer]));
+        scaled_frames[layer].set_timestamp(frame.timestamp());
+        input = &scaled_frames[layer];
+      }
+      ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK,
+                encoders[layer]->Encode(*input, nullptr, nullptr));
+    }
+  }
+  const double cpu_ms =
+      1000.0 * (clock() - start_cpu) / CLOCKS_PER_SEC / kNumFrames;
+  const int64_t elapsed_ms =
+      std::max<int64_t>(1, TickTime::MillisecondTimestamp() - start_ms);
+  ASSERT_EQ(kNumFrames * kNumSimulcastLayers, callback.frames());
+
+  test::PrintResult("h264_simulcast_cpu", "", trace, cpu_ms, "ms/frame", true);
+  test::PrintResult("h264_simulcast_throughput", "", trace,
+                    kNumFrames * 1000.0 / elapsed_ms, "fps", true);
+}
+
+}  // namespace
+
+TEST(H264EncoderPerformanceTest, SimulcastSharedScaling) {
+  RunSimulcastTest(true, "1080p_540p_270p_shared");
+}
+
+TEST(H264EncoderPerformanceTest, SimulcastIndependentEncoders) {
+  RunSimulcastTest(false, "1080p_540p_270p_independent");
+}
+
+TEST(H264EncoderPerformanceTest, Throughput720p) {
+  RunThroughputTests(1280, 720, "720p");
+}
+
+TEST(H264EncoderPerformanceTest, Throughput1080p) {
+  RunThroughputTests(1920, 1080, "1080p");
+}
+
+TEST(H264EncoderPerformanceTest, LatencyLowLatencyMode) {
+  RunLatencyTest(kH264LowLatency, kProfileBase, "low_latency_vga", 150);
+}
+
+TEST(H264EncoderPerformanceTest, LatencyHighQualityMode) {
+  RunLatencyTest(kH264HighQuality, kProfileMain, "high_quality_vga", 150);
+}
+
+}  // namespace webrtc
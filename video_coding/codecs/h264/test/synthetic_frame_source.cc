@@ -0,0 +1,50 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#include "video_coding/codecs/h264/test/synthetic_frame_source.h"
+
+namespace webrtc {
+namespace test {
+
+SyntheticFrameSource::SyntheticFrameSource(int width,
+                                           int height,
+                                           int framerate)
+    : framerate_(framerate), frame_index_(0), random_state_(1) {
+  int stride_uv = (width + 1) / 2;
+  frame_.CreateEmptyFrame(width, height, width, stride_uv, stride_uv);
+}
+
+const VideoFrame& SyntheticFrameSource::NextFrame() {
+  for (int plane = kYPlane; plane < kNumOfPlanes; ++plane) {
+    PlaneType type = static_cast<PlaneType>(plane);
+    int height =
+        type == kYPlane ? frame_.height() : (frame_.height() + 1) / 2;
+    int stride = frame_.stride(type);
+    uint8_t* data = frame_.buffer(type);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < stride; ++x) {
+        random_state_ = random_state_ * 1103515245 + 12345;
+        int noise = static_cast<int>((random_state_ >> 16) & 0x1f) - 16;
+        data[y * stride + x] =
+            static_cast<uint8_t>((x + y + 3 * frame_index_ + noise) & 0xff);
+      }
+    }
+  }
+  frame_.set_timestamp(static_cast<uint32_t>(frame_index_ * 90000 /
+                                             framerate_));
+  frame_.set_render_time_ms(static_cast<int64_t>(frame_index_) * 1000 /
+                            framerate_);
+  ++frame_index_;
+  return frame_;
+}
+
+}  // namespace test
+}  // namespace webrtc
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_TEST_SYNTHETIC_FRAME_SOURCE_H_
+#define WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_TEST_SYNTHETIC_FRAME_SOURCE_H_
+
+#include "base/constructormagic.h"
+#include "video_frame.h"
+
+namespace webrtc {
+namespace test {
+
+// Produces deterministic I420 frames with a moving gradient and pseudo random
+// noise, so that encoder tests and benchmarks have content with motion and
+// detail without depending on resource files.
+class SyntheticFrameSource {
+ public:
+  SyntheticFrameSource(int width, int height, int framerate);
+
+  // Renders the next frame. The returned frame stays valid until the next
+  // call. RTP timestamps advance at 90 kHz, render times in ms.
+  const VideoFrame& NextFrame();
+
+  int frame_index() const { return frame_index_; }
+
+ private:
+  const int framerate_;
+  int frame_index_;
+  uint32_t random_state_;
+  VideoFrame frame_;
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(SyntheticFrameSource);
+};
+
+}  // namespace test
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_TEST_SYNTHETIC_FRAME_SOURCE_H_
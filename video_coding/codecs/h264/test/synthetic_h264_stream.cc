@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#include "video_coding/codecs/h264/test/synthetic_h264_stream.h"
+
+#include <string.h>
+
+#include "base/checks.h"
+#include "video_coding/codecs/h264/h264_encoder_impl.h"
+#include "video_coding/codecs/h264/test/synthetic_frame_source.h"
+
+namespace webrtc {
+namespace test {
+
+namespace {
+
+// FFmpeg reads up to this many bytes past the end of the bitstream.
+const size_t kPaddingBytes = 32;
+
+}  // namespace
+
+SyntheticH264Stream::SyntheticH264Stream(int width,
+                                         int height,
+                                         int framerate,
+                                         int bitrate_kbps,
+                                         int key_frame_interval,
+                                         int num_frames) {
+  VideoCodec codec_settings;
+  memset(&codec_settings, 0, sizeof(codec_settings));
+  codec_settings.codecType = kVideoCodecH264;
+  codec_settings.width = width;
+  codec_settings.height = height;
+  codec_settings.maxFramerate = framerate;
+  codec_settings.startBitrate = bitrate_kbps;
+  codec_settings.maxBitrate = bitrate_kbps;
+  codec_settings.codecSpecific.H264 = VideoEncoder::GetDefaultH264Settings();
+  codec_settings.codecSpecific.H264.keyFrameInterval = key_frame_interval;
+
+  H264EncoderImpl encoder;
+  encoder.RegisterEncodeCompleteCallback(this);
+  RTC_CHECK_EQ(WEBRTC_VIDEO_CODEC_OK,
+               encoder.InitEncode(&codec_settings, 1, 0));
+  buffers_.reserve(num_frames);
+  images_.reserve(num_frames);
+  SyntheticFrameSource source(width, height, framerate);
+  for (int i = 0; i < num_frames; ++i) {
+    RTC_CHECK_EQ(WEBRTC_VIDEO_CODEC_OK,
+                 encoder.Encode(source.NextFrame(), nullptr, nullptr));
+  }
+}
+
+int32_t SyntheticH264Stream::Encoded(
+    const EncodedImage& encoded_image,
+    const CodecSpecificInfo* codec_specific_info,
+    const RTPFragmentationHeader* fragmentation) {
+  buffers_.push_back(std::vector<uint8_t>(
+      encoded_image._length + kPaddingBytes, 0));
+  std::vector<uint8_t>& buffer = buffers_.back();
+  memcpy(&buffer[0], encoded_image._buffer, encoded_image._length);
+  EncodedImage image = encoded_image;
+  image._buffer = &buffer[0];
+  image._size = buffer.size();
+  images_.push_back(image);
+  return 0;
+}
+
+}  // namespace test
+}  // namespace webrtc
@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ *
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_TEST_SYNTHETIC_H264_STREAM_H_
+#define WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_TEST_SYNTHETIC_H264_STREAM_H_
+
+#include <vector>
+
+#include "base/constructormagic.h"
+#include "video_coding/include/video_codec_interface.h"
+
+namespace webrtc {
+namespace test {
+
+// An H.264 stream encoded with H264EncoderImpl from SyntheticFrameSource
+// input, kept in memory for decoder tests and benchmarks. Every frame has its
+// own buffer, padded as H264DecoderImpl::Decode requires.
+class SyntheticH264Stream : public EncodedImageCallback {
+ public:
+  // Encodes |num_frames| frames in low latency mode, with an IDR every
+  // |key_frame_interval| frames.
+  SyntheticH264Stream(int width,
+                      int height,
+                      int framerate,
+                      int bitrate_kbps,
+                      int key_frame_interval,
+                      int num_frames);
+
+  size_t num_frames() const { return images_.size(); }
+  // The returned image references memory owned by this object.
+  const EncodedImage& frame(size_t index) const { return images_[index]; }
+
+  int32_t Encoded(const EncodedImage& encoded_image,
+                  const CodecSpecificInfo* codec_specific_info,
+                  const RTPFragmentationHeader* fragmentation) override;
+
+ private:
+  std::vector<std::vector<uint8_t>> buffers_;
+  std::vector<EncodedImage> images_;
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(SyntheticH264Stream);
+};
+
+}  // namespace test
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_CODECS_H264_TEST_SYNTHETIC_H264_STREAM_H_
@@ -21,6 +21,12 @@
 namespace webrtc {
 namespace test {
 
+namespace {
+
+const int64_t kRtpTimestampRate = 90000;
+
+}  // namespace
+
 TestConfig::TestConfig()
     : name(""),
       description(""),
@@ -32,6 +38,7 @@ TestConfig::TestConfig()
       exclude_frame_types(kExcludeOnlyFirstKeyFrame),
       frame_length_in_bytes(0),
       use_single_core(false),
+      number_of_cores(0),
       keyframe_interval(0),
       codec_settings(NULL),
       verbose(true) {}
@@ -60,7 +67,9 @@ VideoProcessorImpl::VideoProcessorImpl(webrtc::VideoEncoder* encoder,
       initialized_(false),
       encoded_frame_size_(0),
       encoded_frame_type_(kKeyFrame),
-      prev_time_stamp_(0),
+      prev_frame_number_(0),
+      last_processed_frame_number_(0),
+      last_decoded_frame_number_(0),
       num_dropped_frames_(0),
       num_spatial_resizes_(0),
       last_encoder_frame_width_(0),
@@ -106,7 +115,9 @@ bool VideoProcessorImpl::Init() {
   // Init the encoder and decoder
   uint32_t nbr_of_cores = 1;
   if (!config_.use_single_core) {
-    nbr_of_cores = CpuInfo::DetectNumberOfCores();
+    nbr_of_cores = config_.number_of_cores > 0
+                       ? static_cast<uint32_t>(config_.number_of_cores)
+                       : CpuInfo::DetectNumberOfCores();
   }
   int32_t init_result =
       encoder_->InitEncode(config_.codec_settings, nbr_of_cores,
@@ -180,9 +191,11 @@ bool VideoProcessorImpl::ProcessFrame(int frame_number) {
     fprintf(stderr, "Attempting to use uninitialized VideoProcessor!\n");
     return false;
   }
-  // |prev_time_stamp_| is used for getting number of dropped frames.
+  // |prev_frame_number_| is used for getting number of dropped frames.
   if (frame_number == 0) {
-    prev_time_stamp_ = -1;
+    prev_frame_number_ = -1;
+    last_processed_frame_number_ = -1;
+    last_decoded_frame_number_ = -1;
   }
   if (frame_reader_->ReadFrame(source_buffer_)) {
     // Copy the source frame to the newly read frame data.
@@ -193,10 +206,11 @@ bool VideoProcessorImpl::ProcessFrame(int frame_number) {
 
     // Ensure we have a new statistics data object we can fill:
     FrameStatistic& stat = stats_->NewFrame(frame_number);
+    last_processed_frame_number_ = frame_number;
 
     encode_start_ = TickTime::Now();
-    // Use the frame number as "timestamp" to identify frames
-    source_frame_.set_timestamp(frame_number);
+    // Use the timestamp to identify frames.
+    source_frame_.set_timestamp(FrameNumberToTimestamp(frame_number));
 
     // Decide if we're going to force a keyframe:
     std::vector<VideoFrameType> frame_types(1, kDeltaFrame);
@@ -222,18 +236,23 @@ bool VideoProcessorImpl::ProcessFrame(int frame_number) {
   }
 }
 
+void VideoProcessorImpl::WriteRemainingFrames() {
+  for (; last_decoded_frame_number_ < last_processed_frame_number_;
+       ++last_decoded_frame_number_) {
+    frame_writer_->WriteFrame(last_successful_frame_buffer_);
+  }
+}
+
 void VideoProcessorImpl::FrameEncoded(const EncodedImage& encoded_image) {
-  // Timestamp is frame number, so this gives us #dropped frames.
-  int num_dropped_from_prev_encode =  encoded_image._timeStamp -
-      prev_time_stamp_ - 1;
-  num_dropped_frames_ +=  num_dropped_from_prev_encode;
-  prev_time_stamp_ =  encoded_image._timeStamp;
-  if (num_dropped_from_prev_encode > 0) {
-    // For dropped frames, we write out the last decoded frame to avoid getting
-    // out of sync for the computation of PSNR and SSIM.
-    for (int i = 0; i < num_dropped_from_prev_encode; i++) {
-      frame_writer_->WriteFrame(last_successful_frame_buffer_);
-    }
+  // The frame number of this and the previous frame gives us #dropped frames.
+  int frame_number = TimestampToFrameNumber(encoded_image._timeStamp);
+  if (frame_number > prev_frame_number_) {
+    num_dropped_frames_ += frame_number - prev_frame_number_ - 1;
+    prev_frame_number_ = frame_number;
+  } else {
+    // Counted as dropped when a later frame was output first, which encoders
+    // with B-frames do.
+    --num_dropped_frames_;
   }
   // Frame is not dropped, so update the encoded frame size
   // (encoder callback is only called for non-zero length frames).
@@ -242,13 +261,12 @@ void VideoProcessorImpl::FrameEncoded(const EncodedImage& encoded_image) {
   encoded_frame_type_ = encoded_image._frameType;
 
   TickTime encode_stop = TickTime::Now();
-  int frame_number = encoded_image._timeStamp;
   FrameStatistic& stat = stats_->stats_[frame_number];
   stat.encode_time_in_us = GetElapsedTimeMicroseconds(encode_start_,
                                                       encode_stop);
   stat.encoding_successful = true;
   stat.encoded_frame_length_in_bytes = encoded_image._length;
-  stat.frame_number = encoded_image._timeStamp;
+  stat.frame_number = frame_number;
   stat.frame_type = encoded_image._frameType;
   stat.bit_rate_in_kbps = encoded_image._length * bit_rate_factor_;
   stat.total_packets = encoded_image._length /
@@ -291,24 +309,28 @@ void VideoProcessorImpl::FrameEncoded(const EncodedImage& encoded_image) {
   int32_t decode_result =
       decoder_->Decode(copied_image, last_frame_missing_, NULL);
   stat.decode_return_code = decode_result;
-  if (decode_result != WEBRTC_VIDEO_CODEC_OK) {
-    // Write the last successful frame the output file to avoid getting it out
-    // of sync with the source file for SSIM and PSNR comparisons:
-    frame_writer_->WriteFrame(last_successful_frame_buffer_);
-  }
   // save status for losses so we can inform the decoder for the next frame:
   last_frame_missing_ = copied_image._length == 0;
 }
 
 void VideoProcessorImpl::FrameDecoded(const VideoFrame& image) {
   TickTime decode_stop = TickTime::Now();
-  int frame_number = image.timestamp();
+  int frame_number = TimestampToFrameNumber(image.timestamp());
   // Report stats
   FrameStatistic& stat = stats_->stats_[frame_number];
   stat.decode_time_in_us = GetElapsedTimeMicroseconds(decode_start_,
                                                       decode_stop);
   stat.decoding_successful = true;
 
+  // For frames that were dropped or failed to decode, we write out the last
+  // decoded frame to avoid getting out of sync with the source file for the
+  // computation of PSNR and SSIM. Decoders output in display order, also when
+  // the encoded frames were reordered.
+  for (++last_decoded_frame_number_; last_decoded_frame_number_ < frame_number;
+       ++last_decoded_frame_number_) {
+    frame_writer_->WriteFrame(last_successful_frame_buffer_);
+  }
+
   // Check for resize action (either down or up):
   if (static_cast<int>(image.width()) != last_encoder_frame_width_ ||
       static_cast<int>(image.height()) != last_encoder_frame_height_ ) {
@@ -373,6 +395,18 @@ int VideoProcessorImpl::GetElapsedTimeMicroseconds(
   return static_cast<int>(encode_time);
 }
 
+uint32_t VideoProcessorImpl::FrameNumberToTimestamp(int frame_number) const {
+  return static_cast<uint32_t>(frame_number * kRtpTimestampRate /
+                               config_.codec_settings->maxFramerate);
+}
+
+int VideoProcessorImpl::TimestampToFrameNumber(uint32_t timestamp) const {
+  // Rounds, frame rates that do not divide 90 kHz give truncated timestamps.
+  const int64_t framerate = config_.codec_settings->maxFramerate;
+  return static_cast<int>((timestamp * framerate + kRtpTimestampRate / 2) /
+                          kRtpTimestampRate);
+}
+
 const char* ExcludeFrameTypesToStr(ExcludeFrameTypes e) {
   switch (e) {
     case kExcludeOnlyFirstKeyFrame:
@@ -389,6 +423,10 @@ const char* VideoCodecTypeToStr(webrtc::VideoCodecType e) {
   switch (e) {
     case kVideoCodecVP8:
       return "VP8";
+    case kVideoCodecVP9:
+      return "VP9";
+    case kVideoCodecH264:
+      return "H264";
     case kVideoCodecI420:
       return "I420";
     case kVideoCodecRED:
@@ -87,6 +87,11 @@ struct TestConfig {
   // Default: false.
   bool use_single_core;
 
+  // If >0 and |use_single_core| is false, the number of cores given to the
+  // encoder and decoder instead of the detected number, e.g. to benchmark
+  // thread counts. Default: 0.
+  int number_of_cores;
+
   // If set to a value >0 this setting forces the encoder to create a keyframe
   // every Nth frame. Note that the encoder may create a keyframe in other
   // locations in addition to the interval that is set using this parameter.
@@ -154,6 +159,13 @@ class VideoProcessor {
 
   // Return the number of spatial resizes.
   virtual int NumberSpatialResizes() = 0;
+
+  // Writes the last decoded frame in place of each processed frame after it,
+  // i.e. the frames at the end of the clip that were dropped or failed to
+  // decode, so that the output file stays in sync with the source file for
+  // PSNR and SSIM. Call after the last ProcessFrame call, and after flushing
+  // a decoder that holds frames back.
+  virtual void WriteRemainingFrames() = 0;
 };
 
 class VideoProcessorImpl : public VideoProcessor {
@@ -168,6 +180,7 @@ class VideoProcessorImpl : public VideoProcessor {
   virtual ~VideoProcessorImpl();
   bool Init() override;
   bool ProcessFrame(int frame_number) override;
+  void WriteRemainingFrames() override;
 
  private:
   // Invoked by the callback when a frame has completed encoding.
@@ -178,6 +191,11 @@ class VideoProcessorImpl : public VideoProcessor {
   // (checks the size is within signed 32-bit bounds before casting it)
   int GetElapsedTimeMicroseconds(const webrtc::TickTime& start,
                                  const webrtc::TickTime& stop);
+  // Frames are identified by their RTP timestamp, which advances at 90 kHz
+  // like in a call, so that encoders pacing by timestamp see the real frame
+  // rate.
+  uint32_t FrameNumberToTimestamp(int frame_number) const;
+  int TimestampToFrameNumber(uint32_t timestamp) const;
   // Updates the encoder with the target bit rate and the frame rate.
   void SetRates(int bit_rate, int frame_rate) override;
   // Return the size of the encoded frame in bytes.
@@ -213,7 +231,9 @@ class VideoProcessorImpl : public VideoProcessor {
   bool initialized_;
   size_t encoded_frame_size_;
   VideoFrameType encoded_frame_type_;
-  int prev_time_stamp_;
+  int prev_frame_number_;
+  int last_processed_frame_number_;
+  int last_decoded_frame_number_;
   int num_dropped_frames_;
   int num_spatial_resizes_;
   int last_encoder_frame_width_;
@@ -95,5 +95,27 @@ TEST_F(VideoProcessorTest, ProcessFrame) {
   video_processor.ProcessFrame(0);
 }
 
+// A frame that never comes out of the encoder is written as a placeholder by
+// WriteRemainingFrames, so that the output has as many frames as the input.
+TEST_F(VideoProcessorTest, WritesRemainingFrames) {
+  ExpectInit();
+  EXPECT_CALL(encoder_mock_, Encode(_, _, _))
+    .Times(1);
+  EXPECT_CALL(frame_reader_mock_, ReadFrame(_))
+    .WillOnce(Return(true));
+  EXPECT_CALL(frame_writer_mock_, WriteFrame(_))
+    .WillOnce(Return(true));
+  VideoProcessorImpl video_processor(&encoder_mock_, &decoder_mock_,
+                                     &frame_reader_mock_,
+                                     &frame_writer_mock_,
+                                     &packet_manipulator_mock_, config_,
+                                     &stats_);
+  ASSERT_TRUE(video_processor.Init());
+  video_processor.ProcessFrame(0);
+  video_processor.WriteRemainingFrames();
+  // Nothing is left to write.
+  video_processor.WriteRemainingFrames();
+}
+
 }  // namespace test
 }  // namespace webrtc
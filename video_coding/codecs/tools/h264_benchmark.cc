@@ -0,0 +1,522 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+// Benchmarks H264EncoderImpl and H264DecoderImpl through VideoProcessorImpl
+// at several resolutions, encoder modes and core counts, and writes encode
+// and decode speed, per frame latency percentiles, bitrate accuracy, PSNR and
+// SSIM of every run as JSON, for tracking regressions.
+//
+// The input is a synthetic clip by default, or an I420 file:
+//   h264_benchmark --resolutions=640x360,1280x720 --cores=1,4
+//   h264_benchmark --input_filename=foreman_cif.yuv --width=352 --height=288
+// Run without arguments for the defaults, see kUsage for all flags.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/scoped_ptr.h"
+#include "base/stringencode.h"
+#include "common_video/libyuv/include/webrtc_libyuv.h"
+#include "json/json.h"
+#include "system_wrappers/interface/tick_util.h"
+#include "video_coding/codecs/h264/h264_decoder_impl.h"
+#include "video_coding/codecs/h264/h264_encoder_impl.h"
+#include "video_coding/codecs/h264/test/synthetic_frame_source.h"
+#include "video_coding/codecs/test/packet_manipulator.h"
+#include "video_coding/codecs/test/stats.h"
+#include "video_coding/codecs/test/videoprocessor.h"
+#include "video_encoder.h"
+
+namespace webrtc {
+namespace test {
+
+namespace {
+
+const char kUsage[] =
+    "Usage: h264_benchmark [--flag=value ...]\n"
+    "  --input_filename  I420 file to encode, a synthetic clip if empty.\n"
+    "  --width --height  Size of the frames in --input_filename.\n"
+    "  --resolutions     Sizes of the synthetic clip, default "
+    "640x360,1280x720,1920x1080.\n"
+    "  --num_frames      Frames per run, default 150.\n"
+    "  --framerate       Default 30.\n"
+    "  --bitrate         Target in kbps, by default 0.1 bits per pixel.\n"
+    "  --modes           Encoder latency modes, default "
+    "low_latency,high_quality.\n"
+    "  --cores           Number of cores, default 1,2,4,8.\n"
+    "  --keyframe_interval  Forces a key frame every Nth frame, default 0.\n"
+    "  --output_filename JSON output, stdout if empty.\n";
+
+const double kDefaultBitsPerPixel = 0.1;
+
+struct Options {
+  Options()
+      : width(0),
+        height(0),
+        resolutions("640x360,1280x720,1920x1080"),
+        num_frames(150),
+        framerate(30),
+        bitrate(0),
+        modes("low_latency,high_quality"),
+        cores("1,2,4,8"),
+        keyframe_interval(0) {}
+
+  std::string input_filename;
+  int width;
+  int height;
+  std::string resolutions;
+  int num_frames;
+  int framerate;
+  int bitrate;
+  std::string modes;
+  std::string cores;
+  int keyframe_interval;
+  std::string output_filename;
+};
+
+// Parses --name=value arguments. Returns false on an unknown flag.
+bool ParseFlags(int argc, char* argv[], Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t equals = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || equals == std::string::npos)
+      return false;
+    std::string name = arg.substr(2, equals - 2);
+    std::string value = arg.substr(equals + 1);
+    if (name == "input_filename") {
+      options->input_filename = value;
+    } else if (name == "width") {
+      options->width = atoi(value.c_str());
+    } else if (name == "height") {
+      options->height = atoi(value.c_str());
+    } else if (name == "resolutions") {
+      options->resolutions = value;
+    } else if (name == "num_frames") {
+      options->num_frames = atoi(value.c_str());
+    } else if (name == "framerate") {
+      options->framerate = atoi(value.c_str());
+    } else if (name == "bitrate") {
+      options->bitrate = atoi(value.c_str());
+    } else if (name == "modes") {
+      options->modes = value;
+    } else if (name == "cores") {
+      options->cores = value;
+    } else if (name == "keyframe_interval") {
+      options->keyframe_interval = atoi(value.c_str());
+    } else if (name == "output_filename") {
+      options->output_filename = value;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<std::string> Split(const std::string& list) {
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos)
+      end = list.size();
+    if (end > start)
+      items.push_back(list.substr(start, end - start));
+    start = end + 1;
+  }
+  return items;
+}
+
+// Renders |num_frames| frames of SyntheticFrameSource.
+class SyntheticFrameReader : public FrameReader {
+ public:
+  SyntheticFrameReader(int width, int height, int framerate, int num_frames)
+      : width_(width),
+        height_(height),
+        framerate_(framerate),
+        num_frames_(num_frames),
+        frames_read_(0) {}
+
+  bool Init() override {
+    source_.reset(new SyntheticFrameSource(width_, height_, framerate_));
+    frames_read_ = 0;
+    return true;
+  }
+
+  bool ReadFrame(uint8_t* source_buffer) override {
+    if (frames_read_ >= num_frames_)
+      return false;
+    ++frames_read_;
+    return ExtractBuffer(source_->NextFrame(), FrameLength(),
+                         source_buffer) > 0;
+  }
+
+  void Close() override { source_.reset(); }
+  size_t FrameLength() override {
+    return CalcBufferSize(kI420, width_, height_);
+  }
+  int NumberOfFrames() override { return num_frames_; }
+
+ private:
+  const int width_;
+  const int height_;
+  const int framerate_;
+  const int num_frames_;
+  int frames_read_;
+  rtc::scoped_ptr<SyntheticFrameSource> source_;
+};
+
+// Reads up to |max_frames| frames of an I420 file.
+class YuvFileFrameReader : public FrameReader {
+ public:
+  YuvFileFrameReader(const std::string& filename,
+                     int width,
+                     int height,
+                     int max_frames)
+      : filename_(filename),
+        frame_length_(CalcBufferSize(kI420, width, height)),
+        max_frames_(max_frames),
+        num_frames_(0),
+        frames_read_(0),
+        file_(NULL) {}
+  ~YuvFileFrameReader() override { Close(); }
+
+  bool Init() override {
+    Close();
+    file_ = fopen(filename_.c_str(), "rb");
+    if (!file_)
+      return false;
+    fseek(file_, 0, SEEK_END);
+    long file_size = ftell(file_);
+    fseek(file_, 0, SEEK_SET);
+    num_frames_ = std::min(max_frames_,
+                           static_cast<int>(file_size / frame_length_));
+    frames_read_ = 0;
+    return num_frames_ > 0;
+  }
+
+  bool ReadFrame(uint8_t* source_buffer) override {
+    if (!file_ || frames_read_ >= num_frames_)
+      return false;
+    ++frames_read_;
+    return fread(source_buffer, 1, frame_length_, file_) == frame_length_;
+  }
+
+  void Close() override {
+    if (file_) {
+      fclose(file_);
+      file_ = NULL;
+    }
+  }
+  size_t FrameLength() override { return frame_length_; }
+  int NumberOfFrames() override { return num_frames_; }
+
+ private:
+  const std::string filename_;
+  const size_t frame_length_;
+  const int max_frames_;
+  int num_frames_;
+  int frames_read_;
+  FILE* file_;
+};
+
+// Instead of writing the decoded frames, compares each one with the next
+// frame of |reference|, a second reader of the input.
+class QualityFrameWriter : public FrameWriter {
+ public:
+  QualityFrameWriter(FrameReader* reference, int width, int height)
+      : reference_(reference),
+        width_(width),
+        height_(height),
+        reference_buffer_(new uint8_t[reference->FrameLength()]) {}
+
+  bool Init() override { return reference_->Init(); }
+
+  bool WriteFrame(uint8_t* frame_buffer) override {
+    if (!reference_->ReadFrame(reference_buffer_.get()))
+      return false;
+    reference_frame_.CreateFrame(reference_buffer_.get(), width_, height_,
+                                 kVideoRotation_0);
+    decoded_frame_.CreateFrame(frame_buffer, width_, height_,
+                               kVideoRotation_0);
+    psnr_.push_back(I420PSNR(&reference_frame_, &decoded_frame_));
+    ssim_.push_back(I420SSIM(&reference_frame_, &decoded_frame_));
+    return true;
+  }
+
+  void Close() override { reference_->Close(); }
+  size_t FrameLength() override { return reference_->FrameLength(); }
+
+  const std::vector<double>& psnr() const { return psnr_; }
+  const std::vector<double>& ssim() const { return ssim_; }
+
+ private:
+  FrameReader* const reference_;
+  const int width_;
+  const int height_;
+  rtc::scoped_ptr<uint8_t[]> reference_buffer_;
+  VideoFrame reference_frame_;
+  VideoFrame decoded_frame_;
+  std::vector<double> psnr_;
+  std::vector<double> ssim_;
+};
+
+// The benchmark measures the codecs, not the network.
+class NoPacketLoss : public PacketManipulator {
+ public:
+  int ManipulatePackets(EncodedImage* encoded_image) override { return 0; }
+};
+
+struct Run {
+  int width;
+  int height;
+  H264LatencyMode latency_mode;
+  int cores;
+  int bitrate;
+};
+
+FrameReader* CreateFrameReader(const Options& options, const Run& run) {
+  if (options.input_filename.empty()) {
+    return new SyntheticFrameReader(run.width, run.height, options.framerate,
+                                    options.num_frames);
+  }
+  return new YuvFileFrameReader(options.input_filename, run.width, run.height,
+                                options.num_frames);
+}
+
+// Nearest rank percentiles and the mean of |values|.
+Json::Value Distribution(std::vector<double> values) {
+  Json::Value result(Json::objectValue);
+  if (values.empty())
+    return result;
+  std::sort(values.begin(), values.end());
+  double sum = 0;
+  for (double value : values)
+    sum += value;
+  result["mean"] = sum / values.size();
+  result["min"] = values.front();
+  const int kPercentiles[] = {50, 90, 99};
+  for (int percentile : kPercentiles) {
+    size_t rank = (values.size() * percentile + 99) / 100;
+    result["p" + rtc::ToString(percentile)] =
+        values[std::max<size_t>(rank, 1) - 1];
+  }
+  result["max"] = values.back();
+  return result;
+}
+
+bool RunBenchmark(const Options& options, const Run& run, Json::Value* result) {
+  VideoCodec codec_settings;
+  memset(&codec_settings, 0, sizeof(codec_settings));
+  codec_settings.codecType = kVideoCodecH264;
+  codec_settings.plType = 126;
+  strncpy(codec_settings.plName, "H264", sizeof(codec_settings.plName) - 1);
+  codec_settings.width = run.width;
+  codec_settings.height = run.height;
+  codec_settings.maxFramerate = options.framerate;
+  codec_settings.startBitrate = run.bitrate;
+  codec_settings.maxBitrate = run.bitrate;
+  codec_settings.codecSpecific.H264 = VideoEncoder::GetDefaultH264Settings();
+  codec_settings.codecSpecific.H264.latencyMode = run.latency_mode;
+  // B-frames need the main profile.
+  codec_settings.codecSpecific.H264.profile =
+      run.latency_mode == kH264HighQuality ? kProfileMain : kProfileBase;
+
+  TestConfig config;
+  config.name = "h264_benchmark";
+  config.codec_settings = &codec_settings;
+  config.number_of_cores = run.cores;
+  config.keyframe_interval = options.keyframe_interval;
+  config.frame_length_in_bytes = CalcBufferSize(kI420, run.width, run.height);
+  config.exclude_frame_types = kExcludeAllKeyFrames;
+  config.verbose = false;
+
+  rtc::scoped_ptr<FrameReader> frame_reader(CreateFrameReader(options, run));
+  rtc::scoped_ptr<FrameReader> reference_reader(
+      CreateFrameReader(options, run));
+  QualityFrameWriter frame_writer(reference_reader.get(), run.width,
+                                  run.height);
+  if (!frame_reader->Init() || !frame_writer.Init()) {
+    fprintf(stderr, "Failed to read the input.\n");
+    return false;
+  }
+  H264EncoderImpl encoder;
+  H264DecoderImpl decoder;
+  NoPacketLoss packet_manipulator;
+  Stats stats;
+  rtc::scoped_ptr<VideoProcessor> processor(new VideoProcessorImpl(
+      &encoder, &decoder, frame_reader.get(), &frame_writer,
+      &packet_manipulator, config, &stats));
+  if (!processor->Init())
+    return false;
+
+  const int64_t start_us = TickTime::MicrosecondTimestamp();
+  int num_frames = 0;
+  while (processor->ProcessFrame(num_frames))
+    ++num_frames;
+  // Frames still inside a decoder with frame threads.
+  decoder.Flush();
+  processor->WriteRemainingFrames();
+  const int64_t elapsed_us =
+      std::max<int64_t>(1, TickTime::MicrosecondTimestamp() - start_us);
+
+  std::vector<double> encode_times_ms;
+  std::vector<double> decode_times_ms;
+  int64_t encode_time_us = 0;
+  int64_t decode_time_us = 0;
+  size_t encoded_bytes = 0;
+  int key_frames = 0;
+  for (const FrameStatistic& stat : stats.stats_) {
+    if (stat.encoding_successful) {
+      encode_times_ms.push_back(stat.encode_time_in_us / 1000.0);
+      encode_time_us += stat.encode_time_in_us;
+      encoded_bytes += stat.encoded_frame_length_in_bytes;
+      if (stat.frame_type == kKeyFrame)
+        ++key_frames;
+    }
+    if (stat.decoding_successful) {
+      decode_times_ms.push_back(stat.decode_time_in_us / 1000.0);
+      decode_time_us += stat.decode_time_in_us;
+    }
+  }
+  const int encoded_frames = static_cast<int>(encode_times_ms.size());
+  const int decoded_frames = static_cast<int>(decode_times_ms.size());
+  const double actual_kbps =
+      encoded_frames > 0 ? encoded_bytes * 8.0 * options.framerate /
+                               encoded_frames / 1000
+                         : 0;
+
+  Json::Value& out = *result;
+  out["width"] = run.width;
+  out["height"] = run.height;
+  out["mode"] = run.latency_mode == kH264HighQuality ? "high_quality"
+                                                       : "low_latency";
+  out["cores"] = run.cores;
+  out["frames"] = num_frames;
+  out["encoded_frames"] = encoded_frames;
+  out["decoded_frames"] = decoded_frames;
+  out["key_frames"] = key_frames;
+  out["dropped_frames"] = processor->NumberDroppedFrames();
+  // Frames per second of encoder or decoder time; the latency of frames held
+  // back by B-frames or frame threads is counted from the Encode or Decode
+  // call that output them.
+  out["encode_fps"] =
+      encode_time_us > 0 ? encoded_frames * 1e6 / encode_time_us : 0.0;
+  out["decode_fps"] =
+      decode_time_us > 0 ? decoded_frames * 1e6 / decode_time_us : 0.0;
+  out["total_fps"] = num_frames * 1e6 / elapsed_us;
+  out["encode_time_ms"] = Distribution(encode_times_ms);
+  out["decode_time_ms"] = Distribution(decode_times_ms);
+  out["target_kbps"] = run.bitrate;
+  out["actual_kbps"] = actual_kbps;
+  out["bitrate_error"] = (actual_kbps - run.bitrate) / run.bitrate;
+  out["psnr"] = Distribution(frame_writer.psnr());
+  out["ssim"] = Distribution(frame_writer.ssim());
+  return true;
+}
+
+int Main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseFlags(argc, argv, &options) || options.num_frames <= 0 ||
+      options.framerate <= 0) {
+    fprintf(stderr, "%s", kUsage);
+    return 1;
+  }
+
+  std::vector<std::pair<int, int>> resolutions;
+  if (!options.input_filename.empty()) {
+    if (options.width <= 0 || options.height <= 0) {
+      fprintf(stderr, "--width and --height are required with a file.\n");
+      return 1;
+    }
+    resolutions.push_back(std::make_pair(options.width, options.height));
+  } else {
+    for (const std::string& resolution : Split(options.resolutions)) {
+      int width = 0;
+      int height = 0;
+      if (sscanf(resolution.c_str(), "%dx%d", &width, &height) != 2 ||
+          width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid resolution: %s\n", resolution.c_str());
+        return 1;
+      }
+      resolutions.push_back(std::make_pair(width, height));
+    }
+  }
+  std::vector<H264LatencyMode> modes;
+  for (const std::string& mode : Split(options.modes)) {
+    if (mode == "low_latency") {
+      modes.push_back(kH264LowLatency);
+    } else if (mode == "high_quality") {
+      modes.push_back(kH264HighQuality);
+    } else {
+      fprintf(stderr, "Invalid mode: %s\n", mode.c_str());
+      return 1;
+    }
+  }
+
+  Json::Value root(Json::objectValue);
+  root["input"] =
+      options.input_filename.empty() ? "synthetic" : options.input_filename;
+  root["framerate"] = options.framerate;
+  root["num_frames"] = options.num_frames;
+  root["runs"] = Json::Value(Json::arrayValue);
+  for (const std::pair<int, int>& resolution : resolutions) {
+    for (H264LatencyMode mode : modes) {
+      for (const std::string& cores : Split(options.cores)) {
+        Run run;
+        run.width = resolution.first;
+        run.height = resolution.second;
+        run.latency_mode = mode;
+        run.cores = std::max(1, atoi(cores.c_str()));
+        run.bitrate = options.bitrate > 0
+                          ? options.bitrate
+                          : static_cast<int>(run.width * run.height *
+                                             options.framerate *
+                                             kDefaultBitsPerPixel / 1000);
+        Json::Value result(Json::objectValue);
+        if (!RunBenchmark(options, run, &result)) {
+          fprintf(stderr, "Failed to run %dx%d with %d cores.\n", run.width,
+                  run.height, run.cores);
+          return 2;
+        }
+        root["runs"].append(result);
+      }
+    }
+  }
+
+  std::string json = Json::StyledWriter().write(root);
+  if (options.output_filename.empty()) {
+    fputs(json.c_str(), stdout);
+    return 0;
+  }
+  FILE* file = fopen(options.output_filename.c_str(), "w");
+  if (!file || fputs(json.c_str(), file) < 0) {
+    fprintf(stderr, "Cannot write output file: %s\n",
+            options.output_filename.c_str());
+    if (file)
+      fclose(file);
+    return 3;
+  }
+  fclose(file);
+  return 0;
+}
+
+}  // namespace
+
+}  // namespace test
+}  // namespace webrtc
+
+int main(int argc, char* argv[]) {
+  return webrtc::test::Main(argc, argv);
+}
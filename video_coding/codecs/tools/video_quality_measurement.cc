@@ -493,6 +493,7 @@ int main(int argc, char* argv[]) {
     Log(".");
     frame_number++;
   }
+  processor->WriteRemainingFrames();
   Log("\n");
   Log("Processed %d frames\n", frame_number);
 
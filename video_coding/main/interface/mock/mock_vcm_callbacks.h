@@ -30,6 +30,13 @@ class MockPacketRequestCallback : public VCMPacketRequestCallback {
                                       uint16_t length));
 };
 
+class MockEncodeUsageCallback : public VCMEncodeUsageCallback {
+ public:
+  MOCK_METHOD1(OnEncodeUsageUpdated, void(const VCMEncodeUsageStats& stats));
+  MOCK_METHOD0(OnEncodeOveruse, void());
+  MOCK_METHOD0(OnEncodeUnderuse, void());
+};
+
 }  // namespace webrtc
 
 #endif  // WEBRTC_MODULES_VIDEO_CODING_MAIN_INTERFACE_MOCK_MOCK_VCM_CALLBACKS_H_
@@ -257,6 +257,19 @@ public:
     virtual int32_t RegisterSendStatisticsCallback(
                                      VCMSendStatisticsCallback* sendStats) = 0;
 
+    // Register a callback which will be called once a second with the encode
+    // time and capture queueing of the send stream, and when the encoder
+    // overuses or has headroom again, see VCMEncodeUsageCallback. The
+    // callback owner has to lower the frame rate or resolution on overuse.
+    //
+    // Input:
+    //      - callback  : The callback object to register.
+    //
+    // Return value      : VCM_OK, on success.
+    //                     < 0,         on error.
+    virtual int32_t RegisterEncodeUsageCallback(
+                                     VCMEncodeUsageCallback* callback) = 0;
+
     // Register a video protection callback which will be called to deliver
     // the requested FEC rate and NACK status (on/off).
     //
@@ -74,6 +74,9 @@ VideoCodecH264 VideoEncoder::GetDefaultH264Settings() {
   h264_settings.profile = kProfileBase;
   h264_settings.frameDroppingOn = true;
   h264_settings.keyFrameInterval = 3000;
+  h264_settings.latencyMode = kH264LowLatency;
+  h264_settings.threadingMode = kH264ThreadingAuto;
+  h264_settings.automaticResizeOn = false;
   h264_settings.spsData = NULL;
   h264_settings.spsLen = 0;
   h264_settings.ppsData = NULL;
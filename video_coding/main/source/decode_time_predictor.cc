@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "video_coding/main/source/decode_time_predictor.h"
+
+#include <algorithm>
+
+namespace webrtc {
+
+namespace {
+// Frames up to this size are in the smallest size class.
+const size_t kSmallestSizeClassBytes = 4096;
+}  // namespace
+
+VCMDecodeTimePredictor::Window::Window() {
+  Reset();
+}
+
+void VCMDecodeTimePredictor::Window::Reset() {
+  num_decode_times_ = 0;
+  next_index_ = 0;
+  percentile_ms_ = -1;
+}
+
+void VCMDecodeTimePredictor::Window::Add(int decode_time_ms) {
+  decode_times_ms_[next_index_] = decode_time_ms;
+  next_index_ = (next_index_ + 1) % kWindowSize;
+  if (num_decode_times_ < kWindowSize)
+    ++num_decode_times_;
+  if (num_decode_times_ < kMinSamples)
+    return;
+  int sorted_ms[kWindowSize];
+  std::copy(decode_times_ms_, decode_times_ms_ + num_decode_times_,
+            sorted_ms);
+  const size_t index = (num_decode_times_ - 1) * kPercentile / 100;
+  std::nth_element(sorted_ms, sorted_ms + index,
+                   sorted_ms + num_decode_times_);
+  percentile_ms_ = sorted_ms[index];
+}
+
+VCMDecodeTimePredictor::VCMDecodeTimePredictor() {
+}
+
+void VCMDecodeTimePredictor::Reset() {
+  for (size_t i = 0; i < 2; ++i) {
+    for (size_t j = 0; j < kNumSizeClasses; ++j)
+      frame_classes_[i][j].Reset();
+  }
+  all_frames_.Reset();
+}
+
+size_t VCMDecodeTimePredictor::SizeClass(size_t frame_size) {
+  size_t size_class = 0;
+  size_t max_size = kSmallestSizeClassBytes;
+  while (size_class < kNumSizeClasses - 1 && frame_size > max_size) {
+    ++size_class;
+    max_size *= 4;
+  }
+  return size_class;
+}
+
+void VCMDecodeTimePredictor::AddDecodeTime(FrameType frame_type,
+                                           size_t frame_size,
+                                           int decode_time_ms) {
+  const size_t key_frame = frame_type == kVideoFrameKey ? 1 : 0;
+  frame_classes_[key_frame][SizeClass(frame_size)].Add(decode_time_ms);
+  all_frames_.Add(decode_time_ms);
+}
+
+int VCMDecodeTimePredictor::PredictDecodeTimeMs(FrameType frame_type,
+                                                size_t frame_size) const {
+  const size_t key_frame = frame_type == kVideoFrameKey ? 1 : 0;
+  return frame_classes_[key_frame][SizeClass(frame_size)].percentile_ms();
+}
+
+int VCMDecodeTimePredictor::PredictDecodeTimeMs() const {
+  return all_frames_.percentile_ms();
+}
+
+}  // namespace webrtc
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_DECODE_TIME_PREDICTOR_H_
+#define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_DECODE_TIME_PREDICTOR_H_
+
+#include "interface/module_common_types.h"
+#include "typedefs.h"
+
+namespace webrtc {
+
+// Predicts the decode time of a frame from the decode times of recent frames
+// of the same type and of a similar size. Key frames typically take several
+// times longer to decode than delta frames, so a single estimate is either
+// too low for key frames or too high for all other frames.
+//
+// The prediction is a high percentile of the last kWindowSize decode times
+// of each class of frames, classes being the frame type and the size rounded
+// up to a power of 4.
+class VCMDecodeTimePredictor {
+ public:
+  enum { kWindowSize = 64 };
+  // Number of decode times a class must have to be predicted from.
+  enum { kMinSamples = 5 };
+  enum { kPercentile = 99 };
+
+  VCMDecodeTimePredictor();
+
+  void Reset();
+
+  void AddDecodeTime(FrameType frame_type,
+                     size_t frame_size,
+                     int decode_time_ms);
+
+  // Returns the predicted decode time of a frame, or -1 if too few similar
+  // frames have been decoded.
+  int PredictDecodeTimeMs(FrameType frame_type, size_t frame_size) const;
+
+  // Returns the predicted decode time of any frame of the stream, or -1 if
+  // too few frames have been decoded. As key frames are rare, this is
+  // typically the decode time of delta frames.
+  int PredictDecodeTimeMs() const;
+
+ private:
+  enum { kNumSizeClasses = 4 };
+
+  class Window {
+   public:
+    Window();
+
+    void Reset();
+    void Add(int decode_time_ms);
+    int percentile_ms() const { return percentile_ms_; }
+
+   private:
+    int decode_times_ms_[kWindowSize];
+    size_t num_decode_times_;
+    size_t next_index_;
+    // The percentile, computed when a decode time is added since it is read
+    // more often than updated.
+    int percentile_ms_;
+  };
+
+  static size_t SizeClass(size_t frame_size);
+
+  Window frame_classes_[2][kNumSizeClasses];
+  Window all_frames_;
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_DECODE_TIME_PREDICTOR_H_
@@ -0,0 +1,289 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "video_coding/main/source/decoder_host.h"
+
+#include <algorithm>
+#include <deque>
+
+#include "base/checks.h"
+#include "system_wrappers/interface/clock.h"
+#include "system_wrappers/interface/cpu_info.h"
+#include "system_wrappers/interface/logging.h"
+#include "video_coding/main/source/queued_encoded_frame.h"
+
+namespace webrtc {
+
+// A queued frame and the time it should be decoded by.
+struct DecoderHost::QueuedFrame : public QueuedEncodedFrame {
+  QueuedFrame(const EncodedImage& input_image,
+              bool missing_frames,
+              const RTPFragmentationHeader* fragmentation,
+              const CodecSpecificInfo* codec_specific_info,
+              int64_t render_time_ms,
+              int64_t deadline_ms)
+      : QueuedEncodedFrame(input_image,
+                           missing_frames,
+                           fragmentation,
+                           codec_specific_info,
+                           render_time_ms),
+        deadline_ms(deadline_ms) {}
+
+  int64_t deadline_ms;
+};
+
+class DecoderHost::Session : public VideoDecoder {
+ public:
+  Session(DecoderHost* host, VideoDecoder* decoder)
+      : host_(host),
+        decoder_(decoder),
+        decoding_(false),
+        needs_key_frame_(false),
+        error_(WEBRTC_VIDEO_CODEC_OK) {}
+
+  ~Session() override {
+    CriticalSectionScoped cs(host_->crit_.get());
+    StopDecoding();
+    --host_->num_sessions_;
+  }
+
+  int32_t InitDecode(const VideoCodec* codec_settings,
+                     int32_t number_of_cores) override {
+    {
+      CriticalSectionScoped cs(host_->crit_.get());
+      StopDecoding();
+    }
+    // The host's threads already keep the cores busy, threads of the decoder
+    // itself would oversubscribe them.
+    return decoder_->InitDecode(codec_settings, 1);
+  }
+
+  int32_t Decode(const EncodedImage& input_image,
+                 bool missing_frames,
+                 const RTPFragmentationHeader* fragmentation,
+                 const CodecSpecificInfo* codec_specific_info,
+                 int64_t render_time_ms) override {
+    if (!input_image._buffer || !input_image._length)
+      return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+    const bool key_frame = input_image._frameType == kKeyFrame;
+    CriticalSectionScoped cs(host_->crit_.get());
+    // Report an error from decoding an earlier frame, so that VideoReceiver
+    // requests a key frame.
+    if (error_ != WEBRTC_VIDEO_CODEC_OK) {
+      int32_t error = error_;
+      error_ = WEBRTC_VIDEO_CODEC_OK;
+      needs_key_frame_ = !key_frame;
+      if (needs_key_frame_)
+        return error;
+    }
+    if (needs_key_frame_) {
+      if (!key_frame)
+        return WEBRTC_VIDEO_CODEC_ERROR;
+      needs_key_frame_ = false;
+    }
+
+    const int64_t give_up_ms =
+        host_->clock_->TimeInMilliseconds() + kMaxBlockingTimeMs;
+    while (frames_.size() >= kMaxQueuedFrames) {
+      int64_t wait_ms = give_up_ms - host_->clock_->TimeInMilliseconds();
+      if (wait_ms <= 0) {
+        LOG(LS_WARNING) << "Decoder session fell behind, dropping "
+                        << frames_.size() << " queued frames.";
+        DropQueuedFrames();
+        if (!key_frame) {
+          needs_key_frame_ = true;
+          return WEBRTC_VIDEO_CODEC_ERROR;
+        }
+        break;
+      }
+      host_->session_cond_->SleepCS(*host_->crit_,
+                                    static_cast<unsigned long>(wait_ms));
+    }
+
+    int64_t deadline_ms = render_time_ms >= 0
+                              ? render_time_ms
+                              : host_->clock_->TimeInMilliseconds();
+    frames_.push_back(new QueuedFrame(input_image, missing_frames,
+                                      fragmentation, codec_specific_info,
+                                      render_time_ms, deadline_ms));
+    if (frames_.size() == 1 && !decoding_)
+      host_->Schedule(this);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t RegisterDecodeCompleteCallback(
+      DecodedImageCallback* callback) override {
+    CriticalSectionScoped cs(host_->crit_.get());
+    WaitUntilIdle();
+    return decoder_->RegisterDecodeCompleteCallback(callback);
+  }
+
+  int32_t Release() override {
+    {
+      CriticalSectionScoped cs(host_->crit_.get());
+      StopDecoding();
+    }
+    return decoder_->Release();
+  }
+
+  int32_t Reset() override {
+    {
+      CriticalSectionScoped cs(host_->crit_.get());
+      StopDecoding();
+      needs_key_frame_ = false;
+      error_ = WEBRTC_VIDEO_CODEC_OK;
+    }
+    return decoder_->Reset();
+  }
+
+  // Called on a host thread, with |host_->crit_| held: takes the next frame
+  // and marks the session as decoding.
+  QueuedFrame* PopFrame() {
+    RTC_DCHECK(!frames_.empty());
+    RTC_DCHECK(!decoding_);
+    QueuedFrame* frame = frames_.front();
+    frames_.pop_front();
+    decoding_ = true;
+    return frame;
+  }
+
+  // Called on a host thread, without |host_->crit_| held.
+  int32_t DecodeFrame(const QueuedFrame& frame) {
+    return frame.Decode(decoder_);
+  }
+
+  // Called on a host thread, with |host_->crit_| held, after DecodeFrame.
+  void FrameDecoded(int32_t result) {
+    RTC_DCHECK(decoding_);
+    decoding_ = false;
+    if (result < WEBRTC_VIDEO_CODEC_OK && error_ == WEBRTC_VIDEO_CODEC_OK)
+      error_ = result;
+    if (!frames_.empty())
+      host_->Schedule(this);
+  }
+
+  // Orders a heap with the earliest deadline on top.
+  static bool LaterDeadline(const Session* a, const Session* b) {
+    return a->frames_.front()->deadline_ms > b->frames_.front()->deadline_ms;
+  }
+
+ private:
+  void DropQueuedFrames() {
+    if (!frames_.empty() && !decoding_)
+      host_->Unschedule(this);
+    for (QueuedFrame* frame : frames_)
+      delete frame;
+    frames_.clear();
+  }
+
+  void WaitUntilIdle() {
+    while (decoding_)
+      host_->session_cond_->SleepCS(*host_->crit_);
+  }
+
+  // Drops the queue and waits for the frame being decoded, after which
+  // |decoder_| may be used on the calling thread.
+  void StopDecoding() {
+    DropQueuedFrames();
+    WaitUntilIdle();
+  }
+
+  DecoderHost* const host_;
+  VideoDecoder* const decoder_;
+  // The members below are guarded by |host_->crit_|.
+  std::deque<QueuedFrame*> frames_;
+  bool decoding_;
+  bool needs_key_frame_;
+  int32_t error_;
+};
+
+DecoderHost::DecoderHost(int num_threads, Clock* clock)
+    : clock_(clock),
+      crit_(CriticalSectionWrapper::CreateCriticalSection()),
+      work_cond_(ConditionVariableWrapper::CreateConditionVariable()),
+      session_cond_(ConditionVariableWrapper::CreateConditionVariable()),
+      num_sessions_(0),
+      stopping_(false) {
+  if (num_threads <= 0)
+    num_threads = static_cast<int>(CpuInfo::DetectNumberOfCores());
+  for (int i = 0; i < num_threads; ++i) {
+    rtc::scoped_ptr<ThreadWrapper> thread =
+        ThreadWrapper::CreateThread(WorkerThreadRun, this, "DecoderHost");
+    RTC_CHECK(thread->Start());
+    threads_.push_back(thread.release());
+  }
+}
+
+DecoderHost::~DecoderHost() {
+  {
+    CriticalSectionScoped cs(crit_.get());
+    RTC_DCHECK_EQ(0, num_sessions_);
+    stopping_ = true;
+    work_cond_->WakeAll();
+  }
+  for (ThreadWrapper* thread : threads_)
+    thread->Stop();
+}
+
+VideoDecoder* DecoderHost::CreateSession(VideoDecoder* decoder) {
+  CriticalSectionScoped cs(crit_.get());
+  ++num_sessions_;
+  return new Session(this, decoder);
+}
+
+bool DecoderHost::WorkerThreadRun(void* obj) {
+  return static_cast<DecoderHost*>(obj)->DecodeNextFrame();
+}
+
+bool DecoderHost::DecodeNextFrame() {
+  Session* session;
+  QueuedFrame* frame;
+  {
+    CriticalSectionScoped cs(crit_.get());
+    while (ready_.empty() && !stopping_)
+      work_cond_->SleepCS(*crit_);
+    if (stopping_)
+      return false;
+    std::pop_heap(ready_.begin(), ready_.end(), Session::LaterDeadline);
+    session = ready_.back();
+    ready_.pop_back();
+    frame = session->PopFrame();
+    // There is room in the session's queue now.
+    session_cond_->WakeAll();
+  }
+
+  int32_t result = session->DecodeFrame(*frame);
+  if (result < WEBRTC_VIDEO_CODEC_OK) {
+    LOG(LS_WARNING) << "Failed to decode frame with timestamp "
+                    << frame->image._timeStamp << ", error code: " << result;
+  }
+  delete frame;
+
+  CriticalSectionScoped cs(crit_.get());
+  session->FrameDecoded(result);
+  session_cond_->WakeAll();
+  return true;
+}
+
+void DecoderHost::Schedule(Session* session) {
+  ready_.push_back(session);
+  std::push_heap(ready_.begin(), ready_.end(), Session::LaterDeadline);
+  work_cond_->Wake();
+}
+
+void DecoderHost::Unschedule(Session* session) {
+  std::vector<Session*>::iterator it =
+      std::find(ready_.begin(), ready_.end(), session);
+  RTC_DCHECK(it != ready_.end());
+  ready_.erase(it);
+  std::make_heap(ready_.begin(), ready_.end(), Session::LaterDeadline);
+}
+
+}  // namespace webrtc
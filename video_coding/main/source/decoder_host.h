@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_DECODER_HOST_H_
+#define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_DECODER_HOST_H_
+
+#include <vector>
+
+#include "base/scoped_ptr.h"
+#include "base/thread_annotations.h"
+#include "system_wrappers/interface/condition_variable_wrapper.h"
+#include "system_wrappers/interface/critical_section_wrapper.h"
+#include "system_wrappers/interface/scoped_vector.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "video_coding/include/video_codec_interface.h"
+
+namespace webrtc {
+
+class Clock;
+
+// Runs the VideoDecoders of many receive streams on one bounded set of
+// threads, e.g. on a server decoding dozens of streams, instead of one decode
+// thread per stream with every decoder free to use all cores.
+//
+// Each stream decodes through a session, a VideoDecoder that queues the frame
+// and returns. Frames of a session are decoded in order, one at a time. Among
+// sessions with queued frames, the one whose next frame has the earliest
+// render time goes first. Decode callbacks are made on the host's threads.
+//
+// A session holds at most |kMaxQueuedFrames| frames. When it is full, Decode
+// blocks the VCMReceiver feeding it for up to |kMaxBlockingTimeMs|. A session
+// still full after that has fallen behind: its queue is dropped and Decode
+// fails, which makes VideoReceiver request a key frame, until a key frame
+// arrives.
+class DecoderHost {
+ public:
+  static const size_t kMaxQueuedFrames = 8;
+  static const int kMaxBlockingTimeMs = 200;
+
+  // |num_threads| <= 0 uses one thread per core. |clock| orders frames
+  // without a render time by arrival and must be the clock render times are
+  // computed with.
+  DecoderHost(int num_threads, Clock* clock);
+  ~DecoderHost();
+
+  // Returns a session decoding with |decoder|, for
+  // VideoCodingModule::RegisterExternalDecoder. The caller owns the session
+  // and must delete it before the host; |decoder| must outlive the session.
+  VideoDecoder* CreateSession(VideoDecoder* decoder);
+
+ private:
+  class Session;
+  struct QueuedFrame;
+
+  static bool WorkerThreadRun(void* obj);
+  // Decodes the next frame by deadline. Returns false when stopping.
+  bool DecodeNextFrame();
+  // Adds |session| to the sessions ready to decode.
+  void Schedule(Session* session) EXCLUSIVE_LOCKS_REQUIRED(crit_);
+  void Unschedule(Session* session) EXCLUSIVE_LOCKS_REQUIRED(crit_);
+
+  Clock* const clock_;
+  const rtc::scoped_ptr<CriticalSectionWrapper> crit_;
+  // Signaled when a session becomes ready to decode.
+  const rtc::scoped_ptr<ConditionVariableWrapper> work_cond_;
+  // Signaled when a session gets room in its queue or stops decoding.
+  const rtc::scoped_ptr<ConditionVariableWrapper> session_cond_;
+  // Sessions with queued frames that are not being decoded, a min-heap on
+  // the deadline of their next frame.
+  std::vector<Session*> ready_ GUARDED_BY(crit_);
+  int num_sessions_ GUARDED_BY(crit_);
+  bool stopping_ GUARDED_BY(crit_);
+  ScopedVector<ThreadWrapper> threads_;
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_DECODER_HOST_H_
@@ -0,0 +1,224 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <utility>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include "base/scoped_ptr.h"
+#include "system_wrappers/interface/clock.h"
+#include "system_wrappers/interface/critical_section_wrapper.h"
+#include "system_wrappers/interface/event_wrapper.h"
+#include "system_wrappers/interface/sleep.h"
+#include "video_coding/main/source/decoder_host.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kMaxWaitMs = 10000;
+
+// The (decoder id, RTP timestamp) of every decoded frame, in decode order.
+class DecodeLog {
+ public:
+  DecodeLog() : crit_(CriticalSectionWrapper::CreateCriticalSection()) {}
+
+  void Add(int id, uint32_t timestamp) {
+    CriticalSectionScoped cs(crit_.get());
+    entries_.push_back(std::make_pair(id, timestamp));
+  }
+
+  bool WaitForEntries(size_t count) {
+    for (int i = 0; i < kMaxWaitMs; ++i) {
+      {
+        CriticalSectionScoped cs(crit_.get());
+        if (entries_.size() >= count)
+          return true;
+      }
+      SleepMs(1);
+    }
+    return false;
+  }
+
+  std::vector<std::pair<int, uint32_t>> entries() const {
+    CriticalSectionScoped cs(crit_.get());
+    return entries_;
+  }
+
+ private:
+  const rtc::scoped_ptr<CriticalSectionWrapper> crit_;
+  std::vector<std::pair<int, uint32_t>> entries_;
+};
+
+// Logs every frame and fails if it is entered by two threads at once. If
+// |gate| is set, every Decode waits for it first.
+class FakeDecoder : public VideoDecoder {
+ public:
+  FakeDecoder(int id, DecodeLog* log, EventWrapper* gate)
+      : id_(id), log_(log), gate_(gate), in_decode_(false) {}
+
+  int32_t InitDecode(const VideoCodec* codec_settings,
+                     int32_t number_of_cores) override {
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t Decode(const EncodedImage& input_image,
+                 bool missing_frames,
+                 const RTPFragmentationHeader* fragmentation,
+                 const CodecSpecificInfo* codec_specific_info,
+                 int64_t render_time_ms) override {
+    EXPECT_FALSE(in_decode_);
+    in_decode_ = true;
+    if (gate_) {
+      EXPECT_EQ(kEventSignaled, gate_->Wait(kMaxWaitMs));
+    }
+    log_->Add(id_, input_image._timeStamp);
+    in_decode_ = false;
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t RegisterDecodeCompleteCallback(
+      DecodedImageCallback* callback) override {
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  int32_t Release() override { return WEBRTC_VIDEO_CODEC_OK; }
+  int32_t Reset() override { return WEBRTC_VIDEO_CODEC_OK; }
+
+ private:
+  const int id_;
+  DecodeLog* const log_;
+  EventWrapper* const gate_;
+  volatile bool in_decode_;
+};
+
+}  // namespace
+
+class DecoderHostTest : public ::testing::Test {
+ protected:
+  DecoderHostTest()
+      : clock_(Clock::GetRealTimeClock()),
+        gate_(EventWrapper::Create()),
+        payload_(100, 0) {}
+
+  int32_t Decode(VideoDecoder* session,
+                 uint32_t timestamp,
+                 VideoFrameType frame_type,
+                 int64_t render_time_ms) {
+    EncodedImage image(&payload_[0], payload_.size(), payload_.size());
+    image._timeStamp = timestamp;
+    image._frameType = frame_type;
+    return session->Decode(image, false, nullptr, nullptr, render_time_ms);
+  }
+
+  Clock* const clock_;
+  rtc::scoped_ptr<EventWrapper> gate_;
+  std::vector<uint8_t> payload_;
+  DecodeLog log_;
+};
+
+// Many sessions on few threads: every frame is decoded, in order per session,
+// and no decoder is entered twice at once.
+TEST_F(DecoderHostTest, DecodesEverySessionInOrder) {
+  const int kNumSessions = 8;
+  const uint32_t kNumFrames = 30;
+  DecoderHost host(3, clock_);
+  std::vector<FakeDecoder*> decoders;
+  std::vector<VideoDecoder*> sessions;
+  for (int i = 0; i < kNumSessions; ++i) {
+    decoders.push_back(new FakeDecoder(i, &log_, nullptr));
+    sessions.push_back(host.CreateSession(decoders.back()));
+    ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, sessions.back()->InitDecode(nullptr, 4));
+  }
+  for (uint32_t t = 0; t < kNumFrames; ++t) {
+    for (VideoDecoder* session : sessions) {
+      EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+                Decode(session, t, t == 0 ? kKeyFrame : kDeltaFrame,
+                       clock_->TimeInMilliseconds() + 100));
+    }
+  }
+  ASSERT_TRUE(log_.WaitForEntries(kNumSessions * kNumFrames));
+
+  std::vector<uint32_t> next_timestamp(kNumSessions, 0);
+  for (const auto& entry : log_.entries())
+    EXPECT_EQ(next_timestamp[entry.first]++, entry.second);
+  for (int i = 0; i < kNumSessions; ++i) {
+    delete sessions[i];
+    delete decoders[i];
+  }
+}
+
+// With the only thread busy, frames queued in other sessions are decoded
+// earliest render time first.
+TEST_F(DecoderHostTest, DecodesEarliestRenderTimeFirst) {
+  DecoderHost host(1, clock_);
+  FakeDecoder blocking_decoder(0, &log_, gate_.get());
+  FakeDecoder decoder_a(1, &log_, nullptr);
+  FakeDecoder decoder_b(2, &log_, nullptr);
+  FakeDecoder decoder_c(3, &log_, nullptr);
+  rtc::scoped_ptr<VideoDecoder> blocking(host.CreateSession(&blocking_decoder));
+  rtc::scoped_ptr<VideoDecoder> a(host.CreateSession(&decoder_a));
+  rtc::scoped_ptr<VideoDecoder> b(host.CreateSession(&decoder_b));
+  rtc::scoped_ptr<VideoDecoder> c(host.CreateSession(&decoder_c));
+
+  const int64_t now_ms = clock_->TimeInMilliseconds();
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            Decode(blocking.get(), 0, kKeyFrame, now_ms));
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, Decode(a.get(), 0, kKeyFrame, now_ms + 300));
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, Decode(b.get(), 0, kKeyFrame, now_ms + 100));
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, Decode(c.get(), 0, kKeyFrame, now_ms + 200));
+  gate_->Set();
+  ASSERT_TRUE(log_.WaitForEntries(4));
+
+  std::vector<std::pair<int, uint32_t>> entries = log_.entries();
+  EXPECT_EQ(0, entries[0].first);
+  EXPECT_EQ(2, entries[1].first);
+  EXPECT_EQ(3, entries[2].first);
+  EXPECT_EQ(1, entries[3].first);
+}
+
+// A session that stays full blocks Decode for a bounded time, then drops its
+// queue and fails until it gets a key frame.
+TEST_F(DecoderHostTest, FullSessionBlocksThenWaitsForKeyFrame) {
+  DecoderHost host(1, clock_);
+  FakeDecoder blocking_decoder(0, &log_, gate_.get());
+  FakeDecoder decoder(1, &log_, nullptr);
+  rtc::scoped_ptr<VideoDecoder> blocking(host.CreateSession(&blocking_decoder));
+  rtc::scoped_ptr<VideoDecoder> session(host.CreateSession(&decoder));
+
+  const int64_t now_ms = clock_->TimeInMilliseconds();
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            Decode(blocking.get(), 0, kKeyFrame, now_ms));
+  uint32_t timestamp = 0;
+  for (size_t i = 0; i < DecoderHost::kMaxQueuedFrames; ++i, ++timestamp) {
+    EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+              Decode(session.get(), timestamp,
+                     i == 0 ? kKeyFrame : kDeltaFrame, now_ms + 100));
+  }
+
+  const int64_t start_ms = clock_->TimeInMilliseconds();
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERROR,
+            Decode(session.get(), timestamp++, kDeltaFrame, now_ms + 100));
+  EXPECT_GE(clock_->TimeInMilliseconds() - start_ms,
+            DecoderHost::kMaxBlockingTimeMs - 1);
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERROR,
+            Decode(session.get(), timestamp++, kDeltaFrame, now_ms + 100));
+  const uint32_t key_frame_timestamp = timestamp;
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK,
+            Decode(session.get(), timestamp++, kKeyFrame, now_ms + 100));
+
+  gate_->Set();
+  ASSERT_TRUE(log_.WaitForEntries(2));
+  std::vector<std::pair<int, uint32_t>> entries = log_.entries();
+  EXPECT_EQ(1, entries[1].first);
+  EXPECT_EQ(key_frame_timestamp, entries[1].second);
+}
+
+}  // namespace webrtc
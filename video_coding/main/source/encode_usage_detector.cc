@@ -0,0 +1,182 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "video_coding/main/source/encode_usage_detector.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "system_wrappers/interface/clock.h"
+
+namespace webrtc {
+
+namespace {
+int Percentile(std::vector<int>* values, int percentile) {
+  const size_t index = (values->size() - 1) * percentile / 100;
+  std::nth_element(values->begin(), values->begin() + index, values->end());
+  return (*values)[index];
+}
+}  // namespace
+
+VCMEncodeUsageDetector::VCMEncodeUsageDetector(Clock* clock) : clock_(clock) {
+  Reset();
+}
+
+void VCMEncodeUsageDetector::Reset() {
+  rtc::CritScope cs(&crit_);
+  ClearSamples();
+  pending_frames_.clear();
+  checks_above_threshold_ = 0;
+  num_overuses_ = 0;
+  low_usage_since_ms_ = -1;
+  last_adaptation_ms_ = -1;
+  last_adaptation_was_underuse_ = false;
+  ramp_up_delay_ms_ = kMinRampUpDelayMs;
+}
+
+void VCMEncodeUsageDetector::ClearSamples() {
+  num_samples_ = 0;
+  next_index_ = 0;
+  last_capture_time_ms_ = -1;
+}
+
+void VCMEncodeUsageDetector::FrameCaptured(uint32_t timestamp,
+                                           int64_t capture_time_ms) {
+  rtc::CritScope cs(&crit_);
+  if (pending_frames_.size() == kWindowSize)
+    pending_frames_.pop_front();
+  PendingFrame frame;
+  frame.timestamp = timestamp;
+  frame.capture_time_ms = capture_time_ms;
+  frame.encode_start_ms = clock_->TimeInMilliseconds();
+  pending_frames_.push_back(frame);
+}
+
+void VCMEncodeUsageDetector::FrameSent(uint32_t timestamp) {
+  rtc::CritScope cs(&crit_);
+  std::list<PendingFrame>::iterator it = pending_frames_.begin();
+  while (it != pending_frames_.end() && it->timestamp != timestamp)
+    ++it;
+  if (it == pending_frames_.end())
+    return;
+  AddSample(it->capture_time_ms, it->encode_start_ms,
+            static_cast<int>(clock_->TimeInMilliseconds() -
+                             it->encode_start_ms));
+  pending_frames_.erase(pending_frames_.begin(), ++it);
+}
+
+void VCMEncodeUsageDetector::FrameEncoded(int64_t capture_time_ms,
+                                          int64_t encode_start_ms,
+                                          int encode_time_ms) {
+  rtc::CritScope cs(&crit_);
+  AddSample(capture_time_ms, encode_start_ms, encode_time_ms);
+}
+
+void VCMEncodeUsageDetector::AddSample(int64_t capture_time_ms,
+                                       int64_t encode_start_ms,
+                                       int encode_time_ms) {
+  if (capture_time_ms <= 0)
+    capture_time_ms = encode_start_ms;
+  Sample& sample = samples_[next_index_];
+  sample.encode_time_ms = encode_time_ms;
+  sample.queue_delay_ms =
+      static_cast<int>(std::max<int64_t>(encode_start_ms - capture_time_ms, 0));
+  sample.interval_ms =
+      last_capture_time_ms_ < 0
+          ? -1
+          : static_cast<int>(capture_time_ms - last_capture_time_ms_);
+  last_capture_time_ms_ = capture_time_ms;
+  next_index_ = (next_index_ + 1) % kWindowSize;
+  if (num_samples_ < kWindowSize)
+    ++num_samples_;
+}
+
+VCMEncodeUsageDetector::Usage VCMEncodeUsageDetector::Check(
+    VCMEncodeUsageStats* stats) {
+  rtc::CritScope cs(&crit_);
+  *stats = VCMEncodeUsageStats();
+  if (num_samples_ < kMinSamples)
+    return kNormalUsage;
+
+  std::vector<int> encode_times_ms;
+  std::vector<int> queue_delays_ms;
+  std::vector<int> intervals_ms;
+  for (size_t i = 0; i < num_samples_; ++i) {
+    encode_times_ms.push_back(samples_[i].encode_time_ms);
+    queue_delays_ms.push_back(samples_[i].queue_delay_ms);
+    if (samples_[i].interval_ms >= 0)
+      intervals_ms.push_back(samples_[i].interval_ms);
+  }
+  // The median interval, so that an occasional late frame does not make the
+  // encoder look idle.
+  const int frame_interval_ms = std::max(Percentile(&intervals_ms, 50), 1);
+  stats->encode_time_p50_ms = Percentile(&encode_times_ms, 50);
+  stats->encode_time_p95_ms = Percentile(&encode_times_ms, 95);
+  stats->encode_usage_p50_percent =
+      stats->encode_time_p50_ms * 100 / frame_interval_ms;
+  stats->encode_usage_p95_percent =
+      stats->encode_time_p95_ms * 100 / frame_interval_ms;
+  stats->capture_queue_delay_p50_ms = Percentile(&queue_delays_ms, 50);
+  stats->capture_queue_delay_p95_ms = Percentile(&queue_delays_ms, 95);
+
+  const int64_t now_ms = clock_->TimeInMilliseconds();
+  if (IsOverusing(*stats, frame_interval_ms)) {
+    low_usage_since_ms_ = -1;
+    if (++checks_above_threshold_ < kChecksForOveruse)
+      return kNormalUsage;
+    // Overusing right after an underuse: the previous setting is too much
+    // for this machine, stay longer at this one next time.
+    if (last_adaptation_was_underuse_ &&
+        now_ms - last_adaptation_ms_ < kMinRampUpDelayMs) {
+      ramp_up_delay_ms_ = std::min(2 * ramp_up_delay_ms_,
+                                   static_cast<int>(kMaxRampUpDelayMs));
+    } else {
+      ramp_up_delay_ms_ = kMinRampUpDelayMs;
+    }
+    checks_above_threshold_ = 0;
+    ++num_overuses_;
+    last_adaptation_ms_ = now_ms;
+    last_adaptation_was_underuse_ = false;
+    // The next decision is made on frames of the new setting.
+    ClearSamples();
+    return kOveruse;
+  }
+  checks_above_threshold_ = 0;
+
+  if (!IsUnderusing(*stats, frame_interval_ms)) {
+    low_usage_since_ms_ = -1;
+    return kNormalUsage;
+  }
+  if (low_usage_since_ms_ < 0)
+    low_usage_since_ms_ = now_ms;
+  if (num_overuses_ == 0 || now_ms - low_usage_since_ms_ < ramp_up_delay_ms_)
+    return kNormalUsage;
+  --num_overuses_;
+  low_usage_since_ms_ = -1;
+  last_adaptation_ms_ = now_ms;
+  last_adaptation_was_underuse_ = true;
+  ClearSamples();
+  return kUnderuse;
+}
+
+bool VCMEncodeUsageDetector::IsOverusing(const VCMEncodeUsageStats& stats,
+                                         int frame_interval_ms) const {
+  return stats.encode_usage_p95_percent > kHighUsagePercent ||
+         stats.capture_queue_delay_p95_ms >
+             kMaxQueuedFrames * frame_interval_ms;
+}
+
+bool VCMEncodeUsageDetector::IsUnderusing(const VCMEncodeUsageStats& stats,
+                                          int frame_interval_ms) const {
+  return stats.encode_usage_p95_percent < kLowUsagePercent &&
+         stats.capture_queue_delay_p95_ms <= frame_interval_ms;
+}
+
+}  // namespace webrtc
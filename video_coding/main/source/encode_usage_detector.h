@@ -0,0 +1,127 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_ENCODE_USAGE_DETECTOR_H_
+#define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_ENCODE_USAGE_DETECTOR_H_
+
+#include <list>
+
+#include "base/criticalsection.h"
+#include "base/thread_annotations.h"
+#include "video_coding/main/interface/video_coding_defines.h"
+#include "typedefs.h"
+
+namespace webrtc {
+
+class Clock;
+
+// Detects when the encoder takes too large a share of the frame interval, or
+// frames wait too long between capture and encode. An encoder that cannot
+// keep up with its input builds a queue in front of it, and the latency grows
+// until frames are dropped; lowering the frame rate or the resolution first
+// keeps the latency bounded.
+//
+// The stats are percentiles over the last kWindowSize frames. Overuse is
+// reported when kChecksForOveruse checks in a row find the p95 encode usage
+// or capture queue delay too high. Underuse is reported only to undo an
+// earlier overuse, when the usage has been low for the ramp up delay. The
+// ramp up delay doubles each time an overuse follows an underuse quickly, so
+// the stream does not oscillate between two settings.
+//
+// The encode time of a frame is the time from FrameCaptured() to FrameSent(),
+// so that encoders which output frames after Encode() returns, on a thread of
+// their own or a frame later, are measured too. All methods can be called on
+// any thread.
+class VCMEncodeUsageDetector {
+ public:
+  enum Usage { kNormalUsage, kOveruse, kUnderuse };
+
+  // Three seconds at 30 fps.
+  enum { kWindowSize = 90 };
+  enum { kMinSamples = 30 };
+  enum { kChecksForOveruse = 2 };
+  enum { kHighUsagePercent = 85 };
+  enum { kLowUsagePercent = 50 };
+  // A p95 capture queue delay of this many frame intervals means frames are
+  // piling up.
+  enum { kMaxQueuedFrames = 2 };
+  enum { kMinRampUpDelayMs = 10000 };
+  enum { kMaxRampUpDelayMs = 240000 };
+
+  explicit VCMEncodeUsageDetector(Clock* clock);
+
+  void Reset();
+
+  // Called when the frame with RTP timestamp |timestamp|, captured at
+  // |capture_time_ms| or 0 if unknown, is handed to the encoder.
+  void FrameCaptured(uint32_t timestamp, int64_t capture_time_ms);
+
+  // Called when the encoder outputs the frame with RTP timestamp |timestamp|.
+  // Only the first output of a frame counts, e.g. its first simulcast layer.
+  // Frames handed to the encoder before it, which it hasn't output, are
+  // taken as dropped by the encoder.
+  void FrameSent(uint32_t timestamp);
+
+  // Adds a frame captured at |capture_time_ms|, or 0 if unknown, which the
+  // encoder was given at |encode_start_ms| and took |encode_time_ms| to
+  // encode. Times are on the clock of the detector.
+  void FrameEncoded(int64_t capture_time_ms,
+                    int64_t encode_start_ms,
+                    int encode_time_ms);
+
+  // Returns the stats over the current window in |stats|, and whether the
+  // frame rate or resolution should change.
+  Usage Check(VCMEncodeUsageStats* stats);
+
+ private:
+  struct Sample {
+    int encode_time_ms;
+    int queue_delay_ms;
+    // Since the previous frame, -1 for the first frame of the window.
+    int interval_ms;
+  };
+
+  struct PendingFrame {
+    uint32_t timestamp;
+    int64_t capture_time_ms;
+    int64_t encode_start_ms;
+  };
+
+  void AddSample(int64_t capture_time_ms,
+                 int64_t encode_start_ms,
+                 int encode_time_ms) EXCLUSIVE_LOCKS_REQUIRED(crit_);
+  void ClearSamples() EXCLUSIVE_LOCKS_REQUIRED(crit_);
+  bool IsOverusing(const VCMEncodeUsageStats& stats,
+                   int frame_interval_ms) const;
+  bool IsUnderusing(const VCMEncodeUsageStats& stats,
+                    int frame_interval_ms) const;
+
+  Clock* const clock_;
+  rtc::CriticalSection crit_;
+  Sample samples_[kWindowSize] GUARDED_BY(crit_);
+  size_t num_samples_ GUARDED_BY(crit_);
+  size_t next_index_ GUARDED_BY(crit_);
+  int64_t last_capture_time_ms_ GUARDED_BY(crit_);
+  // Frames handed to the encoder and not output yet, in input order. At most
+  // kWindowSize, older ones are taken as dropped.
+  std::list<PendingFrame> pending_frames_ GUARDED_BY(crit_);
+  int checks_above_threshold_ GUARDED_BY(crit_);
+  // Overuses not yet undone by an underuse.
+  int num_overuses_ GUARDED_BY(crit_);
+  // Since when the checks found the usage low, -1 if the last one did not.
+  int64_t low_usage_since_ms_ GUARDED_BY(crit_);
+  int64_t last_adaptation_ms_ GUARDED_BY(crit_);
+  bool last_adaptation_was_underuse_ GUARDED_BY(crit_);
+  int ramp_up_delay_ms_ GUARDED_BY(crit_);
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_ENCODE_USAGE_DETECTOR_H_
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include "video_coding/main/source/encode_usage_detector.h"
+#include "system_wrappers/interface/clock.h"
+
+namespace webrtc {
+
+namespace {
+const int kFrameIntervalMs = 33;
+}  // namespace
+
+class VCMEncodeUsageDetectorTest : public ::testing::Test {
+ protected:
+  VCMEncodeUsageDetectorTest() : clock_(1000), detector_(&clock_) {}
+
+  // Encodes one second of frames taking |encode_time_ms| each, which waited
+  // |queue_delay_ms| after capture, and checks the usage.
+  VCMEncodeUsageDetector::Usage EncodeOneSecond(int encode_time_ms,
+                                                int queue_delay_ms) {
+    for (int i = 0; i < 1000 / kFrameIntervalMs; ++i) {
+      const int64_t capture_time_ms = clock_.TimeInMilliseconds();
+      detector_.FrameEncoded(capture_time_ms,
+                             capture_time_ms + queue_delay_ms,
+                             encode_time_ms);
+      clock_.AdvanceTimeMilliseconds(kFrameIntervalMs);
+    }
+    return detector_.Check(&stats_);
+  }
+
+  SimulatedClock clock_;
+  VCMEncodeUsageDetector detector_;
+  VCMEncodeUsageStats stats_;
+};
+
+TEST_F(VCMEncodeUsageDetectorTest, NoStatsBeforeMinSamples) {
+  for (int i = 0; i < VCMEncodeUsageDetector::kMinSamples - 1; ++i)
+    detector_.FrameEncoded(0, i * kFrameIntervalMs, 30);
+  EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage, detector_.Check(&stats_));
+  EXPECT_EQ(-1, stats_.encode_time_p95_ms);
+  EXPECT_EQ(-1, stats_.encode_usage_p95_percent);
+}
+
+TEST_F(VCMEncodeUsageDetectorTest, ReportsPercentiles) {
+  // One frame in ten takes three times as long, like a key frame.
+  for (int i = 0; i < VCMEncodeUsageDetector::kWindowSize; ++i) {
+    const int64_t capture_time_ms = 1000 + i * kFrameIntervalMs;
+    detector_.FrameEncoded(capture_time_ms, capture_time_ms + 5,
+                           i % 10 == 0 ? 30 : 10);
+  }
+  EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage, detector_.Check(&stats_));
+  EXPECT_EQ(10, stats_.encode_time_p50_ms);
+  EXPECT_EQ(30, stats_.encode_time_p95_ms);
+  EXPECT_EQ(10 * 100 / kFrameIntervalMs, stats_.encode_usage_p50_percent);
+  EXPECT_EQ(30 * 100 / kFrameIntervalMs, stats_.encode_usage_p95_percent);
+  EXPECT_EQ(5, stats_.capture_queue_delay_p50_ms);
+  EXPECT_EQ(5, stats_.capture_queue_delay_p95_ms);
+}
+
+// The encoder outputs each frame, and its simulcast layers, a frame later,
+// and drops every fifth frame.
+TEST_F(VCMEncodeUsageDetectorTest, EncodeTimeLastsUntilFrameIsSent) {
+  for (int i = 0; i < VCMEncodeUsageDetector::kWindowSize; ++i) {
+    const uint32_t timestamp = 90 * kFrameIntervalMs * i;
+    detector_.FrameCaptured(timestamp, clock_.TimeInMilliseconds() - 5);
+    clock_.AdvanceTimeMilliseconds(kFrameIntervalMs);
+    if (i % 5 != 0) {
+      detector_.FrameSent(timestamp);
+      detector_.FrameSent(timestamp);
+    }
+  }
+  EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage, detector_.Check(&stats_));
+  EXPECT_EQ(kFrameIntervalMs, stats_.encode_time_p50_ms);
+  EXPECT_EQ(kFrameIntervalMs, stats_.encode_time_p95_ms);
+  EXPECT_EQ(5, stats_.capture_queue_delay_p95_ms);
+}
+
+TEST_F(VCMEncodeUsageDetectorTest, OveruseWhenEncodeTimeNearsFrameInterval) {
+  EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage, EncodeOneSecond(20, 0));
+  EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage, EncodeOneSecond(31, 0));
+  EXPECT_EQ(VCMEncodeUsageDetector::kOveruse, EncodeOneSecond(31, 0));
+}
+
+TEST_F(VCMEncodeUsageDetectorTest, OveruseWhenFramesQueueUp) {
+  EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage, EncodeOneSecond(10, 0));
+  EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage,
+            EncodeOneSecond(10, 3 * kFrameIntervalMs));
+  EXPECT_EQ(VCMEncodeUsageDetector::kOveruse,
+            EncodeOneSecond(10, 3 * kFrameIntervalMs));
+}
+
+TEST_F(VCMEncodeUsageDetectorTest, NoUnderuseWithoutOveruse) {
+  for (int i = 0; i < 30; ++i)
+    EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage, EncodeOneSecond(5, 0));
+}
+
+TEST_F(VCMEncodeUsageDetectorTest, UnderuseAfterRampUpDelay) {
+  EncodeOneSecond(31, 0);
+  ASSERT_EQ(VCMEncodeUsageDetector::kOveruse, EncodeOneSecond(31, 0));
+  int seconds = 0;
+  while (EncodeOneSecond(5, 0) != VCMEncodeUsageDetector::kUnderuse)
+    ASSERT_LT(++seconds, 60);
+  EXPECT_GE(seconds * 1000, VCMEncodeUsageDetector::kMinRampUpDelayMs);
+  // The overuse is undone, no further underuse.
+  for (int i = 0; i < 30; ++i)
+    EXPECT_EQ(VCMEncodeUsageDetector::kNormalUsage, EncodeOneSecond(5, 0));
+}
+
+TEST_F(VCMEncodeUsageDetectorTest, RampUpDelayDoublesWhenOverusingAgain) {
+  EncodeOneSecond(31, 0);
+  ASSERT_EQ(VCMEncodeUsageDetector::kOveruse, EncodeOneSecond(31, 0));
+  while (EncodeOneSecond(5, 0) != VCMEncodeUsageDetector::kUnderuse) {
+  }
+  // The higher setting overuses right away.
+  EncodeOneSecond(31, 0);
+  ASSERT_EQ(VCMEncodeUsageDetector::kOveruse, EncodeOneSecond(31, 0));
+  int seconds = 0;
+  while (EncodeOneSecond(5, 0) != VCMEncodeUsageDetector::kUnderuse)
+    ASSERT_LT(++seconds, 60);
+  EXPECT_GE(seconds * 1000, 2 * VCMEncodeUsageDetector::kMinRampUpDelayMs);
+}
+
+}  // namespace webrtc
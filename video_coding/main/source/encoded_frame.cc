@@ -10,6 +10,7 @@
 
 #include "video_coding/main/interface/video_coding_defines.h"
 #include "video_coding/main/source/encoded_frame.h"
+#include "video_coding/main/source/encoded_frame_buffer_pool.h"
 #include "video_coding/main/source/generic_encoder.h"
 #include "video_coding/main/source/jitter_buffer_common.h"
 
@@ -79,8 +80,9 @@ void VCMEncodedFrame::Free()
     Reset();
     if (_buffer != NULL)
     {
-        delete [] _buffer;
+        EncodedFrameBufferPool::Global()->Free(_buffer, _size);
         _buffer = NULL;
+        _size = 0;
     }
 }
 
@@ -213,16 +215,20 @@ void VCMEncodedFrame::VerifyAndAllocate(size_t minimumSize)
 {
     if(minimumSize > _size)
     {
-        // create buffer of sufficient size
-        uint8_t* newBuffer = new uint8_t[minimumSize];
+        // The pool rounds the size up to its next size class, so that a frame
+        // growing packet by packet only reallocates a few times.
+        EncodedFrameBufferPool* pool = EncodedFrameBufferPool::Global();
+        const size_t newSize = EncodedFrameBufferPool::AllocationSize(
+            minimumSize);
+        uint8_t* newBuffer = pool->Allocate(newSize);
         if(_buffer)
         {
             // copy old data
-            memcpy(newBuffer, _buffer, _size);
-            delete [] _buffer;
+            memcpy(newBuffer, _buffer, _length);
+            pool->Free(_buffer, _size);
         }
         _buffer = newBuffer;
-        _size = minimumSize;
+        _size = newSize;
     }
 }
 
@@ -104,9 +104,10 @@ public:
 protected:
     /**
     * Verifies that current allocated buffer size is larger than or equal to the input size.
-    * If the current buffer size is smaller, a new allocation is made and the old buffer data
-    * is copied to the new buffer.
-    * Buffer size is updated to minimumSize.
+    * If the current buffer size is smaller, a new buffer is taken from
+    * EncodedFrameBufferPool::Global() and the first _length bytes of the old
+    * buffer are copied to it. The new buffer is not zeroed.
+    * Buffer size is updated to EncodedFrameBufferPool::AllocationSize(minimumSize).
     */
     void VerifyAndAllocate(size_t minimumSize);
 
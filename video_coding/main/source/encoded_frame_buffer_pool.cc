@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "video_coding/main/source/encoded_frame_buffer_pool.h"
+
+#include <assert.h>
+
+namespace webrtc {
+
+EncodedFrameBufferPool::SizeClass::SizeClass()
+    : crit_sect(CriticalSectionWrapper::CreateCriticalSection()),
+      num_allocations(0),
+      num_reused(0),
+      num_in_use(0) {
+}
+
+EncodedFrameBufferPool::EncodedFrameBufferPool() {
+}
+
+EncodedFrameBufferPool::~EncodedFrameBufferPool() {
+  for (size_t i = 0; i < kNumSizeClasses; ++i) {
+    SizeClass& size_class = size_classes_[i];
+    CriticalSectionScoped cs(size_class.crit_sect.get());
+    assert(size_class.num_in_use == 0);
+    for (size_t j = 0; j < size_class.free_buffers.size(); ++j)
+      delete[] size_class.free_buffers[j];
+  }
+}
+
+EncodedFrameBufferPool* EncodedFrameBufferPool::Global() {
+  static EncodedFrameBufferPool* const pool = new EncodedFrameBufferPool();
+  return pool;
+}
+
+size_t EncodedFrameBufferPool::SizeClassIndex(size_t size) {
+  size_t index = 0;
+  while (index < kNumSizeClasses && SizeClassSize(index) < size)
+    ++index;
+  return index;
+}
+
+size_t EncodedFrameBufferPool::AllocationSize(size_t size) {
+  const size_t index = SizeClassIndex(size);
+  return index < kNumSizeClasses ? SizeClassSize(index) : size;
+}
+
+uint8_t* EncodedFrameBufferPool::Allocate(size_t size) {
+  const size_t index = SizeClassIndex(size);
+  if (index == kNumSizeClasses)
+    return new uint8_t[size];
+  SizeClass& size_class = size_classes_[index];
+  {
+    CriticalSectionScoped cs(size_class.crit_sect.get());
+    ++size_class.num_allocations;
+    ++size_class.num_in_use;
+    if (!size_class.free_buffers.empty()) {
+      ++size_class.num_reused;
+      uint8_t* buffer = size_class.free_buffers.back();
+      size_class.free_buffers.pop_back();
+      return buffer;
+    }
+  }
+  return new uint8_t[SizeClassSize(index)];
+}
+
+void EncodedFrameBufferPool::Free(uint8_t* buffer, size_t size) {
+  const size_t index = SizeClassIndex(size);
+  if (index == kNumSizeClasses) {
+    delete[] buffer;
+    return;
+  }
+  assert(size == SizeClassSize(index));
+  SizeClass& size_class = size_classes_[index];
+  {
+    CriticalSectionScoped cs(size_class.crit_sect.get());
+    assert(size_class.num_in_use > 0);
+    --size_class.num_in_use;
+    if ((size_class.free_buffers.size() + 1) * size <=
+        kMaxFreeBytesPerSizeClass) {
+      size_class.free_buffers.push_back(buffer);
+      return;
+    }
+  }
+  delete[] buffer;
+}
+
+EncodedFrameBufferPool::Stats EncodedFrameBufferPool::GetStats() const {
+  Stats stats;
+  for (size_t i = 0; i < kNumSizeClasses; ++i) {
+    const SizeClass& size_class = size_classes_[i];
+    CriticalSectionScoped cs(size_class.crit_sect.get());
+    stats.num_allocations += size_class.num_allocations;
+    stats.num_reused += size_class.num_reused;
+    stats.bytes_in_use += size_class.num_in_use * SizeClassSize(i);
+    stats.bytes_free += size_class.free_buffers.size() * SizeClassSize(i);
+  }
+  return stats;
+}
+
+}  // namespace webrtc
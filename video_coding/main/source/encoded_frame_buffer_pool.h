@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_ENCODED_FRAME_BUFFER_POOL_H_
+#define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_ENCODED_FRAME_BUFFER_POOL_H_
+
+#include <vector>
+
+#include "base/scoped_ptr.h"
+#include "base/thread_annotations.h"
+#include "system_wrappers/interface/critical_section_wrapper.h"
+#include "typedefs.h"
+
+namespace webrtc {
+
+// Recycles the buffers of VCMEncodedFrames, in a few size classes growing by
+// a factor of 4, so that frames growing packet by packet don't reallocate for
+// every packet and that freed buffers can be reused by the frames of other
+// streams. One pool is shared by all jitter buffers in the process, see
+// Global(); with hundreds of receive streams malloc contention otherwise
+// shows up in profiles. Each size class has its own lock.
+//
+// Buffers are not zeroed when reused. Buffers larger than the largest size
+// class are allocated and freed directly.
+class EncodedFrameBufferPool {
+ public:
+  static const size_t kNumSizeClasses = 6;
+  static const size_t kSmallestSizeClass = 4096;
+  // No more than this is kept in the free buffers of each size class.
+  static const size_t kMaxFreeBytesPerSizeClass = 16 * 1024 * 1024;
+
+  struct Stats {
+    Stats()
+        : num_allocations(0),
+          num_reused(0),
+          bytes_in_use(0),
+          bytes_free(0) {}
+
+    // Share of the allocations served with a free buffer.
+    double hit_rate() const {
+      return num_allocations > 0 ?
+          static_cast<double>(num_reused) / num_allocations : 0.0;
+    }
+    // Bytes allocated by the pool, in use or not.
+    size_t bytes_resident() const { return bytes_in_use + bytes_free; }
+
+    uint64_t num_allocations;
+    uint64_t num_reused;
+    size_t bytes_in_use;
+    size_t bytes_free;
+  };
+
+  EncodedFrameBufferPool();
+  ~EncodedFrameBufferPool();
+
+  // The pool used by VCMEncodedFrame. Never deleted, so that frames can be
+  // freed at any time.
+  static EncodedFrameBufferPool* Global();
+
+  // Returns the size of the buffer Allocate returns for |size| bytes.
+  static size_t AllocationSize(size_t size);
+
+  // Returns a buffer of AllocationSize(|size|) bytes.
+  uint8_t* Allocate(size_t size);
+  // Returns |buffer|, which was allocated with AllocationSize() |size|, to
+  // the pool.
+  void Free(uint8_t* buffer, size_t size);
+
+  Stats GetStats() const;
+
+ private:
+  struct SizeClass {
+    SizeClass();
+
+    rtc::scoped_ptr<CriticalSectionWrapper> crit_sect;
+    std::vector<uint8_t*> free_buffers GUARDED_BY(crit_sect);
+    uint64_t num_allocations GUARDED_BY(crit_sect);
+    uint64_t num_reused GUARDED_BY(crit_sect);
+    size_t num_in_use GUARDED_BY(crit_sect);
+  };
+
+  // Returns the index of the smallest size class of at least |size| bytes,
+  // or kNumSizeClasses if there is none.
+  static size_t SizeClassIndex(size_t size);
+  static size_t SizeClassSize(size_t index) {
+    return kSmallestSizeClass << (2 * index);
+  }
+
+  SizeClass size_classes_[kNumSizeClasses];
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_ENCODED_FRAME_BUFFER_POOL_H_
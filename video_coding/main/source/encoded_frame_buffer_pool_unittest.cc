@@ -0,0 +1,168 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+#include "base/scoped_ptr.h"
+#include "video_coding/main/source/encoded_frame_buffer_pool.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "system_wrappers/interface/tick_util.h"
+#include "test/testsupport/perf_test.h"
+
+namespace webrtc {
+
+TEST(EncodedFrameBufferPoolTest, AllocationSize) {
+  EXPECT_EQ(4096u, EncodedFrameBufferPool::AllocationSize(1));
+  EXPECT_EQ(4096u, EncodedFrameBufferPool::AllocationSize(4096));
+  EXPECT_EQ(16384u, EncodedFrameBufferPool::AllocationSize(4097));
+  EXPECT_EQ(65536u, EncodedFrameBufferPool::AllocationSize(30000));
+  EXPECT_EQ(4194304u, EncodedFrameBufferPool::AllocationSize(4000000));
+  // Too large for any size class.
+  EXPECT_EQ(5000000u, EncodedFrameBufferPool::AllocationSize(5000000));
+}
+
+TEST(EncodedFrameBufferPoolTest, ReusesFreedBuffers) {
+  EncodedFrameBufferPool pool;
+  uint8_t* buffer = pool.Allocate(1000);
+  pool.Free(buffer, EncodedFrameBufferPool::AllocationSize(1000));
+  // Any size of the same size class gets the freed buffer.
+  EXPECT_EQ(buffer, pool.Allocate(4000));
+  // Other size classes don't.
+  uint8_t* other_buffer = pool.Allocate(5000);
+  EXPECT_NE(buffer, other_buffer);
+  pool.Free(buffer, 4096);
+  pool.Free(other_buffer, 16384);
+}
+
+TEST(EncodedFrameBufferPoolTest, Stats) {
+  EncodedFrameBufferPool pool;
+  EncodedFrameBufferPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(0u, stats.num_allocations);
+  EXPECT_EQ(0.0, stats.hit_rate());
+  EXPECT_EQ(0u, stats.bytes_resident());
+
+  uint8_t* small_buffer = pool.Allocate(4096);
+  uint8_t* large_buffer = pool.Allocate(65536);
+  stats = pool.GetStats();
+  EXPECT_EQ(2u, stats.num_allocations);
+  EXPECT_EQ(0u, stats.num_reused);
+  EXPECT_EQ(4096u + 65536u, stats.bytes_in_use);
+  EXPECT_EQ(0u, stats.bytes_free);
+
+  pool.Free(large_buffer, 65536);
+  stats = pool.GetStats();
+  EXPECT_EQ(4096u, stats.bytes_in_use);
+  EXPECT_EQ(65536u, stats.bytes_free);
+  EXPECT_EQ(4096u + 65536u, stats.bytes_resident());
+
+  large_buffer = pool.Allocate(65536);
+  stats = pool.GetStats();
+  EXPECT_EQ(3u, stats.num_allocations);
+  EXPECT_EQ(1u, stats.num_reused);
+  EXPECT_DOUBLE_EQ(1.0 / 3, stats.hit_rate());
+  EXPECT_EQ(0u, stats.bytes_free);
+
+  pool.Free(small_buffer, 4096);
+  pool.Free(large_buffer, 65536);
+}
+
+TEST(EncodedFrameBufferPoolTest, DoesNotPoolOversizedBuffers) {
+  EncodedFrameBufferPool pool;
+  const size_t kSize = 8 * 1024 * 1024;
+  uint8_t* buffer = pool.Allocate(kSize);
+  buffer[kSize - 1] = 0;
+  pool.Free(buffer, kSize);
+  EncodedFrameBufferPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(0u, stats.num_allocations);
+  EXPECT_EQ(0u, stats.bytes_resident());
+}
+
+TEST(EncodedFrameBufferPoolTest, LimitsFreeBytesPerSizeClass) {
+  EncodedFrameBufferPool pool;
+  const size_t kSize = 4194304;
+  const size_t kMaxFreeBuffers =
+      EncodedFrameBufferPool::kMaxFreeBytesPerSizeClass / kSize;
+  std::vector<uint8_t*> buffers;
+  for (size_t i = 0; i < kMaxFreeBuffers + 2; ++i)
+    buffers.push_back(pool.Allocate(kSize));
+  for (size_t i = 0; i < buffers.size(); ++i)
+    pool.Free(buffers[i], kSize);
+  EncodedFrameBufferPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(0u, stats.bytes_in_use);
+  EXPECT_EQ(kMaxFreeBuffers * kSize, stats.bytes_free);
+}
+
+class EncodedFrameBufferPoolThreadTest : public ::testing::Test {
+ protected:
+  enum { kNumThreads = 8 };
+  enum { kIterationsPerThread = 20000 };
+
+  static bool AllocateThread(void* obj) {
+    static_cast<EncodedFrameBufferPoolThreadTest*>(obj)->AllocateAndFree();
+    return false;
+  }
+
+  // Mimics the frames of a receive stream: a few frames in flight, mostly
+  // delta frames in the smaller size classes and an occasional key frame.
+  void AllocateAndFree() {
+    const size_t kSizes[] = {1200, 6000, 20000, 20000, 80000, 300000};
+    const size_t kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+    const size_t kFramesInFlight = 4;
+    uint8_t* buffers[kFramesInFlight] = {NULL};
+    size_t sizes[kFramesInFlight] = {0};
+    for (int i = 0; i < kIterationsPerThread; ++i) {
+      const size_t slot = i % kFramesInFlight;
+      if (buffers[slot])
+        pool_.Free(buffers[slot], sizes[slot]);
+      sizes[slot] = EncodedFrameBufferPool::AllocationSize(
+          kSizes[i % kNumSizes]);
+      buffers[slot] = pool_.Allocate(sizes[slot]);
+      buffers[slot][0] = static_cast<uint8_t>(i);
+    }
+    for (size_t slot = 0; slot < kFramesInFlight; ++slot)
+      pool_.Free(buffers[slot], sizes[slot]);
+  }
+
+  EncodedFrameBufferPool pool_;
+};
+
+TEST_F(EncodedFrameBufferPoolThreadTest, AllocationRate) {
+  std::vector<ThreadWrapper*> threads;
+  const int64_t start_us = TickTime::MicrosecondTimestamp();
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(ThreadWrapper::CreateThread(
+        AllocateThread, this, "EncodedFrameBufferPoolTest").release());
+    ASSERT_TRUE(threads.back()->Start());
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Stop();
+    delete threads[i];
+  }
+  const int64_t elapsed_us = TickTime::MicrosecondTimestamp() - start_us;
+
+  EncodedFrameBufferPool::Stats stats = pool_.GetStats();
+  EXPECT_EQ(static_cast<uint64_t>(kNumThreads * kIterationsPerThread),
+            stats.num_allocations);
+  EXPECT_EQ(0u, stats.bytes_in_use);
+  EXPECT_GT(stats.hit_rate(), 0.9);
+  test::PrintResult("encoded_frame_buffer_pool_allocations", "",
+                    "8_threads",
+                    stats.num_allocations /
+                        (std::max<int64_t>(elapsed_us, 1) / 1e6),
+                    "allocations/s", true);
+  test::PrintResult("encoded_frame_buffer_pool_hit_rate", "", "8_threads",
+                    stats.hit_rate() * 100, "%", false);
+  test::PrintResult("encoded_frame_buffer_pool_resident", "", "8_threads",
+                    stats.bytes_resident() / 1024.0, "KB", false);
+}
+
+}  // namespace webrtc
@@ -14,6 +14,7 @@
 #include <string.h>
 
 #include "base/checks.h"
+#include "video_coding/main/source/h264_depacketizer.h"
 #include "video_coding/main/source/packet.h"
 #include "system_wrappers/interface/logging.h"
 
@@ -104,22 +105,23 @@ VCMFrameBuffer::InsertPacket(const VCMPacket& packet,
         }
     }
 
-    uint32_t requiredSizeBytes = Length() + packet.sizeBytes +
-                   (packet.insertStartCode ? kH264StartCodeLengthBytes : 0);
+    size_t packet_length = packet.sizeBytes +
+        (packet.insertStartCode ? kH264StartCodeLengthBytes : 0);
+    if (packet.codec == kVideoCodecH264) {
+        packet_length = H264Depacketizer::AnnexBLength(
+            packet.sizeBytes, packet.codecSpecificHeader.codecHeader.H264,
+            packet.insertStartCode);
+    }
+    uint32_t requiredSizeBytes = Length() + packet_length;
     if (requiredSizeBytes >= _size) {
         const uint8_t* prevBuffer = _buffer;
-        const uint32_t increments = requiredSizeBytes /
-                                          kBufferIncStepSizeBytes +
-                                        (requiredSizeBytes %
-                                         kBufferIncStepSizeBytes > 0);
-        const uint32_t newSize = _size +
-                                       increments * kBufferIncStepSizeBytes;
-        if (newSize > kMaxJBFrameSizeBytes) {
+        if (requiredSizeBytes > kMaxJBFrameSizeBytes) {
             LOG(LS_ERROR) << "Failed to insert packet due to frame being too "
                              "big.";
             return kSizeError;
         }
-        VerifyAndAllocate(newSize);
+        // Grows the buffer to the next size class of the buffer pool.
+        VerifyAndAllocate(requiredSizeBytes);
         _sessionInfo.UpdateDataPointers(prevBuffer, _buffer);
     }
 
@@ -278,6 +280,8 @@ VCMFrameBuffer::PrepareForDecode(bool continuous) {
     size_t bytes_removed = _sessionInfo.MakeDecodable();
     _length -= bytes_removed;
 #endif
+    if (_codec == kVideoCodecH264)
+        _sessionInfo.BuildH264FragmentationHeader(_buffer, &_fragmentation);
     // Transfer frame information to EncodedFrame and create any codec
     // specific information.
     _frameType = ConvertFrameType(_sessionInfo.FrameType());
@@ -68,7 +68,9 @@ int32_t VCMDecodedFrameCallback::Decoded(VideoFrame& decodedImage) {
         decodedImage.timestamp(),
         frameInfo->decodeStartTimeMs,
         _clock->TimeInMilliseconds(),
-        frameInfo->renderTimeMs);
+        frameInfo->renderTimeMs,
+        frameInfo->frameType,
+        frameInfo->frameSize);
 
     if (callback != NULL)
     {
@@ -149,6 +151,8 @@ int32_t VCMGenericDecoder::Decode(const VCMEncodedFrame& frame,
     _frameInfos[_nextFrameInfoIdx].decodeStartTimeMs = nowMs;
     _frameInfos[_nextFrameInfoIdx].renderTimeMs = frame.RenderTimeMs();
     _frameInfos[_nextFrameInfoIdx].rotation = frame.rotation();
+    _frameInfos[_nextFrameInfoIdx].frameType = frame.FrameType();
+    _frameInfos[_nextFrameInfoIdx].frameSize = frame.Length();
     _callback->Map(frame.TimeStamp(), &_frameInfos[_nextFrameInfoIdx]);
 
     _nextFrameInfoIdx = (_nextFrameInfoIdx + 1) % kDecoderFrameMemoryLength;
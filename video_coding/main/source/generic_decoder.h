@@ -22,7 +22,10 @@ namespace webrtc
 
 class VCMReceiveCallback;
 
-enum { kDecoderFrameMemoryLength = 10 };
+// Frames that may be inside a decoder at once: FFmpeg frame threads delay the
+// output by up to 15 frames, a DecoderHost session queues up to 8 and a
+// GopParallelDecoder holds up to 96, plus one per decoder instance.
+enum { kDecoderFrameMemoryLength = 128 };
 
 struct VCMFrameInformation
 {
@@ -30,6 +33,8 @@ struct VCMFrameInformation
     int64_t     decodeStartTimeMs;
     void*             userData;
     VideoRotation rotation;
+    FrameType frameType;
+    size_t frameSize;
 };
 
 class VCMDecodedFrameCallback : public DecodedImageCallback
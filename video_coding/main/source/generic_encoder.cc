@@ -10,6 +10,7 @@
 
 #include "base/checks.h"
 #include "engine_configurations.h"
+#include "video_coding/main/source/encode_usage_detector.h"
 #include "video_coding/main/source/encoded_frame.h"
 #include "video_coding/main/source/generic_encoder.h"
 #include "video_coding/main/source/media_optimization.h"
@@ -75,6 +76,8 @@ void CopyCodecSpecific(const CodecSpecificInfo* info, RTPVideoHeader* rtp) {
     }
     case kVideoCodecH264:
       rtp->codec = kRtpVideoH264;
+      rtp->codecHeader.H264.InitRTPVideoHeaderH264();
+      rtp->simulcastIdx = info->codecSpecific.H264.simulcast_idx;
       return;
     case kVideoCodecGeneric:
       rtp->codec = kRtpVideoGeneric;
@@ -262,6 +265,7 @@ VCMEncodedFrameCallback::VCMEncodedFrameCallback(
     EncodedImageCallback* post_encode_callback)
     : _sendCallback(),
       _mediaOpt(NULL),
+      encode_usage_(NULL),
       _payloadType(0),
       _internalSource(false),
       _rotation(kVideoRotation_0),
@@ -294,6 +298,8 @@ int32_t VCMEncodedFrameCallback::Encoded(
     const EncodedImage& encodedImage,
     const CodecSpecificInfo* codecSpecificInfo,
     const RTPFragmentationHeader* fragmentationHeader) {
+  if (encode_usage_ != NULL)
+    encode_usage_->FrameSent(encodedImage._timeStamp);
   post_encode_callback_->Encoded(encodedImage, NULL, NULL);
 
   if (_sendCallback == NULL) {
@@ -336,4 +342,9 @@ VCMEncodedFrameCallback::SetMediaOpt(
     _mediaOpt = mediaOpt;
 }
 
+void VCMEncodedFrameCallback::SetEncodeUsageDetector(
+    VCMEncodeUsageDetector* encode_usage) {
+  encode_usage_ = encode_usage;
+}
+
 }  // namespace webrtc
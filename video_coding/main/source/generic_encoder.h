@@ -21,6 +21,7 @@
 
 namespace webrtc {
 class CriticalSectionWrapper;
+class VCMEncodeUsageDetector;
 
 namespace media_optimization {
 class MediaOptimization;
@@ -50,6 +51,10 @@ public:
     * Set media Optimization
     */
     void SetMediaOpt (media_optimization::MediaOptimization* mediaOpt);
+    /**
+    * Set the detector which is told when a frame has been encoded
+    */
+    void SetEncodeUsageDetector(VCMEncodeUsageDetector* encode_usage);
 
     void SetPayloadType(uint8_t payloadType) { _payloadType = payloadType; };
     void SetInternalSource(bool internalSource) { _internalSource = internalSource; };
@@ -59,6 +64,7 @@ public:
 private:
     VCMPacketizationCallback* _sendCallback;
     media_optimization::MediaOptimization* _mediaOpt;
+    VCMEncodeUsageDetector* encode_usage_;
     uint8_t _payloadType;
     bool _internalSource;
     VideoRotation _rotation;
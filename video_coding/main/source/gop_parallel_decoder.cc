@@ -0,0 +1,368 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "video_coding/main/source/gop_parallel_decoder.h"
+
+#include <algorithm>
+
+#include "base/checks.h"
+#include "system_wrappers/interface/logging.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "video_coding/main/source/generic_decoder.h"
+#include "video_coding/main/source/queued_encoded_frame.h"
+
+namespace webrtc {
+
+// VCMGenericDecoder drops the render time of frames decoded after it forgot
+// about them. The constructor lowers the bound further, to leave room for a
+// frame being decoded by each worker.
+static_assert(
+    GopParallelDecoder::kMaxPendingFrames < kDecoderFrameMemoryLength,
+    "VCMGenericDecoder must remember the pending frames");
+
+// A key frame and the frames up to the next one.
+struct GopParallelDecoder::Gop {
+  Gop() : assigned(false), closed(false), done(false) {}
+  ~Gop() {
+    for (QueuedEncodedFrame* frame : frames)
+      delete frame;
+  }
+
+  // Frames not yet taken by the worker.
+  std::deque<QueuedEncodedFrame*> frames;
+  // Decoded frames held back until the GOPs before this one are delivered.
+  std::vector<VideoFrame> decoded;
+  // Taken by a worker.
+  bool assigned;
+  // The next key frame has arrived, no more frames will be added.
+  bool closed;
+  // Closed and all frames decoded.
+  bool done;
+};
+
+// Decodes one GOP at a time with its decoder, on its own thread.
+class GopParallelDecoder::Worker : public DecodedImageCallback {
+ public:
+  Worker(GopParallelDecoder* parent, VideoDecoder* decoder)
+      : parent_(parent),
+        decoder_(decoder),
+        thread_(ThreadWrapper::CreateThread(Run, this, "GopParallelDecoder")),
+        gop_(nullptr),
+        busy_(false) {}
+
+  void Start() { RTC_CHECK(thread_->Start()); }
+  void Stop() { thread_->Stop(); }
+
+  VideoDecoder* decoder() const { return decoder_; }
+
+  // Called with |parent_->crit_| held.
+  bool busy() const { return busy_; }
+  void Detach() {
+    RTC_DCHECK(!busy_);
+    gop_ = nullptr;
+  }
+
+  int32_t Decoded(VideoFrame& decoded_image) override {
+    // |gop_| only changes on this thread, or while it is idle.
+    parent_->FrameDecoded(gop_, decoded_image);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+ private:
+  static bool Run(void* obj) { return static_cast<Worker*>(obj)->Process(); }
+
+  // Decodes the next frame of the GOP, or finishes the GOP. Returns false
+  // when stopping.
+  bool Process() {
+    QueuedEncodedFrame* frame = nullptr;
+    {
+      CriticalSectionScoped cs(parent_->crit_.get());
+      while (!parent_->stopping_) {
+        if (!parent_->draining_) {
+          if (!gop_)
+            gop_ = parent_->NextGop();
+          if (gop_ && (!gop_->frames.empty() || gop_->closed))
+            break;
+        }
+        parent_->work_cond_->SleepCS(*parent_->crit_);
+      }
+      if (parent_->stopping_)
+        return false;
+      if (!gop_->frames.empty()) {
+        frame = gop_->frames.front();
+        gop_->frames.pop_front();
+        --parent_->num_pending_frames_;
+        parent_->pending_cond_->WakeAll();
+      }
+      busy_ = true;
+    }
+
+    int32_t result = WEBRTC_VIDEO_CODEC_OK;
+    if (frame) {
+      result = frame->Decode(decoder_);
+      if (result < WEBRTC_VIDEO_CODEC_OK) {
+        LOG(LS_WARNING) << "Failed to decode frame with timestamp "
+                        << frame->image._timeStamp
+                        << ", error code: " << result;
+      }
+      delete frame;
+    } else {
+      parent_->GopDecoded(gop_);
+    }
+
+    CriticalSectionScoped cs(parent_->crit_.get());
+    if (!frame)
+      gop_ = nullptr;
+    if (result < WEBRTC_VIDEO_CODEC_OK &&
+        parent_->error_ == WEBRTC_VIDEO_CODEC_OK) {
+      parent_->error_ = result;
+    }
+    busy_ = false;
+    parent_->pending_cond_->WakeAll();
+    return true;
+  }
+
+  GopParallelDecoder* const parent_;
+  VideoDecoder* const decoder_;
+  const rtc::scoped_ptr<ThreadWrapper> thread_;
+  // Guarded by |parent_->crit_|.
+  Gop* gop_;
+  bool busy_;
+};
+
+GopParallelDecoder::GopParallelDecoder(
+    const std::vector<VideoDecoder*>& decoders)
+    : deliver_crit_(CriticalSectionWrapper::CreateCriticalSection()),
+      crit_(CriticalSectionWrapper::CreateCriticalSection()),
+      work_cond_(ConditionVariableWrapper::CreateConditionVariable()),
+      pending_cond_(ConditionVariableWrapper::CreateConditionVariable()),
+      callback_(nullptr),
+      needs_key_frame_(true),
+      max_pending_frames_(
+          std::min(static_cast<size_t>(kMaxPendingFrames),
+                   kDecoderFrameMemoryLength - decoders.size())),
+      num_pending_frames_(0),
+      error_(WEBRTC_VIDEO_CODEC_OK),
+      draining_(false),
+      stopping_(false) {
+  RTC_DCHECK(!decoders.empty());
+  // Leaves room in VCMGenericDecoder for at least one pending frame.
+  RTC_CHECK_LT(decoders.size(),
+               static_cast<size_t>(kDecoderFrameMemoryLength));
+  for (VideoDecoder* decoder : decoders)
+    workers_.push_back(new Worker(this, decoder));
+  for (Worker* worker : workers_)
+    worker->Start();
+}
+
+GopParallelDecoder::~GopParallelDecoder() {
+  {
+    CriticalSectionScoped cs(crit_.get());
+    StopDecoding();
+    stopping_ = true;
+    work_cond_->WakeAll();
+  }
+  for (Worker* worker : workers_)
+    worker->Stop();
+}
+
+int32_t GopParallelDecoder::InitDecode(const VideoCodec* codec_settings,
+                                       int32_t number_of_cores) {
+  {
+    CriticalSectionScoped cs(crit_.get());
+    StopDecoding();
+    error_ = WEBRTC_VIDEO_CODEC_OK;
+  }
+  // The GOPs already keep the cores busy.
+  const int32_t cores_per_decoder = std::max(
+      1, number_of_cores / static_cast<int32_t>(workers_.size()));
+  // Frame threads would output the last frames of a GOP while the decoder
+  // decodes the next one.
+  VideoCodec settings;
+  if (codec_settings) {
+    settings = *codec_settings;
+    if (settings.codecType == kVideoCodecH264)
+      settings.codecSpecific.H264.threadingMode = kH264SlicedThreads;
+  }
+  for (Worker* worker : workers_) {
+    worker->decoder()->RegisterDecodeCompleteCallback(worker);
+    int32_t ret = worker->decoder()->InitDecode(
+        codec_settings ? &settings : nullptr, cores_per_decoder);
+    if (ret != WEBRTC_VIDEO_CODEC_OK)
+      return ret;
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t GopParallelDecoder::Decode(
+    const EncodedImage& input_image,
+    bool missing_frames,
+    const RTPFragmentationHeader* fragmentation,
+    const CodecSpecificInfo* codec_specific_info,
+    int64_t render_time_ms) {
+  if (!input_image._buffer || !input_image._length)
+    return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+  const bool key_frame = input_image._frameType == kKeyFrame;
+  CriticalSectionScoped cs(crit_.get());
+  // Report an error from decoding an earlier frame, so that VideoReceiver
+  // requests a key frame.
+  if (error_ != WEBRTC_VIDEO_CODEC_OK) {
+    int32_t error = error_;
+    error_ = WEBRTC_VIDEO_CODEC_OK;
+    if (!key_frame) {
+      if (!needs_key_frame_) {
+        gops_.back()->closed = true;
+        work_cond_->WakeAll();
+      }
+      needs_key_frame_ = true;
+      return error;
+    }
+  }
+  if (needs_key_frame_ && !key_frame)
+    return WEBRTC_VIDEO_CODEC_ERROR;
+
+  while (num_pending_frames_ >= max_pending_frames_)
+    pending_cond_->SleepCS(*crit_);
+
+  if (key_frame) {
+    if (!needs_key_frame_)
+      gops_.back()->closed = true;
+    gops_.push_back(new Gop());
+    needs_key_frame_ = false;
+  }
+  gops_.back()->frames.push_back(new QueuedEncodedFrame(
+      input_image, missing_frames, fragmentation, codec_specific_info,
+      render_time_ms));
+  ++num_pending_frames_;
+  work_cond_->WakeAll();
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t GopParallelDecoder::RegisterDecodeCompleteCallback(
+    DecodedImageCallback* callback) {
+  CriticalSectionScoped cs(deliver_crit_.get());
+  callback_ = callback;
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t GopParallelDecoder::Release() {
+  {
+    CriticalSectionScoped cs(crit_.get());
+    StopDecoding();
+  }
+  int32_t ret = WEBRTC_VIDEO_CODEC_OK;
+  for (Worker* worker : workers_) {
+    int32_t worker_ret = worker->decoder()->Release();
+    if (worker_ret != WEBRTC_VIDEO_CODEC_OK)
+      ret = worker_ret;
+  }
+  return ret;
+}
+
+int32_t GopParallelDecoder::Reset() {
+  {
+    CriticalSectionScoped cs(crit_.get());
+    StopDecoding();
+    error_ = WEBRTC_VIDEO_CODEC_OK;
+  }
+  int32_t ret = WEBRTC_VIDEO_CODEC_OK;
+  for (Worker* worker : workers_) {
+    int32_t worker_ret = worker->decoder()->Reset();
+    if (worker_ret != WEBRTC_VIDEO_CODEC_OK)
+      ret = worker_ret;
+  }
+  return ret;
+}
+
+GopParallelDecoder::Gop* GopParallelDecoder::NextGop() {
+  for (Gop* gop : gops_) {
+    if (!gop->assigned) {
+      gop->assigned = true;
+      return gop;
+    }
+  }
+  return nullptr;
+}
+
+void GopParallelDecoder::FrameDecoded(Gop* gop, VideoFrame& frame) {
+  {
+    CriticalSectionScoped cs(crit_.get());
+    if (gop != gops_.front()) {
+      gop->decoded.push_back(VideoFrame());
+      gop->decoded.back().ShallowCopy(frame);
+      ++num_pending_frames_;
+      return;
+    }
+  }
+  // A worker which made |gop| the first one may still be delivering the
+  // frames held back for it.
+  CriticalSectionScoped cs(deliver_crit_.get());
+  if (callback_)
+    callback_->Decoded(frame);
+}
+
+void GopParallelDecoder::GopDecoded(Gop* gop) {
+  CriticalSectionScoped deliver_cs(deliver_crit_.get());
+  {
+    CriticalSectionScoped cs(crit_.get());
+    gop->done = true;
+    // Otherwise it is delivered with the GOPs before it.
+    if (gop != gops_.front())
+      return;
+  }
+  // Deliver the frames held back for the following GOPs, up to the first one
+  // still being decoded.
+  for (;;) {
+    std::vector<VideoFrame> frames;
+    bool head_done;
+    {
+      CriticalSectionScoped cs(crit_.get());
+      delete gops_.front();
+      gops_.pop_front();
+      if (gops_.empty())
+        return;
+      Gop* head = gops_.front();
+      frames.swap(head->decoded);
+      head_done = head->done;
+    }
+    if (callback_) {
+      for (VideoFrame& frame : frames)
+        callback_->Decoded(frame);
+    }
+    if (!frames.empty()) {
+      // Pending until delivered, as VCMGenericDecoder remembers them until
+      // then.
+      CriticalSectionScoped cs(crit_.get());
+      num_pending_frames_ -= frames.size();
+      pending_cond_->WakeAll();
+    }
+    if (!head_done)
+      return;
+  }
+}
+
+void GopParallelDecoder::StopDecoding() {
+  draining_ = true;
+  work_cond_->WakeAll();
+  for (Worker* worker : workers_) {
+    while (worker->busy())
+      pending_cond_->SleepCS(*crit_);
+  }
+  for (Worker* worker : workers_)
+    worker->Detach();
+  for (Gop* gop : gops_)
+    delete gop;
+  gops_.clear();
+  needs_key_frame_ = true;
+  num_pending_frames_ = 0;
+  draining_ = false;
+}
+
+}  // namespace webrtc
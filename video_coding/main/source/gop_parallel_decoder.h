@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_GOP_PARALLEL_DECODER_H_
+#define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_GOP_PARALLEL_DECODER_H_
+
+#include <deque>
+#include <vector>
+
+#include "base/scoped_ptr.h"
+#include "base/thread_annotations.h"
+#include "system_wrappers/interface/condition_variable_wrapper.h"
+#include "system_wrappers/interface/critical_section_wrapper.h"
+#include "system_wrappers/interface/scoped_vector.h"
+#include "video_coding/include/video_codec_interface.h"
+
+namespace webrtc {
+
+// Throughput mode of the receive pipeline, for streams that are recorded or
+// transcoded rather than rendered: decodes the independent GOPs of a stream
+// in parallel, one GOP per decoder instance, instead of one frame at a time.
+//
+// A GOP starts at a key frame, so no frame of a GOP references a frame of
+// another one. Decode queues the frame and returns; a key frame starts a new
+// GOP, which the next idle decoder takes, while the previous GOPs are still
+// being decoded. Decoded frames are delivered on the decoders' threads in
+// timestamp order: the frames of a GOP are held back until all earlier GOPs
+// are delivered.
+//
+// Register it with VideoCodingModule::RegisterExternalDecoder with
+// |internalRenderTiming| set, so that VCMReceiver hands out frames as soon as
+// they are complete instead of waiting for their render time. At most
+// |kMaxPendingFrames| frames are queued or held back, fewer with so many
+// decoders that VCMGenericDecoder could not remember them besides the frames
+// being decoded; Decode blocks while that many are pending. Decode times
+// reported to VCMTiming include the time a frame was queued.
+class GopParallelDecoder : public VideoDecoder {
+ public:
+  static const size_t kMaxPendingFrames = 96;
+
+  // |decoders| are instances of the same codec, as many as GOPs should be
+  // decoded at once. They must outlive this object and output every frame
+  // from the Decode call of that frame; H.264 decoders are initialized with
+  // slice threads for this.
+  explicit GopParallelDecoder(const std::vector<VideoDecoder*>& decoders);
+  ~GopParallelDecoder() override;
+
+  int32_t InitDecode(const VideoCodec* codec_settings,
+                     int32_t number_of_cores) override;
+
+  int32_t Decode(const EncodedImage& input_image,
+                 bool missing_frames,
+                 const RTPFragmentationHeader* fragmentation,
+                 const CodecSpecificInfo* codec_specific_info,
+                 int64_t render_time_ms) override;
+
+  int32_t RegisterDecodeCompleteCallback(
+      DecodedImageCallback* callback) override;
+
+  int32_t Release() override;
+  int32_t Reset() override;
+
+ private:
+  class Worker;
+  struct Gop;
+
+  // Returns the oldest GOP no worker has taken, or null.
+  Gop* NextGop() EXCLUSIVE_LOCKS_REQUIRED(crit_);
+  // Called on a worker thread for a frame decoded from |gop|.
+  void FrameDecoded(Gop* gop, VideoFrame& frame);
+  // Called on a worker thread when all frames of |gop| are decoded.
+  void GopDecoded(Gop* gop);
+  // Drops the queued GOPs and waits for the workers to go idle, after which
+  // the decoders may be used on the calling thread.
+  void StopDecoding() EXCLUSIVE_LOCKS_REQUIRED(crit_);
+
+  // Serializes the delivery of decoded frames. Acquired before |crit_|.
+  const rtc::scoped_ptr<CriticalSectionWrapper> deliver_crit_;
+  const rtc::scoped_ptr<CriticalSectionWrapper> crit_;
+  // Signaled when a GOP gets a frame or is closed.
+  const rtc::scoped_ptr<ConditionVariableWrapper> work_cond_;
+  // Signaled when frames stop pending or a worker goes idle.
+  const rtc::scoped_ptr<ConditionVariableWrapper> pending_cond_;
+  DecodedImageCallback* callback_ GUARDED_BY(deliver_crit_);
+  // GOPs not yet delivered, oldest first. The last one is open unless a key
+  // frame is needed.
+  std::deque<Gop*> gops_ GUARDED_BY(crit_);
+  bool needs_key_frame_ GUARDED_BY(crit_);
+  const size_t max_pending_frames_;
+  // Frames queued for decoding or held back for delivery.
+  size_t num_pending_frames_ GUARDED_BY(crit_);
+  int32_t error_ GUARDED_BY(crit_);
+  // Set while StopDecoding waits for the workers, which take no work then.
+  bool draining_ GUARDED_BY(crit_);
+  bool stopping_ GUARDED_BY(crit_);
+  ScopedVector<Worker> workers_;
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_GOP_PARALLEL_DECODER_H_
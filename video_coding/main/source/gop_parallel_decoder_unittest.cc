@@ -0,0 +1,241 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include "base/scoped_ptr.h"
+#include "system_wrappers/interface/critical_section_wrapper.h"
+#include "system_wrappers/interface/scoped_vector.h"
+#include "system_wrappers/interface/sleep.h"
+#include "video_coding/main/source/generic_decoder.h"
+#include "video_coding/main/source/gop_parallel_decoder.h"
+
+namespace webrtc {
+
+namespace {
+
+const int kMaxWaitMs = 10000;
+const uint32_t kTimestampDelta = 3000;
+const uint8_t kIdrNalu = 5;
+const uint8_t kSliceNalu = 1;
+
+// The timestamps of the delivered frames, in delivery order.
+class FrameLog : public DecodedImageCallback {
+ public:
+  FrameLog() : crit_(CriticalSectionWrapper::CreateCriticalSection()) {}
+
+  int32_t Decoded(VideoFrame& decoded_image) override {
+    CriticalSectionScoped cs(crit_.get());
+    timestamps_.push_back(decoded_image.timestamp());
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  bool WaitForFrames(size_t count) {
+    for (int i = 0; i < kMaxWaitMs; ++i) {
+      {
+        CriticalSectionScoped cs(crit_.get());
+        if (timestamps_.size() >= count)
+          return true;
+      }
+      SleepMs(1);
+    }
+    return false;
+  }
+
+  size_t num_frames() const {
+    CriticalSectionScoped cs(crit_.get());
+    return timestamps_.size();
+  }
+
+  std::vector<uint32_t> timestamps() const {
+    CriticalSectionScoped cs(crit_.get());
+    return timestamps_;
+  }
+
+ private:
+  const rtc::scoped_ptr<CriticalSectionWrapper> crit_;
+  std::vector<uint32_t> timestamps_;
+};
+
+// Decodes an H.264-like stream of one NAL unit per frame. The work is
+// proportional to the frame size, plus |sleep_ms| of waiting, and a slice must
+// follow the frame before it in the same decoder, as it would reference it.
+class FakeH264Decoder : public VideoDecoder {
+ public:
+  FakeH264Decoder(int passes_per_byte, int sleep_ms)
+      : passes_per_byte_(passes_per_byte),
+        sleep_ms_(sleep_ms),
+        callback_(nullptr),
+        has_reference_(false),
+        last_timestamp_(0),
+        checksum_(0) {
+    frame_.CreateEmptyFrame(16, 16, 16, 8, 8);
+  }
+
+  int32_t InitDecode(const VideoCodec* codec_settings,
+                     int32_t number_of_cores) override {
+    has_reference_ = false;
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t Decode(const EncodedImage& input_image,
+                 bool missing_frames,
+                 const RTPFragmentationHeader* fragmentation,
+                 const CodecSpecificInfo* codec_specific_info,
+                 int64_t render_time_ms) override {
+    const uint8_t nalu_type = input_image._buffer[4] & 0x1F;
+    if (nalu_type == kSliceNalu) {
+      EXPECT_TRUE(has_reference_);
+      EXPECT_EQ(last_timestamp_ + kTimestampDelta, input_image._timeStamp);
+    } else {
+      EXPECT_EQ(kIdrNalu, nalu_type);
+    }
+    has_reference_ = true;
+    last_timestamp_ = input_image._timeStamp;
+
+    for (int pass = 0; pass < passes_per_byte_; ++pass) {
+      for (size_t i = 0; i < input_image._length; ++i)
+        checksum_ = checksum_ * 31 + input_image._buffer[i];
+    }
+    if (sleep_ms_ > 0)
+      SleepMs(sleep_ms_);
+    frame_.set_timestamp(input_image._timeStamp);
+    callback_->Decoded(frame_);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t RegisterDecodeCompleteCallback(
+      DecodedImageCallback* callback) override {
+    callback_ = callback;
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  int32_t Release() override { return WEBRTC_VIDEO_CODEC_OK; }
+  int32_t Reset() override {
+    has_reference_ = false;
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+ private:
+  const int passes_per_byte_;
+  const int sleep_ms_;
+  DecodedImageCallback* callback_;
+  VideoFrame frame_;
+  bool has_reference_;
+  uint32_t last_timestamp_;
+  volatile uint32_t checksum_;
+};
+
+// A frame of the synthetic stream: an Annex B start code and a NAL unit of
+// |size| bytes.
+std::vector<uint8_t> CreateFrame(bool key_frame, size_t size) {
+  std::vector<uint8_t> frame(4 + size, 0xA5);
+  frame[0] = frame[1] = frame[2] = 0;
+  frame[3] = 1;
+  frame[4] = key_frame ? (0x60 | kIdrNalu) : (0x40 | kSliceNalu);
+  return frame;
+}
+
+}  // namespace
+
+class GopParallelDecoderTest : public ::testing::Test {
+ protected:
+  enum { kGopLength = 30 };
+
+  GopParallelDecoderTest()
+      : gop_length_(kGopLength),
+        sleep_ms_(0),
+        key_frame_(CreateFrame(true, 40000)),
+        delta_frame_(CreateFrame(false, 4000)) {}
+
+  int32_t Decode(VideoDecoder* decoder, int frame_number) {
+    const bool key_frame = frame_number % gop_length_ == 0;
+    std::vector<uint8_t>& payload = key_frame ? key_frame_ : delta_frame_;
+    EncodedImage image(&payload[0], payload.size(), payload.size());
+    image._timeStamp = frame_number * kTimestampDelta;
+    image._frameType = key_frame ? kKeyFrame : kDeltaFrame;
+    return decoder->Decode(image, false, nullptr, nullptr, -1);
+  }
+
+  // Decodes |num_frames| frames with |num_decoders| decoders and checks that
+  // all of them are delivered in order.
+  void DecodeStream(int num_decoders, int num_frames, int passes_per_byte) {
+    ScopedVector<FakeH264Decoder> decoders;
+    std::vector<VideoDecoder*> decoder_ptrs;
+    for (int i = 0; i < num_decoders; ++i) {
+      decoders.push_back(new FakeH264Decoder(passes_per_byte, sleep_ms_));
+      decoder_ptrs.push_back(decoders.back());
+    }
+    FrameLog log;
+    GopParallelDecoder decoder(decoder_ptrs);
+    decoder.RegisterDecodeCompleteCallback(&log);
+    EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder.InitDecode(nullptr, 1));
+
+    for (int i = 0; i < num_frames; ++i) {
+      EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, Decode(&decoder, i));
+      // VCMGenericDecoder remembers the frames not yet delivered.
+      EXPECT_LE(i + 1 - log.num_frames(),
+                static_cast<size_t>(kDecoderFrameMemoryLength));
+    }
+    EXPECT_TRUE(log.WaitForFrames(num_frames));
+
+    std::vector<uint32_t> timestamps = log.timestamps();
+    EXPECT_EQ(static_cast<size_t>(num_frames), timestamps.size());
+    for (size_t i = 0; i < timestamps.size(); ++i)
+      EXPECT_EQ(i * kTimestampDelta, timestamps[i]);
+  }
+
+  int gop_length_;
+  // Time each decoder waits per frame.
+  int sleep_ms_;
+  std::vector<uint8_t> key_frame_;
+  std::vector<uint8_t> delta_frame_;
+};
+
+TEST_F(GopParallelDecoderTest, DeliversEveryFrameInOrder) {
+  DecodeStream(3, 10 * kGopLength, 1);
+}
+
+// More frames than may be pending: Decode blocks until the decoders catch up.
+TEST_F(GopParallelDecoderTest, BlocksWhileTooManyFramesPending) {
+  DecodeStream(2, 2 * GopParallelDecoder::kMaxPendingFrames, 16);
+}
+
+// With a frame being decoded by each decoder, fewer frames may be pending.
+TEST_F(GopParallelDecoderTest, BlocksEarlierWithManyDecoders) {
+  // Short GOPs, so that every decoder has one, and decoders which wait, so
+  // that all of them are decoding at once.
+  gop_length_ = 2;
+  sleep_ms_ = 10;
+  DecodeStream(48, 4 * GopParallelDecoder::kMaxPendingFrames, 1);
+}
+
+TEST_F(GopParallelDecoderTest, WaitsForKeyFrame) {
+  FakeH264Decoder fake_decoder(1, 0);
+  FrameLog log;
+  GopParallelDecoder decoder(std::vector<VideoDecoder*>(1, &fake_decoder));
+  decoder.RegisterDecodeCompleteCallback(&log);
+  ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder.InitDecode(nullptr, 1));
+
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERROR, Decode(&decoder, 1));
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, Decode(&decoder, kGopLength));
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, Decode(&decoder, kGopLength + 1));
+  ASSERT_TRUE(log.WaitForFrames(2));
+
+  // After a reset, frames are decoded again from a key frame on.
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, decoder.Reset());
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERROR, Decode(&decoder, kGopLength + 2));
+  EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, Decode(&decoder, 2 * kGopLength));
+  ASSERT_TRUE(log.WaitForFrames(3));
+  EXPECT_EQ(2 * kGopLength * kTimestampDelta, log.timestamps()[2]);
+}
+
+}  // namespace webrtc
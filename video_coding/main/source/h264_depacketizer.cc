@@ -0,0 +1,178 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "video_coding/main/source/h264_depacketizer.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <limits>
+
+#include "video_coding/main/source/jitter_buffer_common.h"
+
+namespace webrtc {
+
+namespace {
+
+const size_t kNaluHeaderSize = 1;
+const size_t kLengthFieldSize = 2;
+const size_t kFuAHeaderSize = 2;
+const uint8_t kFBit = 0x80;
+const uint8_t kNriMask = 0x60;
+const uint8_t kSBit = 0x80;
+const uint8_t kEBit = 0x40;
+
+const uint8_t kStartCode[kH264StartCodeLengthBytes] = {0, 0, 0, 1};
+
+bool ParseStapA(const uint8_t* payload,
+                size_t length,
+                RTPVideoHeaderH264* h264) {
+  size_t offset = kNaluHeaderSize;
+  while (offset < length) {
+    if (h264->nalus_length == kMaxNalusPerPacket ||
+        length - offset < kLengthFieldSize) {
+      return false;
+    }
+    const size_t nalu_length = (payload[offset] << 8) | payload[offset + 1];
+    offset += kLengthFieldSize;
+    if (nalu_length == 0 || nalu_length > length - offset)
+      return false;
+    H264NaluInfo* nalu = &h264->nalus[h264->nalus_length++];
+    nalu->type = H264Depacketizer::GetNaluType(payload[offset]);
+    nalu->offset = static_cast<uint16_t>(offset);
+    nalu->length = static_cast<uint16_t>(nalu_length);
+    offset += nalu_length;
+  }
+  return h264->nalus_length > 0;
+}
+
+bool ParseFuA(const uint8_t* payload,
+              size_t length,
+              RTPVideoHeaderH264* h264) {
+  if (length <= kFuAHeaderSize)
+    return false;
+  const uint8_t fu_header = payload[1];
+  h264->fu_start = (fu_header & kSBit) != 0;
+  h264->fu_end = (fu_header & kEBit) != 0;
+  // A NAL unit which fits in one packet isn't fragmented.
+  if (h264->fu_start && h264->fu_end)
+    return false;
+  const uint8_t type = H264Depacketizer::GetNaluType(fu_header);
+  h264->fu_nalu_header = (payload[0] & (kFBit | kNriMask)) | type;
+  h264->nalus[0].type = type;
+  h264->nalus[0].offset = kFuAHeaderSize;
+  h264->nalus[0].length = static_cast<uint16_t>(length - kFuAHeaderSize);
+  h264->nalus_length = 1;
+  return true;
+}
+
+}  // namespace
+
+bool H264Depacketizer::Parse(const uint8_t* payload,
+                             size_t length,
+                             RTPVideoHeader* video_header,
+                             FrameType* frame_type) {
+  if (length < kNaluHeaderSize ||
+      length > std::numeric_limits<uint16_t>::max()) {
+    return false;
+  }
+  RTPVideoHeaderH264* h264 = &video_header->codecHeader.H264;
+  h264->InitRTPVideoHeaderH264();
+  video_header->codec = kRtpVideoH264;
+  video_header->isFirstPacket = true;
+
+  const uint8_t type = GetNaluType(payload[0]);
+  if (type == kStapA) {
+    h264->packetization_type = kH264StapA;
+    if (!ParseStapA(payload, length, h264))
+      return false;
+  } else if (type == kFuA) {
+    h264->packetization_type = kH264FuA;
+    if (!ParseFuA(payload, length, h264))
+      return false;
+    video_header->isFirstPacket = h264->fu_start;
+  } else if (type > 0 && type < kStapA) {
+    h264->packetization_type = kH264SingleNalu;
+    h264->nalus[0].type = type;
+    h264->nalus[0].offset = 0;
+    h264->nalus[0].length = static_cast<uint16_t>(length);
+    h264->nalus_length = 1;
+  } else {
+    // STAP-B, MTAP and FU-B are only allowed in the interleaved mode.
+    return false;
+  }
+  h264->nalu_type = h264->nalus[0].type;
+
+  if (frame_type) {
+    *frame_type = kVideoFrameDelta;
+    for (size_t i = 0; i < h264->nalus_length; ++i) {
+      if (h264->nalus[i].type == kIdr)
+        *frame_type = kVideoFrameKey;
+    }
+  }
+  return true;
+}
+
+size_t H264Depacketizer::AnnexBLength(size_t length,
+                                      const RTPVideoHeaderH264& header,
+                                      bool insert_start_code) {
+  const size_t start_code_length =
+      insert_start_code ? kH264StartCodeLengthBytes : 0;
+  if (header.nalus_length == 0)
+    return start_code_length + length;
+  if (header.packetization_type == kH264FuA) {
+    return header.nalus[0].length +
+        (header.fu_start ? start_code_length + kNaluHeaderSize : 0);
+  }
+  size_t annex_b_length = 0;
+  for (size_t i = 0; i < header.nalus_length; ++i)
+    annex_b_length += start_code_length + header.nalus[i].length;
+  return annex_b_length;
+}
+
+size_t H264Depacketizer::WriteAnnexB(const uint8_t* payload,
+                                     size_t length,
+                                     const RTPVideoHeaderH264& header,
+                                     bool insert_start_code,
+                                     uint8_t* buffer) {
+  if (header.nalus_length == 0) {
+    size_t written = 0;
+    if (insert_start_code) {
+      memcpy(buffer, kStartCode, kH264StartCodeLengthBytes);
+      written = kH264StartCodeLengthBytes;
+    }
+    memcpy(buffer + written, payload, length);
+    return written + length;
+  }
+  uint8_t* const start = buffer;
+  if (header.packetization_type == kH264FuA && header.fu_start) {
+    if (insert_start_code) {
+      memcpy(buffer, kStartCode, kH264StartCodeLengthBytes);
+      buffer += kH264StartCodeLengthBytes;
+    }
+    *buffer++ = header.fu_nalu_header;
+    memcpy(buffer, payload + header.nalus[0].offset, header.nalus[0].length);
+    return buffer + header.nalus[0].length - start;
+  }
+  for (size_t i = 0; i < header.nalus_length; ++i) {
+    const H264NaluInfo& nalu = header.nalus[i];
+    assert(static_cast<size_t>(nalu.offset) + nalu.length <= length);
+    // The data of a fragment other than the first continues the NAL unit.
+    if (insert_start_code && header.packetization_type != kH264FuA) {
+      memcpy(buffer, kStartCode, kH264StartCodeLengthBytes);
+      buffer += kH264StartCodeLengthBytes;
+    }
+    memcpy(buffer, payload + nalu.offset, nalu.length);
+    buffer += nalu.length;
+  }
+  return buffer - start;
+}
+
+}  // namespace webrtc
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_H264_DEPACKETIZER_H_
+#define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_H264_DEPACKETIZER_H_
+
+#include "interface/module_common_types.h"
+#include "typedefs.h"
+
+namespace webrtc {
+
+// Parses H.264 RTP payloads (RFC 6184, packetization mode 0 and 1: single NAL
+// unit, STAP-A and FU-A packets) into NAL unit descriptors, once per packet.
+// The session then writes the NAL units to the frame buffer in Annex B format
+// without parsing the payload again, and builds the fragmentation header of
+// the frame from them.
+class H264Depacketizer {
+ public:
+  enum NaluType {
+    kSlice = 1,
+    kIdr = 5,
+    kSei = 6,
+    kSps = 7,
+    kPps = 8,
+    kAud = 9,
+    kStapA = 24,
+    kFuA = 28
+  };
+
+  // Parses |payload| and sets the H.264 header, |isFirstPacket| and |codec|
+  // of |video_header|. |isFirstPacket| is set if the payload starts a NAL
+  // unit, i.e. unless it is a FU-A fragment other than the first.
+  // |frame_type|, if not NULL, is set to kVideoFrameKey if the payload
+  // carries an IDR slice, otherwise to kVideoFrameDelta.
+  // Returns false, leaving |video_header| and |frame_type| undefined, if the
+  // payload is malformed or uses a packetization this class doesn't support.
+  static bool Parse(const uint8_t* payload,
+                    size_t length,
+                    RTPVideoHeader* video_header,
+                    FrameType* frame_type);
+
+  // Returns the number of bytes |payload| takes in Annex B format, with a
+  // start code before each NAL unit if |insert_start_code|.
+  static size_t AnnexBLength(size_t length,
+                             const RTPVideoHeaderH264& header,
+                             bool insert_start_code);
+
+  // Writes |payload| in Annex B format to |buffer|, which must have room for
+  // AnnexBLength() bytes. Returns the number of bytes written.
+  static size_t WriteAnnexB(const uint8_t* payload,
+                            size_t length,
+                            const RTPVideoHeaderH264& header,
+                            bool insert_start_code,
+                            uint8_t* buffer);
+
+  static uint8_t GetNaluType(uint8_t nalu_header) {
+    return nalu_header & 0x1F;
+  }
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_H264_DEPACKETIZER_H_
@@ -0,0 +1,491 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+#include "interface/module_common_types.h"
+#include "video_coding/main/source/h264_depacketizer.h"
+#include "video_coding/main/source/packet.h"
+#include "video_coding/main/source/session_info.h"
+#include "system_wrappers/interface/tick_util.h"
+#include "test/testsupport/perf_test.h"
+
+namespace webrtc {
+
+namespace {
+
+typedef std::vector<uint8_t> Buffer;
+
+const size_t kMaxPayloadSize = 1200;
+const uint8_t kNri = 0x60;
+const uint8_t kStartCode[] = {0, 0, 0, 1};
+
+class Random {
+ public:
+  explicit Random(uint32_t seed) : state_(seed) {}
+  uint32_t Next() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_ >> 8;
+  }
+
+ private:
+  uint32_t state_;
+};
+
+Buffer CreateNalu(uint8_t type, size_t length, Random* random) {
+  Buffer nalu(length);
+  nalu[0] = kNri | type;
+  // Payload bytes are never 0, there is no start code emulation to care
+  // about.
+  for (size_t i = 1; i < length; ++i)
+    nalu[i] = static_cast<uint8_t>(random->Next() % 255 + 1);
+  return nalu;
+}
+
+void AppendUWord16(size_t value, Buffer* buffer) {
+  buffer->push_back(static_cast<uint8_t>(value >> 8));
+  buffer->push_back(static_cast<uint8_t>(value));
+}
+
+// Packetizes |nalus| like a sender in packetization mode 1: NAL units that
+// fit in a packet together are aggregated in STAP-A packets, larger ones are
+// sent in FU-A packets.
+std::vector<Buffer> Packetize(const std::vector<Buffer>& nalus) {
+  std::vector<Buffer> packets;
+  size_t i = 0;
+  while (i < nalus.size()) {
+    if (nalus[i].size() > kMaxPayloadSize) {
+      const Buffer& nalu = nalus[i++];
+      for (size_t offset = 1; offset < nalu.size();
+           offset += kMaxPayloadSize - 2) {
+        const size_t end =
+            std::min(nalu.size(), offset + kMaxPayloadSize - 2);
+        Buffer packet;
+        packet.push_back((nalu[0] & 0xE0) | H264Depacketizer::kFuA);
+        packet.push_back((offset == 1 ? 0x80 : 0) |
+                         (end == nalu.size() ? 0x40 : 0) |
+                         H264Depacketizer::GetNaluType(nalu[0]));
+        packet.insert(packet.end(), nalu.begin() + offset, nalu.begin() + end);
+        packets.push_back(packet);
+      }
+      continue;
+    }
+    size_t aggregated_size = 1 + 2 + nalus[i].size();
+    size_t j = i + 1;
+    while (j < nalus.size() &&
+           aggregated_size + 2 + nalus[j].size() <= kMaxPayloadSize) {
+      aggregated_size += 2 + nalus[j].size();
+      ++j;
+    }
+    if (j == i + 1) {
+      packets.push_back(nalus[i++]);
+      continue;
+    }
+    Buffer packet(1, kNri | H264Depacketizer::kStapA);
+    for (; i < j; ++i) {
+      AppendUWord16(nalus[i].size(), &packet);
+      packet.insert(packet.end(), nalus[i].begin(), nalus[i].end());
+    }
+    packets.push_back(packet);
+  }
+  return packets;
+}
+
+// A key frame with parameter sets, an SEI, an IDR slice sent in FU-A packets
+// and a smaller one in a packet of its own.
+std::vector<Buffer> CreateKeyFrame(Random* random) {
+  std::vector<Buffer> nalus;
+  nalus.push_back(CreateNalu(H264Depacketizer::kSps, 12, random));
+  nalus.push_back(CreateNalu(H264Depacketizer::kPps, 5, random));
+  nalus.push_back(CreateNalu(H264Depacketizer::kSei, 30, random));
+  nalus.push_back(CreateNalu(H264Depacketizer::kIdr, 3000, random));
+  nalus.push_back(CreateNalu(H264Depacketizer::kIdr, 900, random));
+  return nalus;
+}
+
+}  // namespace
+
+TEST(TestH264Depacketizer, SingleNalu) {
+  const uint8_t payload[] = {kNri | H264Depacketizer::kIdr, 0xFF, 0xAA};
+  RTPVideoHeader header;
+  FrameType frame_type;
+  ASSERT_TRUE(H264Depacketizer::Parse(payload, sizeof(payload), &header,
+                                      &frame_type));
+  EXPECT_EQ(kRtpVideoH264, header.codec);
+  EXPECT_TRUE(header.isFirstPacket);
+  EXPECT_EQ(kVideoFrameKey, frame_type);
+  const RTPVideoHeaderH264& h264 = header.codecHeader.H264;
+  EXPECT_EQ(kH264SingleNalu, h264.packetization_type);
+  EXPECT_EQ(H264Depacketizer::kIdr, h264.nalu_type);
+  ASSERT_EQ(1u, h264.nalus_length);
+  EXPECT_EQ(0, h264.nalus[0].offset);
+  EXPECT_EQ(sizeof(payload), h264.nalus[0].length);
+
+  uint8_t annex_b[sizeof(kStartCode) + sizeof(payload)];
+  ASSERT_EQ(sizeof(annex_b),
+            H264Depacketizer::AnnexBLength(sizeof(payload), h264, true));
+  ASSERT_EQ(sizeof(annex_b), H264Depacketizer::WriteAnnexB(
+      payload, sizeof(payload), h264, true, annex_b));
+  EXPECT_EQ(0, memcmp(kStartCode, annex_b, sizeof(kStartCode)));
+  EXPECT_EQ(0, memcmp(payload, annex_b + sizeof(kStartCode), sizeof(payload)));
+}
+
+TEST(TestH264Depacketizer, StapA) {
+  const uint8_t payload[] = {kNri | H264Depacketizer::kStapA,
+                             0, 2, kNri | H264Depacketizer::kSps, 0xFF,
+                             0, 3, kNri | H264Depacketizer::kPps, 0xAA, 0xBB,
+                             0, 1, kNri | H264Depacketizer::kSlice};
+  RTPVideoHeader header;
+  FrameType frame_type;
+  ASSERT_TRUE(H264Depacketizer::Parse(payload, sizeof(payload), &header,
+                                      &frame_type));
+  EXPECT_TRUE(header.isFirstPacket);
+  EXPECT_EQ(kVideoFrameDelta, frame_type);
+  const RTPVideoHeaderH264& h264 = header.codecHeader.H264;
+  EXPECT_EQ(kH264StapA, h264.packetization_type);
+  EXPECT_EQ(H264Depacketizer::kSps, h264.nalu_type);
+  ASSERT_EQ(3u, h264.nalus_length);
+  EXPECT_EQ(H264Depacketizer::kSps, h264.nalus[0].type);
+  EXPECT_EQ(3, h264.nalus[0].offset);
+  EXPECT_EQ(2, h264.nalus[0].length);
+  EXPECT_EQ(H264Depacketizer::kPps, h264.nalus[1].type);
+  EXPECT_EQ(7, h264.nalus[1].offset);
+  EXPECT_EQ(3, h264.nalus[1].length);
+  EXPECT_EQ(H264Depacketizer::kSlice, h264.nalus[2].type);
+  EXPECT_EQ(12, h264.nalus[2].offset);
+  EXPECT_EQ(1, h264.nalus[2].length);
+
+  const uint8_t expected[] = {0, 0, 0, 1, kNri | H264Depacketizer::kSps, 0xFF,
+                              0, 0, 0, 1, kNri | H264Depacketizer::kPps, 0xAA,
+                              0xBB,
+                              0, 0, 0, 1, kNri | H264Depacketizer::kSlice};
+  uint8_t annex_b[sizeof(expected)];
+  ASSERT_EQ(sizeof(expected),
+            H264Depacketizer::AnnexBLength(sizeof(payload), h264, true));
+  ASSERT_EQ(sizeof(expected), H264Depacketizer::WriteAnnexB(
+      payload, sizeof(payload), h264, true, annex_b));
+  EXPECT_EQ(0, memcmp(expected, annex_b, sizeof(expected)));
+}
+
+TEST(TestH264Depacketizer, FuA) {
+  // The F bit and NRI of the fragmented NAL unit are in the FU indicator, its
+  // type in the FU header.
+  const uint8_t first[] = {0x80 | kNri | H264Depacketizer::kFuA,
+                           0x80 | H264Depacketizer::kIdr, 0x01, 0x02};
+  const uint8_t middle[] = {kNri | H264Depacketizer::kFuA,
+                            H264Depacketizer::kIdr, 0x03};
+  const uint8_t last[] = {kNri | H264Depacketizer::kFuA,
+                          0x40 | H264Depacketizer::kIdr, 0x04, 0x05};
+  RTPVideoHeader header;
+  FrameType frame_type;
+  ASSERT_TRUE(H264Depacketizer::Parse(first, sizeof(first), &header,
+                                      &frame_type));
+  EXPECT_TRUE(header.isFirstPacket);
+  EXPECT_EQ(kVideoFrameKey, frame_type);
+  const RTPVideoHeaderH264& h264 = header.codecHeader.H264;
+  EXPECT_EQ(kH264FuA, h264.packetization_type);
+  EXPECT_EQ(H264Depacketizer::kIdr, h264.nalu_type);
+  EXPECT_TRUE(h264.fu_start);
+  EXPECT_FALSE(h264.fu_end);
+  EXPECT_EQ(0x80 | kNri | H264Depacketizer::kIdr, h264.fu_nalu_header);
+  const uint8_t expected_first[] = {0, 0, 0, 1,
+                                    0x80 | kNri | H264Depacketizer::kIdr,
+                                    0x01, 0x02};
+  uint8_t annex_b[sizeof(expected_first)];
+  ASSERT_EQ(sizeof(expected_first),
+            H264Depacketizer::AnnexBLength(sizeof(first), h264, true));
+  ASSERT_EQ(sizeof(expected_first), H264Depacketizer::WriteAnnexB(
+      first, sizeof(first), h264, true, annex_b));
+  EXPECT_EQ(0, memcmp(expected_first, annex_b, sizeof(expected_first)));
+
+  // The other fragments only continue the NAL unit.
+  ASSERT_TRUE(H264Depacketizer::Parse(middle, sizeof(middle), &header,
+                                      &frame_type));
+  EXPECT_FALSE(header.isFirstPacket);
+  EXPECT_FALSE(h264.fu_start);
+  EXPECT_FALSE(h264.fu_end);
+  ASSERT_EQ(1u, H264Depacketizer::WriteAnnexB(middle, sizeof(middle), h264,
+                                              false, annex_b));
+  EXPECT_EQ(0x03, annex_b[0]);
+
+  ASSERT_TRUE(H264Depacketizer::Parse(last, sizeof(last), &header,
+                                      &frame_type));
+  EXPECT_FALSE(header.isFirstPacket);
+  EXPECT_TRUE(h264.fu_end);
+  EXPECT_EQ(2u, H264Depacketizer::AnnexBLength(sizeof(last), h264, false));
+}
+
+TEST(TestH264Depacketizer, RejectsMalformedPayloads) {
+  RTPVideoHeader header;
+  const uint8_t empty[] = {0};
+  EXPECT_FALSE(H264Depacketizer::Parse(empty, 0, &header, NULL));
+  // NAL unit type 0 is unspecified, 25 is STAP-B.
+  const uint8_t type_0[] = {0x00, 0x01};
+  EXPECT_FALSE(H264Depacketizer::Parse(type_0, sizeof(type_0), &header, NULL));
+  const uint8_t stap_b[] = {25, 0, 0, 0, 1, 0x65};
+  EXPECT_FALSE(H264Depacketizer::Parse(stap_b, sizeof(stap_b), &header, NULL));
+  const uint8_t stap_a_empty[] = {H264Depacketizer::kStapA};
+  EXPECT_FALSE(H264Depacketizer::Parse(stap_a_empty, sizeof(stap_a_empty),
+                                       &header, NULL));
+  const uint8_t stap_a_truncated[] = {H264Depacketizer::kStapA, 0, 3, 0x67, 1};
+  EXPECT_FALSE(H264Depacketizer::Parse(stap_a_truncated,
+                                       sizeof(stap_a_truncated), &header,
+                                       NULL));
+  const uint8_t stap_a_zero_length[] = {H264Depacketizer::kStapA, 0, 0};
+  EXPECT_FALSE(H264Depacketizer::Parse(stap_a_zero_length,
+                                       sizeof(stap_a_zero_length), &header,
+                                       NULL));
+  const uint8_t stap_a_half_length[] = {H264Depacketizer::kStapA, 0, 1, 0x67,
+                                        0};
+  EXPECT_FALSE(H264Depacketizer::Parse(stap_a_half_length,
+                                       sizeof(stap_a_half_length), &header,
+                                       NULL));
+  const uint8_t fu_a_no_data[] = {H264Depacketizer::kFuA, 0x85};
+  EXPECT_FALSE(H264Depacketizer::Parse(fu_a_no_data, sizeof(fu_a_no_data),
+                                       &header, NULL));
+  const uint8_t fu_a_start_and_end[] = {H264Depacketizer::kFuA, 0xC5, 1};
+  EXPECT_FALSE(H264Depacketizer::Parse(fu_a_start_and_end,
+                                       sizeof(fu_a_start_and_end), &header,
+                                       NULL));
+}
+
+// Random payloads must either be rejected or be described by NAL units within
+// the payload, written in exactly AnnexBLength() bytes.
+TEST(TestH264Depacketizer, RandomPayloads) {
+  const size_t kGuardSize = 16;
+  const uint8_t kGuard = 0xA5;
+  Random random(1234);
+  Buffer payload;
+  Buffer annex_b;
+  int num_parsed = 0;
+  for (int i = 0; i < 100000; ++i) {
+    payload.resize(random.Next() % 64 + 1);
+    for (size_t j = 0; j < payload.size(); ++j)
+      payload[j] = static_cast<uint8_t>(random.Next());
+    // Make STAP-A and FU-A packets, with random contents, common.
+    if (i % 3 == 0)
+      payload[0] = (payload[0] & 0xE0) | H264Depacketizer::kStapA;
+    else if (i % 3 == 1)
+      payload[0] = (payload[0] & 0xE0) | H264Depacketizer::kFuA;
+
+    RTPVideoHeader header;
+    if (!H264Depacketizer::Parse(&payload[0], payload.size(), &header, NULL))
+      continue;
+    ++num_parsed;
+    const RTPVideoHeaderH264& h264 = header.codecHeader.H264;
+    ASSERT_GT(h264.nalus_length, 0u);
+    ASSERT_LE(h264.nalus_length, kMaxNalusPerPacket);
+    for (size_t j = 0; j < h264.nalus_length; ++j) {
+      ASSERT_GT(h264.nalus[j].length, 0);
+      ASSERT_LE(static_cast<size_t>(h264.nalus[j].offset) +
+                h264.nalus[j].length, payload.size());
+    }
+    const bool insert_start_code = header.isFirstPacket;
+    const size_t length = H264Depacketizer::AnnexBLength(
+        payload.size(), h264, insert_start_code);
+    annex_b.assign(length + kGuardSize, kGuard);
+    ASSERT_EQ(length, H264Depacketizer::WriteAnnexB(
+        &payload[0], payload.size(), h264, insert_start_code, &annex_b[0]));
+    for (size_t j = length; j < annex_b.size(); ++j)
+      ASSERT_EQ(kGuard, annex_b[j]);
+  }
+  EXPECT_GT(num_parsed, 0);
+}
+
+class TestH264Session : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    frame_data_.rtt_ms = 0;
+    frame_data_.rolling_average_packets_per_frame = -1;
+    seq_num_ = 0xFFF0;
+    depacketize_ = true;
+  }
+
+  // Depacketizes |packets| and inserts them, except the one at |skip|, in
+  // the order of |order| into |session_|. Returns the number of bytes
+  // inserted.
+  size_t InsertFrame(const std::vector<Buffer>& packets,
+                     uint32_t timestamp,
+                     int skip,
+                     const std::vector<int>& order) {
+    size_t frame_length = 0;
+    for (size_t i = 0; i < packets.size(); ++i) {
+      frame_length +=
+          packets[i].size() + kMaxNalusPerPacket * sizeof(kStartCode);
+    }
+    frame_buffer_.resize(frame_length);
+    session_.Reset();
+    size_t inserted = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+      const int index = order[i];
+      if (index == skip)
+        continue;
+      const Buffer& payload = packets[index];
+      WebRtcRTPHeader rtp_header = WebRtcRTPHeader();
+      rtp_header.header.sequenceNumber =
+          static_cast<uint16_t>(seq_num_ + index);
+      rtp_header.header.timestamp = timestamp;
+      rtp_header.header.markerBit = (index + 1 == static_cast<int>(
+          packets.size()));
+      if (depacketize_) {
+        EXPECT_TRUE(H264Depacketizer::Parse(&payload[0], payload.size(),
+                                            &rtp_header.type.Video,
+                                            &rtp_header.frameType));
+      } else {
+        // Like a depacketizer which doesn't provide the NAL units.
+        rtp_header.type.Video.codec = kRtpVideoH264;
+        rtp_header.type.Video.codecHeader.H264.InitRTPVideoHeaderH264();
+        rtp_header.frameType = kVideoFrameKey;
+      }
+      VCMPacket packet(&payload[0], payload.size(), rtp_header);
+      const int ret = session_.InsertPacket(packet, &frame_buffer_[0],
+                                            kNoErrors, frame_data_);
+      EXPECT_GT(ret, 0);
+      inserted += ret;
+    }
+    seq_num_ += static_cast<uint16_t>(packets.size());
+    return inserted;
+  }
+
+  size_t InsertFrame(const std::vector<Buffer>& packets, uint32_t timestamp) {
+    std::vector<int> order;
+    for (size_t i = 0; i < packets.size(); ++i)
+      order.push_back(static_cast<int>(i));
+    return InsertFrame(packets, timestamp, -1, order);
+  }
+
+  // Expects |nalus| in Annex B format at the start of |frame_buffer_|, with
+  // |fragmentation_| pointing to them.
+  void ExpectNalus(const std::vector<Buffer>& nalus) {
+    ASSERT_EQ(nalus.size(), fragmentation_.fragmentationVectorSize);
+    size_t offset = 0;
+    for (size_t i = 0; i < nalus.size(); ++i) {
+      EXPECT_EQ(0, memcmp(kStartCode, &frame_buffer_[offset],
+                          sizeof(kStartCode)));
+      offset += sizeof(kStartCode);
+      EXPECT_EQ(offset, fragmentation_.fragmentationOffset[i]);
+      ASSERT_EQ(nalus[i].size(), fragmentation_.fragmentationLength[i]);
+      EXPECT_EQ(0, memcmp(&nalus[i][0], &frame_buffer_[offset],
+                          nalus[i].size())) << "NAL unit " << i;
+      offset += nalus[i].size();
+    }
+    EXPECT_EQ(offset, session_.SessionLength());
+  }
+
+  VCMSessionInfo session_;
+  FrameData frame_data_;
+  Buffer frame_buffer_;
+  RTPFragmentationHeader fragmentation_;
+  uint16_t seq_num_;
+  // Whether InsertFrame() sets the NAL units of the packets.
+  bool depacketize_;
+};
+
+TEST_F(TestH264Session, ReassemblesKeyFrame) {
+  Random random(4711);
+  const std::vector<Buffer> nalus = CreateKeyFrame(&random);
+  const std::vector<Buffer> packets = Packetize(nalus);
+  // One STAP-A, three FU-A and a single NAL unit packet.
+  ASSERT_EQ(5u, packets.size());
+
+  // Reversed, FU-A fragments are written before the start of their NAL unit.
+  std::vector<int> order;
+  for (int i = static_cast<int>(packets.size()) - 1; i >= 0; --i)
+    order.push_back(i);
+  InsertFrame(packets, 0, -1, order);
+  EXPECT_TRUE(session_.complete());
+  EXPECT_EQ(kVideoFrameKey, session_.FrameType());
+  EXPECT_EQ(0u, session_.MakeDecodable());
+  session_.BuildH264FragmentationHeader(&frame_buffer_[0], &fragmentation_);
+  ExpectNalus(nalus);
+}
+
+// Every payload is parsed when the packet is created if the depacketizer
+// didn't provide its NAL units.
+TEST_F(TestH264Session, ParsesPacketsWithoutNalus) {
+  depacketize_ = false;
+  Random random(4711);
+  const std::vector<Buffer> nalus = CreateKeyFrame(&random);
+  InsertFrame(Packetize(nalus), 0);
+  EXPECT_TRUE(session_.complete());
+  EXPECT_EQ(0u, session_.MakeDecodable());
+  session_.BuildH264FragmentationHeader(&frame_buffer_[0], &fragmentation_);
+  ExpectNalus(nalus);
+}
+
+TEST_F(TestH264Session, DeltaFrame) {
+  Random random(4711);
+  std::vector<Buffer> nalus;
+  nalus.push_back(CreateNalu(H264Depacketizer::kSlice, 2000, &random));
+  nalus.push_back(CreateNalu(H264Depacketizer::kSlice, 100, &random));
+  nalus.push_back(CreateNalu(H264Depacketizer::kSlice, 100, &random));
+  InsertFrame(Packetize(nalus), 0);
+  EXPECT_TRUE(session_.complete());
+  EXPECT_EQ(kVideoFrameDelta, session_.FrameType());
+  EXPECT_EQ(0u, session_.MakeDecodable());
+  session_.BuildH264FragmentationHeader(&frame_buffer_[0], &fragmentation_);
+  ExpectNalus(nalus);
+}
+
+// The FU header tells where a fragmented NAL unit ends, a lost fragment only
+// costs the rest of its NAL unit.
+TEST_F(TestH264Session, LostFragment) {
+  Random random(4711);
+  std::vector<Buffer> nalus = CreateKeyFrame(&random);
+  const std::vector<Buffer> packets = Packetize(nalus);
+  std::vector<int> order;
+  for (size_t i = 0; i < packets.size(); ++i)
+    order.push_back(static_cast<int>(i));
+  // The middle fragment of the 3000 byte IDR slice.
+  const int kLostPacket = 2;
+  InsertFrame(packets, 0, kLostPacket, order);
+  EXPECT_FALSE(session_.complete());
+  EXPECT_EQ(packets[3].size() - 2, session_.MakeDecodable());
+  session_.BuildH264FragmentationHeader(&frame_buffer_[0], &fragmentation_);
+  // What is left of the slice is its first fragment.
+  nalus[3].resize(packets[1].size() - 1);
+  ExpectNalus(nalus);
+}
+
+TEST_F(TestH264Session, Throughput) {
+  const int kNumFrames = 300;
+  Random random(4711);
+  std::vector<std::vector<Buffer> > frames;
+  for (int i = 0; i < 30; ++i) {
+    std::vector<Buffer> nalus;
+    if (i == 0) {
+      nalus = CreateKeyFrame(&random);
+    } else {
+      for (int j = 0; j < 4; ++j) {
+        nalus.push_back(CreateNalu(H264Depacketizer::kSlice,
+                                   random.Next() % 8000 + 100, &random));
+      }
+    }
+    frames.push_back(Packetize(nalus));
+  }
+
+  size_t num_bytes = 0;
+  const int64_t start_us = TickTime::MicrosecondTimestamp();
+  for (int i = 0; i < kNumFrames; ++i) {
+    num_bytes += InsertFrame(frames[i % frames.size()], i * 3000);
+    session_.MakeDecodable();
+    session_.BuildH264FragmentationHeader(&frame_buffer_[0], &fragmentation_);
+  }
+  const int64_t elapsed_us = TickTime::MicrosecondTimestamp() - start_us;
+  test::PrintResult("h264_depacketizer_throughput", "", "annex_b_frames",
+                    num_bytes * 8.0 / std::max<int64_t>(elapsed_us, 1),
+                    "Mbps", true);
+}
+
+}  // namespace webrtc
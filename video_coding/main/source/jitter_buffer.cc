@@ -10,9 +10,9 @@
 #include "video_coding/main/source/jitter_buffer.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include <algorithm>
-#include <utility>
 
 #include "video_coding/main/interface/video_coding.h"
 #include "video_coding/main/source/frame_buffer.h"
@@ -33,53 +33,118 @@ namespace webrtc {
 // Use this rtt if no value has been reported.
 static const int64_t kDefaultRtt = 200;
 
-typedef std::pair<uint32_t, VCMFrameBuffer*> FrameListPair;
+namespace {
 
-bool IsKeyFrame(FrameListPair pair) {
-  return pair.second->FrameType() == kVideoFrameKey;
+size_t CountBits(uint64_t word) {
+  size_t count = 0;
+  for (; word != 0; word &= word - 1)
+    ++count;
+  return count;
 }
 
-bool HasNonEmptyState(FrameListPair pair) {
-  return pair.second->GetState() != kStateEmpty;
+}  // namespace
+
+FrameList::FrameList() : head_(0), size_(0) {}
+
+size_t FrameList::LowerBound(uint32_t timestamp) const {
+  size_t low = 0;
+  size_t high = size_;
+  while (low < high) {
+    const size_t middle = (low + high) / 2;
+    if (IsNewerTimestamp(timestamp, at(middle)->TimeStamp())) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
 }
 
 void FrameList::InsertFrame(VCMFrameBuffer* frame) {
-  insert(rbegin().base(), FrameListPair(frame->TimeStamp(), frame));
+  const uint32_t timestamp = frame->TimeStamp();
+  size_t index = size_;
+  if (!empty() && !IsNewerTimestamp(timestamp, Back()->TimeStamp())) {
+    index = LowerBound(timestamp);
+    if (index < size_ && at(index)->TimeStamp() == timestamp)
+      return;
+  }
+  assert(size_ < kMaxNumberOfFrames);
+  for (size_t i = size_; i > index; --i)
+    slot(i) = slot(i - 1);
+  slot(index) = frame;
+  ++size_;
+}
+
+VCMFrameBuffer* FrameList::FindFrame(uint32_t timestamp) const {
+  const size_t index = LowerBound(timestamp);
+  if (index == size_ || at(index)->TimeStamp() != timestamp)
+    return NULL;
+  return at(index);
 }
 
 VCMFrameBuffer* FrameList::PopFrame(uint32_t timestamp) {
-  FrameList::iterator it = find(timestamp);
-  if (it == end())
+  const size_t index = LowerBound(timestamp);
+  if (index == size_ || at(index)->TimeStamp() != timestamp)
     return NULL;
-  VCMFrameBuffer* frame = it->second;
-  erase(it);
+  VCMFrameBuffer* frame = at(index);
+  Erase(index);
   return frame;
 }
 
+void FrameList::Erase(size_t index) {
+  assert(index < size_);
+  // Move the shorter side.
+  if (index < size_ / 2) {
+    for (size_t i = index; i > 0; --i)
+      slot(i) = slot(i - 1);
+    head_ = (head_ + 1) % kMaxNumberOfFrames;
+  } else {
+    for (size_t i = index + 1; i < size_; ++i)
+      slot(i - 1) = slot(i);
+  }
+  --size_;
+}
+
 VCMFrameBuffer* FrameList::Front() const {
-  return begin()->second;
+  return at(0);
 }
 
 VCMFrameBuffer* FrameList::Back() const {
-  return rbegin()->second;
+  return at(size_ - 1);
+}
+
+bool FrameList::HasNonEmptyFrame() const {
+  for (size_t i = 0; i < size_; ++i) {
+    if (at(i)->GetState() != kStateEmpty)
+      return true;
+  }
+  return false;
+}
+
+VCMFrameBuffer* FrameList::NewestKeyFrame() const {
+  for (size_t i = size_; i > 0; --i) {
+    if (at(i - 1)->FrameType() == kVideoFrameKey)
+      return at(i - 1);
+  }
+  return NULL;
 }
 
-int FrameList::RecycleFramesUntilKeyFrame(FrameList::iterator* key_frame_it,
+int FrameList::RecycleFramesUntilKeyFrame(VCMFrameBuffer** key_frame,
                                           UnorderedFrameList* free_frames) {
   int drop_count = 0;
-  FrameList::iterator it = begin();
+  *key_frame = NULL;
   while (!empty()) {
     // Throw at least one frame.
-    it->second->Reset();
-    free_frames->push_back(it->second);
-    erase(it++);
+    VCMFrameBuffer* frame = Front();
+    frame->Reset();
+    free_frames->push_back(frame);
+    Erase(0);
     ++drop_count;
-    if (it != end() && it->second->FrameType() == kVideoFrameKey) {
-      *key_frame_it = it;
+    if (!empty() && Front()->FrameType() == kVideoFrameKey) {
+      *key_frame = Front();
       return drop_count;
     }
   }
-  *key_frame_it = end();
   return drop_count;
 }
 
@@ -101,16 +166,144 @@ void FrameList::CleanUpOldOrEmptyFrames(VCMDecodingState* decoding_state,
     free_frames->push_back(oldest_frame);
     TRACE_EVENT_INSTANT1("webrtc", "JB::OldOrEmptyFrameDropped", "timestamp",
                          oldest_frame->TimeStamp());
-    erase(begin());
+    Erase(0);
   }
 }
 
 void FrameList::Reset(UnorderedFrameList* free_frames) {
   while (!empty()) {
-    begin()->second->Reset();
-    free_frames->push_back(begin()->second);
-    erase(begin());
+    Front()->Reset();
+    free_frames->push_back(Front());
+    Erase(0);
+  }
+}
+
+void FrameList::clear() {
+  head_ = 0;
+  size_ = 0;
+}
+
+SequenceNumberSet::SequenceNumberSet() : size_(0), oldest_(0), newest_(0) {
+  memset(bits_, 0, sizeof(bits_));
+}
+
+void SequenceNumberSet::Insert(uint16_t sequence_number) {
+  if (Contains(sequence_number))
+    return;
+  SetBit(sequence_number);
+  if (size_++ == 0) {
+    oldest_ = sequence_number;
+    newest_ = sequence_number;
+  } else if (IsNewerSequenceNumber(sequence_number, newest_)) {
+    newest_ = sequence_number;
+  } else if (IsNewerSequenceNumber(oldest_, sequence_number)) {
+    oldest_ = sequence_number;
+  }
+}
+
+void SequenceNumberSet::InsertNewerRange(uint16_t first, uint16_t last) {
+  assert(empty() || IsNewerSequenceNumber(first, newest_));
+  assert(!IsNewerSequenceNumber(first, last));
+  if (empty())
+    oldest_ = first;
+  newest_ = last;
+  size_ += SetRange(first, last);
+}
+
+void SequenceNumberSet::Erase(uint16_t sequence_number) {
+  if (!Contains(sequence_number))
+    return;
+  ClearBit(sequence_number);
+  --size_;
+  if (size_ > 0 && sequence_number == oldest_)
+    oldest_ = FindFirst(oldest_);
+}
+
+void SequenceNumberSet::EraseUpTo(uint16_t sequence_number) {
+  if (empty() || IsNewerSequenceNumber(oldest_, sequence_number))
+    return;
+  if (!IsNewerSequenceNumber(newest_, sequence_number)) {
+    Clear();
+    return;
+  }
+  size_ -= ClearRange(oldest_, sequence_number);
+  if (size_ > 0)
+    oldest_ = FindFirst(sequence_number + 1);
+}
+
+void SequenceNumberSet::Clear() {
+  if (size_ > 0)
+    ClearRange(oldest_, newest_);
+  size_ = 0;
+}
+
+std::vector<uint16_t> SequenceNumberSet::ToVector() const {
+  std::vector<uint16_t> sequence_numbers;
+  sequence_numbers.reserve(size_);
+  uint16_t sequence_number = oldest_;
+  while (sequence_numbers.size() < size_) {
+    sequence_number = FindFirst(sequence_number);
+    sequence_numbers.push_back(sequence_number);
+    ++sequence_number;
+  }
+  return sequence_numbers;
+}
+
+size_t SequenceNumberSet::SetRange(uint16_t first, uint16_t last) {
+  size_t set = 0;
+  // Bit positions run past 2^16 when the range wraps.
+  uint32_t bit = first;
+  uint32_t remaining = static_cast<uint16_t>(last - first) + 1u;
+  while (remaining > 0) {
+    const uint32_t offset = bit & 63;
+    const uint32_t count = std::min(64 - offset, remaining);
+    const uint64_t mask =
+        (count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1) << offset;
+    uint64_t* word = &bits_[(bit >> 6) % kNumWords];
+    set += CountBits(~*word & mask);
+    *word |= mask;
+    bit += count;
+    remaining -= count;
+  }
+  return set;
+}
+
+size_t SequenceNumberSet::ClearRange(uint16_t first, uint16_t last) {
+  size_t cleared = 0;
+  // Bit positions run past 2^16 when the range wraps.
+  uint32_t bit = first;
+  uint32_t remaining = static_cast<uint16_t>(last - first) + 1u;
+  while (remaining > 0) {
+    const uint32_t offset = bit & 63;
+    const uint32_t count = std::min(64 - offset, remaining);
+    const uint64_t mask =
+        (count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1) << offset;
+    uint64_t* word = &bits_[(bit >> 6) % kNumWords];
+    cleared += CountBits(*word & mask);
+    *word &= ~mask;
+    bit += count;
+    remaining -= count;
+  }
+  return cleared;
+}
+
+uint16_t SequenceNumberSet::FindFirst(uint16_t first) const {
+  uint32_t bit = first;
+  uint32_t remaining = static_cast<uint16_t>(newest_ - first) + 1u;
+  while (remaining > 0) {
+    const uint32_t offset = bit & 63;
+    const uint64_t word = bits_[(bit >> 6) % kNumWords] >> offset;
+    if (word != 0) {
+      uint32_t index = 0;
+      while (((word >> index) & 1) == 0)
+        ++index;
+      return static_cast<uint16_t>(bit + index);
+    }
+    bit += 64 - offset;
+    remaining -= std::min(64 - offset, remaining);
   }
+  assert(false);
+  return newest_;
 }
 
 VCMJitterBuffer::VCMJitterBuffer(Clock* clock,
@@ -118,7 +311,9 @@ VCMJitterBuffer::VCMJitterBuffer(Clock* clock,
     : clock_(clock),
       running_(false),
       crit_sect_(CriticalSectionWrapper::CreateCriticalSection()),
+      insert_crit_sect_(CriticalSectionWrapper::CreateCriticalSection()),
       frame_event_(event.Pass()),
+      frame_slab_(new VCMFrameBuffer[kMaxNumberOfFrames]),
       max_number_of_frames_(kStartNumberOfFrames),
       free_frames_(),
       decodable_frames_(),
@@ -144,31 +339,22 @@ VCMJitterBuffer::VCMJitterBuffer(Clock* clock,
       nack_mode_(kNoNack),
       low_rtt_nack_threshold_ms_(-1),
       high_rtt_nack_threshold_ms_(-1),
-      missing_sequence_numbers_(SequenceNumberLessThan()),
       max_nack_list_size_(0),
       max_packet_age_to_nack_(0),
+      nack_requests_(1),
       max_incomplete_time_ms_(0),
       decode_error_mode_(kNoErrors),
       average_packets_per_frame_(0.0f),
       frame_counter_(0) {
+  free_frames_.reserve(kMaxNumberOfFrames);
   for (int i = 0; i < kStartNumberOfFrames; i++)
-    free_frames_.push_back(new VCMFrameBuffer());
+    free_frames_.push_back(&frame_slab_[i]);
 }
 
 VCMJitterBuffer::~VCMJitterBuffer() {
   Stop();
-  for (UnorderedFrameList::iterator it = free_frames_.begin();
-       it != free_frames_.end(); ++it) {
-    delete *it;
-  }
-  for (FrameList::iterator it = incomplete_frames_.begin();
-       it != incomplete_frames_.end(); ++it) {
-    delete it->second;
-  }
-  for (FrameList::iterator it = decodable_frames_.begin();
-       it != decodable_frames_.end(); ++it) {
-    delete it->second;
-  }
+  delete [] frame_slab_;
+  delete insert_crit_sect_;
   delete crit_sect_;
 }
 
@@ -233,14 +419,10 @@ void VCMJitterBuffer::Stop() {
   last_gof_valid_ = false;
 
   // Make sure all frames are free and reset.
-  for (FrameList::iterator it = decodable_frames_.begin();
-       it != decodable_frames_.end(); ++it) {
-    free_frames_.push_back(it->second);
-  }
-  for (FrameList::iterator it = incomplete_frames_.begin();
-       it != incomplete_frames_.end(); ++it) {
-    free_frames_.push_back(it->second);
-  }
+  for (size_t i = 0; i < decodable_frames_.size(); ++i)
+    free_frames_.push_back(decodable_frames_.at(i));
+  for (size_t i = 0; i < incomplete_frames_.size(); ++i)
+    free_frames_.push_back(incomplete_frames_.at(i));
   for (UnorderedFrameList::iterator it = free_frames_.begin();
        it != free_frames_.end(); ++it) {
     (*it)->Reset();
@@ -271,7 +453,7 @@ void VCMJitterBuffer::Flush() {
   waiting_for_completion_.timestamp = 0;
   waiting_for_completion_.latest_packet_time = -1;
   first_packet_since_reset_ = true;
-  missing_sequence_numbers_.clear();
+  missing_sequence_numbers_.Clear();
 }
 
 // Get received key and delta frames
@@ -452,6 +634,20 @@ bool VCMJitterBuffer::NextMaybeIncompleteTimestamp(uint32_t* timestamp) {
   return true;
 }
 
+bool VCMJitterBuffer::FrameTypeAndSize(uint32_t timestamp,
+                                       FrameType* frame_type,
+                                       size_t* frame_size) const {
+  CriticalSectionScoped cs(crit_sect_);
+  const VCMFrameBuffer* frame = decodable_frames_.FindFrame(timestamp);
+  if (!frame)
+    frame = incomplete_frames_.FindFrame(timestamp);
+  if (!frame)
+    return false;
+  *frame_type = frame->FrameType();
+  *frame_size = frame->Length();
+  return true;
+}
+
 VCMEncodedFrame* VCMJitterBuffer::ExtractAndSetDecode(uint32_t timestamp) {
   CriticalSectionScoped cs(crit_sect_);
   if (!running_) {
@@ -558,39 +754,77 @@ int64_t VCMJitterBuffer::LastPacketTime(const VCMEncodedFrame* frame,
 
 VCMFrameBufferEnum VCMJitterBuffer::InsertPacket(const VCMPacket& packet,
                                                  bool* retransmitted) {
+  // A packet that starts a new frame is inserted into the frame without
+  // holding |crit_sect_|, before the frame is added to the frame lists. That
+  // keeps the payload copy, and the allocation of the frame buffer, from
+  // blocking the decoding thread. Until then the frame is not visible to
+  // anyone else, as if the packet had not arrived yet. Packets of frames
+  // that are already in the lists are inserted under |crit_sect_|, since the
+  // decoding thread reads and extracts those frames. |insert_crit_sect_|
+  // makes sure that only one new frame at a time is outside the lists.
+  CriticalSectionScoped insert_cs(insert_crit_sect_);
+  PendingInsert insert;
+  {
+    CriticalSectionScoped cs(crit_sect_);
+    const VCMFrameBufferEnum error = TakeFrameForPacket(packet, &insert);
+    if (error != kNoError)
+      return error;
+    if (insert.frame_list != NULL) {
+      const VCMFrameBufferEnum buffer_state = insert.frame->InsertPacket(
+          packet, insert.now_ms, insert.decode_error_mode, insert.frame_data);
+      return ReturnFrameWithPacket(packet, insert, buffer_state,
+                                   retransmitted);
+    }
+  }
+  const VCMFrameBufferEnum buffer_state = insert.frame->InsertPacket(
+      packet, insert.now_ms, insert.decode_error_mode, insert.frame_data);
+
   CriticalSectionScoped cs(crit_sect_);
+  // The decoding thread may have moved past the frame meanwhile.
+  if (last_decoded_state_.IsOldPacket(&packet)) {
+    free_frames_.push_back(insert.frame);
+    return HandleOldPacket(packet);
+  }
+  return ReturnFrameWithPacket(packet, insert, buffer_state, retransmitted);
+}
 
+VCMFrameBufferEnum VCMJitterBuffer::HandleOldPacket(const VCMPacket& packet) {
+  // Account only for media packets.
+  if (packet.sizeBytes > 0) {
+    num_discarded_packets_++;
+    num_consecutive_old_packets_++;
+    if (stats_callback_ != NULL)
+      stats_callback_->OnDiscardedPacketsUpdated(num_discarded_packets_);
+  }
+  // Update last decoded sequence number if the packet arrived late and
+  // belongs to a frame with a timestamp equal to the last decoded
+  // timestamp.
+  last_decoded_state_.UpdateOldPacket(&packet);
+  DropPacketsFromNackList(last_decoded_state_.sequence_num());
+
+  // Also see if this old packet made more incomplete frames continuous.
+  FindAndInsertContinuousFramesWithState(last_decoded_state_);
+
+  if (num_consecutive_old_packets_ > kMaxConsecutiveOldPackets) {
+    LOG(LS_WARNING)
+        << num_consecutive_old_packets_
+        << " consecutive old packets received. Flushing the jitter buffer.";
+    Flush();
+    return kFlushIndicator;
+  }
+  return kOldPacket;
+}
+
+VCMFrameBufferEnum VCMJitterBuffer::TakeFrameForPacket(
+    const VCMPacket& packet,
+    PendingInsert* insert) {
   ++num_packets_;
   if (num_packets_ == 1) {
     time_first_packet_ms_ = clock_->TimeInMilliseconds();
   }
   // Does this packet belong to an old frame?
-  if (last_decoded_state_.IsOldPacket(&packet)) {
-    // Account only for media packets.
-    if (packet.sizeBytes > 0) {
-      num_discarded_packets_++;
-      num_consecutive_old_packets_++;
-      if (stats_callback_ != NULL)
-        stats_callback_->OnDiscardedPacketsUpdated(num_discarded_packets_);
-    }
-    // Update last decoded sequence number if the packet arrived late and
-    // belongs to a frame with a timestamp equal to the last decoded
-    // timestamp.
-    last_decoded_state_.UpdateOldPacket(&packet);
-    DropPacketsFromNackList(last_decoded_state_.sequence_num());
-
-    // Also see if this old packet made more incomplete frames continuous.
-    FindAndInsertContinuousFramesWithState(last_decoded_state_);
-
-    if (num_consecutive_old_packets_ > kMaxConsecutiveOldPackets) {
-      LOG(LS_WARNING)
-          << num_consecutive_old_packets_
-          << " consecutive old packets received. Flushing the jitter buffer.";
-      Flush();
-      return kFlushIndicator;
-    }
-    return kOldPacket;
-  }
+  if (last_decoded_state_.IsOldPacket(&packet))
+    return HandleOldPacket(packet);
 
   if (packet.codec == kVideoCodecVP9) {
     // TODO(asapersson): Move this code to appropriate place.
@@ -627,8 +861,8 @@ VCMFrameBufferEnum VCMJitterBuffer::InsertPacket(const VCMPacket& packet,
   num_consecutive_old_packets_ = 0;
 
   VCMFrameBuffer* frame;
-  FrameList* frame_list;
-  const VCMFrameBufferEnum error = GetFrame(packet, &frame, &frame_list);
+  const VCMFrameBufferEnum error =
+      GetFrame(packet, &frame, &insert->frame_list);
   if (error != kNoError)
     return error;
 
@@ -659,14 +893,23 @@ VCMFrameBufferEnum VCMJitterBuffer::InsertPacket(const VCMPacket& packet,
     }
   }
 
-  VCMFrameBufferStateEnum previous_state = frame->GetState();
-  // Insert packet.
-  FrameData frame_data;
-  frame_data.rtt_ms = rtt_ms_;
-  frame_data.rolling_average_packets_per_frame = average_packets_per_frame_;
-  VCMFrameBufferEnum buffer_state =
-      frame->InsertPacket(packet, now_ms, decode_error_mode_, frame_data);
+  insert->frame = frame;
+  insert->previous_state = frame->GetState();
+  insert->frame_data.rtt_ms = rtt_ms_;
+  insert->frame_data.rolling_average_packets_per_frame =
+      average_packets_per_frame_;
+  insert->decode_error_mode = decode_error_mode_;
+  insert->now_ms = now_ms;
+  return kNoError;
+}
 
+VCMFrameBufferEnum VCMJitterBuffer::ReturnFrameWithPacket(
+    const VCMPacket& packet,
+    const PendingInsert& insert,
+    VCMFrameBufferEnum buffer_state,
+    bool* retransmitted) {
+  VCMFrameBuffer* frame = insert.frame;
+  const VCMFrameBufferStateEnum previous_state = insert.previous_state;
   if (previous_state != kStateComplete) {
     TRACE_EVENT_ASYNC_BEGIN1("webrtc", "Video", frame->TimeStamp(),
                              "timestamp", frame->TimeStamp());
@@ -736,8 +979,8 @@ VCMFrameBufferEnum VCMJitterBuffer::InsertPacket(const VCMPacket& packet,
     case kOutOfBoundsPacket:
     case kDuplicatePacket: {
       // Put back the frame where it came from.
-      if (frame_list != NULL) {
-        frame_list->InsertFrame(frame);
+      if (insert.frame_list != NULL) {
+        insert.frame_list->InsertFrame(frame);
       } else {
         free_frames_.push_back(frame);
       }
@@ -771,9 +1014,8 @@ bool VCMJitterBuffer::IsContinuous(const VCMFrameBuffer& frame) const {
   }
   VCMDecodingState decoding_state;
   decoding_state.CopyFrom(last_decoded_state_);
-  for (FrameList::const_iterator it = decodable_frames_.begin();
-       it != decodable_frames_.end(); ++it)  {
-    VCMFrameBuffer* decodable_frame = it->second;
+  for (size_t i = 0; i < decodable_frames_.size(); ++i) {
+    VCMFrameBuffer* decodable_frame = decodable_frames_.at(i);
     if (IsNewerTimestamp(decodable_frame->TimeStamp(), frame.TimeStamp())) {
       break;
     }
@@ -804,22 +1046,21 @@ void VCMJitterBuffer::FindAndInsertContinuousFramesWithState(
   // frame until we hit one of the following:
   // 1. Continuous base or sync layer.
   // 2. The end of the list was reached.
-  for (FrameList::iterator it = incomplete_frames_.begin();
-       it != incomplete_frames_.end();)  {
-    VCMFrameBuffer* frame = it->second;
+  for (size_t i = 0; i < incomplete_frames_.size();) {
+    VCMFrameBuffer* frame = incomplete_frames_.at(i);
     if (IsNewerTimestamp(original_decoded_state.time_stamp(),
                          frame->TimeStamp())) {
-      ++it;
+      ++i;
       continue;
     }
     if (IsContinuousInState(*frame, decoding_state)) {
       decodable_frames_.InsertFrame(frame);
-      incomplete_frames_.erase(it++);
+      incomplete_frames_.Erase(i);
       decoding_state.SetState(frame);
     } else if (frame->TemporalId() <= 0) {
       break;
     } else {
-      ++it;
+      ++i;
     }
   }
 }
@@ -850,7 +1091,7 @@ void VCMJitterBuffer::SetNackMode(VCMNackMode mode,
   CriticalSectionScoped cs(crit_sect_);
   nack_mode_ = mode;
   if (mode == kNoNack) {
-    missing_sequence_numbers_.clear();
+    missing_sequence_numbers_.Clear();
   }
   assert(low_rtt_nack_threshold_ms >= -1 && high_rtt_nack_threshold_ms >= -1);
   assert(high_rtt_nack_threshold_ms == -1 ||
@@ -877,6 +1118,12 @@ void VCMJitterBuffer::SetNackSettings(size_t max_nack_list_size,
   max_nack_list_size_ = max_nack_list_size;
   max_packet_age_to_nack_ = max_packet_age_to_nack;
   max_incomplete_time_ms_ = max_incomplete_time_ms;
+  size_t num_nack_requests = 1;
+  while (num_nack_requests <= static_cast<size_t>(max_packet_age_to_nack) &&
+         num_nack_requests < (1 << 16)) {
+    num_nack_requests *= 2;
+  }
+  nack_requests_.assign(num_nack_requests, NackRequest());
 }
 
 VCMNackMode VCMJitterBuffer::nack_mode() const {
@@ -906,11 +1153,10 @@ uint16_t VCMJitterBuffer::EstimatedLowSequenceNumber(
   return frame.GetLowSeqNum() - 1;
 }
 
-std::vector<uint16_t> VCMJitterBuffer::GetNackList(bool* request_key_frame) {
-  CriticalSectionScoped cs(crit_sect_);
+bool VCMJitterBuffer::PrepareNackList(bool* request_key_frame) {
   *request_key_frame = false;
   if (nack_mode_ == kNoNack) {
-    return std::vector<uint16_t>();
+    return false;
   }
   if (last_decoded_state_.in_initial_state()) {
     VCMFrameBuffer* next_frame = NextFrame();
@@ -918,18 +1164,13 @@ std::vector<uint16_t> VCMJitterBuffer::GetNackList(bool* request_key_frame) {
         next_frame->FrameType() == kVideoFrameKey &&
         next_frame->HaveFirstPacket();
     if (!first_frame_is_key) {
-      bool have_non_empty_frame = decodable_frames_.end() != find_if(
-          decodable_frames_.begin(), decodable_frames_.end(),
-          HasNonEmptyState);
-      if (!have_non_empty_frame) {
-        have_non_empty_frame = incomplete_frames_.end() != find_if(
-            incomplete_frames_.begin(), incomplete_frames_.end(),
-            HasNonEmptyState);
-      }
+      const bool have_non_empty_frame =
+          decodable_frames_.HasNonEmptyFrame() ||
+          incomplete_frames_.HasNonEmptyFrame();
       bool found_key_frame = RecycleFramesUntilKeyFrame();
       if (!found_key_frame) {
         *request_key_frame = have_non_empty_frame;
-        return std::vector<uint16_t>();
+        return false;
       }
     }
   }
@@ -943,25 +1184,69 @@ std::vector<uint16_t> VCMJitterBuffer::GetNackList(bool* request_key_frame) {
       LOG_F(LS_WARNING) << "Too long non-decodable duration: "
                         << non_continuous_incomplete_duration << " > "
                         << 90 * max_incomplete_time_ms_;
-      FrameList::reverse_iterator rit = find_if(incomplete_frames_.rbegin(),
-          incomplete_frames_.rend(), IsKeyFrame);
-      if (rit == incomplete_frames_.rend()) {
+      VCMFrameBuffer* key_frame = incomplete_frames_.NewestKeyFrame();
+      if (key_frame == NULL) {
         // Request a key frame if we don't have one already.
         *request_key_frame = true;
-        return std::vector<uint16_t>();
+        return false;
       } else {
         // Skip to the last key frame. If it's incomplete we will start
         // NACKing it.
         // Note that the estimated low sequence number is correct for VP8
         // streams because only the first packet of a key frame is marked.
         last_decoded_state_.Reset();
-        DropPacketsFromNackList(EstimatedLowSequenceNumber(*rit->second));
+        DropPacketsFromNackList(EstimatedLowSequenceNumber(*key_frame));
+      }
+    }
+  }
+  return true;
+}
+
+std::vector<uint16_t> VCMJitterBuffer::GetNackList(bool* request_key_frame) {
+  CriticalSectionScoped cs(crit_sect_);
+  if (!PrepareNackList(request_key_frame))
+    return std::vector<uint16_t>();
+  return missing_sequence_numbers_.ToVector();
+}
+
+std::vector<VCMNackBlock> VCMJitterBuffer::GetNackBlocks(
+    bool* request_key_frame) {
+  CriticalSectionScoped cs(crit_sect_);
+  std::vector<VCMNackBlock> blocks;
+  if (!PrepareNackList(request_key_frame))
+    return blocks;
+  const int64_t now_ms = clock_->TimeInMilliseconds();
+  // Without an RTT estimate, as after SetNackMode cleared the default one,
+  // assume the default rather than requesting again on every call.
+  const int64_t retry_interval_ms = rtt_ms_ > 0 ? rtt_ms_ : kDefaultRtt;
+  const size_t mask = nack_requests_.size() - 1;
+  uint16_t sequence_number = missing_sequence_numbers_.Oldest();
+  for (size_t i = 0; i < missing_sequence_numbers_.size(); ++i) {
+    sequence_number = missing_sequence_numbers_.FindFirst(sequence_number);
+    NackRequest* request = &nack_requests_[sequence_number & mask];
+    if (request->sequence_number != sequence_number) {
+      request->sequence_number = sequence_number;
+      request->num_requests = 0;
+    }
+    // Don't request packets which are likely still on their way.
+    const bool due = request->num_requests == 0 ||
+        (request->num_requests < kMaxNackRequests &&
+         now_ms - request->last_request_ms >= retry_interval_ms);
+    if (due) {
+      ++request->num_requests;
+      request->last_request_ms = now_ms;
+      const uint16_t distance =
+          blocks.empty() ? 0 : sequence_number - blocks.back().pid;
+      if (distance >= 1 && distance <= 16) {
+        blocks.back().blp |= 1 << (distance - 1);
+      } else {
+        blocks.push_back(VCMNackBlock());
+        blocks.back().pid = sequence_number;
       }
     }
+    ++sequence_number;
   }
-  std::vector<uint16_t> nack_list(missing_sequence_numbers_.begin(),
-                                  missing_sequence_numbers_.end());
-  return nack_list;
+  return blocks;
 }
 
 void VCMJitterBuffer::SetDecodeErrorMode(VCMDecodeErrorMode error_mode) {
@@ -990,11 +1275,14 @@ bool VCMJitterBuffer::UpdateNackList(uint16_t sequence_number) {
   if (IsNewerSequenceNumber(sequence_number,
                             latest_received_sequence_number_)) {
     // Push any missing sequence numbers to the NACK list.
-    for (uint16_t i = latest_received_sequence_number_ + 1;
-         IsNewerSequenceNumber(sequence_number, i); ++i) {
-      missing_sequence_numbers_.insert(missing_sequence_numbers_.end(), i);
-      TRACE_EVENT_INSTANT1(TRACE_DISABLED_BY_DEFAULT("webrtc_rtp"), "AddNack",
-                           "seqnum", i);
+    const uint16_t first_missing = latest_received_sequence_number_ + 1;
+    if (IsNewerSequenceNumber(sequence_number, first_missing)) {
+      const uint16_t last_missing = sequence_number - 1;
+      missing_sequence_numbers_.InsertNewerRange(first_missing, last_missing);
+      ResetNackRequests(first_missing, last_missing);
+      TRACE_EVENT_INSTANT2(TRACE_DISABLED_BY_DEFAULT("webrtc_rtp"), "AddNack",
+                           "first_seqnum", first_missing,
+                           "last_seqnum", last_missing);
     }
     if (TooLargeNackList() && !HandleTooLargeNackList()) {
       LOG(LS_WARNING) << "Requesting key frame due to too large NACK list.";
@@ -1006,13 +1294,27 @@ bool VCMJitterBuffer::UpdateNackList(uint16_t sequence_number) {
       return false;
     }
   } else {
-    missing_sequence_numbers_.erase(sequence_number);
+    missing_sequence_numbers_.Erase(sequence_number);
     TRACE_EVENT_INSTANT1(TRACE_DISABLED_BY_DEFAULT("webrtc_rtp"), "RemoveNack",
                          "seqnum", sequence_number);
   }
   return true;
 }
 
+void VCMJitterBuffer::ResetNackRequests(uint16_t first, uint16_t last) {
+  const size_t mask = nack_requests_.size() - 1;
+  // Only the newest sequence numbers fit if the range is larger than the
+  // request history.
+  const size_t count = std::min<size_t>(
+      static_cast<uint16_t>(last - first) + 1u, nack_requests_.size());
+  for (size_t i = 0; i < count; ++i) {
+    const uint16_t sequence_number = last - static_cast<uint16_t>(i);
+    NackRequest* request = &nack_requests_[sequence_number & mask];
+    request->sequence_number = sequence_number;
+    request->num_requests = 0;
+  }
+}
+
 bool VCMJitterBuffer::TooLargeNackList() const {
   return missing_sequence_numbers_.size() > max_nack_list_size_;
 }
@@ -1036,7 +1338,7 @@ bool VCMJitterBuffer::MissingTooOldPacket(
     return false;
   }
   const uint16_t age_of_oldest_missing_packet = latest_sequence_number -
-      *missing_sequence_numbers_.begin();
+      missing_sequence_numbers_.Oldest();
   // Recycle frames if the NACK list contains too old sequence numbers as
   // the packets may have already been dropped by the sender.
   return age_of_oldest_missing_packet > max_packet_age_to_nack_;
@@ -1045,7 +1347,7 @@ bool VCMJitterBuffer::MissingTooOldPacket(
 bool VCMJitterBuffer::HandleTooOldPackets(uint16_t latest_sequence_number) {
   bool key_frame_found = false;
   const uint16_t age_of_oldest_missing_packet = latest_sequence_number -
-      *missing_sequence_numbers_.begin();
+      missing_sequence_numbers_.Oldest();
   LOG_F(LS_WARNING) << "NACK list contains too old sequence numbers: "
                     << age_of_oldest_missing_packet << " > "
                     << max_packet_age_to_nack_;
@@ -1059,9 +1361,7 @@ void VCMJitterBuffer::DropPacketsFromNackList(
     uint16_t last_decoded_sequence_number) {
   // Erase all sequence numbers from the NACK list which we won't need any
   // longer.
-  missing_sequence_numbers_.erase(missing_sequence_numbers_.begin(),
-                                  missing_sequence_numbers_.upper_bound(
-                                      last_decoded_sequence_number));
+  missing_sequence_numbers_.EraseUpTo(last_decoded_sequence_number);
 }
 
 int64_t VCMJitterBuffer::LastDecodedTimestamp() const {
@@ -1094,15 +1394,16 @@ VCMFrameBuffer* VCMJitterBuffer::GetEmptyFrame() {
       return NULL;
     }
   }
-  VCMFrameBuffer* frame = free_frames_.front();
-  free_frames_.pop_front();
+  // The most recently freed frame is the most likely to be cached.
+  VCMFrameBuffer* frame = free_frames_.back();
+  free_frames_.pop_back();
   return frame;
 }
 
 bool VCMJitterBuffer::TryToIncreaseJitterBufferSize() {
   if (max_number_of_frames_ >= kMaxNumberOfFrames)
     return false;
-  free_frames_.push_back(new VCMFrameBuffer());
+  free_frames_.push_back(&frame_slab_[max_number_of_frames_]);
   ++max_number_of_frames_;
   TRACE_COUNTER1("webrtc", "JBMaxFrames", max_number_of_frames_);
   return true;
@@ -1113,29 +1414,27 @@ bool VCMJitterBuffer::TryToIncreaseJitterBufferSize() {
 bool VCMJitterBuffer::RecycleFramesUntilKeyFrame() {
   // First release incomplete frames, and only release decodable frames if there
   // are no incomplete ones.
-  FrameList::iterator key_frame_it;
-  bool key_frame_found = false;
+  VCMFrameBuffer* key_frame = NULL;
   int dropped_frames = 0;
   dropped_frames += incomplete_frames_.RecycleFramesUntilKeyFrame(
-      &key_frame_it, &free_frames_);
-  key_frame_found = key_frame_it != incomplete_frames_.end();
+      &key_frame, &free_frames_);
   if (dropped_frames == 0) {
     dropped_frames += decodable_frames_.RecycleFramesUntilKeyFrame(
-        &key_frame_it, &free_frames_);
-    key_frame_found = key_frame_it != decodable_frames_.end();
+        &key_frame, &free_frames_);
   }
+  const bool key_frame_found = key_frame != NULL;
   TRACE_EVENT_INSTANT0("webrtc", "JB::RecycleFramesUntilKeyFrame");
   if (key_frame_found) {
     LOG(LS_INFO) << "Found key frame while dropping frames.";
     // Reset last decoded state to make sure the next frame decoded is a key
     // frame, and start NACKing from here.
     last_decoded_state_.Reset();
-    DropPacketsFromNackList(EstimatedLowSequenceNumber(*key_frame_it->second));
+    DropPacketsFromNackList(EstimatedLowSequenceNumber(*key_frame));
   } else if (decodable_frames_.empty()) {
     // All frames dropped. Reset the decoding state and clear missing sequence
     // numbers as we're starting fresh.
     last_decoded_state_.Reset();
-    missing_sequence_numbers_.clear();
+    missing_sequence_numbers_.Clear();
   }
   return key_frame_found;
 }
@@ -1194,8 +1493,7 @@ void VCMJitterBuffer::CleanUpOldOrEmptyFrames() {
 
 // Must be called from within |crit_sect_|.
 bool VCMJitterBuffer::IsPacketRetransmitted(const VCMPacket& packet) const {
-  return missing_sequence_numbers_.find(packet.seqNum) !=
-      missing_sequence_numbers_.end();
+  return missing_sequence_numbers_.Contains(packet.seqNum);
 }
 
 // Must be called under the critical section |crit_sect_|. Should never be
@@ -11,9 +11,6 @@
 #ifndef WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_JITTER_BUFFER_H_
 #define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_JITTER_BUFFER_H_
 
-#include <list>
-#include <map>
-#include <set>
 #include <vector>
 
 #include "base/constructormagic.h"
@@ -25,6 +22,7 @@
 #include "video_coding/main/source/inter_frame_delay.h"
 #include "video_coding/main/source/jitter_buffer_common.h"
 #include "video_coding/main/source/jitter_estimator.h"
+#include "video_coding/main/source/session_info.h"
 #include "system_wrappers/interface/critical_section_wrapper.h"
 #include "typedefs.h"
 
@@ -43,7 +41,9 @@ class VCMFrameBuffer;
 class VCMPacket;
 class VCMEncodedFrame;
 
-typedef std::list<VCMFrameBuffer*> UnorderedFrameList;
+// Frames which are not in use. Reserved for kMaxNumberOfFrames, so that
+// returning a frame never allocates.
+typedef std::vector<VCMFrameBuffer*> UnorderedFrameList;
 
 struct VCMJitterSample {
   VCMJitterSample() : timestamp(0), frame_size(0), latest_packet_time(-1) {}
@@ -52,26 +52,112 @@ struct VCMJitterSample {
   int64_t latest_packet_time;
 };
 
-class TimestampLessThan {
+// Frames ordered by timestamp, oldest first. The frames are kept in a ring
+// with room for all kMaxNumberOfFrames frames, since new frames are almost
+// always the newest and frames leave from the front; inserting or popping
+// elsewhere moves the frames in between.
+class FrameList {
  public:
-  bool operator() (uint32_t timestamp1,
-                   uint32_t timestamp2) const {
-    return IsNewerTimestamp(timestamp2, timestamp1);
+  FrameList();
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  // Returns the |index|th oldest frame.
+  VCMFrameBuffer* at(size_t index) const {
+    return frames_[(head_ + index) % kMaxNumberOfFrames];
   }
-};
 
-class FrameList
-    : public std::map<uint32_t, VCMFrameBuffer*, TimestampLessThan> {
- public:
+  // Does nothing if there already is a frame with the same timestamp.
   void InsertFrame(VCMFrameBuffer* frame);
+  VCMFrameBuffer* FindFrame(uint32_t timestamp) const;
   VCMFrameBuffer* PopFrame(uint32_t timestamp);
+  // Removes the |index|th oldest frame.
+  void Erase(size_t index);
   VCMFrameBuffer* Front() const;
   VCMFrameBuffer* Back() const;
-  int RecycleFramesUntilKeyFrame(FrameList::iterator* key_frame_it,
-      UnorderedFrameList* free_frames);
+  bool HasNonEmptyFrame() const;
+  // Returns the newest key frame, or NULL if there is none.
+  VCMFrameBuffer* NewestKeyFrame() const;
+  // Drops frames from the front, at least one, until a key frame is first.
+  // Returns the number of dropped frames and sets |key_frame| to that key
+  // frame, or NULL if the list was emptied.
+  int RecycleFramesUntilKeyFrame(VCMFrameBuffer** key_frame,
+                                 UnorderedFrameList* free_frames);
   void CleanUpOldOrEmptyFrames(VCMDecodingState* decoding_state,
                                UnorderedFrameList* free_frames);
   void Reset(UnorderedFrameList* free_frames);
+  void clear();
+
+ private:
+  // Returns the index of the oldest frame which isn't older than |timestamp|,
+  // or size() if there is none.
+  size_t LowerBound(uint32_t timestamp) const;
+  VCMFrameBuffer*& slot(size_t index) {
+    return frames_[(head_ + index) % kMaxNumberOfFrames];
+  }
+
+  VCMFrameBuffer* frames_[kMaxNumberOfFrames];
+  size_t head_;
+  size_t size_;
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(FrameList);
+};
+
+// Set of sequence numbers ordered with wrap around, oldest first, kept as
+// one bit for each of the 2^16 sequence numbers. Adding and removing the
+// numbers costs the same however many are missing, and only finding the next
+// oldest number after the oldest is removed scans the bitmap. Ranges of
+// numbers are added and removed a word of the bitmap at a time.
+class SequenceNumberSet {
+ public:
+  SequenceNumberSet();
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  bool Contains(uint16_t sequence_number) const {
+    return (bits_[sequence_number >> 6] &
+            (uint64_t(1) << (sequence_number & 63))) != 0;
+  }
+  // The oldest sequence number. Must not be called when empty.
+  uint16_t Oldest() const { return oldest_; }
+
+  void Insert(uint16_t sequence_number);
+  // Inserts the sequence numbers from |first| to |last|, inclusive, which
+  // must all be newer than the sequence numbers in the set.
+  void InsertNewerRange(uint16_t first, uint16_t last);
+  void Erase(uint16_t sequence_number);
+  // Erases all sequence numbers which aren't newer than |sequence_number|.
+  void EraseUpTo(uint16_t sequence_number);
+  void Clear();
+  // Returns the sequence numbers, oldest first.
+  std::vector<uint16_t> ToVector() const;
+  // Returns the oldest sequence number in the set which isn't older than
+  // |first|. There must be one.
+  uint16_t FindFirst(uint16_t first) const;
+
+ private:
+  enum { kNumWords = (1 << 16) / 64 };
+
+  void SetBit(uint16_t sequence_number) {
+    bits_[sequence_number >> 6] |= uint64_t(1) << (sequence_number & 63);
+  }
+  void ClearBit(uint16_t sequence_number) {
+    bits_[sequence_number >> 6] &= ~(uint64_t(1) << (sequence_number & 63));
+  }
+  // Sets the bits from |first| to |last|, inclusive, and returns how many of
+  // them were clear.
+  size_t SetRange(uint16_t first, uint16_t last);
+  // Clears the bits from |first| to |last|, inclusive, and returns how many
+  // of them were set.
+  size_t ClearRange(uint16_t first, uint16_t last);
+
+  uint64_t bits_[kNumWords];
+  size_t size_;
+  uint16_t oldest_;
+  // Not older than the newest sequence number in the set.
+  uint16_t newest_;
+
+  RTC_DISALLOW_COPY_AND_ASSIGN(SequenceNumberSet);
 };
 
 class VCMJitterBuffer {
@@ -80,6 +166,9 @@ class VCMJitterBuffer {
 
   ~VCMJitterBuffer();
 
+  // GetNackBlocks() gives up on a packet after requesting it this many times.
+  enum { kMaxNackRequests = 10 };
+
   // Initializes and starts jitter buffer.
   void Start();
 
@@ -129,6 +218,12 @@ class VCMJitterBuffer {
   // timestamp is returned. Otherwise, returns false.
   bool NextMaybeIncompleteTimestamp(uint32_t* timestamp);
 
+  // Sets the type and the current size of the frame with |timestamp|, before
+  // it is extracted. Returns false if there is no such frame.
+  bool FrameTypeAndSize(uint32_t timestamp,
+                        FrameType* frame_type,
+                        size_t* frame_size) const;
+
   // Extract frame corresponding to input timestamp.
   // Frame will be set to a decoding state.
   VCMEncodedFrame* ExtractAndSetDecode(uint32_t timestamp);
@@ -146,6 +241,8 @@ class VCMJitterBuffer {
   // Inserts a packet into a frame returned from GetFrame().
   // If the return value is <= 0, |frame| is invalidated and the pointer must
   // be dropped after this function returns.
+  // The payload is copied into the frame without holding the lock that the
+  // decoding thread takes. Calls from several threads are serialized.
   VCMFrameBufferEnum InsertPacket(const VCMPacket& packet,
                                   bool* retransmitted);
 
@@ -174,6 +271,13 @@ class VCMJitterBuffer {
   // Returns a list of the sequence numbers currently missing.
   std::vector<uint16_t> GetNackList(bool* request_key_frame);
 
+  // Returns the missing sequence numbers which are due to be requested, as
+  // generic NACK blocks. A sequence number is due if it hasn't been requested
+  // yet, or if an RTT has passed since it was last requested and it has been
+  // requested less than kMaxNackRequests times. The returned sequence numbers
+  // are counted as requested. |request_key_frame| is set as by GetNackList().
+  std::vector<VCMNackBlock> GetNackBlocks(bool* request_key_frame);
+
   // Set decode error mode - Should not be changed in the middle of the
   // session. Changes will not influence frames already in the buffer.
   void SetDecodeErrorMode(VCMDecodeErrorMode error_mode);
@@ -187,14 +291,37 @@ class VCMJitterBuffer {
   void RegisterStatsCallback(VCMReceiveStatisticsCallback* callback);
 
  private:
-  class SequenceNumberLessThan {
-   public:
-    bool operator() (const uint16_t& sequence_number1,
-                     const uint16_t& sequence_number2) const {
-      return IsNewerSequenceNumber(sequence_number2, sequence_number1);
-    }
+  // The frame InsertPacket() inserts a packet into. A new frame is not in the
+  // frame lists until the packet is inserted, which is done without holding
+  // |crit_sect_|.
+  struct PendingInsert {
+    VCMFrameBuffer* frame;
+    // The list the frame was taken from, or NULL for a new frame.
+    FrameList* frame_list;
+    VCMFrameBufferStateEnum previous_state;
+    FrameData frame_data;
+    VCMDecodeErrorMode decode_error_mode;
+    int64_t now_ms;
   };
-  typedef std::set<uint16_t, SequenceNumberLessThan> SequenceNumberSet;
+
+  // Handles everything about |packet| which comes before inserting it into
+  // its frame, and takes the frame out of the lists into |insert|. Returns
+  // kNoError if the packet should be inserted.
+  VCMFrameBufferEnum TakeFrameForPacket(const VCMPacket& packet,
+                                        PendingInsert* insert)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
+  // Discards |packet|, which belongs to a frame older than the last decoded
+  // one. Returns kOldPacket, or kFlushIndicator if the jitter buffer was
+  // flushed after too many old packets.
+  VCMFrameBufferEnum HandleOldPacket(const VCMPacket& packet)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
+  // Puts the frame of |insert| back according to |buffer_state|, the result
+  // of inserting |packet| into it, and updates the NACK list.
+  VCMFrameBufferEnum ReturnFrameWithPacket(const VCMPacket& packet,
+                                           const PendingInsert& insert,
+                                           VCMFrameBufferEnum buffer_state,
+                                           bool* retransmitted)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
 
   // Gets the frame assigned to the timestamp of the packet. May recycle
   // existing frames if no free frames are available. Returns an error code if
@@ -226,6 +353,15 @@ class VCMJitterBuffer {
   void FindAndInsertContinuousFrames(const VCMFrameBuffer& new_frame)
       EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
   VCMFrameBuffer* NextFrame() const EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
+  // Recycles frames if the NACK list is too large or if frames have been
+  // incomplete for too long. Returns false if no sequence numbers should be
+  // requested, setting |request_key_frame| if a key frame is needed.
+  bool PrepareNackList(bool* request_key_frame)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
+  // Forgets the earlier requests of the sequence numbers |first| to |last|,
+  // inclusive, which were just added to the NACK list.
+  void ResetNackRequests(uint16_t first, uint16_t last)
+      EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
   // Returns true if the NACK list was updated to cover sequence numbers up to
   // |sequence_number|. If false a key frame is needed to get into a state where
   // we can continue decoding.
@@ -298,9 +434,14 @@ class VCMJitterBuffer {
   // If we are running (have started) or not.
   bool running_;
   CriticalSectionWrapper* crit_sect_;
+  // Serializes InsertPacket() calls. Taken before |crit_sect_|.
+  CriticalSectionWrapper* insert_crit_sect_;
   // Event to signal when we have a frame ready for decoder.
   rtc::scoped_ptr<EventWrapper> frame_event_;
-  // Number of allocated frames.
+  // All frames the jitter buffer may use, allocated once. Frames are taken
+  // from here as the jitter buffer grows.
+  VCMFrameBuffer* frame_slab_;
+  // Number of frames taken from |frame_slab_|.
   int max_number_of_frames_;
   UnorderedFrameList free_frames_ GUARDED_BY(crit_sect_);
   FrameList decodable_frames_ GUARDED_BY(crit_sect_);
@@ -349,9 +490,20 @@ class VCMJitterBuffer {
   int64_t high_rtt_nack_threshold_ms_;
   // Holds the internal NACK list (the missing sequence numbers).
   SequenceNumberSet missing_sequence_numbers_;
+  // When and how many times the missing sequence numbers have been requested
+  // by GetNackBlocks(), indexed by sequence number modulo the size, a power of
+  // 2 larger than |max_packet_age_to_nack_|.
+  struct NackRequest {
+    NackRequest() : sequence_number(0), num_requests(0), last_request_ms(-1) {}
+
+    uint16_t sequence_number;
+    uint16_t num_requests;
+    int64_t last_request_ms;
+  };
   uint16_t latest_received_sequence_number_;
   size_t max_nack_list_size_;
   int max_packet_age_to_nack_;  // Measured in sequence numbers.
+  std::vector<NackRequest> nack_requests_;
   int max_incomplete_time_ms_;
 
   VCMDecodeErrorMode decode_error_mode_;
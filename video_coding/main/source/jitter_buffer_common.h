@@ -31,7 +31,6 @@ enum VCMJitterBufferEnum {
   // TODO(sprang): Reduce this limit once codecs don't sometimes wildly
   // overshoot bitrate target.
   kMaxPacketsInSession = 1400,      // Allows ~2MB frames.
-  kBufferIncStepSizeBytes = 30000,  // >20 packets.
   kMaxJBFrameSizeBytes = 4000000    // sanity don't go above 4Mbyte.
 };
 
@@ -10,7 +10,9 @@
 
 #include <string.h>
 
+#include <algorithm>
 #include <list>
+#include <vector>
 
 #include "testing/gtest/include/gtest/gtest.h"
 #include "video_coding/main/source/frame_buffer.h"
@@ -20,8 +22,12 @@
 #include "video_coding/main/source/test/stream_generator.h"
 #include "video_coding/main/test/test_util.h"
 #include "system_wrappers/interface/clock.h"
+#include "system_wrappers/interface/event_wrapper.h"
 #include "system_wrappers/interface/metrics.h"
+#include "system_wrappers/interface/thread_wrapper.h"
+#include "system_wrappers/interface/tick_util.h"
 #include "test/histogram.h"
+#include "test/testsupport/perf_test.h"
 
 namespace webrtc {
 
@@ -2204,4 +2210,321 @@ TEST_F(TestJitterBufferNack, ResetByFutureKeyFrameDoesntError) {
   EXPECT_EQ(0u, nack_list.size());
 }
 
+TEST_F(TestJitterBufferNack, NackBlocksCoverBurstLoss) {
+  EXPECT_GE(InsertFrame(kVideoFrameKey), kNoError);
+  EXPECT_TRUE(DecodeCompleteFrame());
+
+  // Packets 2 to 21 of the delta frame are lost.
+  stream_generator_->GenerateFrame(kVideoFrameDelta, 40, 0,
+                                   clock_->TimeInMilliseconds());
+  EXPECT_EQ(kIncomplete, InsertPacketAndPop(0));
+  for (int i = 0; i < 20; ++i)
+    stream_generator_->NextPacket(NULL);
+  while (stream_generator_->PacketsRemaining() > 0)
+    EXPECT_EQ(kIncomplete, InsertPacketAndPop(0));
+
+  bool request_key_frame = false;
+  std::vector<VCMNackBlock> blocks =
+      jitter_buffer_->GetNackBlocks(&request_key_frame);
+  EXPECT_FALSE(request_key_frame);
+  ASSERT_EQ(2u, blocks.size());
+  EXPECT_EQ(2, blocks[0].pid);
+  EXPECT_EQ(0xFFFF, blocks[0].blp);
+  EXPECT_EQ(19, blocks[1].pid);
+  EXPECT_EQ(0x0003, blocks[1].blp);
+  EXPECT_EQ(20u, jitter_buffer_->GetNackList(&request_key_frame).size());
+}
+
+TEST_F(TestJitterBufferNack, NackBlocksResentAfterRtt) {
+  const int64_t kRttMs = 100;
+  jitter_buffer_->UpdateRtt(kRttMs);
+  EXPECT_GE(InsertFrame(kVideoFrameKey), kNoError);
+  EXPECT_TRUE(DecodeCompleteFrame());
+
+  // Packet 2 is lost.
+  stream_generator_->GenerateFrame(kVideoFrameDelta, 3, 0,
+                                   clock_->TimeInMilliseconds());
+  EXPECT_EQ(kIncomplete, InsertPacketAndPop(0));
+  stream_generator_->NextPacket(NULL);
+  EXPECT_EQ(kIncomplete, InsertPacketAndPop(0));
+
+  bool request_key_frame = false;
+  std::vector<VCMNackBlock> blocks =
+      jitter_buffer_->GetNackBlocks(&request_key_frame);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(2, blocks[0].pid);
+  // The retransmission may still be on its way.
+  clock_->AdvanceTimeMilliseconds(kRttMs - 1);
+  EXPECT_TRUE(jitter_buffer_->GetNackBlocks(&request_key_frame).empty());
+
+  // A packet lost meanwhile is requested right away.
+  stream_generator_->GenerateFrame(kVideoFrameDelta, 3, 0,
+                                   clock_->TimeInMilliseconds());
+  EXPECT_EQ(kIncomplete, InsertPacketAndPop(0));
+  stream_generator_->NextPacket(NULL);
+  EXPECT_EQ(kIncomplete, InsertPacketAndPop(0));
+  blocks = jitter_buffer_->GetNackBlocks(&request_key_frame);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(5, blocks[0].pid);
+  EXPECT_EQ(0, blocks[0].blp);
+
+  clock_->AdvanceTimeMilliseconds(1);
+  blocks = jitter_buffer_->GetNackBlocks(&request_key_frame);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(2, blocks[0].pid);
+  EXPECT_EQ(0, blocks[0].blp);
+
+  // Packet 2 is given up on after kMaxNackRequests requests, packet 5 one
+  // request later.
+  for (int i = 2; i < VCMJitterBuffer::kMaxNackRequests; ++i) {
+    clock_->AdvanceTimeMilliseconds(kRttMs);
+    blocks = jitter_buffer_->GetNackBlocks(&request_key_frame);
+    ASSERT_EQ(1u, blocks.size());
+    EXPECT_EQ(2, blocks[0].pid);
+    EXPECT_EQ(1 << 2, blocks[0].blp);
+  }
+  clock_->AdvanceTimeMilliseconds(kRttMs);
+  blocks = jitter_buffer_->GetNackBlocks(&request_key_frame);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(5, blocks[0].pid);
+  clock_->AdvanceTimeMilliseconds(kRttMs);
+  EXPECT_TRUE(jitter_buffer_->GetNackBlocks(&request_key_frame).empty());
+  // Both are still missing.
+  EXPECT_EQ(2u, jitter_buffer_->GetNackList(&request_key_frame).size());
+}
+
+TEST_F(TestJitterBufferNack, NackBlocksResentAfterDefaultRttWithoutEstimate) {
+  jitter_buffer_->UpdateRtt(0);
+  EXPECT_GE(InsertFrame(kVideoFrameKey), kNoError);
+  EXPECT_TRUE(DecodeCompleteFrame());
+
+  // Packet 2 is lost.
+  stream_generator_->GenerateFrame(kVideoFrameDelta, 3, 0,
+                                   clock_->TimeInMilliseconds());
+  EXPECT_EQ(kIncomplete, InsertPacketAndPop(0));
+  stream_generator_->NextPacket(NULL);
+  EXPECT_EQ(kIncomplete, InsertPacketAndPop(0));
+
+  bool request_key_frame = false;
+  ASSERT_EQ(1u, jitter_buffer_->GetNackBlocks(&request_key_frame).size());
+  // Not requested on every call, and so not given up on before a
+  // retransmission could arrive.
+  for (int i = 0; i < VCMJitterBuffer::kMaxNackRequests; ++i) {
+    clock_->AdvanceTimeMilliseconds(10);
+    EXPECT_TRUE(jitter_buffer_->GetNackBlocks(&request_key_frame).empty());
+  }
+  // Requested again after the default RTT of 200 ms.
+  clock_->AdvanceTimeMilliseconds(200 -
+                                  10 * VCMJitterBuffer::kMaxNackRequests);
+  std::vector<VCMNackBlock> blocks =
+      jitter_buffer_->GetNackBlocks(&request_key_frame);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(2, blocks[0].pid);
+}
+
+// Measures how many packets per second the jitter buffer takes in, NACKing
+// and decoding with errors, when |loss_percent| of the delta frame packets
+// are lost and every fourth pair of packets arrives swapped.
+class TestJitterBufferThroughput : public TestJitterBufferNack {
+ protected:
+  enum { kNumFrames = 3000 };
+  enum { kPacketsPerFrame = 10 };
+  enum { kKeyFrameInterval = 300 };
+
+  virtual void SetUp() {
+    TestJitterBufferNack::SetUp();
+    jitter_buffer_->SetDecodeErrorMode(kWithErrors);
+  }
+
+  // Returns the packets to insert, in arrival order.
+  std::vector<VCMPacket> GeneratePackets(int loss_percent) {
+    std::vector<VCMPacket> packets;
+    uint32_t random = 4711;
+    for (int i = 0; i < kNumFrames; ++i) {
+      const FrameType frame_type =
+          (i % kKeyFrameInterval == 0) ? kVideoFrameKey : kVideoFrameDelta;
+      stream_generator_->GenerateFrame(frame_type, kPacketsPerFrame, 0,
+                                       i * kDefaultFramePeriodMs);
+      VCMPacket packet;
+      while (stream_generator_->NextPacket(&packet)) {
+        random = random * 1103515245 + 12345;
+        if (frame_type == kVideoFrameDelta &&
+            static_cast<int>((random >> 16) % 100) < loss_percent) {
+          continue;
+        }
+        packet.dataPtr = data_buffer_;
+        packets.push_back(packet);
+      }
+    }
+    for (size_t i = 0; i + 1 < packets.size(); i += 8)
+      std::swap(packets[i], packets[i + 1]);
+    return packets;
+  }
+
+  double PacketsPerSecond(int loss_percent) {
+    std::vector<VCMPacket> packets = GeneratePackets(loss_percent);
+    const int64_t start_ms = TickTime::MillisecondTimestamp();
+    for (size_t i = 0; i < packets.size(); ++i) {
+      bool retransmitted = false;
+      jitter_buffer_->InsertPacket(packets[i], &retransmitted);
+      if (!packets[i].markerBit)
+        continue;
+      clock_->AdvanceTimeMilliseconds(kDefaultFramePeriodMs);
+      bool request_key_frame = false;
+      jitter_buffer_->GetNackList(&request_key_frame);
+      while (DecodeCompleteFrame() || DecodeIncompleteFrame()) {
+      }
+    }
+    const int64_t elapsed_ms =
+        std::max<int64_t>(1, TickTime::MillisecondTimestamp() - start_ms);
+    EXPECT_GT(jitter_buffer_->num_packets(), 0);
+    return packets.size() * 1000.0 / elapsed_ms;
+  }
+};
+
+TEST_F(TestJitterBufferThroughput, NoLoss) {
+  test::PrintResult("jitter_buffer_insert_rate", "", "loss_0",
+                    PacketsPerSecond(0), "packets/s", true);
+}
+
+TEST_F(TestJitterBufferThroughput, Loss5Percent) {
+  test::PrintResult("jitter_buffer_insert_rate", "", "loss_5",
+                    PacketsPerSecond(5), "packets/s", true);
+}
+
+TEST_F(TestJitterBufferThroughput, Loss20Percent) {
+  test::PrintResult("jitter_buffer_insert_rate", "", "loss_20",
+                    PacketsPerSecond(20), "packets/s", true);
+}
+
+// Inserts packets on one thread while another thread takes out the complete
+// frames, like the network and decoding threads of a receive stream, and
+// measures how long the inserts take.
+class TestJitterBufferConcurrentInsert : public ::testing::Test {
+ protected:
+  enum { kNumFrames = 3000 };
+  enum { kPacketsPerFrame = 20 };
+  enum { kKeyFrameInterval = 300 };
+  enum { kFrameIntervalMs = 33 };
+
+  TestJitterBufferConcurrentInsert()
+      : clock_(Clock::GetRealTimeClock()),
+        jitter_buffer_(clock_,
+                       rtc::scoped_ptr<EventWrapper>(EventWrapper::Create())),
+        stream_generator_(0, clock_->TimeInMilliseconds()),
+        num_decoded_frames_(0),
+        num_skipped_frames_(0),
+        last_timestamp_(0) {
+    memset(data_buffer_, 0, sizeof(data_buffer_));
+  }
+
+  static bool DecodeThread(void* obj) {
+    return static_cast<TestJitterBufferConcurrentInsert*>(obj)->Decode();
+  }
+
+  bool Decode() {
+    uint32_t timestamp = 0;
+    if (jitter_buffer_.NextCompleteTimestamp(10, &timestamp)) {
+      VCMEncodedFrame* frame = jitter_buffer_.ExtractAndSetDecode(timestamp);
+      if (frame) {
+        if (num_decoded_frames_ > 0 &&
+            frame->TimeStamp() != last_timestamp_ + 90 * kFrameIntervalMs) {
+          ++num_skipped_frames_;
+        }
+        last_timestamp_ = frame->TimeStamp();
+        ++num_decoded_frames_;
+        jitter_buffer_.ReleaseFrame(frame);
+      }
+    }
+    return true;
+  }
+
+  Clock* const clock_;
+  VCMJitterBuffer jitter_buffer_;
+  StreamGenerator stream_generator_;
+  // Only accessed by the decoding thread until it is stopped.
+  int num_decoded_frames_;
+  int num_skipped_frames_;
+  uint32_t last_timestamp_;
+  uint8_t data_buffer_[kMaxPacketSize];
+};
+
+TEST_F(TestJitterBufferConcurrentInsert, InsertLatency) {
+  jitter_buffer_.Start();
+  jitter_buffer_.SetNackMode(kNack, -1, -1);
+  jitter_buffer_.SetNackSettings(250, 450, 0);
+  rtc::scoped_ptr<ThreadWrapper> decode_thread = ThreadWrapper::CreateThread(
+      DecodeThread, this, "JitterBufferDecodeThread");
+  ASSERT_TRUE(decode_thread->Start());
+
+  std::vector<double> insert_times_us;
+  insert_times_us.reserve(kNumFrames * kPacketsPerFrame);
+  // The frames are inserted as fast as possible, their timestamps are those
+  // of a 30 fps stream.
+  const int64_t start_time_ms = clock_->TimeInMilliseconds();
+  for (int i = 0; i < kNumFrames; ++i) {
+    stream_generator_.GenerateFrame(
+        (i % kKeyFrameInterval == 0) ? kVideoFrameKey : kVideoFrameDelta,
+        kPacketsPerFrame, 0, start_time_ms + i * kFrameIntervalMs);
+    VCMPacket packet;
+    while (stream_generator_.NextPacket(&packet)) {
+      packet.dataPtr = data_buffer_;
+      packet.sizeBytes = sizeof(data_buffer_);
+      bool retransmitted = false;
+      const int64_t start_us = TickTime::MicrosecondTimestamp();
+      jitter_buffer_.InsertPacket(packet, &retransmitted);
+      insert_times_us.push_back(
+          static_cast<double>(TickTime::MicrosecondTimestamp() - start_us));
+    }
+  }
+  jitter_buffer_.Stop();
+  decode_thread->Stop();
+  EXPECT_GT(num_decoded_frames_, 0);
+
+  std::sort(insert_times_us.begin(), insert_times_us.end());
+  const size_t num_inserts = insert_times_us.size();
+  test::PrintResult("jitter_buffer_insert_time", "_p50", "concurrent_decode",
+                    insert_times_us[num_inserts / 2], "us", false);
+  test::PrintResult("jitter_buffer_insert_time", "_p99", "concurrent_decode",
+                    insert_times_us[num_inserts * 99 / 100], "us", true);
+  test::PrintResult("jitter_buffer_insert_time", "_max", "concurrent_decode",
+                    insert_times_us[num_inserts - 1], "us", false);
+}
+
+// Inserts duplicates of packets of the previous frame, which is often complete
+// and waiting to be decoded, and verifies that no frame is skipped meanwhile.
+TEST_F(TestJitterBufferConcurrentInsert, DuplicatePacketsDoNotSkipFrames) {
+  jitter_buffer_.Start();
+  jitter_buffer_.SetNackMode(kNack, -1, -1);
+  jitter_buffer_.SetNackSettings(250, 450, 0);
+  rtc::scoped_ptr<ThreadWrapper> decode_thread = ThreadWrapper::CreateThread(
+      DecodeThread, this, "JitterBufferDecodeThread");
+  ASSERT_TRUE(decode_thread->Start());
+
+  const int64_t start_time_ms = clock_->TimeInMilliseconds();
+  VCMPacket previous_packet;
+  for (int i = 0; i < kNumFrames; ++i) {
+    stream_generator_.GenerateFrame(i == 0 ? kVideoFrameKey : kVideoFrameDelta,
+                                    kPacketsPerFrame, 0,
+                                    start_time_ms + i * kFrameIntervalMs);
+    VCMPacket packet;
+    VCMPacket first_packet;
+    while (stream_generator_.NextPacket(&packet)) {
+      packet.dataPtr = data_buffer_;
+      packet.sizeBytes = sizeof(data_buffer_);
+      bool retransmitted = false;
+      jitter_buffer_.InsertPacket(packet, &retransmitted);
+      if (i > 0)
+        jitter_buffer_.InsertPacket(previous_packet, &retransmitted);
+      if (packet.isFirstPacket)
+        first_packet = packet;
+    }
+    previous_packet = first_packet;
+  }
+  jitter_buffer_.Stop();
+  decode_thread->Stop();
+  EXPECT_GT(num_decoded_frames_, 0);
+  EXPECT_EQ(0, num_skipped_frames_);
+}
+
 }  // namespace webrtc
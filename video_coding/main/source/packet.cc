@@ -9,6 +9,7 @@
  */
 
 #include "interface/module_common_types.h"
+#include "video_coding/main/source/h264_depacketizer.h"
 #include "video_coding/main/source/packet.h"
 
 #include <assert.h>
@@ -54,7 +55,16 @@ VCMPacket::VCMPacket(const uint8_t* ptr,
     height(rtpHeader.type.Video.height),
     codecSpecificHeader(rtpHeader.type.Video)
 {
-    CopyCodecSpecifics(rtpHeader.type.Video);
+    // The session needs the NAL units of every H.264 payload, which a
+    // depacketizer other than H264Depacketizer doesn't provide. A payload
+    // which can't be parsed keeps its header and is copied as it is.
+    if (rtpHeader.type.Video.codec == kRtpVideoH264 &&
+        rtpHeader.type.Video.codecHeader.H264.nalus_length == 0) {
+      RTPVideoHeader video_header = rtpHeader.type.Video;
+      if (H264Depacketizer::Parse(ptr, size, &video_header, NULL))
+        codecSpecificHeader = video_header;
+    }
+    CopyCodecSpecifics(codecSpecificHeader);
 }
 
 VCMPacket::VCMPacket(const uint8_t* ptr,
@@ -130,12 +140,25 @@ void VCMPacket::CopyCodecSpecifics(const RTPVideoHeader& videoHeader) {
 
       codec = kVideoCodecVP9;
       return;
-    case kRtpVideoH264:
+    case kRtpVideoH264: {
       isFirstPacket = videoHeader.isFirstPacket;
       if (isFirstPacket)
         insertStartCode = true;
 
-      if (isFirstPacket && markerBit) {
+      const RTPVideoHeaderH264& h264 = videoHeader.codecHeader.H264;
+      if (h264.packetization_type == kH264FuA && h264.nalus_length > 0) {
+        // The FU header tells where the NAL unit ends, the marker bit only
+        // does so for the last NAL unit of the frame.
+        if (h264.fu_start)
+          completeNALU = kNaluStart;
+        else if (h264.fu_end)
+          completeNALU = kNaluEnd;
+        else
+          completeNALU = kNaluIncomplete;
+      } else if (h264.packetization_type == kH264StapA ||
+                 h264.nalus_length > 0) {
+        completeNALU = kNaluComplete;
+      } else if (isFirstPacket && markerBit) {
         completeNALU = kNaluComplete;
       } else if (isFirstPacket) {
         completeNALU = kNaluStart;
@@ -146,6 +169,7 @@ void VCMPacket::CopyCodecSpecifics(const RTPVideoHeader& videoHeader) {
       }
       codec = kVideoCodecH264;
       return;
+    }
     case kRtpVideoGeneric:
     case kRtpVideoNone:
       codec = kVideoCodecUnknown;
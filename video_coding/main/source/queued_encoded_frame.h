@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2015 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_QUEUED_ENCODED_FRAME_H_
+#define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_QUEUED_ENCODED_FRAME_H_
+
+#include <string.h>
+
+#include <vector>
+
+#include "video_coding/include/video_codec_interface.h"
+
+namespace webrtc {
+
+// The arguments of a VideoDecoder::Decode call, with the frame copied out of
+// the caller's buffer, which is returned to the jitter buffer as soon as
+// Decode returns. Used by the decoders that decode on threads of their own.
+struct QueuedEncodedFrame {
+  // Some decoders, e.g. FFmpeg's, read past the end of the bitstream.
+  static const size_t kPaddingBytes = 32;
+
+  QueuedEncodedFrame(const EncodedImage& input_image,
+                     bool missing_frames,
+                     const RTPFragmentationHeader* fragmentation,
+                     const CodecSpecificInfo* codec_specific_info,
+                     int64_t render_time_ms)
+      : image(input_image),
+        buffer(input_image._length + kPaddingBytes, 0),
+        missing_frames(missing_frames),
+        has_fragmentation(fragmentation != nullptr),
+        has_codec_specific_info(codec_specific_info != nullptr),
+        render_time_ms(render_time_ms) {
+    memcpy(&buffer[0], input_image._buffer, input_image._length);
+    image._buffer = &buffer[0];
+    image._size = buffer.size();
+    if (fragmentation)
+      this->fragmentation.CopyFrom(*fragmentation);
+    if (codec_specific_info)
+      this->codec_specific_info = *codec_specific_info;
+  }
+
+  int32_t Decode(VideoDecoder* decoder) const {
+    return decoder->Decode(
+        image, missing_frames, has_fragmentation ? &fragmentation : nullptr,
+        has_codec_specific_info ? &codec_specific_info : nullptr,
+        render_time_ms);
+  }
+
+  EncodedImage image;
+  std::vector<uint8_t> buffer;
+  bool missing_frames;
+  bool has_fragmentation;
+  RTPFragmentationHeader fragmentation;
+  bool has_codec_specific_info;
+  CodecSpecificInfo codec_specific_info;
+  int64_t render_time_ms;
+};
+
+}  // namespace webrtc
+
+#endif  // WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_QUEUED_ENCODED_FRAME_H_
@@ -146,8 +146,19 @@ VCMEncodedFrame* VCMReceiver::FrameForDecoding(uint16_t max_wait_time_ms,
         static_cast<int32_t>(clock_->TimeInMilliseconds() - start_time_ms);
     uint16_t new_max_wait_time = static_cast<uint16_t>(
         VCM_MAX(available_wait_time, 0));
-    uint32_t wait_time_ms = timing_->MaxWaitingTime(
-        next_render_time_ms, clock_->TimeInMilliseconds());
+    FrameType frame_type = kVideoFrameDelta;
+    size_t frame_size = 0;
+    uint32_t wait_time_ms = 0;
+    if (jitter_buffer_.FrameTypeAndSize(frame_timestamp, &frame_type,
+                                        &frame_size)) {
+      // Release the frame its predicted decode time before it is rendered.
+      wait_time_ms = timing_->MaxWaitingTime(
+          next_render_time_ms, clock_->TimeInMilliseconds(), frame_type,
+          frame_size);
+    } else {
+      wait_time_ms = timing_->MaxWaitingTime(
+          next_render_time_ms, clock_->TimeInMilliseconds());
+    }
     if (new_max_wait_time < wait_time_ms) {
       // We're not allowed to wait until the frame is supposed to be rendered,
       // waiting as long as we're allowed to avoid busy looping, and then return
@@ -223,6 +234,10 @@ std::vector<uint16_t> VCMReceiver::NackList(bool* request_key_frame) {
   return jitter_buffer_.GetNackList(request_key_frame);
 }
 
+std::vector<VCMNackBlock> VCMReceiver::NackBlocks(bool* request_key_frame) {
+  return jitter_buffer_.GetNackBlocks(request_key_frame);
+}
+
 void VCMReceiver::SetDecodeErrorMode(VCMDecodeErrorMode decode_error_mode) {
   jitter_buffer_.SetDecodeErrorMode(decode_error_mode);
 }
@@ -61,6 +61,7 @@ class VCMReceiver {
                        int max_incomplete_time_ms);
   VCMNackMode NackMode() const;
   std::vector<uint16_t> NackList(bool* request_key_frame);
+  std::vector<VCMNackBlock> NackBlocks(bool* request_key_frame);
 
   // Receiver video delay.
   int SetMinReceiverDelay(int desired_delay_ms);
@@ -10,25 +10,22 @@
 
 #include "video_coding/main/source/session_info.h"
 
+#include <string.h>
+
+#include "video_coding/main/source/h264_depacketizer.h"
 #include "video_coding/main/source/packet.h"
 #include "system_wrappers/interface/logging.h"
 
 namespace webrtc {
 
-namespace {
-
-uint16_t BufferToUWord16(const uint8_t* dataBuffer) {
-  return (dataBuffer[0] << 8) | dataBuffer[1];
-}
-
-}  // namespace
-
 VCMSessionInfo::VCMSessionInfo()
     : session_nack_(false),
       complete_(false),
       decodable_(false),
       frame_type_(kVideoFrameDelta),
       packets_(),
+      frame_buffer_(NULL),
+      frame_buffer_length_(0),
       empty_seq_num_low_(-1),
       empty_seq_num_high_(-1),
       first_packet_seq_num_(-1),
@@ -42,6 +39,8 @@ void VCMSessionInfo::UpdateDataPointers(const uint8_t* old_base_ptr,
       assert(old_base_ptr != NULL && new_base_ptr != NULL);
       (*it).dataPtr = new_base_ptr + ((*it).dataPtr - old_base_ptr);
     }
+  if (frame_buffer_ != NULL)
+    frame_buffer_ = const_cast<uint8_t*>(new_base_ptr);
 }
 
 int VCMSessionInfo::LowSequenceNumber() const {
@@ -120,6 +119,8 @@ void VCMSessionInfo::Reset() {
   decodable_ = false;
   frame_type_ = kVideoFrameDelta;
   packets_.clear();
+  frame_buffer_ = NULL;
+  frame_buffer_length_ = 0;
   empty_seq_num_low_ = -1;
   empty_seq_num_high_ = -1;
   first_packet_seq_num_ = -1;
@@ -140,59 +141,29 @@ int VCMSessionInfo::NumPackets() const {
 size_t VCMSessionInfo::InsertBuffer(uint8_t* frame_buffer,
                                     PacketIterator packet_it) {
   VCMPacket& packet = *packet_it;
-  PacketIterator it;
 
-  // Calculate the offset into the frame buffer for this packet.
-  size_t offset = 0;
-  for (it = packets_.begin(); it != packet_it; ++it)
-    offset += (*it).sizeBytes;
-
-  // Set the data pointer to pointing to the start of this packet in the
-  // frame buffer.
+  // Append the data after the data of the packets inserted before, whatever
+  // their sequence numbers. Moving the data of the subsequent packets for
+  // every packet that arrives out of order would cost O(n^2) for a reordered
+  // frame; Linearize() orders the data once instead.
   const uint8_t* packet_buffer = packet.dataPtr;
-  packet.dataPtr = frame_buffer + offset;
-
-  // We handle H.264 STAP-A packets in a special way as we need to remove the
-  // two length bytes between each NAL unit, and potentially add start codes.
-  // TODO(pbos): Remove H264 parsing from this step and use a fragmentation
-  // header supplied by the H264 depacketizer.
-  const size_t kH264NALHeaderLengthInBytes = 1;
-  const size_t kLengthFieldLength = 2;
-  if (packet.codecSpecificHeader.codec == kRtpVideoH264 &&
-      packet.codecSpecificHeader.codecHeader.H264.packetization_type ==
-          kH264StapA) {
-    size_t required_length = 0;
-    const uint8_t* nalu_ptr = packet_buffer + kH264NALHeaderLengthInBytes;
-    while (nalu_ptr < packet_buffer + packet.sizeBytes) {
-      size_t length = BufferToUWord16(nalu_ptr);
-      required_length +=
-          length + (packet.insertStartCode ? kH264StartCodeLengthBytes : 0);
-      nalu_ptr += kLengthFieldLength + length;
-    }
-    ShiftSubsequentPackets(packet_it, required_length);
-    nalu_ptr = packet_buffer + kH264NALHeaderLengthInBytes;
-    uint8_t* frame_buffer_ptr = frame_buffer + offset;
-    while (nalu_ptr < packet_buffer + packet.sizeBytes) {
-      size_t length = BufferToUWord16(nalu_ptr);
-      nalu_ptr += kLengthFieldLength;
-      frame_buffer_ptr += Insert(nalu_ptr,
-                                 length,
-                                 packet.insertStartCode,
-                                 const_cast<uint8_t*>(frame_buffer_ptr));
-      nalu_ptr += length;
-    }
-    packet.sizeBytes = required_length;
-    return packet.sizeBytes;
+  packet.dataPtr = frame_buffer + frame_buffer_length_;
+
+  // H.264 packets are written in Annex B format, from the NAL units found by
+  // H264Depacketizer: STAP-A packets are split into NAL units with start
+  // codes, FU-A fragments are appended to the NAL unit they belong to.
+  if (packet.codec == kVideoCodecH264) {
+    packet.sizeBytes = H264Depacketizer::WriteAnnexB(
+        packet_buffer, packet.sizeBytes,
+        packet.codecSpecificHeader.codecHeader.H264, packet.insertStartCode,
+        const_cast<uint8_t*>(packet.dataPtr));
+  } else {
+    packet.sizeBytes = Insert(packet_buffer,
+                              packet.sizeBytes,
+                              packet.insertStartCode,
+                              const_cast<uint8_t*>(packet.dataPtr));
   }
-  ShiftSubsequentPackets(
-      packet_it,
-      packet.sizeBytes +
-          (packet.insertStartCode ? kH264StartCodeLengthBytes : 0));
-
-  packet.sizeBytes = Insert(packet_buffer,
-                            packet.sizeBytes,
-                            packet.insertStartCode,
-                            const_cast<uint8_t*>(packet.dataPtr));
+  frame_buffer_length_ += packet.sizeBytes;
   return packet.sizeBytes;
 }
 
@@ -212,6 +183,34 @@ size_t VCMSessionInfo::Insert(const uint8_t* buffer,
   return length;
 }
 
+void VCMSessionInfo::Linearize() {
+  // Skip the packets which already are in place.
+  size_t offset = 0;
+  PacketIterator it = packets_.begin();
+  for (; it != packets_.end(); ++it) {
+    if ((*it).sizeBytes == 0)
+      continue;
+    if ((*it).dataPtr != frame_buffer_ + offset)
+      break;
+    offset += (*it).sizeBytes;
+  }
+  if (it == packets_.end())
+    return;
+
+  reorder_buffer_.resize(frame_buffer_length_ - offset);
+  size_t length = 0;
+  for (PacketIterator copy_it = it; copy_it != packets_.end(); ++copy_it) {
+    if ((*copy_it).sizeBytes == 0)
+      continue;
+    memcpy(&reorder_buffer_[length], (*copy_it).dataPtr,
+           (*copy_it).sizeBytes);
+    (*copy_it).dataPtr = frame_buffer_ + offset + length;
+    length += (*copy_it).sizeBytes;
+  }
+  assert(offset + length == frame_buffer_length_);
+  memcpy(frame_buffer_ + offset, &reorder_buffer_[0], length);
+}
+
 void VCMSessionInfo::ShiftSubsequentPackets(PacketIterator it,
                                             int steps_to_shift) {
   ++it;
@@ -316,6 +315,7 @@ size_t VCMSessionInfo::DeletePacketData(PacketIterator start,
   }
   if (bytes_to_delete > 0)
     ShiftSubsequentPackets(end, -static_cast<int>(bytes_to_delete));
+  frame_buffer_length_ -= bytes_to_delete;
   return bytes_to_delete;
 }
 
@@ -331,6 +331,7 @@ size_t VCMSessionInfo::BuildVP8FragmentationHeader(
          kMaxVP8Partitions * sizeof(size_t));
   if (packets_.empty())
       return new_length;
+  Linearize();
   PacketIterator it = FindNextPartitionBeginning(packets_.begin());
   while (it != packets_.end()) {
     const int partition_id =
@@ -367,6 +368,61 @@ size_t VCMSessionInfo::BuildVP8FragmentationHeader(
   return new_length;
 }
 
+void VCMSessionInfo::BuildH264FragmentationHeader(
+    const uint8_t* frame_buffer,
+    RTPFragmentationHeader* fragmentation) {
+  // Count the NAL units first, to allocate the header once.
+  size_t num_nalus = 0;
+  for (PacketIteratorConst it = packets_.begin(); it != packets_.end(); ++it) {
+    const RTPVideoHeaderH264& h264 = (*it).codecSpecificHeader.codecHeader.H264;
+    if ((*it).sizeBytes > 0 && (*it).isFirstPacket) {
+      num_nalus += (h264.nalus_length == 0 ||
+                    h264.packetization_type == kH264FuA) ? 1 :
+                   h264.nalus_length;
+    }
+  }
+  fragmentation->VerifyAndAllocateFragmentationHeader(num_nalus);
+  fragmentation->fragmentationVectorSize = 0;
+  if (num_nalus == 0)
+    return;
+  Linearize();
+  size_t index = 0;
+  for (PacketIteratorConst it = packets_.begin(); it != packets_.end(); ++it) {
+    const VCMPacket& packet = *it;
+    if (packet.sizeBytes == 0)
+      continue;
+    if (!packet.isFirstPacket) {
+      // A FU-A fragment, or a NAL unit that is split over several packets,
+      // continues the NAL unit of the previous packet. MakeDecodable has
+      // removed the data of NAL units with missing packets.
+      if (index > 0)
+        fragmentation->fragmentationLength[index - 1] += packet.sizeBytes;
+      continue;
+    }
+    const RTPVideoHeaderH264& h264 =
+        packet.codecSpecificHeader.codecHeader.H264;
+    const size_t start_code_length =
+        packet.insertStartCode ? kH264StartCodeLengthBytes : 0;
+    size_t offset = packet.dataPtr - frame_buffer;
+    if (h264.nalus_length == 0 || h264.packetization_type == kH264FuA) {
+      fragmentation->fragmentationOffset[index] = offset + start_code_length;
+      fragmentation->fragmentationLength[index] =
+          packet.sizeBytes - start_code_length;
+      ++index;
+      continue;
+    }
+    for (size_t i = 0; i < h264.nalus_length; ++i) {
+      offset += start_code_length;
+      fragmentation->fragmentationOffset[index] = offset;
+      fragmentation->fragmentationLength[index] = h264.nalus[i].length;
+      offset += h264.nalus[i].length;
+      ++index;
+    }
+  }
+  assert(index == num_nalus);
+  fragmentation->fragmentationVectorSize = static_cast<uint16_t>(num_nalus);
+}
+
 VCMSessionInfo::PacketIterator VCMSessionInfo::FindNextPartitionBeginning(
     PacketIterator it) const {
   while (it != packets_.end()) {
@@ -415,6 +471,7 @@ size_t VCMSessionInfo::MakeDecodable() {
   if (packets_.empty()) {
     return 0;
   }
+  Linearize();
   PacketIterator it = packets_.begin();
   // Make sure we remove the first NAL unit if it's not decodable.
   if ((*it).completeNALU == kNaluIncomplete ||
@@ -489,7 +546,10 @@ int VCMSessionInfo::InsertPacket(const VCMPacket& packet,
     return -2;
 
   if (packet.codec == kVideoCodecH264) {
-    frame_type_ = packet.frameType;
+    // Only the packets with the IDR slices of a key frame are marked as such,
+    // e.g. not its SEI or the packets in between.
+    if (packet.frameType == kVideoFrameKey || frame_type_ != kVideoFrameKey)
+      frame_type_ = packet.frameType;
     if (packet.isFirstPacket &&
         (first_packet_seq_num_ == -1 ||
          IsNewerSequenceNumber(first_packet_seq_num_, packet.seqNum))) {
@@ -536,6 +596,7 @@ int VCMSessionInfo::InsertPacket(const VCMPacket& packet,
   // The insert operation invalidates the iterator |rit|.
   PacketIterator packet_list_it = packets_.insert(rit.base(), packet);
 
+  frame_buffer_ = frame_buffer;
   size_t returnLength = InsertBuffer(frame_buffer, packet_list_it);
   UpdateCompleteSession();
   if (decode_error_mode == kWithErrors)
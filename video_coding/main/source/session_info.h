@@ -12,6 +12,7 @@
 #define WEBRTC_MODULES_VIDEO_CODING_MAIN_SOURCE_SESSION_INFO_H_
 
 #include <list>
+#include <vector>
 
 #include "interface/module_common_types.h"
 #include "video_coding/main/interface/video_coding.h"
@@ -53,6 +54,10 @@ class VCMSessionInfo {
   bool complete() const;
   bool decodable() const;
 
+  // Packets are stored in the frame buffer in the order they arrive, which
+  // is only the sequence number order if they arrive in order. The functions
+  // below put the packets in sequence number order first.
+
   // Builds fragmentation headers for VP8, each fragment being a decodable
   // VP8 partition. Returns the total number of bytes which are decodable. Is
   // used instead of MakeDecodable for VP8.
@@ -60,6 +65,11 @@ class VCMSessionInfo {
                                      size_t frame_buffer_length,
                                      RTPFragmentationHeader* fragmentation);
 
+  // Builds a fragmentation header for H.264 with one fragment per NAL unit,
+  // excluding the start code. Is used after MakeDecodable.
+  void BuildH264FragmentationHeader(const uint8_t* frame_buffer,
+                                    RTPFragmentationHeader* fragmentation);
+
   // Makes the frame decodable. I.e., only contain decodable NALUs. All
   // non-decodable NALUs will be deleted and packets will be moved to in
   // memory to remove any empty space.
@@ -120,6 +130,8 @@ class VCMSessionInfo {
                 size_t length,
                 bool insert_start_code,
                 uint8_t* frame_buffer);
+  // Moves the packet data into sequence number order, if it isn't already.
+  void Linearize();
   void ShiftSubsequentPackets(PacketIterator it, int steps_to_shift);
   PacketIterator FindNaluEnd(PacketIterator packet_iter) const;
   // Deletes the data of all packets between |start| and |end|, inclusively.
@@ -153,6 +165,12 @@ class VCMSessionInfo {
   webrtc::FrameType frame_type_;
   // Packets in this frame.
   PacketList packets_;
+  // The frame buffer that the packet data is in, and the number of bytes used
+  // by it. New packet data is appended.
+  uint8_t* frame_buffer_;
+  size_t frame_buffer_length_;
+  // Used by Linearize(). Kept to reuse the allocation for the next frame.
+  std::vector<uint8_t> reorder_buffer_;
   int empty_seq_num_low_;
   int empty_seq_num_high_;
 
@@ -10,10 +10,15 @@
 
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "testing/gtest/include/gtest/gtest.h"
 #include "interface/module_common_types.h"
 #include "video_coding/main/source/packet.h"
 #include "video_coding/main/source/session_info.h"
+#include "system_wrappers/interface/tick_util.h"
+#include "test/testsupport/perf_test.h"
 
 namespace webrtc {
 
@@ -1061,4 +1066,83 @@ TEST_F(TestNalUnits, ReorderWrapLosses) {
   EXPECT_EQ(0U, session_.SessionLength());
 }
 
+// A large key frame whose packets arrive in random order.
+class TestReorderedFrame : public ::testing::Test {
+ protected:
+  enum { kNumPackets = 1400 };
+  enum { kPacketSize = 1200 };
+
+  virtual void SetUp() {
+    frame_buffer_.resize(kNumPackets * kPacketSize);
+    packet_buffer_.resize(kPacketSize);
+    frame_data_.rtt_ms = 0;
+    frame_data_.rolling_average_packets_per_frame = -1;
+    for (int i = 0; i < kNumPackets; ++i)
+      order_.push_back(i);
+    uint32_t random = 4711;
+    for (int i = kNumPackets - 1; i > 0; --i) {
+      random = random * 1103515245 + 12345;
+      std::swap(order_[i], order_[(random >> 8) % (i + 1)]);
+    }
+  }
+
+  // Inserts all packets, and returns the time it took in microseconds.
+  int64_t InsertPackets() {
+    session_.Reset();
+    VCMPacket packet;
+    packet.codec = kVideoCodecVP8;
+    packet.frameType = kVideoFrameKey;
+    packet.completeNALU = kNaluComplete;
+    packet.sizeBytes = kPacketSize;
+    const int64_t start_us = TickTime::MicrosecondTimestamp();
+    for (int i = 0; i < kNumPackets; ++i) {
+      const int index = order_[i];
+      for (size_t j = 0; j < packet_buffer_.size(); ++j)
+        packet_buffer_[j] = static_cast<uint8_t>(index + j);
+      packet.dataPtr = &packet_buffer_[0];
+      packet.sizeBytes = kPacketSize;
+      packet.seqNum = static_cast<uint16_t>(0xFF00 + index);
+      packet.isFirstPacket = (index == 0);
+      packet.markerBit = (index == kNumPackets - 1);
+      EXPECT_EQ(kPacketSize, session_.InsertPacket(packet, &frame_buffer_[0],
+                                                   kNoErrors, frame_data_));
+    }
+    return TickTime::MicrosecondTimestamp() - start_us;
+  }
+
+  std::vector<int> order_;
+  std::vector<uint8_t> frame_buffer_;
+  std::vector<uint8_t> packet_buffer_;
+  VCMSessionInfo session_;
+  FrameData frame_data_;
+};
+
+TEST_F(TestReorderedFrame, DataInSequenceNumberOrder) {
+  InsertPackets();
+  EXPECT_TRUE(session_.complete());
+  EXPECT_EQ(0U, session_.MakeDecodable());
+  EXPECT_EQ(static_cast<size_t>(kNumPackets * kPacketSize),
+            session_.SessionLength());
+  for (int i = 0; i < kNumPackets; ++i) {
+    for (int j = 0; j < kPacketSize; ++j) {
+      ASSERT_EQ(static_cast<uint8_t>(i + j),
+                frame_buffer_[i * kPacketSize + j])
+          << "packet " << i << ", byte " << j;
+    }
+  }
+}
+
+TEST_F(TestReorderedFrame, InsertTime) {
+  const int kNumRuns = 10;
+  int64_t insert_time_us = 0;
+  for (int i = 0; i < kNumRuns; ++i) {
+    insert_time_us += InsertPackets();
+    const int64_t start_us = TickTime::MicrosecondTimestamp();
+    session_.MakeDecodable();
+    insert_time_us += TickTime::MicrosecondTimestamp() - start_us;
+  }
+  test::PrintResult("session_insert_time", "", "1400_packets_reordered",
+                    insert_time_us / 1000.0 / kNumRuns, "ms", true);
+}
+
 }  // namespace webrtc
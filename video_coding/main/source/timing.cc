@@ -13,6 +13,7 @@
 #include "video_coding/main/source/internal_defines.h"
 #include "video_coding/main/source/jitter_buffer_common.h"
 #include "system_wrappers/interface/clock.h"
+#include "system_wrappers/interface/field_trial.h"
 #include "system_wrappers/interface/metrics.h"
 #include "system_wrappers/interface/timestamp_extrapolator.h"
 
@@ -26,6 +27,10 @@ VCMTiming::VCMTiming(Clock* clock,
       master_(false),
       ts_extrapolator_(),
       codec_timer_(),
+      decode_time_prediction_(
+          field_trial::FindFullName("WebRTC-DecodeTimePrediction") ==
+          "Enabled"),
+      decode_time_predictor_(),
       render_delay_ms_(kDefaultRenderDelayMs),
       min_playout_delay_ms_(0),
       jitter_delay_ms_(0),
@@ -77,6 +82,7 @@ void VCMTiming::Reset() {
   CriticalSectionScoped cs(crit_sect_);
   ts_extrapolator_->Reset(clock_->TimeInMilliseconds());
   codec_timer_.Reset();
+  decode_time_predictor_.Reset();
   render_delay_ms_ = kDefaultRenderDelayMs;
   min_playout_delay_ms_ = 0;
   jitter_delay_ms_ = 0;
@@ -87,6 +93,7 @@ void VCMTiming::Reset() {
 void VCMTiming::ResetDecodeTime() {
   CriticalSectionScoped lock(crit_sect_);
   codec_timer_.Reset();
+  decode_time_predictor_.Reset();
 }
 
 void VCMTiming::set_render_delay(uint32_t render_delay_ms) {
@@ -153,7 +160,7 @@ void VCMTiming::UpdateCurrentDelay(int64_t render_time_ms,
   CriticalSectionScoped cs(crit_sect_);
   uint32_t target_delay_ms = TargetDelayInternal();
   int64_t delayed_ms = actual_decode_time_ms -
-      (render_time_ms - MaxDecodeTimeMs() - render_delay_ms_);
+      (render_time_ms - DecodeTimeMs() - render_delay_ms_);
   if (delayed_ms < 0) {
     return;
   }
@@ -167,11 +174,14 @@ void VCMTiming::UpdateCurrentDelay(int64_t render_time_ms,
 int32_t VCMTiming::StopDecodeTimer(uint32_t time_stamp,
                                    int64_t start_time_ms,
                                    int64_t now_ms,
-                                   int64_t render_time_ms) {
+                                   int64_t render_time_ms,
+                                   FrameType frame_type,
+                                   size_t frame_size) {
   CriticalSectionScoped cs(crit_sect_);
   int32_t time_diff_ms = codec_timer_.StopTimer(start_time_ms, now_ms);
   assert(time_diff_ms >= 0);
   last_decode_ms_ = time_diff_ms;
+  decode_time_predictor_.AddDecodeTime(frame_type, frame_size, time_diff_ms);
 
   // Update stats.
   ++num_decoded_frames_;
@@ -219,12 +229,39 @@ int32_t VCMTiming::MaxDecodeTimeMs(FrameType frame_type /*= kVideoFrameDelta*/)
   return decode_time_ms;
 }
 
+int32_t VCMTiming::DecodeTimeMs() const {
+  const int decode_time_ms = decode_time_prediction_ ?
+      decode_time_predictor_.PredictDecodeTimeMs() : -1;
+  return decode_time_ms >= 0 ? decode_time_ms : MaxDecodeTimeMs();
+}
+
+int32_t VCMTiming::DecodeTimeMs(FrameType frame_type,
+                                size_t frame_size) const {
+  const int decode_time_ms = decode_time_prediction_ ?
+      decode_time_predictor_.PredictDecodeTimeMs(frame_type, frame_size) : -1;
+  return decode_time_ms >= 0 ? decode_time_ms : MaxDecodeTimeMs(frame_type);
+}
+
 uint32_t VCMTiming::MaxWaitingTime(int64_t render_time_ms, int64_t now_ms)
     const {
   CriticalSectionScoped cs(crit_sect_);
+  return MaxWaitingTimeInternal(render_time_ms, now_ms, DecodeTimeMs());
+}
+
+uint32_t VCMTiming::MaxWaitingTime(int64_t render_time_ms,
+                                   int64_t now_ms,
+                                   FrameType frame_type,
+                                   size_t frame_size) const {
+  CriticalSectionScoped cs(crit_sect_);
+  return MaxWaitingTimeInternal(render_time_ms, now_ms,
+                                DecodeTimeMs(frame_type, frame_size));
+}
 
+uint32_t VCMTiming::MaxWaitingTimeInternal(int64_t render_time_ms,
+                                           int64_t now_ms,
+                                           int32_t decode_time_ms) const {
   const int64_t max_wait_time_ms = render_time_ms - now_ms -
-      MaxDecodeTimeMs() - render_delay_ms_;
+      decode_time_ms - render_delay_ms_;
 
   if (max_wait_time_ms < 0) {
     return 0;
@@ -235,7 +272,7 @@ uint32_t VCMTiming::MaxWaitingTime(int64_t render_time_ms, int64_t now_ms)
 bool VCMTiming::EnoughTimeToDecode(uint32_t available_processing_time_ms)
     const {
   CriticalSectionScoped cs(crit_sect_);
-  int32_t max_decode_time_ms = MaxDecodeTimeMs();
+  int32_t max_decode_time_ms = DecodeTimeMs();
   if (max_decode_time_ms < 0) {
     // Haven't decoded any frames yet, try decoding one to get an estimate
     // of the decode time.
@@ -256,7 +293,7 @@ uint32_t VCMTiming::TargetVideoDelay() const {
 
 uint32_t VCMTiming::TargetDelayInternal() const {
   return std::max(min_playout_delay_ms_,
-      jitter_delay_ms_ + MaxDecodeTimeMs() + render_delay_ms_);
+      jitter_delay_ms_ + DecodeTimeMs() + render_delay_ms_);
 }
 
 void VCMTiming::GetTimings(int* decode_ms,
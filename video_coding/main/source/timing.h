@@ -13,6 +13,7 @@
 
 #include "base/thread_annotations.h"
 #include "video_coding/main/source/codec_timer.h"
+#include "video_coding/main/source/decode_time_predictor.h"
 #include "system_wrappers/interface/critical_section_wrapper.h"
 #include "typedefs.h"
 
@@ -56,11 +57,14 @@ class VCMTiming {
                           int64_t actual_decode_time_ms);
 
   // Stops the decoder timer, should be called when the decoder returns a frame
-  // or when the decoded frame callback is called.
+  // or when the decoded frame callback is called. |frame_type| and
+  // |frame_size| are those of the encoded frame.
   int32_t StopDecodeTimer(uint32_t time_stamp,
                           int64_t start_time_ms,
                           int64_t now_ms,
-                          int64_t render_time_ms);
+                          int64_t render_time_ms,
+                          FrameType frame_type,
+                          size_t frame_size);
 
   // Used to report that a frame is passed to decoding. Updates the timestamp
   // filter which is used to map between timestamps and receiver system time.
@@ -73,6 +77,13 @@ class VCMTiming {
   // Returns the maximum time in ms that we can wait for a frame to become
   // complete before we must pass it to the decoder.
   uint32_t MaxWaitingTime(int64_t render_time_ms, int64_t now_ms) const;
+  // As above, but with the decode time predicted for a frame of |frame_type|
+  // and |frame_size| bytes, so that the frame is passed to the decoder just in
+  // time to be rendered.
+  uint32_t MaxWaitingTime(int64_t render_time_ms,
+                          int64_t now_ms,
+                          FrameType frame_type,
+                          size_t frame_size) const;
 
   // Returns the current target delay which is required delay + decode time +
   // render delay.
@@ -97,6 +108,18 @@ class VCMTiming {
  protected:
   int32_t MaxDecodeTimeMs(FrameType frame_type = kVideoFrameDelta) const
       EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
+  // The decode time budgeted for the frames of the stream, which is the
+  // predicted decode time unless prediction is disabled or there are too few
+  // decoded frames, in which case it is MaxDecodeTimeMs().
+  int32_t DecodeTimeMs() const EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
+  // The decode time budgeted for a frame of |frame_type| and |frame_size|
+  // bytes.
+  int32_t DecodeTimeMs(FrameType frame_type, size_t frame_size) const
+      EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
+  uint32_t MaxWaitingTimeInternal(int64_t render_time_ms,
+                                  int64_t now_ms,
+                                  int32_t decode_time_ms) const
+      EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
   int64_t RenderTimeMsInternal(uint32_t frame_timestamp, int64_t now_ms) const
       EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
   uint32_t TargetDelayInternal() const EXCLUSIVE_LOCKS_REQUIRED(crit_sect_);
@@ -109,6 +132,11 @@ class VCMTiming {
   bool master_ GUARDED_BY(crit_sect_);
   TimestampExtrapolator* ts_extrapolator_ GUARDED_BY(crit_sect_);
   VCMCodecTimer codec_timer_ GUARDED_BY(crit_sect_);
+  // Enabled with the field trial "WebRTC-DecodeTimePrediction/Enabled/".
+  // Off by default: the delay then no longer budgets the decode time of key
+  // frames, which are decoded late.
+  const bool decode_time_prediction_;
+  VCMDecodeTimePredictor decode_time_predictor_ GUARDED_BY(crit_sect_);
   uint32_t render_delay_ms_ GUARDED_BY(crit_sect_);
   uint32_t min_playout_delay_ms_ GUARDED_BY(crit_sect_);
   uint32_t jitter_delay_ms_ GUARDED_BY(crit_sect_);
@@ -19,8 +19,10 @@
 #include "video_coding/main/source/timing.h"
 #include "video_coding/main/test/test_util.h"
 #include "system_wrappers/interface/clock.h"
+#include "system_wrappers/interface/field_trial_default.h"
 #include "system_wrappers/interface/trace.h"
 #include "test/testsupport/fileutils.h"
+#include "test/testsupport/perf_test.h"
 
 namespace webrtc {
 
@@ -87,7 +89,8 @@ TEST(ReceiverTiming, Tests) {
     clock.AdvanceTimeMilliseconds(10);
     timing.StopDecodeTimer(timeStamp, startTimeMs,
                            clock.TimeInMilliseconds(), timing.RenderTimeMs(
-                               timeStamp, clock.TimeInMilliseconds()));
+                               timeStamp, clock.TimeInMilliseconds()),
+                           kVideoFrameDelta, 10000);
     timeStamp += 90000 / 25;
     clock.AdvanceTimeMilliseconds(1000 / 25 - 10);
     timing.IncomingTimestamp(timeStamp, clock.TimeInMilliseconds());
@@ -144,4 +147,105 @@ TEST(ReceiverTiming, WrapAround) {
   }
 }
 
+namespace {
+
+struct TraceResult {
+  TraceResult() : added_latency_ms(0), late_frame_rate(0) {}
+
+  // Mean time from the completion of a frame to its render time.
+  double added_latency_ms;
+  // Share of the frames decoded after their render time minus render delay.
+  double late_frame_rate;
+};
+
+// Replays a 30 fps trace with a key frame every 3 seconds through |timing|
+// the way VCMReceiver and VCMGenericDecoder use it. Frames complete every
+// 33 ms and are passed to the decoder after MaxWaitingTime(). Delta frames
+// take 4 to 16 ms to decode depending on their size, key frames 30 to 40 ms.
+TraceResult ReplayTrace(SimulatedClock* clock, VCMTiming* timing) {
+  const int kNumFrames = 1800;
+  const int kKeyFrameInterval = 90;
+  const int kFrameIntervalMs = 33;
+  const int kJitterDelayMs = 20;
+  uint32_t random = 1234;
+  uint32_t timestamp = 0;
+  int num_late_frames = 0;
+  int64_t sum_added_latency_ms = 0;
+  timing->set_render_delay(VCMTiming::kDefaultRenderDelayMs);
+  timing->SetJitterDelay(kJitterDelayMs);
+  for (int i = 0; i < kNumFrames; ++i) {
+    random = random * 1103515245 + 12345;
+    const int noise = (random >> 16) % 100;
+    const FrameType frame_type =
+        i % kKeyFrameInterval == 0 ? kVideoFrameKey : kVideoFrameDelta;
+    size_t frame_size = 0;
+    int decode_time_ms = 0;
+    if (frame_type == kVideoFrameKey) {
+      frame_size = 80000 + noise * 400;
+      decode_time_ms = 30 + noise / 10;
+    } else {
+      frame_size = 4000 + noise * 200;
+      decode_time_ms = 4 + static_cast<int>(frame_size / 2000);
+    }
+
+    const int64_t complete_time_ms = clock->TimeInMilliseconds();
+    timing->IncomingTimestamp(timestamp, complete_time_ms);
+    timing->UpdateCurrentDelay(timestamp);
+    const int64_t render_time_ms =
+        timing->RenderTimeMs(timestamp, complete_time_ms);
+    const int64_t decode_start_ms = complete_time_ms +
+        timing->MaxWaitingTime(render_time_ms, complete_time_ms, frame_type,
+                               frame_size);
+    const int64_t decode_end_ms = decode_start_ms + decode_time_ms;
+    timing->StopDecodeTimer(timestamp, decode_start_ms, decode_end_ms,
+                            render_time_ms, frame_type, frame_size);
+    if (decode_end_ms > render_time_ms - VCMTiming::kDefaultRenderDelayMs)
+      ++num_late_frames;
+    sum_added_latency_ms += render_time_ms - complete_time_ms;
+
+    clock->AdvanceTimeMilliseconds(kFrameIntervalMs);
+    timestamp += 90 * kFrameIntervalMs;
+  }
+  TraceResult result;
+  result.added_latency_ms =
+      static_cast<double>(sum_added_latency_ms) / kNumFrames;
+  result.late_frame_rate = static_cast<double>(num_late_frames) / kNumFrames;
+  return result;
+}
+
+}  // namespace
+
+TEST(ReceiverTiming, DecodeTimePredictionTrace) {
+  SimulatedClock max_filter_clock(0);
+  VCMTiming max_filter_timing(&max_filter_clock);
+  const TraceResult max_filter =
+      ReplayTrace(&max_filter_clock, &max_filter_timing);
+
+  SimulatedClock prediction_clock(0);
+  field_trial::InitFieldTrialsFromString("WebRTC-DecodeTimePrediction/"
+                                         "Enabled/");
+  VCMTiming prediction_timing(&prediction_clock);
+  field_trial::InitFieldTrialsFromString("");
+  const TraceResult prediction =
+      ReplayTrace(&prediction_clock, &prediction_timing);
+
+  // Frames are late at the start, before there is any decode time estimate.
+  const double kStartupLateFrameRate = 0.01;
+  // The max filter budgets the key frame decode time for every frame.
+  EXPECT_LT(max_filter.late_frame_rate, kStartupLateFrameRate);
+  EXPECT_LT(prediction.added_latency_ms + 10, max_filter.added_latency_ms);
+  // With prediction, the delay only budgets the decode time of delta frames
+  // and key frames are decoded late, but no other frames.
+  EXPECT_LT(prediction.late_frame_rate, 1.0 / 90 + kStartupLateFrameRate);
+
+  test::PrintResult("decode_time_prediction_added_latency", "", "max_filter",
+                    max_filter.added_latency_ms, "ms", false);
+  test::PrintResult("decode_time_prediction_added_latency", "", "prediction",
+                    prediction.added_latency_ms, "ms", true);
+  test::PrintResult("decode_time_prediction_late_frames", "", "max_filter",
+                    max_filter.late_frame_rate * 100, "%", false);
+  test::PrintResult("decode_time_prediction_late_frames", "", "prediction",
+                    prediction.late_frame_rate * 100, "%", true);
+}
+
 }  // namespace webrtc
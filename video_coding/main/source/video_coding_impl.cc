@@ -161,6 +161,11 @@ class VideoCodingModuleImpl : public VideoCodingModule {
     return sender_->RegisterSendStatisticsCallback(sendStats);
   }
 
+  int32_t RegisterEncodeUsageCallback(
+      VCMEncodeUsageCallback* callback) override {
+    return sender_->RegisterEncodeUsageCallback(callback);
+  }
+
   int32_t RegisterProtectionCallback(
       VCMProtectionCallback* protection) override {
     return sender_->RegisterProtectionCallback(protection);
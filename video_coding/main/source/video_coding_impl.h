@@ -18,6 +18,7 @@
 #include "base/thread_annotations.h"
 #include "base/thread_checker.h"
 #include "video_coding/main/source/codec_database.h"
+#include "video_coding/main/source/encode_usage_detector.h"
 #include "video_coding/main/source/frame_buffer.h"
 #include "video_coding/main/source/generic_decoder.h"
 #include "video_coding/main/source/generic_encoder.h"
@@ -96,6 +97,7 @@ class VideoSender {
 
   int32_t RegisterTransportCallback(VCMPacketizationCallback* transport);
   int32_t RegisterSendStatisticsCallback(VCMSendStatisticsCallback* sendStats);
+  int32_t RegisterEncodeUsageCallback(VCMEncodeUsageCallback* callback);
   int32_t RegisterProtectionCallback(VCMProtectionCallback* protection);
   void SetVideoProtection(VCMVideoProtection videoProtection);
 
@@ -133,6 +135,9 @@ class VideoSender {
   std::vector<FrameType> _nextFrameTypes;
   media_optimization::MediaOptimization _mediaOpt;
   VCMSendStatisticsCallback* _sendStatsCallback GUARDED_BY(process_crit_sect_);
+  VCMEncodeUsageDetector encode_usage_;
+  VCMEncodeUsageCallback* encode_usage_callback_
+      GUARDED_BY(process_crit_sect_);
   VCMCodecDataBase _codecDataBase GUARDED_BY(send_crit_);
   bool frame_dropper_enabled_ GUARDED_BY(send_crit_);
   VCMProcessTimer _sendStatsTimer;
@@ -138,7 +138,8 @@ int32_t VideoReceiver::Process() {
     if (callback_registered && length > 0) {
       // Collect sequence numbers from the default receiver.
       bool request_key_frame = false;
-      std::vector<uint16_t> nackList = _receiver.NackList(&request_key_frame);
+      std::vector<VCMNackBlock> nack_blocks =
+          _receiver.NackBlocks(&request_key_frame);
       int32_t ret = VCM_OK;
       if (request_key_frame) {
         ret = RequestKeyFrame();
@@ -146,10 +147,11 @@ int32_t VideoReceiver::Process() {
           returnValue = ret;
         }
       }
-      if (ret == VCM_OK && !nackList.empty()) {
+      if (ret == VCM_OK && !nack_blocks.empty()) {
         CriticalSectionScoped cs(process_crit_sect_.get());
         if (_packetRequestCallback != NULL) {
-          _packetRequestCallback->ResendPackets(&nackList[0], nackList.size());
+          _packetRequestCallback->ResendPacketBlocks(&nack_blocks[0],
+                                                     nack_blocks.size());
         }
       }
     }
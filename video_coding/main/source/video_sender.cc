@@ -35,6 +35,8 @@ VideoSender::VideoSender(Clock* clock,
       _nextFrameTypes(1, kVideoFrameDelta),
       _mediaOpt(clock_),
       _sendStatsCallback(nullptr),
+      encode_usage_(clock_),
+      encode_usage_callback_(nullptr),
       _codecDataBase(encoder_rate_observer),
       frame_dropper_enabled_(true),
       _sendStatsTimer(1000, clock_),
@@ -47,6 +49,7 @@ VideoSender::VideoSender(Clock* clock,
   // one external project (diffractor).
   _mediaOpt.EnableQM(qm_settings_callback_ != nullptr);
   _mediaOpt.Reset();
+  _encodedFrameCallback.SetEncodeUsageDetector(&encode_usage_);
   main_thread_.DetachFromThread();
 }
 
@@ -63,6 +66,15 @@ int32_t VideoSender::Process() {
       uint32_t frameRate = _mediaOpt.SentFrameRate();
       _sendStatsCallback->SendStatistics(bitRate, frameRate);
     }
+    if (encode_usage_callback_ != nullptr) {
+      VCMEncodeUsageStats stats;
+      VCMEncodeUsageDetector::Usage usage = encode_usage_.Check(&stats);
+      encode_usage_callback_->OnEncodeUsageUpdated(stats);
+      if (usage == VCMEncodeUsageDetector::kOveruse)
+        encode_usage_callback_->OnEncodeOveruse();
+      else if (usage == VCMEncodeUsageDetector::kUnderuse)
+        encode_usage_callback_->OnEncodeUnderuse();
+    }
   }
 
   {
@@ -268,6 +280,14 @@ int32_t VideoSender::RegisterSendStatisticsCallback(
   return VCM_OK;
 }
 
+int32_t VideoSender::RegisterEncodeUsageCallback(
+    VCMEncodeUsageCallback* callback) {
+  CriticalSectionScoped cs(process_crit_sect_.get());
+  encode_usage_callback_ = callback;
+  encode_usage_.Reset();
+  return VCM_OK;
+}
+
 // Register a video protection callback which will be called to deliver the
 // requested FEC rate and NACK status (on/off).
 // Note: this callback is assumed to only be registered once and before it is
@@ -337,6 +357,10 @@ int32_t VideoSender::AddVideoFrame(const VideoFrame& videoFrame,
     RTC_CHECK(!converted_frame.IsZeroSize())
         << "Frame conversion failed, won't be able to encode frame.";
   }
+  // The render time of a frame to send is its capture time. The encode time
+  // ends when the encoder outputs the frame, which need not be in Encode.
+  encode_usage_.FrameCaptured(converted_frame.timestamp(),
+                              converted_frame.render_time_ms());
   int32_t ret =
       _encoder->Encode(converted_frame, codecSpecificInfo, _nextFrameTypes);
   if (ret < 0) {
@@ -27,12 +27,14 @@
 
 using ::testing::_;
 using ::testing::AllOf;
+using ::testing::DoAll;
 using ::testing::ElementsAre;
 using ::testing::ElementsAreArray;
 using ::testing::Field;
 using ::testing::NiceMock;
 using ::testing::Pointee;
 using ::testing::Return;
+using ::testing::SaveArg;
 using ::testing::FloatEq;
 using std::vector;
 using webrtc::test::FrameGenerator;
@@ -204,6 +206,10 @@ class TestVideoSenderWithMockEncoder : public TestVideoSender {
 
   void SetUp() override {
     TestVideoSender::SetUp();
+    encode_complete_callback_ = nullptr;
+    ON_CALL(encoder_, RegisterEncodeCompleteCallback(_))
+        .WillByDefault(
+            DoAll(SaveArg<0>(&encode_complete_callback_), Return(0)));
     EXPECT_EQ(
         0,
         sender_->RegisterExternalEncoder(&encoder_, kUnusedPayloadType, false));
@@ -265,6 +271,7 @@ class TestVideoSenderWithMockEncoder : public TestVideoSender {
 
   VideoCodec settings_;
   NiceMock<MockVideoEncoder> encoder_;
+  EncodedImageCallback* encode_complete_callback_;
 };
 
 TEST_F(TestVideoSenderWithMockEncoder, TestIntraRequests) {
@@ -328,6 +335,49 @@ TEST_F(TestVideoSenderWithMockEncoder, EncoderFramerateUpdatedViaProcess) {
   AddFrame();
 }
 
+// Outputs the previous frame, like an encoder which encodes on a thread of
+// its own and takes a frame interval per frame.
+ACTION_P2(OutputPreviousFrame, callback, previous_timestamp) {
+  if (*previous_timestamp != 0) {
+    uint8_t payload = 0;
+    EncodedImage image(&payload, sizeof(payload), sizeof(payload));
+    image._timeStamp = *previous_timestamp;
+    RTPFragmentationHeader fragmentation;
+    (*callback)->Encoded(image, nullptr, &fragmentation);
+  }
+  *previous_timestamp = arg0.timestamp();
+  return 0;
+}
+
+// Encode returns at once, the encode time lasts until the frame is output.
+TEST_F(TestVideoSenderWithMockEncoder, ReportsEncodeOveruseViaProcess) {
+  const int kFrameIntervalMs = 33;
+  sender_->SetChannelParameters(settings_.startBitrate, 0, 200);
+  MockEncodeUsageCallback usage_callback;
+  EXPECT_EQ(0, sender_->RegisterEncodeUsageCallback(&usage_callback));
+  uint32_t previous_timestamp = 0;
+  EXPECT_CALL(encoder_, Encode(_, _, _))
+      .WillRepeatedly(OutputPreviousFrame(&encode_complete_callback_,
+                                          &previous_timestamp));
+  EXPECT_CALL(usage_callback,
+              OnEncodeUsageUpdated(Field(
+                  &VCMEncodeUsageStats::encode_time_p95_ms, kFrameIntervalMs)))
+      .Times(VCMEncodeUsageDetector::kChecksForOveruse);
+  EXPECT_CALL(usage_callback, OnEncodeOveruse()).Times(1);
+  EXPECT_CALL(usage_callback, OnEncodeUnderuse()).Times(0);
+  for (int i = 0; i < VCMEncodeUsageDetector::kChecksForOveruse; ++i) {
+    const int64_t start_time = clock_.TimeInMilliseconds();
+    while (clock_.TimeInMilliseconds() < start_time + 1000) {
+      VideoFrame frame = *generator_->NextFrame();
+      frame.set_timestamp(
+          static_cast<uint32_t>(90 * clock_.TimeInMilliseconds()));
+      sender_->AddVideoFrame(frame, NULL, NULL);
+      clock_.AdvanceTimeMilliseconds(kFrameIntervalMs);
+    }
+    sender_->Process();
+  }
+}
+
 class TestVideoSenderWithVp8 : public TestVideoSender {
  public:
   TestVideoSenderWithVp8()
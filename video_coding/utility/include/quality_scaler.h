@@ -25,7 +25,14 @@ class QualityScaler {
   };
 
   QualityScaler();
-  void Init(int low_qp_threshold, bool use_framerate_reduction);
+  // Upscales when the average QP is at most |low_qp_threshold| and, unless
+  // |high_qp_threshold| is negative, downscales when it is above
+  // |high_qp_threshold|. Encoders that rarely drop frames, e.g. x264 which
+  // raises the QP instead, need the latter to ever downscale. With a high QP
+  // threshold, downscale requests at the minimum resolution are ignored.
+  void Init(int low_qp_threshold,
+            int high_qp_threshold,
+            bool use_framerate_reduction);
   void SetMinResolution(int min_width, int min_height);
   void ReportFramerate(int framerate);
   void ReportQP(int qp);
@@ -47,6 +54,7 @@ class QualityScaler {
   int framerate_;
   int target_framerate_;
   int low_qp_threshold_;
+  int high_qp_threshold_;
   MovingAverage<int> framedrop_percent_;
   MovingAverage<int> average_qp_;
   Resolution res_;
@@ -23,15 +23,19 @@ const int QualityScaler::kDefaultMinDownscaleDimension = 90;
 QualityScaler::QualityScaler()
     : num_samples_(0),
       low_qp_threshold_(-1),
+      high_qp_threshold_(-1),
       downscale_shift_(0),
       framerate_down_(false),
       min_width_(kDefaultMinDownscaleDimension),
       min_height_(kDefaultMinDownscaleDimension) {
 }
 
-void QualityScaler::Init(int low_qp_threshold, bool use_framerate_reduction) {
+void QualityScaler::Init(int low_qp_threshold,
+                         int high_qp_threshold,
+                         bool use_framerate_reduction) {
   ClearSamples();
   low_qp_threshold_ = low_qp_threshold;
+  high_qp_threshold_ = high_qp_threshold;
   use_framerate_reduction_ = use_framerate_reduction;
   target_framerate_ = -1;
 }
@@ -68,10 +72,14 @@ void QualityScaler::OnEncodeFrame(const VideoFrame& frame) {
   int avg_drop = 0;
   int avg_qp = 0;
 
-  // When encoder consistently overshoots, framerate reduction and spatial
-  // resizing will be triggered to get a smoother video.
-  if (framedrop_percent_.GetAverage(num_samples_, &avg_drop) &&
-      avg_drop >= kFramedropPercentThreshold) {
+  // When encoder consistently overshoots, or consistently encodes at a high
+  // QP, framerate reduction and spatial resizing will be triggered to get a
+  // smoother video.
+  if ((framedrop_percent_.GetAverage(num_samples_, &avg_drop) &&
+       avg_drop >= kFramedropPercentThreshold) ||
+      (high_qp_threshold_ >= 0 &&
+       average_qp_.GetAverage(num_samples_, &avg_qp) &&
+       avg_qp > high_qp_threshold_)) {
     // Reducing frame rate before spatial resolution change.
     // Reduce frame rate only when it is above a certain number.
     // Only one reduction is allowed for now.
@@ -97,13 +105,19 @@ void QualityScaler::OnEncodeFrame(const VideoFrame& frame) {
   }
 
   assert(downscale_shift_ >= 0);
-  for (int shift = downscale_shift_;
-       shift > 0 && (res_.width / 2 >= min_width_) &&
-           (res_.height / 2 >= min_height_);
-       --shift) {
+  int shift = 0;
+  for (; shift < downscale_shift_ && (res_.width / 2 >= min_width_) &&
+             (res_.height / 2 >= min_height_);
+       ++shift) {
     res_.width /= 2;
     res_.height /= 2;
   }
+  // The QP stays high at the minimum resolution when there is a high QP
+  // threshold, and further downscale requests would only delay the upscale
+  // once the quality is good again. Frame drops stop at some point, so the
+  // shift is kept without one.
+  if (high_qp_threshold_ >= 0)
+    downscale_shift_ = shift;
 }
 
 QualityScaler::Resolution QualityScaler::GetScaledResolution() const {
@@ -21,6 +21,7 @@ static const int kHeight = 1080;
 static const int kFramerate = 30;
 static const int kLowQp = 15;
 static const int kNormalQp = 30;
+static const int kHighQp = 40;
 static const int kMaxQp = 56;
 }  // namespace
 
@@ -39,7 +40,7 @@ class QualityScalerTest : public ::testing::Test {
   QualityScalerTest() {
     input_frame_.CreateEmptyFrame(
         kWidth, kHeight, kWidth, kHalfWidth, kHalfWidth);
-    qs_.Init(kMaxQp / QualityScaler::kDefaultLowQpDenominator, false);
+    qs_.Init(kMaxQp / QualityScaler::kDefaultLowQpDenominator, -1, false);
     qs_.ReportFramerate(kFramerate);
     qs_.OnEncodeFrame(input_frame_);
   }
@@ -79,6 +80,11 @@ class QualityScalerTest : public ::testing::Test {
 
   void ContinuouslyDownscalesByHalfDimensionsAndBackUp();
 
+  // Requests four downscales of a frame which can be downscaled twice, then
+  // two upscales, and expects the frame to end up |expected_width| wide.
+  void DownscaleRequestsAtMinResolution(int high_qp_threshold,
+                                        int expected_width);
+
   void DoesNotDownscaleFrameDimensions(int width, int height);
 
   Resolution TriggerResolutionChange(BadQualityMetric dropframe_lowqp,
@@ -153,6 +159,79 @@ TEST_F(QualityScalerTest, DoesNotDownscaleAfterHalfFramedrop) {
   }
 }
 
+TEST_F(QualityScalerTest, DoesNotDownscaleOnHighQpWithoutHighQpThreshold) {
+  for (int i = 0; i < kFramerate * kNumSeconds; ++i) {
+    qs_.ReportQP(kHighQp);
+    qs_.OnEncodeFrame(input_frame_);
+    ASSERT_EQ(input_frame_.width(), qs_.GetScaledResolution().width)
+        << "Unexpected scale on high QP.";
+  }
+}
+
+TEST_F(QualityScalerTest, DownscalesOnHighQpAndBackUpOnLowQp) {
+  qs_.Init(kMaxQp / QualityScaler::kDefaultLowQpDenominator, kNormalQp + 5,
+           false);
+  qs_.ReportFramerate(kFramerate);
+  for (int i = 0; i < kFramerate * kNumSeconds; ++i) {
+    qs_.ReportQP(kHighQp);
+    qs_.OnEncodeFrame(input_frame_);
+  }
+  // One step per measurement period.
+  EXPECT_EQ(kWidth / 4, qs_.GetScaledResolution().width);
+
+  // A QP between the thresholds keeps the resolution.
+  for (int i = 0; i < kFramerate * kNumSeconds; ++i) {
+    qs_.ReportQP(kNormalQp);
+    qs_.OnEncodeFrame(input_frame_);
+  }
+  EXPECT_EQ(kWidth / 4, qs_.GetScaledResolution().width);
+
+  for (int i = 0; i < kFramerate * kNumSeconds; ++i) {
+    qs_.ReportQP(kLowQp);
+    qs_.OnEncodeFrame(input_frame_);
+  }
+  EXPECT_EQ(kWidth, qs_.GetScaledResolution().width);
+}
+
+void QualityScalerTest::DownscaleRequestsAtMinResolution(
+    int high_qp_threshold,
+    int expected_width) {
+  const int kMinDimension = QualityScaler::kDefaultMinDownscaleDimension;
+  input_frame_.CreateEmptyFrame(4 * kMinDimension, 4 * kMinDimension,
+                                4 * kMinDimension, 2 * kMinDimension,
+                                2 * kMinDimension);
+  qs_.Init(kMaxQp / QualityScaler::kDefaultLowQpDenominator,
+           high_qp_threshold, false);
+  qs_.ReportFramerate(kFramerate);
+  // Two downscale requests per period, the second period ends at the minimum
+  // resolution with two more requests.
+  for (int i = 0; i < 2 * kFramerate * kNumSeconds; ++i) {
+    qs_.ReportDroppedFrame();
+    qs_.OnEncodeFrame(input_frame_);
+  }
+  EXPECT_EQ(kMinDimension, qs_.GetScaledResolution().width);
+
+  // Two upscale requests.
+  for (int i = 0; i < kFramerate * kNumSeconds; ++i) {
+    qs_.ReportQP(kLowQp);
+    qs_.OnEncodeFrame(input_frame_);
+  }
+  EXPECT_EQ(expected_width, qs_.GetScaledResolution().width);
+}
+
+// VP8 doesn't set a high QP threshold, and keeps the downscale requests.
+TEST_F(QualityScalerTest,
+       KeepsDownscaleRequestsAtMinResolutionWithoutHighQpThreshold) {
+  DownscaleRequestsAtMinResolution(-1,
+                                   QualityScaler::kDefaultMinDownscaleDimension);
+}
+
+TEST_F(QualityScalerTest,
+       IgnoresDownscaleRequestsAtMinResolutionWithHighQpThreshold) {
+  DownscaleRequestsAtMinResolution(
+      kNormalQp + 5, 4 * QualityScaler::kDefaultMinDownscaleDimension);
+}
+
 void QualityScalerTest::ContinuouslyDownscalesByHalfDimensionsAndBackUp() {
   const int initial_min_dimension = input_frame_.width() < input_frame_.height()
                                   ? input_frame_.width()
@@ -262,7 +341,7 @@ QualityScalerTest::Resolution QualityScalerTest::TriggerResolutionChange(
 void QualityScalerTest::VerifyQualityAdaptation(
     int initial_framerate, int seconds, bool expect_spatial_resize,
     bool expect_framerate_reduction) {
-  qs_.Init(kMaxQp / QualityScaler::kDefaultLowQpDenominator, true);
+  qs_.Init(kMaxQp / QualityScaler::kDefaultLowQpDenominator, -1, true);
   qs_.OnEncodeFrame(input_frame_);
   int init_width = qs_.GetScaledResolution().width;
   int init_height = qs_.GetScaledResolution().height;
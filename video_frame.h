@@ -193,6 +193,8 @@ class EncodedImage {
   size_t _length;
   size_t _size;
   bool _completeFrame = false;
+  // Average QP of the frame, -1 if the encoder does not report it.
+  int qp_ = -1;
 };
 
 }  // namespace webrtc
@@ -51,7 +51,9 @@ ModuleVideoRenderImpl::ModuleVideoRenderImpl(
                                              void* window,
                                              const bool fullscreen) :
     _id(id), _moduleCrit(*CriticalSectionWrapper::CreateCriticalSection()),
-    _ptrWindow(window), _fullScreen(fullscreen), _ptrRenderer(NULL)
+    _ptrWindow(window), _fullScreen(fullscreen), _ptrRenderer(NULL),
+    _renderScheduler(
+        new RenderScheduler(RenderScheduler::kSharedTimerSlackMs))
 {
 
     // Create platform specific renderer
@@ -197,7 +199,7 @@ ModuleVideoRenderImpl::AddIncomingRenderStream(const uint32_t streamId,
     }
 
     // Create platform independant code
-    IncomingVideoStream* ptrIncomingStream = new IncomingVideoStream(streamId);
+    IncomingVideoStream* ptrIncomingStream = new IncomingVideoStream(streamId, _renderScheduler.get());
     ptrIncomingStream->SetRenderCallback(ptrRenderCallback);
     VideoRenderCallback* moduleCallback = ptrIncomingStream->ModuleCallback();
 
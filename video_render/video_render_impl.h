@@ -13,6 +13,7 @@
 
 #include <map>
 
+#include "base/scoped_ptr.h"
 #include "engine_configurations.h"
 #include "video_render/include/video_render.h"
 
@@ -20,6 +21,7 @@ namespace webrtc {
 class CriticalSectionWrapper;
 class IncomingVideoStream;
 class IVideoRender;
+class RenderScheduler;
 
 // Class definitions
 class ModuleVideoRenderImpl: public VideoRender
@@ -206,6 +208,8 @@ private:
     bool _fullScreen;
 
     IVideoRender* _ptrRenderer;
+    // Renders all the incoming streams on one thread.
+    const rtc::scoped_ptr<RenderScheduler> _renderScheduler;
     typedef std::map<uint32_t, IncomingVideoStream*> IncomingVideoStreamMap;
     IncomingVideoStreamMap _streamRenderMap;
 };